@@ -43,8 +43,18 @@ vertex VS_out VS(const device VS_in *vertices VERTEX_BUFFER_BINDING,
     VS_in in = vertices[index];
 
     VS_out out = {};
+    if (kDeferredLighting) {
+        // Fullscreen quad: worldPosition carries the direction from the camera through the pixel (symmetric
+        // perspective, rigid view matrix).
+        const float3 viewRay = float3(in.position.x / appState.P[0][0], in.position.y / appState.P[1][1], -1.0);
+        out.worldPosition = transpose(float3x3(appState.V[0].xyz, appState.V[1].xyz, appState.V[2].xyz)) * viewRay;
+        out.normal = float3(0, 0, 1);
+        out.gl_Position = float4(in.position.xy, 0.0, 1.0);
+        return out;
+    }
+
     out.worldPosition = float3(worldTransform(transform, float4(in.position, 1.0)).xyz);
-    out.normal = normalize(float3x3(transform.invTransM[0].xyz, transform.invTransM[1].xyz, transform.invTransM[2].xyz) * float3(in.normal));
+    out.normal = worldNormal(transform, float3(in.normal));
     out.gl_Position = (appState.P * appState.V) * float4(out.worldPosition, 1.0);
     return out;
 }
@@ -56,9 +66,14 @@ vertex VS_out VS(const device VS_in *vertices VERTEX_BUFFER_BINDING,
 // Light (voxel) cone tracing settings.
 // --------------------------------------
 #define MIPMAP_HARDCAP 5.4f /* Too high mipmap levels => glitchiness, too low mipmap levels => sharpness. */
-#define VOXEL_SIZE (1/64.0) /* Size of a voxel. 128x128x128 => 1/128 = 0.0078125. */
+#define VOXEL_SIZE (1.0f / appState.voxelTextureSize) /* Size of a voxel. 128x128x128 => 1/128 = 0.0078125. Runtime setting, needs appState in scope. */
 #define SHADOWS 1 /* Shadow cone tracing. */
 #define DIFFUSE_INDIRECT_FACTOR 0.52f /* Just changes intensity of diffuse indirect lighting. */
+#define DIFFUSE_CONE_SPREAD 0.325f
+#define ANISOTROPIC_DIFFUSE_CONE_SPREAD 0.5f /* Anisotropic voxels trace 5 wider cones instead of 9. */
+#define UPSAMPLE_DEPTH_TOLERANCE 0.05f /* Relative distance difference at which a low resolution sample weighs 1/e (BilateralUpsampler::DEPTH_TOLERANCE). */
+#define UPSAMPLE_NORMAL_POWER 8.0f /* Exponent of the cosine between the normals (BilateralUpsampler::NORMAL_POWER). */
+#define UPSAMPLE_MIN_WEIGHT 1e-4f /* Below this total weight, the geometrically closest sample is used as is (BilateralUpsampler::MIN_WEIGHT). */
 // --------------------------------------
 // Other lighting settings.
 // --------------------------------------
@@ -92,10 +107,102 @@ float3 orthogonal(float3 u){
 static inline
 float3 scaleAndBias(const float3 p) { return 0.5f * p + float3(0.5f); }
 
+typedef array<texture3d<float>, VOXEL_CLIPMAP_LEVELS> VoxelCascades;
+typedef array<texture3d<float>, 6> AnisotropicVoxels; // +X, -X, +Y, -Y, +Z, -Z. Level i is level i + 1 of the voxel texture.
+
+// Samples the directional volumes, blending the three faces a cone going in a (normalized) direction looks at.
+// Below the first directional level, blends with the first level of the voxel texture.
+static inline
+float4 textureLodAnisotropic(texture3d<float> texture3D, AnisotropicVoxels anisotropic,
+                             float3 coordinate, float3 direction, float mipmapLevel)
+{
+    const float3 weights = direction * direction;
+    const float level = max(mipmapLevel - 1, 0.0f);
+    float4 voxel = weights.x * textureLod(anisotropic[direction.x > 0 ? 0 : 1], coordinate, level) +
+                   weights.y * textureLod(anisotropic[direction.y > 0 ? 2 : 3], coordinate, level) +
+                   weights.z * textureLod(anisotropic[direction.z > 0 ? 4 : 5], coordinate, level);
+    if (mipmapLevel < 1)
+        voxel = mix(textureLod(texture3D, coordinate, 0), voxel, mipmapLevel);
+    return voxel;
+}
+
+// Samples the voxels at a world space position, seen by a cone going in a direction. The mipmap level is relative to
+// the voxels of the [-1, 1] volume, i.e. of the first clipmap cascade. Returns false outside of the voxelized space.
+static inline
+bool sampleVoxels(float3 worldPosition, float3 direction, float mipmapLevel,
+                  texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState,
+                  thread float4 &voxel)
+{
+    if (!appState.voxelClipmap)
+    {
+        const float3 c = scaleAndBias(worldPosition);
+        if(!isInsideCube(c, 0)) return false;
+        voxel = appState.anisotropicVoxels ? textureLodAnisotropic(texture3D, anisotropic, c, direction, mipmapLevel)
+                                           : textureLod(texture3D, c, mipmapLevel);
+        return true;
+    }
+
+    // Cascades are stored toroidally: world voxel w is at texel (w mod size), which repeat addressing does for us.
+    constexpr sampler clipmapSampler (mag_filter::linear, min_filter::linear, mip_filter::linear,
+                                      s_address::repeat,
+                                      r_address::repeat,
+                                      t_address::repeat);
+    const float size = appState.voxelTextureSize;
+
+    // Every cascade has the same resolution and twice the voxel size of the previous one, so the cone radius picks
+    // the cascade: the first one whose voxels are not smaller than half the cone, unless the position is outside of it.
+    for (uint i = 0; i < VOXEL_CLIPMAP_LEVELS; ++i)
+    {
+        const float lod = max(mipmapLevel - float(i), 0.0f);
+        if (lod >= 1 && i + 1 < VOXEL_CLIPMAP_LEVELS) continue;
+
+        // Keep a texel of the sampled mip away from the window borders, where the filtering would wrap around.
+        const float windowSize = clipmap.levels[i].minCorner.w * size;
+        const float3 local = (worldPosition - clipmap.levels[i].minCorner.xyz) / windowSize;
+        const float margin = exp2(lod) / size;
+        if (any(local < margin) || any(local > 1 - margin)) continue;
+
+        voxel = cascades[i].sample(clipmapSampler, worldPosition / windowSize, level(lod));
+        return true;
+    }
+    return false;
+}
+
+// How far diffuse cones go: the voxel volume, or the last clipmap cascade.
+static inline
+float maxDiffuseTraceDistance(constant VoxelClipmap &clipmap, constant AppState &appState)
+{
+    if (!appState.voxelClipmap) return SQRT2;
+    return SQRT2 * 0.5f * clipmap.levels[VOXEL_CLIPMAP_LEVELS - 1].minCorner.w * appState.voxelTextureSize;
+}
+
+// Samples the opacity of the voxels, from the R8 opacity volume when there is one.
+static inline
+bool sampleOpacity(float3 worldPosition, float3 direction, float mipmapLevel,
+                   texture3d<float> opacityTexture, texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic,
+                   constant VoxelClipmap &clipmap, constant AppState &appState,
+                   thread float &opacity)
+{
+    if (appState.opacityVolume && !appState.voxelClipmap)
+    {
+        const float3 c = scaleAndBias(worldPosition);
+        opacity = 0;
+        if(!isInsideCube(c, 0)) return false;
+        opacity = textureLod(opacityTexture, c, mipmapLevel).r;
+        return true;
+    }
+
+    float4 voxel = float4(0.0f);
+    const bool inside = sampleVoxels(worldPosition, direction, mipmapLevel, texture3D, cascades, anisotropic, clipmap, appState, voxel);
+    opacity = voxel.a;
+    return inside;
+}
+
 // Returns a soft shadow blend by using shadow cone tracing.
 // Uses 2 samples per step, so it's pretty expensive.
 static inline
-float traceShadowCone(VS_out in, float3 direction, float targetDistance, texture3d<float> texture3D){
+float traceShadowCone(VS_out in, float3 direction, float targetDistance,
+                      texture3d<float> opacityTexture, texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState){
     const float3 normal = in.normal;
     float3 from = in.worldPosition;
     from += normal * 0.05f; // Removes artifacts but makes self shadowing for dense meshes meh.
@@ -108,11 +215,12 @@ float traceShadowCone(VS_out in, float3 direction, float targetDistance, texture
 
     while(dist < STOP && acc < 1){
         float3 c = from + dist * direction;
-        c = scaleAndBias(c);
-        if(!isInsideCube(c, 0)) break;
         float l = pow(dist, 2); // Experimenting with inverse square falloff for shadows.
-        float s1 = 0.5 * textureLod(texture3D, c, l).a;
-        float s2 = 0.03 * textureLod(texture3D, c, 2 * l).a;
+        float a1, a2;
+        if(!sampleOpacity(c, direction, l, opacityTexture, texture3D, cascades, anisotropic, clipmap, appState, a1)) break;
+        sampleOpacity(c, direction, 2 * l, opacityTexture, texture3D, cascades, anisotropic, clipmap, appState, a2);
+        float s1 = 0.5 * a1;
+        float s2 = 0.03 * a2;
         float s = s1 + s2;
         acc += (1 - acc) * s;
         dist += 0.9 * VOXEL_SIZE * (1 + 0.05 * l);
@@ -122,11 +230,10 @@ float traceShadowCone(VS_out in, float3 direction, float targetDistance, texture
 
 // Traces a diffuse voxel cone.
 static inline
-float3 traceDiffuseVoxelCone(const float3 from, float3 direction, texture3d<float> texture3D){
+float3 traceDiffuseVoxelCone(const float3 from, float3 direction, const float coneSpread,
+                             texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState){
     direction = normalize(direction);
 
-    const float CONE_SPREAD = 0.325;
-
     float4 acc = float4(0.0f);
 
     // Controls bleeding from close surfaces.
@@ -135,30 +242,30 @@ float3 traceDiffuseVoxelCone(const float3 from, float3 direction, texture3d<floa
     float dist = 0.1953125;
 
     // Trace.
-    while(dist < SQRT2 && acc.a < 1){
+    const float maxDistance = maxDiffuseTraceDistance(clipmap, appState);
+    while(dist < maxDistance && acc.a < 1){
         float3 c = from + dist * direction;
-        c = scaleAndBias(c);
-        if(!isInsideCube(c, 0)) break;
-        float radius = (2 * CONE_SPREAD * dist / VOXEL_SIZE);
+        float radius = (2 * coneSpread * dist / VOXEL_SIZE);
         float level = log2(radius);
-        float4 voxel = textureLod(texture3D, c, min(MIPMAP_HARDCAP, level));
+        float4 voxel;
+        if(!sampleVoxels(c, direction, min(MIPMAP_HARDCAP, level), texture3D, cascades, anisotropic, clipmap, appState, voxel)) break;
         acc += attenuate(dist) * voxel * pow(1 - voxel.a, 2);
         dist += radius * VOXEL_SIZE;
     }
     return pow(acc.rgb * 2.0, float3(1.5));
 }
 
-// Calculates indirect diffuse light using voxel cone tracing.
+// Sums the diffuse cones of a surface point (normalized normal).
 // The current implementation uses 9 cones. I think 5 cones should be enough, but it might generate
-// more aliasing and bad blur.
+// more aliasing and bad blur. Anisotropic voxels don't leak as much at coarse levels, so they use
+// 5 wider cones.
 static inline
-float3 indirectDiffuseLight(VS_out in, texture3d<float> texture3D, constant ObjectState &objectState){
+float3 traceDiffuseCones(const float3 worldPosition, const float3 normal,
+                         texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState){
     const float ANGLE_MIX = 0.5f; // Angle mix (1.0f => orthogonal direction, 0.0f => direction of normal).
 
     const float w[3] = {1.0, 1.0, 1.0}; // Cone weights.
 
-    const float3 normal = in.normal;
-
     // Find a base for the side cones with the normal as one of its base vectors.
     const float3 ortho = normalize(orthogonal(normal));
     const float3 ortho2 = normalize(cross(ortho, normal));
@@ -169,7 +276,7 @@ float3 indirectDiffuseLight(VS_out in, texture3d<float> texture3D, constant Obje
 
     // Find start position of trace (start with a bit of offset).
     const float3 N_OFFSET = normal * (1 + 4 * ISQRT2) * VOXEL_SIZE;
-    const float3 C_ORIGIN = in.worldPosition + N_OFFSET;
+    const float3 C_ORIGIN = worldPosition + N_OFFSET;
 
     // Accumulate indirect diffuse light.
     float3 acc = float3(0);
@@ -179,8 +286,11 @@ float3 indirectDiffuseLight(VS_out in, texture3d<float> texture3D, constant Obje
     // artifacts.
     const float CONE_OFFSET = -0.01;
 
+    const bool fewerCones = appState.anisotropicVoxels && !appState.voxelClipmap;
+    const float coneSpread = fewerCones ? ANISOTROPIC_DIFFUSE_CONE_SPREAD : DIFFUSE_CONE_SPREAD;
+
     // Trace front cone
-    acc += w[0] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * normal, normal, texture3D);
+    acc += w[0] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * normal, normal, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
 
     // Trace 4 side cones.
     const float3 s1 = mix(normal, ortho, ANGLE_MIX);
@@ -188,29 +298,130 @@ float3 indirectDiffuseLight(VS_out in, texture3d<float> texture3D, constant Obje
     const float3 s3 = mix(normal, ortho2, ANGLE_MIX);
     const float3 s4 = mix(normal, -ortho2, ANGLE_MIX);
 
-    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho, s1, texture3D);
-    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho, s2, texture3D);
-    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho2, s3, texture3D);
-    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho2, s4, texture3D);
+    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho, s1, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho, s2, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho2, s3, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho2, s4, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+
+    // Trace 4 corner cones, weighted in the remaining cones when skipped.
+    if (fewerCones)
+        return (9.0f / 5.0f) * acc;
 
-    // Trace 4 corner cones.
     const float3 c1 = mix(normal, corner, ANGLE_MIX);
     const float3 c2 = mix(normal, -corner, ANGLE_MIX);
     const float3 c3 = mix(normal, corner2, ANGLE_MIX);
     const float3 c4 = mix(normal, -corner2, ANGLE_MIX);
 
-    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner, c1, texture3D);
-    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner, c2, texture3D);
-    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner2, c3, texture3D);
-    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner2, c4, texture3D);
+    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner, c1, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner, c2, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner2, c3, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner2, c4, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+
+    return acc;
+}
+
+// Estimate of traceDiffuseCones from 3 cones (2 with anisotropic voxels): the front cone, one side cone and one corner
+// cone, the base turned by rotation + pattern * 90 degrees. The 4 patterns average to traceDiffuseCones with its base
+// turned by rotation, so temporal accumulation converges to the full cone set. The CPU mirror is
+// CpuConeTracer::traceDiffuseConePattern.
+static inline
+float3 traceDiffuseConePattern(const float3 worldPosition, const float3 normal, const uint pattern, const float rotation,
+                               texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState){
+    const float ANGLE_MIX = 0.5f;
+    const float CONE_OFFSET = -0.01;
+
+    const float3 ortho = normalize(orthogonal(normal));
+    const float3 ortho2 = normalize(cross(ortho, normal));
+    const float angle = rotation + float(pattern) * M_PI_2_F;
+    const float3 side = cos(angle) * ortho + sin(angle) * ortho2;
+    const float3 side2 = cos(angle) * ortho2 - sin(angle) * ortho; // side turned by 90 degrees.
+    const float3 corner = 0.5f * (side + side2);
+
+    const float3 C_ORIGIN = worldPosition + normal * (1 + 4 * ISQRT2) * VOXEL_SIZE;
+    const bool fewerCones = appState.anisotropicVoxels && !appState.voxelClipmap;
+    const float coneSpread = fewerCones ? ANISOTROPIC_DIFFUSE_CONE_SPREAD : DIFFUSE_CONE_SPREAD;
+
+    float3 acc = traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * normal, normal, coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    acc += 4 * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * side, mix(normal, side, ANGLE_MIX), coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    if (fewerCones)
+        return (9.0f / 5.0f) * acc;
+
+    acc += 4 * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner, mix(normal, corner, ANGLE_MIX), coneSpread, texture3D, cascades, anisotropic, clipmap, appState);
+    return acc;
+}
+
+// Light the material reflects from the sum of the diffuse cones.
+static inline
+float3 reflectIndirectDiffuse(const float3 acc, thread const Material &material){
+    return DIFFUSE_INDIRECT_FACTOR * material.diffuseReflectivity * acc * (material.diffuseColor + float3(0.001f));
+}
+
+// Calculates indirect diffuse light using voxel cone tracing.
+static inline
+float3 indirectDiffuseLight(VS_out in,
+                            texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState,
+                            thread const Material &material){
+    const float3 acc = traceDiffuseCones(in.worldPosition, in.normal, texture3D, cascades, anisotropic, clipmap, appState);
+    return reflectIndirectDiffuse(acc, material);
+}
+
+// Octahedral encoding of a unit vector, for the normals of the screen G-buffer.
+static inline
+float2 encodeOctahedral(float3 n){
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0 ? n.xy : (1.0f - abs(n.yx)) * select(float2(-1.0f), float2(1.0f), n.xy >= 0);
+}
 
-    // Return result.
-    return DIFFUSE_INDIRECT_FACTOR * objectState.material.diffuseReflectivity * acc * (objectState.material.diffuseColor + float3(0.001f));
+static inline
+float3 decodeOctahedral(const float2 e){
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0)
+        n.xy = (1.0f - abs(n.yx)) * select(float2(-1.0f), float2(1.0f), n.xy >= 0);
+    return normalize(n);
+}
+
+// Joint bilateral upsampling of the diffuse cones traced by traceIndirectDiffuse: the 4 nearest low resolution
+// pixels are blended with their bilinear weights, times how close their distance to the camera and their normal
+// are to the ones of this pixel, so that light doesn't bleed across depth or orientation edges.
+// The CPU mirror is BilateralUpsampler::upsamplePixel.
+static inline
+float3 upsampleIndirectDiffuse(const float2 pixelCenter, const float3 normal, const float distance,
+                               texture2d<float, access::read> lowIrradiance, texture2d<float, access::read> lowGBuffer, constant AppState &appState){
+    // Low resolution pixel i is centered on full resolution pixel (i + 0.5) * scale.
+    const float2 f = pixelCenter / float(appState.indirectDiffuseScale) - 0.5f;
+    const float2 base = floor(f);
+    const float2 t = f - base;
+    const int2 last = int2(lowGBuffer.get_width(), lowGBuffer.get_height()) - 1;
+
+    float3 sum = float3(0), fallback = float3(0);
+    float total = 0, bestGeometric = -1;
+    for (int corner = 0; corner < 4; ++corner) {
+        const int2 offset = int2(corner & 1, corner >> 1);
+        const uint2 p = uint2(clamp(int2(base) + offset, int2(0), last));
+        const float4 sample = lowGBuffer.read(p);
+        if (dot(sample.xyz, sample.xyz) == 0)
+            continue; // No surface in that block.
+
+        const float bilinear = (offset.x ? t.x : 1 - t.x) * (offset.y ? t.y : 1 - t.y);
+        const float depthWeight = exp(-abs(sample.w - distance) / (UPSAMPLE_DEPTH_TOLERANCE * distance));
+        const float normalWeight = pow(max(dot(sample.xyz, normal), 0.0f), UPSAMPLE_NORMAL_POWER);
+        const float geometric = depthWeight * normalWeight;
+        const float3 value = lowIrradiance.read(p).rgb;
+        if (geometric > bestGeometric) {
+            bestGeometric = geometric;
+            fallback = value;
+        }
+        sum += bilinear * geometric * value;
+        total += bilinear * geometric;
+    }
+    return total > UPSAMPLE_MIN_WEIGHT ? sum / total : fallback;
 }
 
 // Traces a specular voxel cone.
 static inline
-float3 traceSpecularVoxelCone(VS_out in, float3 direction, texture3d<float> texture3D, constant ObjectState &objectState){
+float3 traceSpecularVoxelCone(VS_out in, float3 direction,
+                              texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState,
+                              thread const Material &material){
     const float3 normal = in.normal;
 
     const float OFFSET = 8 * VOXEL_SIZE;
@@ -225,45 +436,47 @@ float3 traceSpecularVoxelCone(VS_out in, float3 direction, texture3d<float> text
     // Trace.
     while(dist < SQRT2 && acc.a < 1){
         float3 c = from + dist * direction;
-        c = scaleAndBias(c);
-        if(!isInsideCube(c, 0)) break;
-
-        float level = 0.1 * objectState.material.specularDiffusion * log2(1 + dist / VOXEL_SIZE);
-        float4 voxel = textureLod(texture3D, c, min(level, MIPMAP_HARDCAP));
+        float level = 0.1 * material.specularDiffusion * log2(1 + dist / VOXEL_SIZE);
+        float4 voxel;
+        if(!sampleVoxels(c, direction, min(level, MIPMAP_HARDCAP), texture3D, cascades, anisotropic, clipmap, appState, voxel)) break;
         float f = 1 - acc.a;
-        acc.rgb += attenuate(dist) * 0.25 * (1 + objectState.material.specularDiffusion) * voxel.rgb * voxel.a * f;
+        acc.rgb += attenuate(dist) * 0.25 * (1 + material.specularDiffusion) * voxel.rgb * voxel.a * f;
         acc.a += 0.25 * voxel.a * f;
         dist += STEP * (1.0f + 0.125f * level);
     }
-    return 1.0 * pow(objectState.material.specularDiffusion + 1, 0.8) * acc.rgb;
+    return 1.0 * pow(material.specularDiffusion + 1, 0.8) * acc.rgb;
 }
 
 // Calculates indirect specular light using voxel cone tracing.
 static inline
-float3 indirectSpecularLight(VS_out in, float3 viewDirection, texture3d<float> texture3D, constant ObjectState &objectState){
+float3 indirectSpecularLight(VS_out in, float3 viewDirection,
+                             texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState,
+                             thread const Material &material){
     const float3 normal = in.normal;
     const float3 reflection = normalize(reflect(viewDirection, normal));
-    return objectState.material.specularReflectivity * objectState.material.specularColor *
-           traceSpecularVoxelCone(in, reflection, texture3D, objectState);
+    return material.specularReflectivity * material.specularColor *
+           traceSpecularVoxelCone(in, reflection, texture3D, cascades, anisotropic, clipmap, appState, material);
 }
 
 // Calculates refractive light using voxel cone tracing.
 static inline
-float3 indirectRefractiveLight(VS_out in, float3 viewDirection, texture3d<float> texture3D, constant ObjectState &objectState){
+float3 indirectRefractiveLight(VS_out in, float3 viewDirection,
+                               texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap, constant AppState &appState,
+                               thread const Material &material){
     const float3 normal = in.normal;
-    const float3 refraction = normalize(refract(viewDirection, normal, 1.0 / objectState.material.refractiveIndex));
-    const float3 cmix = mix(objectState.material.specularColor, 0.5 * (objectState.material.specularColor + float3(1)),
-                            objectState.material.transparency);
-    return cmix * traceSpecularVoxelCone(in, refraction, texture3D, objectState);
+    const float3 refraction = normalize(refract(viewDirection, normal, 1.0 / material.refractiveIndex));
+    const float3 cmix = mix(material.specularColor, 0.5 * (material.specularColor + float3(1)),
+                            material.transparency);
+    return cmix * traceSpecularVoxelCone(in, refraction, texture3D, cascades, anisotropic, clipmap, appState, material);
 }
 
 // Calculates diffuse and specular direct light for a given point light.
 // Uses shadow cone tracing for soft shadows.
 static inline
 float3 calculateDirectLight(VS_out in, PointLight light, const float3 viewDirection,
-                            texture3d<float> texture3D,
+                            texture3d<float> opacityTexture, texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap,
                             constant AppState &appState,
-                            constant ObjectState &objectState)
+                            thread const Material &material)
 {
     const float3 normal = in.normal;
     float3 lightDirection = light.position - in.worldPosition;
@@ -290,9 +503,9 @@ float3 calculateDirectLight(VS_out in, PointLight light, const float3 viewDirect
 #endif
 
     float refractiveAngle = 0;
-    if(objectState.material.transparency > 0.01){
-        float3 refraction = refract(viewDirection, normal, 1.0 / objectState.material.refractiveIndex);
-        refractiveAngle = max(0.0, objectState.material.transparency * dot(refraction, lightDirection));
+    if(material.transparency > 0.01){
+        float3 refraction = refract(viewDirection, normal, 1.0 / material.refractiveIndex);
+        refractiveAngle = max(0.0, material.transparency * dot(refraction, lightDirection));
     }
 
     // --------------------
@@ -300,8 +513,8 @@ float3 calculateDirectLight(VS_out in, PointLight light, const float3 viewDirect
     // --------------------
     float shadowBlend = 1;
 #if (SHADOWS == 1)
-    if(diffuseAngle * (1.0f - objectState.material.transparency) > 0 && appState.settings.shadows)
-        shadowBlend = traceShadowCone(in, lightDirection, distanceToLight, texture3D);
+    if(diffuseAngle * (1.0f - material.transparency) > 0 && appState.settings.shadows)
+        shadowBlend = traceShadowCone(in, lightDirection, distanceToLight, opacityTexture, texture3D, cascades, anisotropic, clipmap, appState);
 #endif
 
     // --------------------
@@ -309,12 +522,12 @@ float3 calculateDirectLight(VS_out in, PointLight light, const float3 viewDirect
     // --------------------
     diffuseAngle = min(shadowBlend, diffuseAngle);
     specularAngle = min(shadowBlend, max(specularAngle, refractiveAngle));
-    const float df = 1.0f / (1.0f + 0.25f * objectState.material.specularDiffusion); // Diffusion factor.
+    const float df = 1.0f / (1.0f + 0.25f * material.specularDiffusion); // Diffusion factor.
     const float specular = SPECULAR_FACTOR * pow(specularAngle, df * SPECULAR_POWER);
-    const float diffuse = diffuseAngle * (1.0f - objectState.material.transparency);
+    const float diffuse = diffuseAngle * (1.0f - material.transparency);
 
-    const float3 diff = objectState.material.diffuseReflectivity * objectState.material.diffuseColor * diffuse;
-    const float3 spec = objectState.material.specularReflectivity * objectState.material.specularColor * specular;
+    const float3 diff = material.diffuseReflectivity * material.diffuseColor * diffuse;
+    const float3 spec = material.specularReflectivity * material.specularColor * specular;
     const float3 total = light.color * (diff + spec);
     return attenuate(distanceToLight) * total;
 }
@@ -322,24 +535,51 @@ float3 calculateDirectLight(VS_out in, PointLight light, const float3 viewDirect
 // Sums up all direct light from point lights (both diffuse and specular).
 static inline
 float3 directLight(VS_out in, const float3 viewDirection,
-                   texture3d<float> texture3D,
+                   texture3d<float> opacityTexture, texture3d<float> texture3D, VoxelCascades cascades, AnisotropicVoxels anisotropic, constant VoxelClipmap &clipmap,
                    constant AppState &appState,
-                   constant ObjectState &objectState){
+                   thread const Material &material){
     float3 direct = float3(0.0f);
     const uint maxLights = min(appState.numberOfLights, MAX_LIGHTS);
     for (uint i = 0; i < maxLights; ++i)
-        direct += calculateDirectLight(in, appState.pointLights[i], viewDirection, texture3D, appState, objectState);
+        direct += calculateDirectLight(in, appState.pointLights[i], viewDirection, opacityTexture, texture3D, cascades, anisotropic, clipmap, appState, material);
     direct *= DIRECT_LIGHT_INTENSITY;
     return direct;
 }
 
 fragment float4 FS(VS_out input [[stage_in]],
                    texture3d<float> texture3D [[texture(2)]],
+                   VoxelCascades cascades [[texture(5)]],
+                   AnisotropicVoxels anisotropic [[texture(9)]],
+                   texture3d<float> opacityTexture [[texture(15)]],
+                   texture2d<float, access::read> lowIrradiance [[texture(16), function_constant(kUpsampledIndirectDiffuse)]],
+                   texture2d<float, access::read> lowGBuffer [[texture(17), function_constant(kUpsampledIndirectDiffuse)]],
+                   texture2d<float, access::read> sceneGBuffer [[texture(18), function_constant(kDeferredLighting)]],
+                   constant VoxelClipmap& clipmap [[buffer(VOXEL_CLIPMAP_BINDING_IDX)]],
                    constant AppState& appState APPSTATE_BINDING,
-                   constant ObjectState &objectState OBJECT_STATE_BINDING)
+                   constant ObjectState &objectState OBJECT_STATE_BINDING,
+                   constant uint &materialIndex [[buffer(MATERIAL_INDEX_BINDING_IDX), function_constant(kSceneGBuffer)]],
+                   constant Material *materials [[buffer(MATERIAL_TABLE_BINDING_IDX), function_constant(kDeferredLighting)]])
 {
     VS_out in = input;
-    in.normal = normalize(in.normal);
+    Material material;
+    if (kDeferredLighting) {
+        // The closest surface of the pixel, at its distance along the ray of the pixel.
+        const float4 surface = sceneGBuffer.read(uint2(input.gl_Position.xy));
+        if (surface.z == 0)
+            return float4(0, 0, 0, 1); // Background.
+        in.normal = decodeOctahedral(surface.xy);
+        in.worldPosition = float3(appState.cameraPosition) + normalize(input.worldPosition) * surface.z;
+        material = materials[uint(surface.w)];
+    }
+    else {
+        in.normal = normalize(in.normal);
+        material = objectState.material;
+    }
+
+    // Screen G-buffer: octahedral normal, distance to the camera (0, the clear color, where there is no surface) and
+    // material index.
+    if (kSceneGBuffer)
+        return float4(encodeOctahedral(in.normal), distance(in.worldPosition, float3(appState.cameraPosition)), float(materialIndex));
 
     float4 color = float4(0, 0, 0, 1);
     const float3 viewDirection = normalize(in.worldPosition - appState.cameraPosition);
@@ -347,26 +587,32 @@ fragment float4 FS(VS_out input [[stage_in]],
 #if 1
     // Indirect diffuse light.
     if(appState.settings.indirectDiffuseLight &&
-       objectState.material.diffuseReflectivity * (1.0f - objectState.material.transparency) > 0.01f)
-        color.rgb += indirectDiffuseLight(in, texture3D, objectState);
+       material.diffuseReflectivity * (1.0f - material.transparency) > 0.01f) {
+        if (kUpsampledIndirectDiffuse)
+            color.rgb += reflectIndirectDiffuse(upsampleIndirectDiffuse(in.gl_Position.xy, in.normal,
+                                                                        distance(in.worldPosition, float3(appState.cameraPosition)),
+                                                                        lowIrradiance, lowGBuffer, appState), material);
+        else
+            color.rgb += indirectDiffuseLight(in, texture3D, cascades, anisotropic, clipmap, appState, material);
+    }
 
     // Indirect specular light (glossy reflections).
     if(appState.settings.indirectSpecularLight &&
-       objectState.material.specularReflectivity * (1.0f - objectState.material.transparency) > 0.01f)
-        color.rgb += indirectSpecularLight(in, viewDirection, texture3D, objectState);
+       material.specularReflectivity * (1.0f - material.transparency) > 0.01f)
+        color.rgb += indirectSpecularLight(in, viewDirection, texture3D, cascades, anisotropic, clipmap, appState, material);
 
     // Emissivity.
-    color.rgb += objectState.material.emissivity * objectState.material.diffuseColor;
+    color.rgb += material.emissivity * material.diffuseColor;
 
     // Transparency
-    if(objectState.material.transparency > 0.01f)
+    if(material.transparency > 0.01f)
         color.rgb = mix(color.rgb,
-                        indirectRefractiveLight(in, viewDirection, texture3D, objectState), objectState.material.transparency);
+                        indirectRefractiveLight(in, viewDirection, texture3D, cascades, anisotropic, clipmap, appState, material), material.transparency);
 #endif
 
     // Direct light.
     if(appState.settings.directLight)
-        color.rgb += directLight(in, viewDirection, texture3D, appState, objectState);
+        color.rgb += directLight(in, viewDirection, opacityTexture, texture3D, cascades, anisotropic, clipmap, appState, material);
 
 #if (GAMMA_CORRECTION == 1)
     color.rgb = pow(color.rgb, float3(1.0 / 2.2));
@@ -374,3 +620,193 @@ fragment float4 FS(VS_out input [[stage_in]],
 
     return color;
 }
+
+// --------------------------------------
+// Multi-bounce indirect light.
+// --------------------------------------
+#define MULTI_BOUNCE_FACTOR 0.25f /* Indirect diffuse is tuned for display: re-injected as is, it saturates the voxels within a few bounces. */
+
+struct BounceParams
+{
+    uint4 subset; // xyz: position of the traced voxels within each 2x2x2 block.
+};
+
+// Traces the indirect diffuse cones at the occupied voxels of one interleaved subset (one voxel per 2x2x2 block,
+// one thread each) and stores the light they reflect. Light injection adds it to the direct light, so the next
+// mips carry one more bounce. The CPU mirror is CpuLightInjector::injectBounce.
+kernel void injectBounce(uint3 gIdx [[thread_position_in_grid]],
+                         texture3d<float> texture3D [[texture(2)]],
+                         VoxelCascades cascades [[texture(5)]],
+                         AnisotropicVoxels anisotropic [[texture(9)]],
+                         texture3d<float, access::read> textureAlbedo [[texture(16)]],
+                         texture3d<float, access::read> textureNormal [[texture(17)]],
+                         texture3d<float, access::write> textureBounce [[texture(18)]],
+                         constant VoxelClipmap& clipmap [[buffer(VOXEL_CLIPMAP_BINDING_IDX)]],
+                         constant AppState& appState APPSTATE_BINDING,
+                         constant BounceParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    const uint3 idx = 2 * gIdx + params.subset.xyz;
+    const uint3 dim = uint3(textureBounce.get_width(), textureBounce.get_height(), textureBounce.get_depth());
+    if (idx.x >= dim.x || idx.y >= dim.y || idx.z >= dim.z)
+        return;
+
+    const float4 normal = textureNormal.read(idx);
+    if (normal.a == 0)
+        return; // Empty voxel, light injection ignores its bounce.
+
+    // Same encoding as decodeVoxelNormal in voxel_lighting.metal.
+    const float3 N = normalize(normal.xyz * 2.0f - float3(1.0f));
+    const float3 worldPosition = (float3(idx) + float3(0.5)) / float3(dim) * 2.0 - float3(1.0);
+    const float3 acc = traceDiffuseCones(worldPosition, N, texture3D, cascades, anisotropic, clipmap, appState);
+
+    const float4 albedo = textureAlbedo.read(idx);
+    textureBounce.write(float4(MULTI_BOUNCE_FACTOR * DIFFUSE_INDIRECT_FACTOR * albedo.rgb * acc, 1.0f), idx);
+}
+
+// --------------------------------------
+// Low resolution indirect diffuse light.
+// --------------------------------------
+#define TEMPORAL_CONE_PATTERNS 4 /* TemporalAccumulator::CONE_PATTERNS */
+#define TEMPORAL_DEPTH_TOLERANCE 0.05f /* TemporalAccumulator::DEPTH_TOLERANCE */
+#define TEMPORAL_NORMAL_THRESHOLD 0.9f /* TemporalAccumulator::NORMAL_THRESHOLD */
+#define TEMPORAL_MAX_FRAMES 16.0f /* TemporalAccumulator::MAX_FRAMES */
+
+struct IndirectDiffuseParams
+{
+    float4x4 inverseViewProjection;
+    float4x4 previousViewProjection; // Of the frame the history was accumulated at.
+    float4 previousCameraPosition;
+    uint4 temporal; // x: temporal accumulation, y: frame index, z: whether the history is valid.
+};
+
+// Traces the indirect diffuse cones once per block of indirectDiffuseScale^2 pixels of the screen G-buffer (one thread
+// each), at the closest surface of the block so that edges keep the foreground. Writes that sample to lowGBuffer for
+// the upsampling weights of the cone tracing pass (see upsampleIndirectDiffuse), and its position to lowPosition for
+// the reprojection of accumulateIndirectDiffuse. With temporal accumulation, only the cone pattern of the sample in
+// this frame is traced. The CPU mirror is ScreenGBuffer::downsample plus CpuConeTracer::traceDiffuseCones (or
+// traceDiffuseConePattern).
+kernel void traceIndirectDiffuse(uint2 gIdx [[thread_position_in_grid]],
+                                 texture3d<float> texture3D [[texture(2)]],
+                                 VoxelCascades cascades [[texture(5)]],
+                                 AnisotropicVoxels anisotropic [[texture(9)]],
+                                 texture2d<float, access::read> gBuffer [[texture(16)]],
+                                 texture2d<float, access::write> lowGBuffer [[texture(17)]],
+                                 texture2d<float, access::write> lowIrradiance [[texture(18)]],
+                                 texture2d<float, access::write> lowPosition [[texture(19)]],
+                                 constant VoxelClipmap& clipmap [[buffer(VOXEL_CLIPMAP_BINDING_IDX)]],
+                                 constant AppState& appState APPSTATE_BINDING,
+                                 constant IndirectDiffuseParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    if (gIdx.x >= lowIrradiance.get_width() || gIdx.y >= lowIrradiance.get_height())
+        return;
+
+    const uint scale = appState.indirectDiffuseScale;
+    const uint2 size = uint2(gBuffer.get_width(), gBuffer.get_height());
+    const uint2 first = gIdx * scale;
+    const uint2 end = min(size, first + scale);
+    float4 closest = float4(0);
+    uint2 closestPixel = first;
+    for (uint y = first.y; y < end.y; ++y)
+        for (uint x = first.x; x < end.x; ++x) {
+            const float4 sample = gBuffer.read(uint2(x, y));
+            if (sample.z > 0 && (closest.w == 0 || sample.z < closest.w)) {
+                closest = float4(decodeOctahedral(sample.xy), sample.z);
+                closestPixel = uint2(x, y);
+            }
+        }
+    lowGBuffer.write(closest, gIdx);
+    if (closest.w == 0) {
+        lowIrradiance.write(float4(0), gIdx);
+        lowPosition.write(float4(0), gIdx);
+        return;
+    }
+
+    // The position is at that distance along the ray through the center of the pixel.
+    const float2 ndc = float2(2.0f * (float(closestPixel.x) + 0.5f) / size.x - 1.0f, 1.0f - 2.0f * (float(closestPixel.y) + 0.5f) / size.y);
+    const float4 farPoint = params.inverseViewProjection * float4(ndc, 1.0f, 1.0f);
+    const float3 cameraPosition = float3(appState.cameraPosition);
+    const float3 worldPosition = cameraPosition + normalize(farPoint.xyz / farPoint.w - cameraPosition) * closest.w;
+    lowPosition.write(float4(worldPosition, 1.0f), gIdx);
+    const float3 normal = normalize(closest.xyz);
+    float3 acc;
+    if (params.temporal.x) {
+        // Same as TemporalAccumulator::conePattern and patternRotation.
+        const uint frame = params.temporal.y;
+        const uint pattern = (frame + gIdx.x + 2 * gIdx.y) % TEMPORAL_CONE_PATTERNS;
+        const float cycle = float(frame / TEMPORAL_CONE_PATTERNS);
+        const float rotation = fract(cycle * 0.618034f) * M_PI_2_F;
+        acc = traceDiffuseConePattern(worldPosition, normal, pattern, rotation, texture3D, cascades, anisotropic, clipmap, appState);
+    }
+    else
+        acc = traceDiffuseCones(worldPosition, normal, texture3D, cascades, anisotropic, clipmap, appState);
+    lowIrradiance.write(float4(acc, 1.0f), gIdx);
+}
+
+// Blends the cone pattern traced this frame into the history of the previous frame, reprojected with its view
+// projection matrix. History samples of another surface (distance or normal too different) are skipped, and the
+// history is clamped to the range of the light of the 3x3 neighbourhood (which has all the cone patterns) so that
+// nothing lags behind moving objects. The CPU mirror is TemporalAccumulator::accumulate.
+kernel void accumulateIndirectDiffuse(uint2 gIdx [[thread_position_in_grid]],
+                                      texture2d<float, access::read> lowGBuffer [[texture(16)]],
+                                      texture2d<float, access::read> lowPosition [[texture(17)]],
+                                      texture2d<float, access::read> frameIrradiance [[texture(18)]],
+                                      texture2d<float, access::read> previousGBuffer [[texture(19)]],
+                                      texture2d<float, access::read> previousHistory [[texture(20)]],
+                                      texture2d<float, access::write> history [[texture(21)]],
+                                      constant IndirectDiffuseParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    const uint2 size = uint2(history.get_width(), history.get_height());
+    if (gIdx.x >= size.x || gIdx.y >= size.y)
+        return;
+
+    const float4 sample = lowGBuffer.read(gIdx);
+    if (sample.w == 0) {
+        history.write(float4(0), gIdx);
+        return;
+    }
+    const float3 current = frameIrradiance.read(gIdx).rgb;
+    const float3 normal = normalize(sample.xyz);
+
+    float3 lo = current, hi = current;
+    for (uint y = max(gIdx.y, 1u) - 1; y <= min(gIdx.y + 1, size.y - 1); ++y)
+        for (uint x = max(gIdx.x, 1u) - 1; x <= min(gIdx.x + 1, size.x - 1); ++x)
+            if (lowGBuffer.read(uint2(x, y)).w > 0) {
+                const float3 neighbour = frameIrradiance.read(uint2(x, y)).rgb;
+                lo = min(lo, neighbour);
+                hi = max(hi, neighbour);
+            }
+
+    float4 previous = float4(0);
+    float total = 0;
+    if (params.temporal.z) {
+        const float3 worldPosition = lowPosition.read(gIdx).xyz;
+        const float4 clip = params.previousViewProjection * float4(worldPosition, 1.0f);
+        if (clip.w > 0) {
+            const float2 f = float2((clip.x / clip.w * 0.5f + 0.5f) * size.x, (0.5f - clip.y / clip.w * 0.5f) * size.y) - 0.5f;
+            const float2 base = floor(f);
+            const float2 t = f - base;
+            const float expectedDistance = distance(worldPosition, params.previousCameraPosition.xyz);
+            for (int corner = 0; corner < 4; ++corner) {
+                const int2 offset = int2(corner & 1, corner >> 1);
+                const int2 p = int2(base) + offset;
+                if (p.x < 0 || p.y < 0 || p.x >= int(size.x) || p.y >= int(size.y))
+                    continue;
+                const float4 old = previousGBuffer.read(uint2(p));
+                if (old.w == 0 || abs(old.w - expectedDistance) > TEMPORAL_DEPTH_TOLERANCE * expectedDistance
+                    || dot(normalize(old.xyz), normal) < TEMPORAL_NORMAL_THRESHOLD)
+                    continue;
+                const float weight = (offset.x ? t.x : 1 - t.x) * (offset.y ? t.y : 1 - t.y);
+                previous += weight * previousHistory.read(uint2(p));
+                total += weight;
+            }
+        }
+    }
+
+    float4 result = float4(current, 1.0f);
+    if (total > 1e-3f) {
+        previous /= total;
+        const float frames = min(previous.a + 1.0f, TEMPORAL_MAX_FRAMES);
+        result = float4(mix(clamp(previous.rgb, lo, hi), current, 1.0f / frames), frames);
+    }
+    history.write(result, gIdx);
+}
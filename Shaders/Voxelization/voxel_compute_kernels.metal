@@ -2,18 +2,21 @@
 #include <simd/simd.h>
 
 #include "../common.metal"
+#include "voxel_lighting.metal"
 
 using namespace metal;
 
 struct ClearParams
 {
     float4 color;
+    uint4 offset; // First texel of the cleared region.
 };
 
-kernel void clear(uint3 idx[[thread_position_in_grid]],
+kernel void clear(uint3 gIdx[[thread_position_in_grid]],
                   texture3d<float, access::write> textureVoxel [[texture(0)]],
                   constant ClearParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
 {
+    uint3 idx = gIdx + params.offset.xyz;
     uint3 dim = uint3(textureVoxel.get_width(), textureVoxel.get_height(), textureVoxel.get_depth());
     if (idx.x >= dim.x || idx.y >= dim.y || idx.z >= dim.z)
         return;
@@ -21,23 +24,95 @@ kernel void clear(uint3 idx[[thread_position_in_grid]],
     textureVoxel.write(params.color, idx);
 }
 
+#define VOXEL_BRICK_SIZE 8
+
+// Clears a list of 8^3 bricks of the first level, one thread group per brick.
+kernel void clearBricks(uint3 lIdx [[thread_position_in_threadgroup]],
+                        uint3 groupIdx [[threadgroup_position_in_grid]],
+                        texture3d<float, access::write> textureVoxel [[texture(0)]],
+                        constant ClearParams &params [[buffer(COMPUTE_PARAM_START_IDX)]],
+                        const device uint4 *bricks [[buffer(COMPUTE_PARAM_START_IDX + 1)]])
+{
+    uint3 idx = bricks[groupIdx.x].xyz * VOXEL_BRICK_SIZE + lIdx;
+    uint3 dim = uint3(textureVoxel.get_width(), textureVoxel.get_height(), textureVoxel.get_depth());
+    if (idx.x >= dim.x || idx.y >= dim.y || idx.z >= dim.z)
+        return;
+
+    textureVoxel.write(params.color, idx);
+}
+
+struct CopyBufferParams
+{
+    uint layout; // Order of the voxels in the buffer (see voxelBufferIndex).
+};
+
 kernel void copyRgba8Buffer(uint3 idx[[thread_position_in_grid]],
                             const device uint *bufferVoxel [[buffer(0)]],
                             texture3d<float, access::write> textureVoxel [[texture(0)]],
-                            constant ClearParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+                            constant CopyBufferParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
 {
     uint3 dim = uint3(textureVoxel.get_width(), textureVoxel.get_height(), textureVoxel.get_depth());
     if (idx.x >= dim.x || idx.y >= dim.y || idx.z >= dim.z)
         return;
 
-    uint idx1D = idx.z * (dim.x * dim.y) +
-                 idx.y * dim.x +
-                 idx.x;
+    uint idx1D = voxelBufferIndex(idx, dim.x, params.layout);
 
     float4 color = rgba8ToVec4(bufferVoxel[idx1D]) / 255.0;
     textureVoxel.write(color, idx);
 }
 
+struct InjectLightParams
+{
+    uint multiBounce; // Whether to add the light reflected by the voxels (injectBounce in voxel_cone_tracing.metal).
+};
+
+// Writes the threadgroups of the light injection dispatch from the voxel count of the occupied voxel list.
+kernel void prepareInjectLight(device uint *occupiedList [[buffer(VOXEL_OCCUPIED_LIST_BINDING_IDX)]])
+{
+    occupiedList[1] = (occupiedList[0] + INJECT_LIGHT_THREADGROUP_SIZE - 1) / INJECT_LIGHT_THREADGROUP_SIZE;
+    occupiedList[2] = 1;
+    occupiedList[3] = 1;
+}
+
+// Light injection: computes the radiance volume's first level from the voxel G-buffer.
+// Produces the same value as the voxelization fragment shader does in one go, but evaluated at
+// the voxel center, so the lights can change without re-rasterizing the scene.
+// Runs over the occupied voxel list only, the other voxels of the first level stay empty since the last full clear.
+kernel void injectLight(uint listIdx[[thread_position_in_grid]],
+                        texture3d<float, access::read> textureAlbedo [[texture(0)]],
+                        texture3d<float, access::read> textureNormal [[texture(1)]],
+                        texture3d<float, access::read> textureEmissive [[texture(2)]],
+                        texture3d<float, access::write> textureVoxel [[texture(3)]],
+                        texture3d<float, access::read> textureBounce [[texture(4)]],
+                        constant AppState& appState APPSTATE_BINDING,
+                        const device uint *occupiedList [[buffer(VOXEL_OCCUPIED_LIST_BINDING_IDX)]],
+                        constant InjectLightParams& params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    if (listIdx >= occupiedList[0])
+        return;
+
+    uint3 dim = uint3(textureAlbedo.get_width(), textureAlbedo.get_height(), textureAlbedo.get_depth());
+    uint voxelIndex = occupiedList[VOXEL_OCCUPIED_LIST_HEADER + listIdx];
+    uint3 idx = uint3(voxelIndex % dim.x, (voxelIndex / dim.x) % dim.y, voxelIndex / (dim.x * dim.y));
+
+    float4 normal = textureNormal.read(idx);
+    if (normal.a == 0)
+    {
+        // Emptied by a partial re-voxelization since it was listed
+        textureVoxel.write(float4(0), idx);
+        return;
+    }
+
+    float4 albedo = textureAlbedo.read(idx);
+    float4 emissive = textureEmissive.read(idx);
+    float3 worldPosition = (float3(idx) + float3(0.5)) / float3(dim) * 2.0 - float3(1.0);
+    float3 color = albedo.rgb * calculatePointLights(worldPosition, decodeVoxelNormal(normal), appState) + emissive.rgb;
+    if (params.multiBounce)
+        color += textureBounce.read(idx).rgb;
+
+    textureVoxel.write(float4(color, albedo.a), idx);
+}
+
 struct VS_in
 {
     packed_float3 position;
@@ -81,6 +156,66 @@ kernel void computeTriangleDominantAxis(uint triIdx[[thread_position_in_grid]],
     triDominantAxis[triIdx] = dominantAxis;
 }
 
+// -------------- Opacity volume -----------------------------------------
+struct ExtractOpacityParams
+{
+    uint4 offset; // First texel of the updated region.
+};
+
+// Copies the alpha of the voxels into the first level of the R8 opacity volume read by shadow cones.
+kernel void extractOpacity(uint3 gIdx [[thread_position_in_grid]],
+                           texture3d<float, access::read> textureVoxel [[texture(0)]],
+                           texture3d<float, access::write> textureOpacity [[texture(1)]],
+                           constant ExtractOpacityParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    uint3 idx = gIdx + params.offset.xyz;
+    if (idx.x >= textureOpacity.get_width() || idx.y >= textureOpacity.get_height() || idx.z >= textureOpacity.get_depth())
+        return;
+    textureOpacity.write(float4(textureVoxel.read(idx).a), idx);
+}
+
+// -------------- Anisotropic (directional) mipmaps ----------------------
+struct AnisotropicMipParams
+{
+    uint4 dstOffset; // First texel of the updated region.
+};
+
+// Builds one level of the six directional volumes (+X, -X, +Y, -Y, +Z, -Z) from the previous one.
+// A texel of a direction is what a cone going that way sees through the 2x2x2 source block: the two
+// texels of each row along the axis are composited front to back, then the 4 rows are averaged.
+// Thin walls stay opaque this way, instead of averaging out like an isotropic box filter does.
+kernel void generateAnisotropicMip(uint3 gIdx [[thread_position_in_grid]],
+                                   array<texture3d<float, access::read>, 6> src [[texture(0)]],
+                                   array<texture3d<float, access::write>, 6> dst [[texture(6)]],
+                                   constant AnisotropicMipParams &params [[buffer(COMPUTE_PARAM_START_IDX)]])
+{
+    uint3 idx = gIdx + params.dstOffset.xyz;
+    uint3 dim = uint3(dst[0].get_width(), dst[0].get_height(), dst[0].get_depth());
+    if (idx.x >= dim.x || idx.y >= dim.y || idx.z >= dim.z)
+        return;
+
+    uint3 srcLast = uint3(src[0].get_width(), src[0].get_height(), src[0].get_depth()) - uint3(1);
+    for (uint d = 0; d < 6; ++d)
+    {
+        uint axis = d / 2;
+        bool negative = (d & 1) != 0;
+        float4 sum = float4(0.0f);
+        for (uint row = 0; row < 4; ++row)
+        {
+            uint3 near = 2 * idx;
+            near[(axis + 1) % 3] += row & 1;
+            near[(axis + 2) % 3] += row >> 1;
+            uint3 far = near;
+            far[axis] += 1;
+            // Clamp to edge, like the isotropic mips.
+            float4 front = src[d].read(min(negative ? far : near, srcLast));
+            float4 back = src[d].read(min(negative ? near : far, srcLast));
+            sum += front + (1 - front.a) * back;
+        }
+        dst[d].write(0.25f * sum, idx);
+    }
+}
+
 // -------------- Generate 3D texture mipmaps ----------------------------
 #define k3DMipGenThreadGroupXYZ (8 * 8 * 8)
 #define k3DMipGenThreadGroupXY (8 * 8)
@@ -90,19 +225,32 @@ struct GenMipParams
 {
     uint srcLevel;
     uint numMipLevelsToGen;
+    // Whether the first texel of each thread group comes from groupOffsets instead of dstOffset.
+    uint useGroupOffsets;
+    // Whether to skip sampling the empty 8^3 bricks of level 0 (brickOccupancy), first batch only.
+    uint useBrickOccupancy;
+    // First texel of the updated region in dstMip1. Must be a multiple of 8 (thread group size)
+    // so that the shared memory reduction stays aligned.
+    uint3 dstOffset;
 };
 
 // NOTE(hqle): For numMipLevelsToGen > 1, this function assumes the texture is power of two. If it
 // is not, quality will not be good.
 kernel void generate3DMipmaps(uint lIndex [[thread_index_in_threadgroup]],
-                              ushort3 gIndices [[thread_position_in_grid]],
+                              ushort3 gIndicesInRegion [[thread_position_in_grid]],
+                              ushort3 lIndices [[thread_position_in_threadgroup]],
+                              uint3 groupIndices [[threadgroup_position_in_grid]],
                               texture3d<float> srcTexture [[texture(0)]],
                               texture3d<float, access::write> dstMip1 [[texture(1)]],
                               texture3d<float, access::write> dstMip2 [[texture(2)]],
                               texture3d<float, access::write> dstMip3 [[texture(3)]],
                               texture3d<float, access::write> dstMip4 [[texture(4)]],
-                              constant GenMipParams &options [[buffer(0)]])
+                              constant GenMipParams &options [[buffer(0)]],
+                              const device uint4 *groupOffsets [[buffer(1)]],
+                              const device uint *brickOccupancy [[buffer(2)]])
 {
+    ushort3 gIndices = options.useGroupOffsets ? ushort3(groupOffsets[groupIndices.x].xyz) + lIndices
+                                               : gIndicesInRegion + ushort3(options.dstOffset);
     uint firstMipLevel = options.srcLevel + 1;
     ushort3 mipSize =
         ushort3(dstMip1.get_width(), dstMip1.get_height(), dstMip1.get_depth());
@@ -133,8 +281,26 @@ kernel void generate3DMipmaps(uint lIndex [[thread_index_in_threadgroup]],
     float4 texel1;
     if (validThread)
     {
-        float3 texCoords = (float3(gIndices) + float3(0.5, 0.5, 0.5)) / float3(mipSize);
-        texel1    = srcTexture.sample(textureSampler, texCoords, level(options.srcLevel));
+        // Nothing was voxelized into an empty brick, its texels are known to be zero.
+        bool emptyBrick = false;
+        if (options.useBrickOccupancy && options.srcLevel == 0)
+        {
+            // A texel of the first mip covers 2^3 voxels, a brick 4^3 texels.
+            uint3 brick = uint3(gIndices) >> 2;
+            uint bricksPerAxis = max(uint(mipSize.x) >> 2, 1u);
+            uint brickIndex = (brick.z * bricksPerAxis + brick.y) * bricksPerAxis + brick.x;
+            emptyBrick = ((brickOccupancy[brickIndex >> 5] >> (brickIndex & 31)) & 1) == 0;
+        }
+
+        if (emptyBrick)
+        {
+            texel1 = float4(0);
+        }
+        else
+        {
+            float3 texCoords = (float3(gIndices) + float3(0.5, 0.5, 0.5)) / float3(mipSize);
+            texel1    = srcTexture.sample(textureSampler, texCoords, level(options.srcLevel));
+        }
 
         // Write to texture
         dstMip1.write(texel1, gIndices);
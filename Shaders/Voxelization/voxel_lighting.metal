@@ -0,0 +1,43 @@
+// Direct lighting rules used to fill the voxel radiance volume.
+// Shared by the voxelization fragment shader and the light injection kernel.
+// The CPU mirror lives in Source/Graphic/Voxelization/VoxelLighting.h. Keep both in sync.
+// Must be included after common.metal.
+#ifndef VOXEL_LIGHTING_METAL
+#define VOXEL_LIGHTING_METAL
+
+// Lighting attenuation factors.
+#define DIST_FACTOR 1.1f /* Distance is multiplied by this when calculating attenuation. */
+#define CONSTANT 1
+#define LINEAR 0
+#define QUADRATIC 1
+
+// Returns an attenuation factor given a distance.
+static inline
+float attenuate(float dist){ dist *= DIST_FACTOR; return 1.0f / (CONSTANT + LINEAR * dist + QUADRATIC * dist * dist); }
+
+static inline
+float3 calculatePointLight(float3 worldPosition, float3 normal, constant PointLight& light){
+    const float3 direction = normalize(light.position - worldPosition);
+    const float distanceToLight = distance(float3(light.position), worldPosition);
+    const float attenuation = attenuate(distanceToLight);
+    const float d = max(dot(normalize(normal), direction), 0.0f);
+    return d * POINT_LIGHT_INTENSITY * attenuation * light.color;
+}
+
+// Sum of the diffuse contributions of all point lights.
+static inline
+float3 calculatePointLights(float3 worldPosition, float3 normal, constant AppState& appState){
+    float3 color = float3(0.0f);
+    const uint maxLights = min(appState.numberOfLights, MAX_LIGHTS);
+    for (uint i = 0; i < maxLights; ++i) color += calculatePointLight(worldPosition, normal, appState.pointLights[i]);
+    return color;
+}
+
+// Normal <-> RGBA8 voxel G-buffer encoding. Alpha marks the voxel as occupied.
+static inline
+float4 encodeVoxelNormal(float3 normal) { return float4(0.5f * normalize(normal) + float3(0.5f), 1.0f); }
+
+static inline
+float3 decodeVoxelNormal(float4 encoded) { return encoded.xyz * 2.0f - float3(1.0f); }
+
+#endif // VOXEL_LIGHTING_METAL
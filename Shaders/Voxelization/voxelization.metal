@@ -7,11 +7,18 @@
 #include <simd/simd.h>
 
 #include "../common.metal"
+#include "voxel_lighting.metal"
 
 constant bool kVoxelizationMultiPass = !kVoxelizationSinglePass;
 constant bool kUseRWTexture = kReadWriteTextureSupported && kRasterOrderGroupSupported;
 constant bool kUseWTexture = !kUseRWTexture && kRasterOrderGroupSupported;
 constant bool kUseAtomicBuffer = !kUseRWTexture && !kUseWTexture;
+// Extra outputs of the voxel G-buffer mode (albedo goes to the same slot as the lit color).
+constant bool kUseGBufferRWTexture = kUseRWTexture && kVoxelizeGBuffer;
+constant bool kUseGBufferWTexture = kUseWTexture && kVoxelizeGBuffer;
+constant bool kUseGBufferAtomicBuffer = kUseAtomicBuffer && kVoxelizeGBuffer;
+// One bit per 8^3 brick written to, for mip generation to skip the empty ones. The clipmap cascades don't use it.
+constant bool kWriteBrickOccupancy = !kVoxelizeClipmap;
 
 using namespace metal;
 
@@ -19,6 +26,8 @@ struct VS_out
 {
     float3 worldPosition [[user(locn0)]];
     float3 normal [[user(locn1)]];
+    // Position in the [-1, 1] space of the voxel volume. Same as worldPosition unless voxelizing a clipmap level.
+    float3 volumePosition [[user(locn2)]];
     float4 gl_Position [[position]];
 };
 
@@ -31,6 +40,14 @@ struct VS_in
 struct VoxelProjectionDir
 {
     uint direction;
+    uint presorted; // The index buffer range drawn only has triangles of this dominant axis.
+};
+
+// Only voxels inside [min, max) are written (partial re-voxelization).
+struct VoxelRegion
+{
+    uint4 min;
+    uint4 max;
 };
 
 static inline
@@ -48,7 +65,9 @@ vertex VS_out VS(uint vid [[ vertex_id ]],
                  const device uint *indices INDEX_BUFFER_BINDING,
                  const device uchar *triDominantAxis [[buffer(TRI_DOMINANT_BUFFER_BINDING_IDX), function_constant(kVoxelizationMultiPass)]],
                  constant ObjectState& transform TRANSFORM_BINDING,
-                 constant VoxelProjectionDir& projDir [[buffer(VOXEL_PROJ_BINDING_IDX), function_constant(kVoxelizationMultiPass)]])
+                 constant AppState& appState APPSTATE_BINDING,
+                 constant VoxelProjectionDir& projDir [[buffer(VOXEL_PROJ_BINDING_IDX), function_constant(kVoxelizationMultiPass)]],
+                 constant VoxelClipmapLevel& clipmapLevel [[buffer(VOXEL_CLIPMAP_BINDING_IDX), function_constant(kVoxelizeClipmap)]])
 {
     uint index = indices[vid];
     VS_in in = vertices[index];
@@ -56,12 +75,19 @@ vertex VS_out VS(uint vid [[ vertex_id ]],
     VS_out out = {};
 
     out.worldPosition = float3(worldTransform(transform, float4(in.position, 1.0)).xyz);
+    out.volumePosition = out.worldPosition;
+    if (kVoxelizeClipmap)
+    {
+        // The window of the level maps to [-1, 1].
+        float windowSize = clipmapLevel.minCorner.w * appState.voxelTextureSize;
+        out.volumePosition = 2.0f * (out.worldPosition - clipmapLevel.minCorner.xyz) / windowSize - 1.0f;
+    }
 
     if (kVoxelizationMultiPass)
     {
         // In multipass mode, we skip the primitive if the current projection direction
-        // is not the same as dominant axis
-        uint dominantAxis = triDominantAxis[vid / 3];
+        // is not the same as dominant axis (unless the draw only covers triangles of that axis)
+        uint dominantAxis = projDir.presorted ? projDir.direction : uint(triDominantAxis[vid / 3]);
         if (dominantAxis != projDir.direction)
         {
             // Degenerate point. This will be culled.
@@ -69,7 +95,7 @@ vertex VS_out VS(uint vid [[ vertex_id ]],
         }
         else
         {
-            out.gl_Position = float4(projectOnAxis(out.worldPosition, dominantAxis), 1);
+            out.gl_Position = float4(projectOnAxis(out.volumePosition, dominantAxis), 1);
         }
     }
     else
@@ -98,83 +124,135 @@ vertex VS_out VS(uint vid [[ vertex_id ]],
 
         // In single pass mode, we only project the triangle to the plane representing its
         // dominant axis
-        out.gl_Position = float4(projectOnAxis(out.worldPosition, dominantAxis), 1);
+        out.gl_Position = float4(projectOnAxis(out.volumePosition, dominantAxis), 1);
     }
 
-    out.normal = normalize(float3x3(transform.invTransM[0].xyz, transform.invTransM[1].xyz, transform.invTransM[2].xyz) * float3(in.normal));
+    out.normal = worldNormal(transform, float3(in.normal));
     return out;
 }
 
-// Lighting attenuation factors.
-#define DIST_FACTOR 1.1f /* Distance is multiplied by this when calculating attenuation. */
-#define CONSTANT 1
-#define LINEAR 0
-#define QUADRATIC 1
-
-// Returns an attenuation factor given a distance.
 static inline
-float attenuate(float dist){ dist *= DIST_FACTOR; return 1.0f / (CONSTANT + LINEAR * dist + QUADRATIC * dist * dist); }
+float3 scaleAndBias(float3 p) { return 0.5f * p + float3(0.5f); }
 
+// RGBA8 max blend into an atomic buffer. res is in [0, 1].
 static inline
-float3 calculatePointLight(VS_out in, constant PointLight& light){
-    const float3 direction = normalize(light.position - in.worldPosition);
-    const float distanceToLight = distance(float3(light.position), in.worldPosition);
-    const float attenuation = attenuate(distanceToLight);
-    const float d = max(dot(normalize(in.normal), direction), 0.0f);
-    return d * POINT_LIGHT_INTENSITY * attenuation * light.color;
+void atomicMaxRgba8(device atomic_uint *buffer, uint idx1D, float4 res)
+{
+    res *= 255.0;
+    uint prevValue = 0;
+    uint newValue = vec4ToRgba8(res);
+    while (!atomic_compare_exchange_weak_explicit(&buffer[idx1D], &prevValue, newValue, memory_order_relaxed, memory_order_relaxed))
+    {
+        float4 storedColor = rgba8ToVec4(prevValue);
+        res = max(res, storedColor);
+        newValue = vec4ToRgba8(res);
+    }
 }
 
-static inline
-float3 scaleAndBias(float3 p) { return 0.5f * p + float3(0.5f); }
-
 fragment void FS(VS_out in [[stage_in]],
                  constant AppState& appState APPSTATE_BINDING,
                  constant ObjectState &objectState OBJECT_STATE_BINDING,
+                 constant VoxelRegion &region [[buffer(VOXEL_REGION_BINDING_IDX)]],
+                 constant VoxelClipmapLevel &clipmapLevel [[buffer(VOXEL_CLIPMAP_BINDING_IDX), function_constant(kVoxelizeClipmap)]],
                  texture3d<float, access::read_write> textureVoxelRW [[texture(2), raster_order_group(0), function_constant(kUseRWTexture)]],
                  texture3d<float, access::write> textureVoxelW [[texture(2), raster_order_group(0), function_constant(kUseWTexture)]],
-                 device atomic_uint *bufferVoxel [[buffer(VOXEL_ATOMIC_BUFFER_BINDING_IDX), function_constant(kUseAtomicBuffer)]])
+                 texture3d<float, access::read_write> textureNormalRW [[texture(3), raster_order_group(0), function_constant(kUseGBufferRWTexture)]],
+                 texture3d<float, access::write> textureNormalW [[texture(3), raster_order_group(0), function_constant(kUseGBufferWTexture)]],
+                 texture3d<float, access::read_write> textureEmissiveRW [[texture(4), raster_order_group(0), function_constant(kUseGBufferRWTexture)]],
+                 texture3d<float, access::write> textureEmissiveW [[texture(4), raster_order_group(0), function_constant(kUseGBufferWTexture)]],
+                 device atomic_uint *bufferVoxel [[buffer(VOXEL_ATOMIC_BUFFER_BINDING_IDX), function_constant(kUseAtomicBuffer)]],
+                 device atomic_uint *bufferNormal [[buffer(VOXEL_NORMAL_ATOMIC_BUFFER_BINDING_IDX), function_constant(kUseGBufferAtomicBuffer)]],
+                 device atomic_uint *bufferEmissive [[buffer(VOXEL_EMISSIVE_ATOMIC_BUFFER_BINDING_IDX), function_constant(kUseGBufferAtomicBuffer)]],
+                 device atomic_uint *brickOccupancy [[buffer(VOXEL_OCCUPANCY_BINDING_IDX), function_constant(kWriteBrickOccupancy)]],
+                 device atomic_uint *occupiedMask [[buffer(VOXEL_OCCUPIED_MASK_BINDING_IDX), function_constant(kVoxelizeGBuffer)]],
+                 device atomic_uint *occupiedList [[buffer(VOXEL_OCCUPIED_LIST_BINDING_IDX), function_constant(kVoxelizeGBuffer)]])
 {
-    float3 color = float3(0.0f);
-    if(!isInsideCube(in.worldPosition, 0)) return;
+    if(!isInsideCube(in.volumePosition, 0)) return;
+
+    float3 voxel = scaleAndBias(in.volumePosition);
+    uint3 dim = uint3(appState.voxelTextureSize, appState.voxelTextureSize, appState.voxelTextureSize);
+    uint3 windowCoords = uint3(int3(float3(dim) * voxel));
+    if (any(windowCoords < region.min.xyz) || any(windowCoords >= region.max.xyz)) return;
+
+    // Clipmap levels are stored toroidally, the window origin moves but the texels of a world voxel don't.
+    uint3 coords = windowCoords;
+    if (kVoxelizeClipmap)
+        coords = uint3((int3(windowCoords) + clipmapLevel.origin.xyz) & int(appState.voxelTextureSize - 1));
+
+    if (kWriteBrickOccupancy)
+    {
+        uint bricksPerAxis = appState.voxelTextureSize >> 3;
+        uint3 brick = coords >> 3;
+        uint brickIndex = (brick.z * bricksPerAxis + brick.y) * bricksPerAxis + brick.x;
+        atomic_fetch_or_explicit(&brickOccupancy[brickIndex >> 5], 1u << (brickIndex & 31), memory_order_relaxed);
+    }
+
+    if (kVoxelizeGBuffer)
+    {
+        // The first fragment of a voxel appends it to the list light injection runs over. The mask bit stays set
+        // until the next full clear, so a voxel cleared by partial re-voxelization isn't listed twice.
+        uint voxelIndex = (coords.z * appState.voxelTextureSize + coords.y) * appState.voxelTextureSize + coords.x;
+        uint bit = 1u << (voxelIndex & 31);
+        if ((atomic_load_explicit(&occupiedMask[voxelIndex >> 5], memory_order_relaxed) & bit) == 0 &&
+            (atomic_fetch_or_explicit(&occupiedMask[voxelIndex >> 5], bit, memory_order_relaxed) & bit) == 0)
+        {
+            uint slot = atomic_fetch_add_explicit(&occupiedList[0], 1, memory_order_relaxed);
+            atomic_store_explicit(&occupiedList[VOXEL_OCCUPIED_LIST_HEADER + slot], voxelIndex, memory_order_relaxed);
+        }
+    }
 
-    // Calculate diffuse lighting fragment contribution.
-    const uint maxLights = min(appState.numberOfLights, MAX_LIGHTS);
-    for (uint i = 0; i < maxLights; ++i) color += calculatePointLight(in, appState.pointLights[i]);
     float3 spec = objectState.material.specularReflectivity * objectState.material.specularColor;
     float3 diff = objectState.material.diffuseReflectivity * objectState.material.diffuseColor;
-    color = (diff + spec) * color + fast::clamp(objectState.material.emissivity, 0, 1) * objectState.material.diffuseColor;
-
-    // Output lighting to 3D texture.
-    float3 voxel = scaleAndBias(in.worldPosition);
+    float3 emissive = fast::clamp(objectState.material.emissivity, 0, 1) * objectState.material.diffuseColor;
     float alpha = pow(1 - objectState.material.transparency, 4); // For soft shadows to work better with transparent materials.
-    float4 res = alpha * float4(float3(color), 1);
 
-    uint3 dim = uint3(appState.voxelTextureSize, appState.voxelTextureSize, appState.voxelTextureSize);
-    uint3 coords = uint3(int3(float3(dim) * voxel));
+    float4 res;
+    float4 normal = float4(0.0f);
+    if (kVoxelizeGBuffer)
+    {
+        // Material only. Lighting is added later by the light injection pass.
+        res = alpha * float4(diff + spec, 1);
+        emissive *= alpha;
+        normal = encodeVoxelNormal(in.normal);
+    }
+    else
+    {
+        // Calculate diffuse lighting fragment contribution.
+        float3 color = calculatePointLights(in.worldPosition, in.normal, appState);
+        color = (diff + spec) * color + emissive;
+        res = alpha * float4(float3(color), 1);
+    }
+
+    // Output to 3D texture.
     if (kUseRWTexture)
     {
         // max blend
         res = max(res, textureVoxelRW.read(coords));
         textureVoxelRW.write(res, coords);
+        if (kVoxelizeGBuffer)
+        {
+            textureNormalRW.write(normal, coords);
+            textureEmissiveRW.write(max(float4(emissive, 1), textureEmissiveRW.read(coords)), coords);
+        }
     }
     else if (kUseWTexture)
     {
         textureVoxelW.write(res, coords);
+        if (kVoxelizeGBuffer)
+        {
+            textureNormalW.write(normal, coords);
+            textureEmissiveW.write(float4(emissive, 1), coords);
+        }
     }
     else
     {
         // Use atomic buffer in case Raster order group feature is not supported
-        uint idx1D = coords.z * (appState.voxelTextureSize * appState.voxelTextureSize) +
-                     coords.y * appState.voxelTextureSize +
-                     coords.x;
-        res *= 255.0;
-        uint prevValue = 0;
-        uint newValue = vec4ToRgba8(res);
-        while (!atomic_compare_exchange_weak_explicit(&bufferVoxel[idx1D], &prevValue, newValue, memory_order_relaxed, memory_order_relaxed))
+        uint idx1D = voxelBufferIndex(coords, appState.voxelTextureSize, appState.voxelBufferLayout);
+        atomicMaxRgba8(bufferVoxel, idx1D, res);
+        if (kVoxelizeGBuffer)
         {
-            float4 storedColor = rgba8ToVec4(prevValue);
-            res = max(res, storedColor);
-            newValue = vec4ToRgba8(res);
+            atomic_store_explicit(&bufferNormal[idx1D], vec4ToRgba8(normal * 255.0), memory_order_relaxed);
+            atomicMaxRgba8(bufferEmissive, idx1D, float4(emissive, 1));
         }
     }
 }
@@ -43,6 +43,34 @@ struct AppState
 
     // Debug state
     int state;
+
+    // Whether the voxels are camera centered clipmap cascades (see VoxelClipmap) instead of the [-1, 1] cube.
+    uint voxelClipmap;
+
+    // Whether cones sample the six directional voxel volumes (see Texture3D::generateAnisotropicMips).
+    uint anisotropicVoxels;
+
+    // Whether shadow cones read the R8 opacity volume instead of the alpha of the voxels.
+    uint opacityVolume;
+
+    // Order of the voxels in the voxel atomic buffers (see voxelBufferIndex).
+    uint voxelBufferLayout;
+
+    // Side of the blocks of pixels that share one trace of the indirect diffuse cones (see traceIndirectDiffuse).
+    uint indirectDiffuseScale;
+};
+
+#define VOXEL_CLIPMAP_LEVELS 4
+
+struct VoxelClipmapLevel
+{
+    float4 minCorner; // xyz: world space min corner of the window, w: voxel size.
+    int4 origin; // xyz: world voxel coordinate of the window min corner. Voxel w is stored at texel (w mod size).
+};
+
+struct VoxelClipmap
+{
+    VoxelClipmapLevel levels[VOXEL_CLIPMAP_LEVELS];
 };
 
 struct ObjectState
@@ -51,23 +79,54 @@ struct ObjectState
     float4x4 M;
     float4x4 invTransM;
     Material material;
+    // Whether the vertex buffer already holds world space positions and normals (see WorldVertexStream).
+    uint worldSpaceVertices;
 };
 
 #define TRANSFORM_BINDING [[buffer(0)]]
 #define OBJECT_STATE_BINDING TRANSFORM_BINDING
 #define APPSTATE_BINDING [[buffer(1)]]
 #define VOXEL_PROJ_BINDING_IDX 2
+#define VOXEL_REGION_BINDING_IDX 3
+#define VOXEL_CLIPMAP_BINDING_IDX 4
+#define VOXEL_OCCUPANCY_BINDING_IDX 5
+#define MATERIAL_INDEX_BINDING_IDX 6
+#define MATERIAL_TABLE_BINDING_IDX 7
 #define VERTEX_BUFFER_BINDING [[buffer(8)]]
 #define INDEX_BUFFER_BINDING [[buffer(9)]]
 #define TRI_DOMINANT_BUFFER_BINDING_IDX 10
 #define TRI_DOMINANT_BUFFER_BINDING [[buffer(TRI_DOMINANT_BUFFER_BINDING_IDX)]]
 #define VOXEL_ATOMIC_BUFFER_BINDING_IDX 11
 #define VOXEL_ATOMIC_BUFFER_BINDING [[buffer(VOXEL_ATOMIC_BUFFER_BINDING_IDX)]]
+#define VOXEL_NORMAL_ATOMIC_BUFFER_BINDING_IDX 12
+#define VOXEL_EMISSIVE_ATOMIC_BUFFER_BINDING_IDX 13
+#define VOXEL_OCCUPIED_MASK_BINDING_IDX 14
+#define VOXEL_OCCUPIED_LIST_BINDING_IDX 15
 #define COMPUTE_PARAM_START_IDX 16
 
+// The occupied voxel list of the voxel G-buffer starts with a header: the voxel count, then the threadgroups of the
+// indirect light injection dispatch. The linear index of each voxel written since the last full clear follows.
+#define VOXEL_OCCUPIED_LIST_HEADER 4
+#define INJECT_LIGHT_THREADGROUP_SIZE 64
+
 constant bool kReadWriteTextureSupported[[function_constant(0)]];
 constant bool kRasterOrderGroupSupported [[function_constant(1)]];
 constant bool kVoxelizationSinglePass[[function_constant(2)]];
+// Optional: voxelization writes material data (voxel G-buffer) instead of lit colors.
+constant bool kVoxelizeGBufferValue[[function_constant(3)]];
+constant bool kVoxelizeGBuffer = is_function_constant_defined(kVoxelizeGBufferValue) && kVoxelizeGBufferValue;
+// Optional: voxelization writes into a clipmap level (toroidal addressing) instead of the [-1, 1] cube.
+constant bool kVoxelizeClipmapValue[[function_constant(4)]];
+constant bool kVoxelizeClipmap = is_function_constant_defined(kVoxelizeClipmapValue) && kVoxelizeClipmapValue;
+// Optional: the cone tracing shader writes the screen G-buffer (normal, distance to the camera) instead of shading.
+constant bool kSceneGBufferValue[[function_constant(5)]];
+constant bool kSceneGBuffer = is_function_constant_defined(kSceneGBufferValue) && kSceneGBufferValue;
+// Optional: the cone tracing shader upsamples the indirect diffuse light traced at a lower resolution.
+constant bool kUpsampledIndirectDiffuseValue[[function_constant(6)]];
+constant bool kUpsampledIndirectDiffuse = is_function_constant_defined(kUpsampledIndirectDiffuseValue) && kUpsampledIndirectDiffuseValue;
+// Optional: the cone tracing shader draws a fullscreen quad and shades the surface of each pixel of the screen G-buffer.
+constant bool kDeferredLightingValue[[function_constant(7)]];
+constant bool kDeferredLighting = is_function_constant_defined(kDeferredLightingValue) && kDeferredLightingValue;
 
 static constexpr sampler gCommonTextureSampler (mag_filter::linear, min_filter::linear, mip_filter::linear,
                                                 s_address::repeat,
@@ -78,7 +137,15 @@ static constexpr sampler gCommonTextureSampler (mag_filter::linear, min_filter::
 static inline
 float4 worldTransform(constant ObjectState &transform, float4 pos)
 {
-    return (transform.M * pos);
+    return transform.worldSpaceVertices ? pos : (transform.M * pos);
+}
+
+static inline
+float3 worldNormal(constant ObjectState &transform, float3 normal)
+{
+    if (transform.worldSpaceVertices)
+        return normal;
+    return normalize(float3x3(transform.invTransM[0].xyz, transform.invTransM[1].xyz, transform.invTransM[2].xyz) * normal);
 }
 
 static inline
@@ -91,10 +158,43 @@ float4 rgba8ToVec4(uint val)
 static inline
 uint vec4ToRgba8(float4 val)
 {
-    uint4 ival = uint4(val);
+    // Saturate like an RGBA8 texture write (lit colors can exceed 1), instead of wrapping around.
+    uint4 ival = uint4(clamp(val, 0.0f, 255.0f));
     return (ival.x & 0xff) | ((ival.y & 0xff) << 8) | ((ival.z & 0xff) << 16) | ((ival.w & 0xff) << 24);
 }
 
+#define VOXEL_LAYOUT_LINEAR 0
+#define VOXEL_LAYOUT_MORTON 1
+#define VOXEL_LAYOUT_BRICK4 2
+
+// Spreads the 10 low bits of v to every third bit.
+static inline
+uint spreadBits3(uint v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Index of a voxel in a voxel buffer of the given layout, same as VoxelIndex::encode. size must be a power of 2
+// for the Morton (Z-order) and 4^3 brick layouts, which keep neighboring voxels closer in memory than rows do.
+static inline
+uint voxelBufferIndex(uint3 coords, uint size, uint layout)
+{
+    if (layout == VOXEL_LAYOUT_MORTON)
+        return spreadBits3(coords.x) | (spreadBits3(coords.y) << 1) | (spreadBits3(coords.z) << 2);
+    if (layout == VOXEL_LAYOUT_BRICK4)
+    {
+        uint shift = ctz(size) - 2;
+        uint3 brick = coords >> 2;
+        uint3 voxel = coords & 3;
+        return (((((brick.z << shift) | brick.y) << shift) | brick.x) << 6) | (voxel.z << 4) | (voxel.y << 2) | voxel.x;
+    }
+    return coords.z * (size * size) + coords.y * size + coords.x;
+}
 
 // Returns true if the point p is inside the unity cube.
 static inline
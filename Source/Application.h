@@ -55,4 +55,7 @@ private:
 
 	// Pause updating?
 	bool pause = false;
+
+	// Keys left to press for the toggle tour (see VOXEL_TOGGLE_TOUR in Application.mm), null when it is off.
+	const char * toggleTour = nullptr;
 };
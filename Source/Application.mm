@@ -1,8 +1,10 @@
 #include "Application.h"
 
 // Standard library.
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <cstdlib>
 #include <time.h>
 
 // Internal.
@@ -12,10 +14,17 @@
 #include "Graphic/Material/MaterialStore.h"
 #include "Graphic/Renderer/MeshRenderer.h"
 #include "Graphic/Camera/Controllers/FirstPersonController.h"
+#include "Graphic/Voxelization/VoxelLayout.h"
 #include "Time/Time.h"
 
 static constexpr double kFPSInterval = 1.0;
 
+// When the VOXEL_TOGGLE_TOUR environment variable is set, these keys are pressed one every kToggleTourInterval frames
+// and the application exits after the last one. Each toggle is flipped on top of the previous ones, the cycling
+// settings go through all their values, then the toggles are flipped back in reverse order.
+static const char * const kToggleTourKeys = "LQFBG4HN'/K" ",,,777YYYYEE=-" "K/'NH4GBFQL";
+static constexpr unsigned long long kToggleTourInterval = 60;
+
 using __DEFAULT_LEVEL = MultipleObjectsScene; // The scene that will be loaded on startup.
 // (see ScenePack.h for more scenes)
 
@@ -32,6 +41,9 @@ void Application::init(id<MTLDevice> metalDevice, uint32_t viewportWidth, uint32
 	scene = new __DEFAULT_LEVEL();
 	scene->init(viewportWidth, viewportHeight);
 	std::cout << "[3] : Scene initialized." << std::endl;
+
+	if (std::getenv("VOXEL_TOGGLE_TOUR"))
+		toggleTour = kToggleTourKeys;
 }
 
 void Application::iterate(id<MTLCommandBuffer> commandBuffer,
@@ -78,6 +90,17 @@ void Application::iterate(id<MTLCommandBuffer> commandBuffer,
 	{
 		transientCameraMoveKeyPressed[i] = cameraMoveKeyPressed[i];
 	}
+
+	if (toggleTour && Time::frameCount % kToggleTourInterval == 0)
+	{
+		if (*toggleTour == '\0')
+		{
+			std::cout << "Toggle tour finished after " << Time::frameCount << " frames." << std::endl;
+			std::exit(EXIT_SUCCESS);
+		}
+		std::cout << "Toggle tour key: " << *toggleTour << std::endl;
+		onKeyUp(*toggleTour++);
+	}
 }
 
 Application::~Application() {
@@ -179,5 +202,100 @@ void Application::onKeyUp(char key)
 			graphics.useComputeShaderToGenMip = !graphics.useComputeShaderToGenMip;
 			std::cout << "Mipmap generation use computeshader: " << graphics.useComputeShaderToGenMip << std::endl;
 			break;
+		case 'L': case 'l':
+			graphics.decoupledLightInjection = !graphics.decoupledLightInjection;
+			graphics.voxelizationQueued = true;
+			std::cout << "Decoupled light injection: " << graphics.decoupledLightInjection << std::endl;
+			break;
+		case 'B': case 'b':
+			graphics.partialVoxelization = !graphics.partialVoxelization;
+			std::cout << "Partial re-voxelization of changed regions: " << graphics.partialVoxelization << std::endl;
+			break;
+		case '=': case '+': case '-': {
+			const uint32_t size = key == '-' ? graphics.getVoxelTextureSize() / 2 : graphics.getVoxelTextureSize() * 2;
+			if (size < Graphics::MIN_VOXEL_TEXTURE_SIZE || size > Graphics::MAX_VOXEL_TEXTURE_SIZE)
+				break;
+			graphics.setVoxelTextureSize(size);
+			std::cout << "Voxel resolution: " << size << "^3 (" << graphics.getVoxelMemoryUsage(size) / (1024 * 1024) << " MB)" << std::endl;
+			break;
+		}
+		case 'K': case 'k':
+			if (graphics.isSinglePassVoxelization()) {
+				std::cout << "Voxel clipmap cascades require multipass voxelization." << std::endl;
+				break;
+			}
+			graphics.useVoxelClipmap = !graphics.useVoxelClipmap;
+			// Whichever voxels get used now missed the changes of the previous frames.
+			graphics.voxelizationQueued = true;
+			std::cout << "Voxel clipmap cascades: " << graphics.useVoxelClipmap << std::endl;
+			break;
+		case 'Y': case 'y':
+			// Cycles through no time slicing, then 1, 2 and 4 ms per frame.
+			graphics.voxelizationFrameBudget = graphics.voxelizationFrameBudget >= 4.0f ? 0.0f :
+											   std::max(1.0f, 2.0f * graphics.voxelizationFrameBudget);
+			std::cout << "Voxelization budget per frame: " << graphics.voxelizationFrameBudget << " ms (0: whole scene every frame), last cycle took "
+					  << graphics.getVoxelizationCycleFrames() << " frame(s)" << std::endl;
+			break;
+		case 'E': case 'e':
+		{
+			using Mode = VoxelizationScheduler::Mode;
+			graphics.voxelizationSlicing = graphics.voxelizationSlicing == Mode::SLABS ? Mode::OBJECTS : Mode::SLABS;
+			std::cout << "Time sliced voxelization by " << (graphics.voxelizationSlicing == Mode::SLABS ? "slabs" : "objects") << std::endl;
+		}
+			break;
+		case 'F': case 'f':
+			graphics.skipUnchangedVoxelization = !graphics.skipUnchangedVoxelization;
+			std::cout << "Skip voxelization when the scene didn't change: " << graphics.skipUnchangedVoxelization << std::endl;
+			break;
+		case 'G': case 'g':
+		{
+			graphics.residentBricksOnly = !graphics.residentBricksOnly;
+			std::cout << "Clear and mip resident bricks only: " << graphics.residentBricksOnly << std::endl;
+			const auto & stats = graphics.getVoxelBrickStats();
+			std::cout << "Resident voxel bricks: " << stats.residentBricks << " (" << stats.residentBytes / 1048576.0 << " MB), pool: "
+					  << stats.poolBricks << " (" << stats.poolBytes / 1048576.0 << " MB)" << std::endl;
+		}
+			break;
+		case 'H': case 'h':
+			graphics.separateOpacityVolume = !graphics.separateOpacityVolume;
+			// The opacity volume is only kept up to date while in use.
+			graphics.regenerateMipmapQueued = true;
+			std::cout << "Separate opacity volume for shadows: " << graphics.separateOpacityVolume << std::endl;
+			break;
+		case 'N': case 'n':
+			graphics.anisotropicVoxels = !graphics.anisotropicVoxels;
+			// The directional textures are only kept up to date while in use.
+			graphics.regenerateMipmapQueued = true;
+			std::cout << "Anisotropic voxels: " << graphics.anisotropicVoxels << std::endl;
+			break;
+		case 'Q': case 'q':
+			graphics.multiBounce = !graphics.multiBounce;
+			std::cout << "Multi-bounce indirect light: " << graphics.multiBounce
+					  << (graphics.decoupledLightInjection ? "" : " (needs decoupled light injection, L)") << std::endl;
+			break;
+		case '4':
+			graphics.skipEmptyBricksInMips = !graphics.skipEmptyBricksInMips;
+			std::cout << "Skip empty bricks in mip generation: " << graphics.skipEmptyBricksInMips << std::endl;
+			break;
+		case '7': {
+			// Cycles through the linear, Morton and 4^3 brick layouts.
+			graphics.voxelBufferLayout = VoxelLayout((uint32_t(graphics.voxelBufferLayout) + 1) % 3);
+			graphics.voxelizationQueued = true;
+			std::cout << "Voxel atomic buffer layout: " << VoxelIndex::name(graphics.voxelBufferLayout)
+					  << (graphics.isSinglePassVoxelization() ? "" : " (single pass voxelization only)") << std::endl;
+			break;
+		}
+		case ',':
+			graphics.indirectDiffuseScale = graphics.indirectDiffuseScale >= 4 ? 1 : graphics.indirectDiffuseScale * 2;
+			std::cout << "Application indirect diffuse resolution: 1/" << graphics.indirectDiffuseScale << std::endl;
+			break;
+		case '/':
+			graphics.temporalIndirectDiffuse = !graphics.temporalIndirectDiffuse;
+			std::cout << "Application temporal indirect diffuse: " << graphics.temporalIndirectDiffuse << std::endl;
+			break;
+		case '\'':
+			graphics.deferredShading = !graphics.deferredShading;
+			std::cout << "Application deferred shading: " << graphics.deferredShading << std::endl;
+			break;
 	}
 }
@@ -0,0 +1,137 @@
+#include "BenchScene.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "../Utility/External/tiny_obj_loader.h"
+
+const std::vector<std::string> & BenchScene::getSceneNames()
+{
+	static const std::vector<std::string> names = { "multiple", "cornell" };
+	return names;
+}
+
+int BenchScene::loadObjFile(const std::string & relativePath)
+{
+	const std::string path = assetRoot + "/" + relativePath;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string err;
+	if (!tinyobj::LoadObj(shapes, materials, err, path.c_str()) || shapes.size() == 0) {
+		std::cerr << "Failed to load object with path '" << path << "'. Error message:" << std::endl << err << std::endl;
+		return -1;
+	}
+
+	const int first = int(meshes.size());
+	for (const auto & shape : shapes) {
+		MeshData mesh;
+		mesh.indices.assign(shape.mesh.indices.begin(), shape.mesh.indices.end());
+		mesh.vertexData.resize(std::max(shape.mesh.positions.size(), shape.mesh.normals.size()) / 3);
+		for (size_t i = 0; i < shape.mesh.positions.size() / 3; ++i)
+			mesh.vertexData[i].position = glm::vec3(shape.mesh.positions[3 * i], shape.mesh.positions[3 * i + 1], shape.mesh.positions[3 * i + 2]);
+		for (size_t i = 0; i < shape.mesh.normals.size() / 3; ++i)
+			mesh.vertexData[i].normal = glm::vec3(shape.mesh.normals[3 * i], shape.mesh.normals[3 * i + 1], shape.mesh.normals[3 * i + 2]);
+		meshes.push_back(std::move(mesh));
+	}
+	return first;
+}
+
+void BenchScene::addObject(const MeshData & mesh, const Transform & transform, const MaterialSetting & material)
+{
+	transforms.push_back(transform);
+	transforms.back().updateTransformMatrix();
+
+	VoxelizationObject object;
+	object.vertices = &mesh.vertexData;
+	object.indices = &mesh.indices;
+	object.model = transforms.back().getTransformMatrix();
+	object.modelInverseTranspose = transforms.back().getInverseTransposeTransformMatrix();
+	object.material = material;
+	input.objects.push_back(object);
+}
+
+bool BenchScene::load(const std::string & name, const std::string & _assetRoot, float aspect)
+{
+	if (std::find(getSceneNames().begin(), getSceneNames().end(), name) == getSceneNames().end()) {
+		std::cerr << "Unknown scene '" << name << "'." << std::endl;
+		return false;
+	}
+	assetRoot = _assetRoot;
+	input = VoxelizationInput();
+	transforms.clear();
+	meshes.clear();
+
+	// Same camera as FirstPersonScene.
+	camera = PerspectiveCamera(1.22173f, aspect);
+	camera.position = glm::vec3(0, 0, 1.8f);
+	camera.updateViewMatrix();
+
+	auto makeTransform = [](glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
+		Transform transform;
+		transform.position = position;
+		transform.rotation = rotation;
+		transform.scale = scale;
+		return transform;
+	};
+	auto makeMaterial = [](glm::vec3 color, float specularReflectivity, float diffuseReflectivity, float specularDiffusion) {
+		MaterialSetting material(color, 0.0f, specularReflectivity, diffuseReflectivity);
+		material.specularColor = color;
+		material.specularDiffusion = specularDiffusion;
+		return material;
+	};
+	const MaterialSetting white(glm::vec3(0.97f)), red(glm::vec3(1.0f, 0.26f, 0.27f)), green(glm::vec3(0.27f, 1.0f, 0.26f)),
+		blue(glm::vec3(0.35f, 0.38f, 1.0f));
+
+	// Cornell box. Its two boxes are only enabled in CornellScene.
+	const bool cornellScene = name == "cornell";
+	const int cornell = loadObjFile("Assets/Models/cornell.obj");
+	if (cornell < 0) return false;
+	MaterialSetting cornellMaterials[] = { cornellScene ? green : red, white, white, cornellScene ? red : blue, white, white, white };
+	if (!cornellScene) {
+		cornellMaterials[1].diffuseReflectivity = 0.7f;
+		cornellMaterials[1].specularReflectivity = 0.3f;
+		cornellMaterials[1].specularDiffusion = 5.f;
+	}
+	const size_t cornellMeshes = meshes.size() - cornell;
+	for (size_t i = 0; i < std::min<size_t>(cornellMeshes, cornellScene ? 7 : 5); ++i)
+		addObject(meshes[cornell + i], makeTransform(glm::vec3(0), glm::vec3(0), glm::vec3(0.995f)), cornellMaterials[i]);
+
+	if (name == "multiple") {
+		struct Model { const char * path; Transform transform; MaterialSetting material; };
+		Model models[] = {
+			{ "Assets/Models/susanne.obj", makeTransform(glm::vec3(0.07, -0.49, 0.36), glm::vec3(0.00, 0.30, 0.00), glm::vec3(0.23f)),
+			  makeMaterial(glm::vec3(0.2, 0.8, 1.0), 0.9f, 0.1f, 3.2f) },
+			{ "Assets/Models/dragon.obj", makeTransform(glm::vec3(-0.28, -0.52, 0.00), glm::vec3(0, 2.1, 0), glm::vec3(1.3f)),
+			  makeMaterial(glm::vec3(1.0, 0.8, 0.6), 0.65f, 0.35f, 2.2f) },
+			{ "Assets/Models/bunny.obj", makeTransform(glm::vec3(0.44, -0.52, 0), glm::vec3(0, 0.4, 0), glm::vec3(0.31f)),
+			  makeMaterial(glm::vec3(0.7, 0.8, 0.7), 0.6f, 0.4f, 3.4f) },
+		};
+		models[0].material.transparency = 0.1f;
+		for (const auto & model : models) {
+			// The dragon isn't part of every checkout, the scene is benchmarked without it then.
+			const int first = loadObjFile(model.path);
+			if (first < 0) {
+				std::cerr << "Skipping '" << model.path << "'." << std::endl;
+				continue;
+			}
+			// Like the scene, only the first mesh of a model gets its transform and material.
+			for (size_t i = first; i < meshes.size(); ++i)
+				addObject(meshes[i], i == size_t(first) ? model.transform : Transform(), i == size_t(first) ? model.material : MaterialSetting());
+		}
+	}
+
+	// Light sphere (the last mesh of sphere.obj) at the position of the animated light at time 0.
+	const int lightSphere = loadObjFile("Assets/Models/sphere.obj");
+	if (lightSphere < 0) return false;
+	const glm::vec3 lightPosition = glm::vec3(0, 0.5, 0.1) * glm::vec3(4.5f, 1.0f, 4.5f);
+	MaterialSetting emissive(glm::vec3(1.0f), 8.0f, 0.0f, 0.0f);
+	for (size_t i = lightSphere; i < meshes.size(); ++i) {
+		if (i + 1 == meshes.size())
+			addObject(meshes[i], makeTransform(lightPosition, glm::vec3(0), glm::vec3(0.049f)), emissive);
+		else
+			addObject(meshes[i], Transform(), MaterialSetting());
+	}
+
+	input.pointLights.push_back(PointLight(lightPosition, cornellScene ? glm::normalize(glm::vec3(1.4f, 0.9f, 0.35f)) : glm::vec3(1)));
+	return true;
+}
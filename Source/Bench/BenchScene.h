@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../Graphic/Camera/PerspectiveCamera.h"
+#include "../Graphic/Voxelization/VoxelizationInput.h"
+#include "../Shape/Transform.h"
+
+/// <summary> One of the demo scenes loaded without Metal: the same meshes, transforms, materials, lights and camera
+/// as the scene at its first frame, as a VoxelizationInput. </summary>
+class BenchScene {
+public:
+	/// <summary> Names of the scenes that can be loaded. </summary>
+	static const std::vector<std::string> & getSceneNames();
+
+	/// <summary> Loads a scene by name, with the models found in assetRoot/Assets/Models. Returns false if the
+	/// name is unknown or a model can't be loaded. </summary>
+	bool load(const std::string & name, const std::string & assetRoot, float aspect = 16.0f / 9.0f);
+
+	/// <summary> Enabled objects and point lights, pointing into the meshes of this scene. </summary>
+	VoxelizationInput input;
+
+	/// <summary> Transforms of the objects of the input, in the same order. </summary>
+	std::vector<Transform> transforms;
+
+	PerspectiveCamera camera;
+
+private:
+	struct MeshData {
+		std::vector<VertexData> vertexData;
+		std::vector<unsigned int> indices;
+	};
+
+	/// <summary> Loads the meshes of an .obj-file like ObjLoader does, returns the index of the first one or -1. </summary>
+	int loadObjFile(const std::string & relativePath);
+
+	/// <summary> Adds a loaded mesh to the input. </summary>
+	void addObject(const MeshData & mesh, const Transform & transform, const MaterialSetting & material);
+
+	std::string assetRoot;
+	// A deque so that the input can point into it while more meshes get loaded.
+	std::deque<MeshData> meshes;
+};
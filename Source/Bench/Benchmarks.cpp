@@ -0,0 +1,940 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "BenchScene.h"
+#include "../Graphic/Voxelization/BilateralUpsampler.h"
+#include "../Graphic/Voxelization/BrickPagedVolume.h"
+#include "../Graphic/Voxelization/CpuConeTracer.h"
+#include "../Graphic/Voxelization/CpuLightInjector.h"
+#include "../Graphic/Voxelization/CpuMipBuilder.h"
+#include "../Graphic/Voxelization/CpuVoxelizer.h"
+#include "../Graphic/Voxelization/DominantAxisPartition.h"
+#include "../Graphic/Voxelization/EpochVoxelGrid.h"
+#include "../Graphic/Voxelization/ObjectVoxelCache.h"
+#include "../Graphic/Voxelization/ScreenGBuffer.h"
+#include "../Graphic/Voxelization/SparseVoxelOctree.h"
+#include "../Graphic/Voxelization/TemporalAccumulator.h"
+#include "../Graphic/Voxelization/VoxelBrickOccupancy.h"
+#include "../Graphic/Voxelization/VoxelGBuffer.h"
+#include "../Graphic/Voxelization/VoxelGrid.h"
+#include "../Graphic/Voxelization/VoxelLayout.h"
+#include "../Graphic/Voxelization/VoxelMipChain.h"
+#include "../Graphic/Voxelization/VoxelOpacityVolume.h"
+#include "../Graphic/Voxelization/WorldVertexStream.h"
+#include "../Shape/TransformStore.h"
+#include "../Time/Time.h"
+#include "../Utility/ThreadPool.h"
+
+namespace {
+
+void benchmarkCpuVoxelization(const BenchScene & scene, const BenchOptions & options)
+{
+	// Voxelize the scene with the CPU reference voxelizer using 1, 2, 4, ... threads.
+	const auto & input = scene.input;
+	VoxelGrid grid(options.voxelTextureSize);
+	VoxelGBuffer gBuffer(options.voxelTextureSize);
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << "CPU voxelization of " << input.countTriangles() << " triangles at " << grid.getSize() << "^3:" << std::endl;
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+		ThreadPool threadPool(threads);
+		CpuVoxelizer voxelizer(threadPool);
+		auto stats = voxelizer.voxelize(input, grid);
+		std::cout << std::setprecision(4) << " - " << stats.threads << " thread(s): " << stats.seconds * 1000.0 << " ms, "
+				  << stats.trianglesPerSecond() / 1e6 << " Mtriangles/s, " << grid.countOccupied() << " voxels occupied." << std::endl;
+
+		// Decoupled path: G-buffer voxelization once, then light injection alone (what a light change costs).
+		CpuLightInjector injector(threadPool);
+		auto gBufferStats = voxelizer.voxelizeGBuffer(input, gBuffer);
+		auto injectStats = injector.inject(gBuffer, input.pointLights, grid);
+		std::cout << "   G-buffer: " << gBufferStats.seconds * 1000.0 << " ms, light injection: " << injectStats.seconds * 1000.0 << " ms, "
+				  << injectStats.voxelsPerSecond() / 1e6 << " Mvoxels/s." << std::endl;
+		if (threads == maxThreads) break;
+	}
+}
+
+void benchmarkCoverage(const BenchScene & scene, const BenchOptions &)
+{
+	// Conservative voxelization against the rules of the single pass GPU voxelization, voxel by voxel.
+	using Coverage = CpuVoxelizer::Coverage;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+
+	std::cout << "Conservative vs single pass raster coverage:" << std::endl;
+	for (uint32_t size = 64; size <= 256; size *= 2) {
+		VoxelGrid conservative(size), raster(size);
+		voxelizer.setCoverage(Coverage::CONSERVATIVE);
+		const auto conservativeStats = voxelizer.voxelize(scene.input, conservative);
+		voxelizer.setCoverage(Coverage::SINGLE_PASS_RASTER);
+		const auto rasterStats = voxelizer.voxelize(scene.input, raster);
+
+		size_t both = 0, conservativeOnly = 0, rasterOnly = 0;
+		double squaredError = 0;
+		for (size_t i = 0; i < conservative.getVoxelCount(); ++i) {
+			const uint32_t a = conservative.data()[i], b = raster.data()[i];
+			both += a && b;
+			conservativeOnly += a && !b;
+			rasterOnly += !a && b;
+			if (a && b) {
+				const glm::vec4 difference = VoxelGrid::rgba8ToVec4(a) - VoxelGrid::rgba8ToVec4(b);
+				squaredError += glm::dot(difference, difference) / 4.0;
+			}
+		}
+		std::cout << std::setprecision(4) << " - " << size << "^3: conservative " << conservativeStats.seconds * 1000.0 << " ms, "
+				  << both + conservativeOnly << " voxels | single pass raster " << rasterStats.seconds * 1000.0 << " ms, "
+				  << both + rasterOnly << " voxels | " << both << " in both, " << conservativeOnly << " conservative only, " << rasterOnly
+				  << " raster only | RGBA8 RMSE of the common voxels " << std::sqrt(squaredError / std::max<size_t>(both, 1)) << " (of 255)" << std::endl;
+	}
+}
+
+void benchmarkSparseVoxelOctree(const BenchScene & scene, const BenchOptions &)
+{
+	// Dense mip chain (what the voxel texture costs) vs sparse voxel octree of the current scene at several resolutions.
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	SparseVoxelOctree octree(threadPool);
+	std::vector<VoxelFragment> fragments;
+
+	std::cout << "Dense voxel mip chain vs sparse voxel octree, " << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 64; size <= 512; size *= 2) {
+		double denseSeconds;
+		size_t denseBytes;
+		{
+			VoxelMipChain mipChain(size);
+			const double startTime = Time::currentTime();
+			voxelizer.voxelize(input, mipChain.level(0));
+			mipChain.generateMips();
+			denseSeconds = Time::currentTime() - startTime;
+			denseBytes = mipChain.getMemoryUsage();
+		}
+
+		auto fragmentStats = voxelizer.voxelizeFragments(input, size, fragments);
+		auto stats = octree.build(fragments, size);
+		std::cout << std::setprecision(4) << " - " << size << "^3: dense " << denseBytes / 1048576.0 << " MB, " << denseSeconds * 1000.0
+				  << " ms | octree " << octree.getMemoryUsage() / 1048576.0 << " MB (" << stats.nodes << " nodes, " << stats.bricks
+				  << " bricks), " << (fragmentStats.seconds + stats.seconds) * 1000.0 << " ms (build " << stats.seconds * 1000.0 << " ms)" << std::endl;
+
+		BrickPagedVolume pagedVolume(size);
+		auto pagedStats = pagedVolume.voxelize(fragments);
+		std::cout << "   brick paged: " << (pagedStats.poolBytes + pagedStats.pageTableBytes) / 1048576.0 << " MB ("
+				  << pagedStats.residentBricks << " resident bricks, " << pagedStats.poolBricks << " in pool), "
+				  << (fragmentStats.seconds + pagedStats.seconds) * 1000.0 << " ms (build " << pagedStats.seconds * 1000.0 << " ms)" << std::endl;
+	}
+}
+
+void benchmarkShadowOpacity(const BenchScene & scene, const BenchOptions & options)
+{
+	// Shadow cones toward the first light from the occupied voxels (one in 2x2x2), through each opacity layout.
+	const auto & input = scene.input;
+	if (input.pointLights.empty()) return;
+	const uint32_t size = options.voxelTextureSize;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	VoxelMipChain mipChain(size);
+	voxelizer.voxelize(input, mipChain.level(0));
+	mipChain.generateMips();
+
+	std::vector<glm::vec3> points;
+	const VoxelGrid & grid = mipChain.level(0);
+	for (uint32_t z = 0; z < size; z += 2)
+		for (uint32_t y = 0; y < size; y += 2)
+			for (uint32_t x = 0; x < size; x += 2)
+				if (grid.load(x, y, z) >> 24) points.push_back((glm::vec3(x, y, z) + 0.5f) / float(size) * 2.0f - 1.0f);
+
+	const glm::vec3 lightPosition = input.pointLights[0].position;
+	auto trace = [&](const char * name, size_t bytes, float texelSize, const std::vector<float> * reference, auto opacity) {
+		std::vector<float> result;
+		result.reserve(points.size());
+		size_t samples = 0;
+		auto countedOpacity = [&](const glm::vec3 & coordinate, float mipmapLevel) { ++samples; return opacity(coordinate, mipmapLevel); };
+		const double startTime = Time::currentTime();
+		for (auto & point : points) {
+			// The voxel faces the light.
+			glm::vec3 direction = lightPosition - point;
+			const float distance = glm::length(direction);
+			direction /= distance;
+			result.push_back(CpuConeTracer::traceShadowCone(point, direction, direction, distance, size, countedOpacity));
+		}
+		const double seconds = Time::currentTime() - startTime;
+
+		// Each sample filters 8 texels of 2 levels.
+		double difference = 0;
+		if (reference)
+			for (size_t i = 0; i < result.size(); ++i) difference += std::abs(result[i] - (*reference)[i]);
+		std::cout << std::setprecision(4) << " - " << name << ": " << bytes / 1048576.0 << " MB, " << seconds * 1000.0 << " ms, "
+				  << samples * 16 * texelSize / 1048576.0 << " MB fetched, mean difference " << difference / std::max<size_t>(1, result.size()) << std::endl;
+		return result;
+	};
+
+	std::cout << "Shadow cones of " << points.size() << " voxels at " << size << "^3:" << std::endl;
+	auto reference = trace("RGBA8", mipChain.getMemoryUsage(), 4.0f, nullptr,
+						   [&](const glm::vec3 & c, float l) { return mipChain.textureLod(c, l).a; });
+	for (auto layout : { VoxelOpacityVolume::Layout::R8, VoxelOpacityVolume::Layout::Bits }) {
+		VoxelOpacityVolume volume(size, layout);
+		volume.build(grid);
+		trace(layout == VoxelOpacityVolume::Layout::R8 ? "R8" : "1-bit", volume.getMemoryUsage(), volume.getTexelSize(), &reference,
+			  [&](const glm::vec3 & c, float l) { return volume.textureLod(c, l); });
+	}
+}
+
+void benchmarkMultiBounce(const BenchScene & scene, const BenchOptions &)
+{
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuLightInjector injector(threadPool);
+
+	std::cout << "CPU multi-bounce injection, " << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 32; size <= 256; size *= 2) {
+		VoxelGBuffer gBuffer(size);
+		VoxelMipChain radiance(size);
+		VoxelGrid bounce(size);
+		voxelizer.voxelizeGBuffer(input, gBuffer);
+		injector.inject(gBuffer, input.pointLights, radiance.level(0));
+		radiance.generateMips();
+
+		// One cycle over the subsets, re-injecting and regenerating the mips after each one like the frames do.
+		double bounceSeconds = 0, maxSubsetSeconds = 0, otherSeconds = 0;
+		size_t voxels = 0;
+		for (uint32_t subset = 0; subset < CpuLightInjector::BOUNCE_SUBSETS; ++subset) {
+			auto stats = injector.injectBounce(gBuffer, radiance, subset, bounce);
+			bounceSeconds += stats.seconds;
+			maxSubsetSeconds = std::max(maxSubsetSeconds, stats.seconds);
+			voxels += stats.voxels;
+
+			const double startTime = Time::currentTime();
+			injector.inject(gBuffer, input.pointLights, radiance.level(0), &bounce);
+			radiance.generateMips();
+			otherSeconds += Time::currentTime() - startTime;
+		}
+		std::cout << std::setprecision(4) << " - " << size << "^3, " << voxels << " occupied voxels: bounce "
+				  << bounceSeconds * 1000.0 / CpuLightInjector::BOUNCE_SUBSETS << " ms per frame (max " << maxSubsetSeconds * 1000.0
+				  << "), " << bounceSeconds * 1000.0 << " ms per bounce, " << voxels / std::max(bounceSeconds, 1e-9) / 1e6
+				  << " Mvoxels/s | injection + mips " << otherSeconds * 1000.0 / CpuLightInjector::BOUNCE_SUBSETS << " ms per frame" << std::endl;
+	}
+}
+
+void benchmarkMipBuilder(const BenchScene & scene, const BenchOptions &)
+{
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuMipBuilder builder(threadPool);
+
+	std::cout << "CPU mip generation, " << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 64; size <= 512; size *= 2) {
+		VoxelMipChain simd(size), scalar(size);
+		voxelizer.voxelize(input, simd.level(0));
+		std::copy(simd.level(0).data(), simd.level(0).data() + simd.level(0).getVoxelCount(), scalar.level(0).data());
+
+		auto simdStats = builder.build(simd, true);
+		auto scalarStats = builder.build(scalar, false);
+		size_t mismatches = 0;
+		for (uint32_t level = 1; level < simd.getLevelCount(); ++level)
+			mismatches += !std::equal(simd.level(level).data(), simd.level(level).data() + simd.level(level).getVoxelCount(),
+									  scalar.level(level).data());
+
+		// Reference box filter, single threaded and requantizing every level.
+		const double startTime = Time::currentTime();
+		scalar.generateMips();
+		const double referenceSeconds = Time::currentTime() - startTime;
+
+		std::cout << std::setprecision(4) << " - " << size << "^3: SIMD " << simdStats.seconds * 1000.0 << " ms, "
+				  << simdStats.voxelsPerSecond() / 1e6 << " Mvoxels/s | scalar " << scalarStats.seconds * 1000.0 << " ms, "
+				  << scalarStats.voxelsPerSecond() / 1e6 << " Mvoxels/s | VoxelMipChain " << referenceSeconds * 1000.0 << " ms, "
+				  << simdStats.voxels / std::max(referenceSeconds, 1e-9) / 1e6 << " Mvoxels/s | "
+				  << (mismatches ? "SIMD and scalar levels differ!" : "SIMD and scalar identical") << std::endl;
+	}
+}
+
+void benchmarkEmptyBrickSkipping(const BenchScene & scene, const BenchOptions &)
+{
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuMipBuilder builder(threadPool);
+
+	std::cout << "CPU mip generation skipping empty bricks, " << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 64; size <= 512; size *= 2) {
+		VoxelMipChain dense(size), sparse(size);
+		VoxelBrickOccupancy occupancy(size);
+		voxelizer.voxelize(input, dense.level(0), true, &occupancy);
+		std::copy(dense.level(0).data(), dense.level(0).data() + dense.level(0).getVoxelCount(), sparse.level(0).data());
+
+		auto denseStats = builder.build(dense);
+		auto sparseStats = builder.build(sparse, true, &occupancy);
+		size_t mismatches = 0;
+		for (uint32_t level = 1; level < dense.getLevelCount(); ++level)
+			mismatches += !std::equal(dense.level(level).data(), dense.level(level).data() + dense.level(level).getVoxelCount(),
+									  sparse.level(level).data());
+
+		std::cout << std::setprecision(4) << " - " << size << "^3, " << 100.0 * occupancy.countOccupied() / occupancy.getBrickCount()
+				  << "% bricks occupied: dense " << denseStats.seconds * 1000.0 << " ms (" << denseStats.voxelsPerSecond() / 1e6
+				  << " Mvoxels/s) | skipping " << sparseStats.seconds * 1000.0 << " ms (" << sparseStats.voxelsPerSecond() / 1e6
+				  << " Mvoxels/s, " << sparseStats.emptyTiles << "/" << sparseStats.tiles << " tiles empty), x"
+				  << denseStats.seconds / std::max(sparseStats.seconds, 1e-9) << " | "
+				  << (mismatches ? "mips differ!" : "same mips") << std::endl;
+	}
+}
+
+void benchmarkEpochClear(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr int frames = 4;
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+
+	std::cout << "CPU clear + voxelization per frame, dense grid vs epoch tagged grid, " << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 64; size <= 512; size *= 2) {
+		VoxelGrid dense(size), epochCopy(size);
+		EpochVoxelGrid epochGrid(size);
+		double denseClearSeconds = 0, denseVoxelizeSeconds = 0, epochSeconds = 0;
+		for (int frame = 0; frame < frames; ++frame) {
+			double startTime = Time::currentTime();
+			dense.clear();
+			denseClearSeconds += Time::currentTime() - startTime;
+			denseVoxelizeSeconds += voxelizer.voxelize(input, dense, false).seconds;
+			epochSeconds += voxelizer.voxelize(input, epochGrid).seconds;
+		}
+		epochGrid.copyTo(epochCopy);
+		const bool same = std::equal(dense.data(), dense.data() + dense.getVoxelCount(), epochCopy.data());
+
+		const size_t bricks = size_t(size / EpochVoxelGrid::BRICK_SIZE) * (size / EpochVoxelGrid::BRICK_SIZE) * (size / EpochVoxelGrid::BRICK_SIZE);
+		std::cout << std::setprecision(4) << " - " << size << "^3: dense clear " << denseClearSeconds * 1000.0 / frames
+				  << " ms + voxelize " << denseVoxelizeSeconds * 1000.0 / frames << " ms = "
+				  << (denseClearSeconds + denseVoxelizeSeconds) * 1000.0 / frames << " ms | epoch "
+				  << epochSeconds * 1000.0 / frames << " ms (" << epochGrid.countLiveBricks() << "/" << bricks
+				  << " bricks reset), x" << (denseClearSeconds + denseVoxelizeSeconds) / std::max(epochSeconds, 1e-9) << " | "
+				  << (same ? "same voxels" : "voxels differ!") << std::endl;
+	}
+}
+
+void benchmarkVoxelLayouts(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr int rays = 1 << 15;
+	constexpr int stepsPerRay = 48;
+	const VoxelLayout layouts[] = { VoxelLayout::LINEAR, VoxelLayout::MORTON, VoxelLayout::BRICK4 };
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+
+	std::cout << "CPU voxel layouts, fragment writes (rasterization order) and trilinear gathers (rays), 1 thread:" << std::endl;
+	for (uint32_t size = 64; size <= 512; size *= 2) {
+		std::vector<VoxelFragment> fragments;
+		voxelizer.voxelizeFragments(input, size, fragments);
+		std::vector<uint32_t> x(fragments.size()), y(fragments.size()), z(fragments.size()), indices(fragments.size());
+		for (size_t i = 0; i < fragments.size(); ++i) {
+			x[i] = fragments[i].x();
+			y[i] = fragments[i].y();
+			z[i] = fragments[i].z();
+		}
+
+		// Same rays for every layout, one voxel per step.
+		std::mt19937 random(size);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::vector<glm::vec3> origins(rays), directions(rays);
+		for (int i = 0; i < rays; ++i) {
+			origins[i] = glm::vec3(uniform(random), uniform(random), uniform(random)) * float(size);
+			directions[i] = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random)) * 2.0f - 1.0f + 1e-3f);
+		}
+
+		std::cout << " - " << size << "^3, " << fragments.size() << " fragments:" << std::endl;
+		double linearSum = 0;
+		VoxelGrid linear(size);
+		for (VoxelLayout layout : layouts) {
+			VoxelGrid grid(size, layout);
+
+			double startTime = Time::currentTime();
+			VoxelIndex::encode(layout, size, x.data(), y.data(), z.data(), indices.data(), fragments.size());
+			const double encodeSeconds = Time::currentTime() - startTime;
+
+			startTime = Time::currentTime();
+			for (size_t i = 0; i < fragments.size(); ++i)
+				grid.atomicMax(grid.index(x[i], y[i], z[i]), fragments[i].rgba8);
+			const double writeSeconds = Time::currentTime() - startTime;
+
+			startTime = Time::currentTime();
+			double sum = 0;
+			const glm::vec3 maxPosition(float(size) - 1.001f);
+			for (int i = 0; i < rays; ++i) {
+				glm::vec3 position = origins[i];
+				for (int step = 0; step < stepsPerRay; ++step, position += directions[i]) {
+					const glm::vec3 p = glm::clamp(position, glm::vec3(0.0f), maxPosition);
+					const glm::uvec3 base(p);
+					const glm::vec3 f = p - glm::vec3(base);
+					glm::vec4 color(0.0f);
+					for (uint32_t corner = 0; corner < 8; ++corner) {
+						const glm::uvec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+						const glm::vec3 w = glm::mix(1.0f - f, f, glm::vec3(offset));
+						const glm::uvec3 v = base + offset;
+						color += w.x * w.y * w.z * VoxelGrid::rgba8ToVec4(grid.load(v.x, v.y, v.z));
+					}
+					sum += color.w;
+				}
+			}
+			const double gatherSeconds = Time::currentTime() - startTime;
+
+			if (layout == VoxelLayout::LINEAR) {
+				grid.copyTo(linear);
+				linearSum = sum;
+			}
+			VoxelGrid converted(size);
+			grid.copyTo(converted);
+			const bool same = sum == linearSum &&
+				std::equal(converted.data(), converted.data() + converted.getVoxelCount(), linear.data());
+
+			std::cout << std::setprecision(4) << "    - " << VoxelIndex::name(layout) << ": encode "
+					  << fragments.size() / std::max(encodeSeconds, 1e-9) / 1e6 << " M/s | writes "
+					  << fragments.size() / std::max(writeSeconds, 1e-9) / 1e6 << " Mfragments/s | gathers "
+					  << double(rays) * stepsPerRay / std::max(gatherSeconds, 1e-9) / 1e6 << " Msamples/s | "
+					  << (same ? "same voxels" : "voxels differ!") << std::endl;
+		}
+	}
+}
+
+void benchmarkFragmentAccumulation(const BenchScene & scene, const BenchOptions &)
+{
+	using Accumulation = CpuVoxelizer::Accumulation;
+	const Accumulation accumulations[] = { Accumulation::ATOMIC, Accumulation::PRIVATE_TILES, Accumulation::SORTED_FRAGMENTS };
+	const auto & input = scene.input;
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << "CPU voxelization fragment accumulation of " << input.countTriangles() << " triangles:" << std::endl;
+	for (uint32_t size = 64; size <= 256; size *= 4) {
+		VoxelGrid reference(size), grid(size);
+		{
+			ThreadPool threadPool(1);
+			CpuVoxelizer(threadPool).voxelize(input, reference);
+		}
+
+		for (Accumulation accumulation : accumulations) {
+			std::cout << " - " << size << "^3, " << CpuVoxelizer::getAccumulationName(accumulation) << ":";
+			double singleThreadSeconds = 0;
+			bool same = true;
+			for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+				ThreadPool threadPool(threads);
+				CpuVoxelizer voxelizer(threadPool);
+				voxelizer.setAccumulation(accumulation);
+				// Best of 3, the first run also allocates the per worker storage.
+				double seconds = 1e9;
+				for (int run = 0; run < 3; ++run)
+					seconds = std::min(seconds, voxelizer.voxelize(input, grid).seconds);
+				if (threads == 1)
+					singleThreadSeconds = seconds;
+				same = same && std::equal(grid.data(), grid.data() + grid.getVoxelCount(), reference.data());
+
+				std::cout << std::setprecision(4) << " | " << threads << "T " << seconds * 1000.0 << " ms (x"
+						  << singleThreadSeconds / std::max(seconds, 1e-9) << ")";
+				if (threads == maxThreads) break;
+			}
+			std::cout << " | " << (same ? "same voxels" : "voxels differ!") << std::endl;
+		}
+	}
+}
+
+void benchmarkObjectVoxelCache(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr int frames = 4;
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+
+	std::cout << "CPU voxelization vs stamping object voxel caches, " << input.objects.size() << " objects, "
+			  << threadPool.size() << " thread(s):" << std::endl;
+	for (uint32_t size = 64; size <= 256; size *= 2) {
+		auto frameInput = input;
+		std::vector<ObjectVoxelCache> caches;
+		size_t cacheBytes = 0, cacheBricks = 0;
+		double startTime = Time::currentTime();
+		for (const auto & object : input.objects) {
+			// A world voxel in local units, at the scale the object is loaded with.
+			const float scale = std::max(glm::length(glm::vec3(object.model[0])),
+										 std::max(glm::length(glm::vec3(object.model[1])), glm::length(glm::vec3(object.model[2]))));
+			caches.emplace_back(threadPool);
+			caches.back().build(object, 2.0f / (size * scale));
+			cacheBytes += caches.back().getMemoryUsage();
+			cacheBricks += caches.back().getBrickCount();
+		}
+		const double buildSeconds = Time::currentTime() - startTime;
+
+		VoxelGBuffer voxelized(size), stamped(size);
+		double voxelizeSeconds = 0, stampSeconds = 0, resampleSeconds = 0;
+		size_t rasterized = 0, covered = 0, extra = 0, extraFar = 0;
+		for (int frame = 0; frame < frames; ++frame) {
+			// Spin every object around its origin, and move it a little.
+			if (frame > 0) {
+				for (auto & object : frameInput.objects) {
+					const glm::vec3 center = glm::vec3(object.model[3]);
+					object.model = glm::translate(glm::mat4(1.0f), center + glm::vec3(0.01f, 0.0f, 0.0f)) *
+								   glm::rotate(glm::mat4(1.0f), 0.3f, glm::normalize(glm::vec3(1.0f, 2.0f, 0.5f))) *
+								   glm::translate(glm::mat4(1.0f), -center) * object.model;
+					object.modelInverseTranspose = glm::transpose(glm::inverse(object.model));
+				}
+			}
+			voxelizeSeconds += voxelizer.voxelizeGBuffer(frameInput, voxelized).seconds;
+
+			startTime = Time::currentTime();
+			stamped.clear();
+			for (size_t i = 0; i < caches.size(); ++i)
+				resampleSeconds += caches[i].stamp(frameInput.objects[i], stamped).seconds;
+			stampSeconds += Time::currentTime() - startTime;
+
+			// Stamping is conservative: every rasterized voxel should be stamped, and the extra ones should be next to one.
+			auto rasterizedAt = [&](int x, int y, int z) {
+				return x >= 0 && y >= 0 && z >= 0 && x < int(size) && y < int(size) && z < int(size) && voxelized.normal.load(x, y, z) != 0;
+			};
+			for (int z = 0; z < int(size); ++z)
+				for (int y = 0; y < int(size); ++y)
+					for (int x = 0; x < int(size); ++x) {
+						const bool voxelizedOccupied = voxelized.normal.load(x, y, z) != 0, stampedOccupied = stamped.normal.load(x, y, z) != 0;
+						rasterized += voxelizedOccupied;
+						covered += voxelizedOccupied && stampedOccupied;
+						if (!stampedOccupied || voxelizedOccupied)
+							continue;
+						++extra;
+						bool nextToRasterized = false;
+						for (int n = 0; n < 27 && !nextToRasterized; ++n)
+							nextToRasterized = rasterizedAt(x + n % 3 - 1, y + n / 3 % 3 - 1, z + n / 9 - 1);
+						extraFar += !nextToRasterized;
+					}
+		}
+
+		std::cout << std::setprecision(4) << " - " << size << "^3: voxelize " << voxelizeSeconds * 1000.0 / frames
+				  << " ms | clear + stamp " << stampSeconds * 1000.0 / frames << " ms (x" << voxelizeSeconds / std::max(stampSeconds, 1e-9)
+				  << ", resampling " << resampleSeconds * 1000.0 / frames << " ms) | caches " << cacheBricks << " bricks, " << cacheBytes / 1048576.0 << " MB, built in " << buildSeconds * 1000.0
+				  << " ms | covers " << 100.0 * covered / std::max<size_t>(rasterized, 1) << "% of the rasterized voxels, +"
+				  << 100.0 * extra / std::max<size_t>(rasterized, 1) << "% extra (" << extraFar << " not next to a rasterized one)" << std::endl;
+	}
+}
+
+void benchmarkDominantAxisPartition(const BenchScene & scene, const BenchOptions &)
+{
+	const auto & input = scene.input;
+	const size_t triangles = input.countTriangles();
+	std::vector<DominantAxisPartition> partitions;
+	for (const auto & object : input.objects)
+		partitions.emplace_back(*object.vertices, *object.indices);
+
+	// Every range must only hold triangles of its axis, and all the triangles once.
+	auto rangesMatch = [&](const glm::mat4 & rotation) {
+		for (size_t i = 0; i < partitions.size(); ++i) {
+			const auto & vertices = *input.objects[i].vertices;
+			const auto & indices = partitions[i].getIndices();
+			const glm::mat3 linear = glm::mat3(rotation * input.objects[i].model);
+			size_t sortedTriangles = 0;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				const auto & range = partitions[i].getRange(axis);
+				sortedTriangles += range.triangleCount;
+				for (uint32_t triangle = range.firstTriangle; triangle < range.firstTriangle + range.triangleCount; ++triangle)
+					if (DominantAxisPartition::dominantAxis(linear, vertices[indices[3 * triangle]].position, vertices[indices[3 * triangle + 1]].position,
+															vertices[indices[3 * triangle + 2]].position) != axis)
+						return false;
+			}
+			if (3 * sortedTriangles != indices.size())
+				return false;
+		}
+		return true;
+	};
+	// Reports the objects rotated around the scene's y axis to every partition.
+	auto update = [&](const glm::mat4 & rotation, double & seconds, size_t & sorted, size_t & changed, size_t & valid) {
+		seconds = 0;
+		sorted = changed = valid = 0;
+		for (size_t i = 0; i < partitions.size(); ++i) {
+			auto stats = partitions[i].update(rotation * input.objects[i].model);
+			seconds += stats.seconds;
+			sorted += stats.sorted;
+			changed += stats.changedTriangles;
+			valid += partitions[i].isValid();
+		}
+	};
+
+	double seconds;
+	size_t sorted, changed, valid;
+	std::cout << "Dominant axis presorting of " << triangles << " triangles (" << partitions.size() << " meshes):" << std::endl;
+	update(glm::mat4(1.0f), seconds, sorted, changed, valid);
+	std::cout << std::setprecision(4) << " - initial sort " << seconds * 1000.0 << " ms, " << sorted << " meshes sorted, ranges "
+			  << (rangesMatch(glm::mat4(1.0f)) ? "match" : "DON'T match") << " | vertices transformed per multipass voxelization: "
+			  << 9 * triangles << " unsorted, " << 3 * triangles << " presorted" << std::endl;
+
+	update(glm::mat4(1.0f), seconds, sorted, changed, valid);
+	std::cout << " - same transforms " << seconds * 1000.0 << " ms, " << valid << "/" << partitions.size() << " meshes presorted" << std::endl;
+
+	for (float angle : { 0.001f, 0.3f }) {
+		const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+		update(rotation, seconds, sorted, changed, valid);
+		std::cout << " - rotated by " << angle << " rad: check " << seconds * 1000.0 << " ms, " << changed << " triangles changed axis, "
+				  << valid << "/" << partitions.size() << " meshes still presorted";
+		double sortSeconds = 0;
+		for (uint32_t frame = 1; frame < DominantAxisPartition::STABLE_UPDATES; ++frame) {
+			update(rotation, seconds, sorted, changed, valid);
+			sortSeconds += seconds;
+		}
+		std::cout << " | re-sorted after " << DominantAxisPartition::STABLE_UPDATES << " updates in " << sortSeconds * 1000.0 << " ms, "
+				  << valid << "/" << partitions.size() << " presorted, ranges " << (rangesMatch(rotation) ? "match" : "DON'T match") << std::endl;
+	}
+}
+
+void benchmarkWorldVertexStream(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr int runs = 20;
+	auto input = scene.input;
+	size_t vertexCount = 0;
+	for (const auto & object : input.objects)
+		vertexCount += object.vertices->size();
+
+	// Kernels alone, every object every run.
+	std::vector<VertexData> simd, scalar;
+	double simdSeconds = 1e9, scalarSeconds = 1e9;
+	for (int run = 0; run < runs; ++run) {
+		double seconds[2] = { 0, 0 };
+		for (int kernel = 0; kernel < 2; ++kernel) {
+			auto & output = kernel == 0 ? simd : scalar;
+			output.resize(vertexCount);
+			const double startTime = Time::currentTime();
+			size_t first = 0;
+			for (const auto & object : input.objects) {
+				if (kernel == 0)
+					WorldVertexStream::transform(object.vertices->data(), object.vertices->size(), object.model, object.modelInverseTranspose, &output[first]);
+				else
+					WorldVertexStream::transformScalar(object.vertices->data(), object.vertices->size(), object.model, object.modelInverseTranspose, &output[first]);
+				first += object.vertices->size();
+			}
+			seconds[kernel] = Time::currentTime() - startTime;
+		}
+		simdSeconds = std::min(simdSeconds, seconds[0]);
+		scalarSeconds = std::min(scalarSeconds, seconds[1]);
+	}
+	float maxDifference = 0;
+	for (size_t i = 0; i < vertexCount; ++i)
+		maxDifference = std::max(maxDifference, std::max(glm::length(simd[i].position - scalar[i].position), glm::length(simd[i].normal - scalar[i].normal)));
+
+	std::cout << std::setprecision(4) << "World space vertex stream of " << vertexCount << " vertices (" << input.objects.size() << " meshes), 1 thread: SIMD "
+			  << simdSeconds * 1000.0 << " ms (" << vertexCount / std::max(simdSeconds, 1e-9) / 1e6 << " Mvertices/s), scalar "
+			  << scalarSeconds * 1000.0 << " ms (x" << scalarSeconds / std::max(simdSeconds, 1e-9) << "), max difference " << maxDifference << std::endl;
+
+	// Frames: only the objects whose transform changed are transformed again.
+	std::vector<WorldVertexStream> streams(input.objects.size());
+	auto frame = [&]() {
+		size_t transformed = 0;
+		double seconds = 0;
+		for (size_t i = 0; i < streams.size(); ++i) {
+			auto stats = streams[i].update(*input.objects[i].vertices, input.objects[i].model, input.objects[i].modelInverseTranspose, true);
+			transformed += stats.vertices;
+			seconds += stats.seconds;
+		}
+		std::cout << transformed << " vertices transformed in " << seconds * 1000.0 << " ms";
+	};
+	std::cout << " - first frame: ";
+	frame();
+	std::cout << " | nothing moved: ";
+	frame();
+	auto & moved = input.objects.back();
+	moved.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.01f, 0.0f, 0.0f)) * moved.model;
+	std::cout << " | one object moved: ";
+	frame();
+	std::cout << " | before, every pass transformed the vertices again (dominant axis, 3 voxel passes, shading)" << std::endl;
+}
+
+void benchmarkTransformStore(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr int frames = 10;
+	const std::vector<Transform> & sceneTransforms = scene.transforms;
+	if (sceneTransforms.empty())
+		return;
+
+	std::mt19937 random(1);
+	for (size_t count : { 1024, 16384, 65536 }) {
+		// Copies of the scene transforms, one in four of them a root with three children (two of them nested).
+		std::vector<Transform> transforms(count);
+		TransformStore store;
+		for (size_t i = 0; i < count; ++i) {
+			transforms[i] = sceneTransforms[i % sceneTransforms.size()];
+			transforms[i].position += glm::vec3(float(i / sceneTransforms.size()), 0.0f, 0.0f);
+			const size_t parent = i % 4 == 0 ? count : (i % 4 == 3 ? i - 3 : i - 1);
+			transforms[i].parent = parent < count ? &transforms[parent] : nullptr;
+			store.add(parent < count ? TransformStore::Handle(parent) : TransformStore::NO_PARENT);
+		}
+
+		std::cout << std::setprecision(4) << count << " transforms:";
+		for (int moving : { 1, 10, 0 }) {
+			double storeSeconds = 0, glmSeconds = 0;
+			size_t worldUpdates = 0;
+			float maxDifference = 0;
+			for (int frame = 0; frame < frames; ++frame) {
+				for (size_t i = 0; i < count; ++i) if (moving != 0 && random() % moving == 0)
+					transforms[i].rotation.y += 0.01f;
+
+				// The store compares the fields itself, the glm path recomputes everything like the render passes did.
+				double startTime = Time::currentTime();
+				for (size_t i = 0; i < count; ++i)
+					store.setLocal(TransformStore::Handle(i), transforms[i].position, transforms[i].rotation, transforms[i].scale);
+				worldUpdates += store.update().worldUpdates;
+				storeSeconds += Time::currentTime() - startTime;
+
+				startTime = Time::currentTime();
+				for (auto & transform : transforms)
+					transform.updateTransformMatrix();
+				glmSeconds += Time::currentTime() - startTime;
+
+				for (size_t i = 0; i < count; ++i) {
+					const glm::mat4 & expected = transforms[i].getTransformMatrix();
+					const glm::mat4 difference = store.getWorldMatrix(TransformStore::Handle(i)) - expected;
+					for (int c = 0; c < 4; ++c)
+						maxDifference = std::max(maxDifference, glm::length(difference[c]) / (1.0f + glm::length(expected[c])));
+				}
+			}
+			std::cout << (moving == 0 ? " | none moving: " : moving == 1 ? " all moving: " : " | a tenth moving: ")
+					  << storeSeconds * 1000.0 / frames << " ms (" << worldUpdates / frames << " updated) vs glm "
+					  << glmSeconds * 1000.0 / frames << " ms";
+			if (moving == 1)
+				std::cout << ", max relative difference " << maxDifference;
+		}
+		std::cout << std::endl;
+	}
+	std::cout << "Before, every render pass recomputed the matrices of all the renderers with glm (4 times per frame)" << std::endl;
+}
+
+void benchmarkIndirectDiffuseUpsampling(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr uint32_t width = 640, height = 360, size = 64;
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuLightInjector injector(threadPool);
+	BilateralUpsampler upsampler(threadPool);
+
+	// Direct light in the voxels, traced from the pixels of the camera like the indirect diffuse cones do.
+	VoxelGBuffer voxelGBuffer(size);
+	VoxelMipChain radiance(size);
+	voxelizer.voxelizeGBuffer(input, voxelGBuffer);
+	injector.inject(voxelGBuffer, input.pointLights, radiance.level(0));
+	radiance.generateMips();
+
+	const Camera & camera = scene.camera;
+	ScreenGBuffer full(width, height);
+	full.rasterize(input, camera.getProjectionMatrix() * camera.viewMatrix, camera.position);
+	auto trace = [&](const ScreenGBuffer & gBuffer, std::vector<glm::vec3> & light) {
+		const double startTime = Time::currentTime();
+		light.assign(size_t(gBuffer.getWidth()) * gBuffer.getHeight(), glm::vec3(0.0f));
+		threadPool.parallelFor(gBuffer.getHeight(), 1, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t y = begin; y < end; ++y)
+				for (uint32_t x = 0; x < gBuffer.getWidth(); ++x) {
+					const ScreenGBuffer::Sample & sample = gBuffer.at(x, uint32_t(y));
+					if (sample.covered())
+						light[y * gBuffer.getWidth() + x] = CpuConeTracer::traceDiffuseCones(sample.position, sample.normal, size,
+							[&](const glm::vec3 & c, float l) { return radiance.textureLod(c, l); });
+				}
+		});
+		return Time::currentTime() - startTime;
+	};
+
+	std::vector<glm::vec3> reference;
+	const double referenceSeconds = trace(full, reference);
+	double referenceEnergy = 0;
+	for (const auto & value : reference)
+		referenceEnergy += glm::dot(value, value);
+
+	std::cout << std::setprecision(4) << "Indirect diffuse at " << width << "x" << height << " (" << full.getCoveredPixels()
+			  << " covered pixels), " << threadPool.size() << " thread(s): per pixel " << referenceSeconds * 1000.0 << " ms" << std::endl;
+	for (uint32_t scale : { 2, 4 }) {
+		const ScreenGBuffer low = full.downsample(scale);
+		std::vector<glm::vec3> lowLight, light;
+		const double traceSeconds = trace(low, lowLight);
+		const auto stats = upsampler.upsample(low, lowLight, full, scale, light);
+
+		// Error relative to the per pixel cones, and the error of just stretching the low resolution pixels.
+		double error = 0, nearestError = 0;
+		for (uint32_t y = 0; y < height; ++y)
+			for (uint32_t x = 0; x < width; ++x) {
+				if (!full.at(x, y).covered())
+					continue;
+				const glm::vec3 & expected = reference[size_t(y) * width + x];
+				const glm::vec3 difference = light[size_t(y) * width + x] - expected;
+				const glm::vec3 nearestDifference = lowLight[size_t(y / scale) * low.getWidth() + x / scale] - expected;
+				error += glm::dot(difference, difference);
+				nearestError += glm::dot(nearestDifference, nearestDifference);
+			}
+		const double totalSeconds = traceSeconds + stats.seconds;
+		std::cout << " - 1/" << scale << " resolution: trace " << traceSeconds * 1000.0 << " ms + upsample " << stats.seconds * 1000.0
+				  << " ms, " << referenceSeconds / std::max(totalSeconds, 1e-9) << "x faster, relative RMSE "
+				  << std::sqrt(error / std::max(referenceEnergy, 1e-12)) << " (nearest pixel "
+				  << std::sqrt(nearestError / std::max(referenceEnergy, 1e-12)) << ")" << std::endl;
+	}
+}
+
+void benchmarkTemporalIndirectDiffuse(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr uint32_t width = 320, height = 180, size = 64, frames = 24;
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuLightInjector injector(threadPool);
+
+	VoxelGBuffer voxelGBuffer(size);
+	VoxelMipChain radiance(size);
+	voxelizer.voxelizeGBuffer(input, voxelGBuffer);
+	injector.inject(voxelGBuffer, input.pointLights, radiance.level(0));
+	radiance.generateMips();
+	auto voxels = [&](const glm::vec3 & c, float l) { return radiance.textureLod(c, l); };
+
+	// The 9 cones, or the cone pattern of each pixel in a frame (frame >= 0).
+	auto trace = [&](const ScreenGBuffer & gBuffer, int frame, std::vector<glm::vec3> & light) {
+		const double startTime = Time::currentTime();
+		light.assign(size_t(width) * height, glm::vec3(0.0f));
+		threadPool.parallelFor(height, 1, [&](size_t begin, size_t end, unsigned int) {
+			for (uint32_t y = uint32_t(begin); y < end; ++y)
+				for (uint32_t x = 0; x < width; ++x) {
+					const ScreenGBuffer::Sample & sample = gBuffer.at(x, y);
+					if (!sample.covered())
+						continue;
+					light[size_t(y) * width + x] = frame < 0
+						? CpuConeTracer::traceDiffuseCones(sample.position, sample.normal, size, voxels)
+						: CpuConeTracer::traceDiffuseConePattern(sample.position, sample.normal, TemporalAccumulator::conePattern(x, y, frame),
+																 TemporalAccumulator::patternRotation(frame), size, voxels);
+				}
+		});
+		return Time::currentTime() - startTime;
+	};
+	auto relativeError = [](const std::vector<glm::vec3> & light, const std::vector<glm::vec3> & reference) {
+		double error = 0, energy = 0;
+		for (size_t i = 0; i < light.size(); ++i) {
+			error += glm::dot(light[i] - reference[i], light[i] - reference[i]);
+			energy += glm::dot(reference[i], reference[i]);
+		}
+		return std::sqrt(error / std::max(energy, 1e-12));
+	};
+
+	const Camera & camera = scene.camera;
+	std::cout << std::setprecision(4) << "Temporal indirect diffuse at " << width << "x" << height << ", " << threadPool.size()
+			  << " thread(s), errors relative to the 9 cones after " << frames << " frames:" << std::endl;
+	for (bool turning : { false, true }) {
+		TemporalAccumulator accumulator(threadPool);
+		ScreenGBuffer gBuffer(width, height);
+		std::vector<glm::vec3> frameLight;
+		double traceSeconds = 0, accumulateSeconds = 0;
+		size_t reprojected = 0;
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			// Turning the camera moves the image by about 2 pixels per frame.
+			const glm::mat4 view = glm::rotate(glm::mat4(1.0f), turning ? 0.005f * frame : 0.0f, glm::vec3(0, 1, 0)) * camera.viewMatrix;
+			const glm::mat4 viewProjection = camera.getProjectionMatrix() * view;
+			gBuffer.clear();
+			gBuffer.rasterize(input, viewProjection, camera.position);
+			traceSeconds += trace(gBuffer, int(frame), frameLight);
+			const auto stats = accumulator.accumulate(gBuffer, frameLight, viewProjection, camera.position);
+			accumulateSeconds += stats.seconds;
+			reprojected = stats.reprojected;
+		}
+
+		std::vector<glm::vec3> reference;
+		const double referenceSeconds = trace(gBuffer, -1, reference);
+		const double frameSeconds = (traceSeconds + accumulateSeconds) / frames;
+		std::cout << (turning ? " - turning camera: " : " - still camera: ") << "9 cones " << referenceSeconds * 1000.0
+				  << " ms | 3 cones " << traceSeconds * 1000.0 / frames << " ms + accumulation " << accumulateSeconds * 1000.0 / frames
+				  << " ms, " << referenceSeconds / std::max(frameSeconds, 1e-9) << "x faster | relative RMSE of one frame "
+				  << relativeError(frameLight, reference) << ", accumulated " << relativeError(accumulator.getLight(), reference)
+				  << " (" << 100.0 * reprojected / std::max<size_t>(gBuffer.getCoveredPixels(), 1) << "% of the pixels kept their history)" << std::endl;
+	}
+}
+
+void benchmarkDeferredShading(const BenchScene & scene, const BenchOptions &)
+{
+	constexpr uint32_t width = 320, height = 180, size = 64;
+	const auto & input = scene.input;
+	ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()));
+	CpuVoxelizer voxelizer(threadPool);
+	CpuLightInjector injector(threadPool);
+
+	VoxelGBuffer voxelGBuffer(size);
+	VoxelMipChain radiance(size);
+	voxelizer.voxelizeGBuffer(input, voxelGBuffer);
+	injector.inject(voxelGBuffer, input.pointLights, radiance.level(0));
+	radiance.generateMips();
+
+	// The 9 diffuse cones of each sample, the bulk of the lighting of a fragment.
+	auto trace = [&](const std::vector<ScreenGBuffer::Sample> & samples) {
+		const double startTime = Time::currentTime();
+		std::vector<glm::vec3> light(samples.size());
+		threadPool.parallelFor(samples.size(), 64, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; ++i)
+				light[i] = CpuConeTracer::traceDiffuseCones(samples[i].position, samples[i].normal, size,
+					[&](const glm::vec3 & c, float l) { return radiance.textureLod(c, l); });
+		});
+		return Time::currentTime() - startTime;
+	};
+
+	const Camera & camera = scene.camera;
+	const glm::mat4 viewProjection = camera.getProjectionMatrix() * camera.viewMatrix;
+	std::cout << std::setprecision(4) << "Deferred shading at " << width << "x" << height << ", " << threadPool.size() << " thread(s):" << std::endl;
+	for (bool reversed : { false, true }) {
+		// Forward shading pays for every fragment that passes the depth test when it is drawn, so it depends on the draw order.
+		auto orderedInput = input;
+		if (reversed)
+			std::reverse(orderedInput.objects.begin(), orderedInput.objects.end());
+		ScreenGBuffer gBuffer(width, height);
+		std::vector<ScreenGBuffer::Sample> fragments;
+		gBuffer.rasterize(orderedInput, viewProjection, camera.position, &fragments);
+
+		std::vector<ScreenGBuffer::Sample> pixels;
+		for (uint32_t y = 0; y < height; ++y)
+			for (uint32_t x = 0; x < width; ++x)
+				if (gBuffer.at(x, y).covered())
+					pixels.push_back(gBuffer.at(x, y));
+
+		const double forwardSeconds = trace(fragments);
+		const double deferredSeconds = trace(pixels);
+		std::cout << (reversed ? " - reversed draw order: " : " - scene draw order: ") << fragments.size() << " shaded fragments for "
+				  << pixels.size() << " visible pixels (" << double(fragments.size()) / std::max<size_t>(pixels.size(), 1)
+				  << " per pixel) | forward " << forwardSeconds * 1000.0 << " ms, deferred " << deferredSeconds * 1000.0 << " ms, "
+				  << forwardSeconds / std::max(deferredSeconds, 1e-9) << "x faster" << std::endl;
+	}
+}
+
+}
+
+const std::vector<Benchmark> & Benchmarks::getBenchmarks()
+{
+	static const std::vector<Benchmark> benchmarks = {
+		{ "voxelization", "Voxelizes the scene with the CPU reference voxelizer and prints its throughput (triangles/s) per thread count.",
+		  benchmarkCpuVoxelization },
+		{ "coverage", "Voxelizes the scene from 64^3 to 256^3 with the conservative coverage and with the rules of the single pass GPU voxelization, and prints the voxels they don't share and the color difference of the others.",
+		  benchmarkCoverage },
+		{ "sparse-octree", "Prints the memory usage and build time of the dense voxel mip chain vs the sparse voxel octree and the brick paged volume of the scene, from 64^3 to 512^3.",
+		  benchmarkSparseVoxelOctree },
+		{ "shadow-opacity", "Traces the shadow cones of the scene on the CPU through RGBA8, R8 and 1-bit opacity, and prints their memory, time, bytes fetched and difference.",
+		  benchmarkShadowOpacity },
+		{ "multi-bounce", "Runs the bounce pass of multi-bounce indirect light on the CPU from 32^3 to 256^3 and prints its cost per frame and per bounce.",
+		  benchmarkMultiBounce },
+		{ "mips", "Builds the mip chain of the scene on the CPU from 64^3 to 512^3 like the compute shader (SIMD and scalar) and prints the throughput (voxels/s).",
+		  benchmarkMipBuilder },
+		{ "empty-bricks", "Builds the mip chain of the scene on the CPU from 64^3 to 512^3 with and without skipping the empty bricks, and prints the speedup.",
+		  benchmarkEmptyBrickSkipping },
+		{ "epoch-clear", "Clears and voxelizes the scene on the CPU from 64^3 to 512^3 into a dense grid and into an epoch tagged grid (no clear pass), and prints the cost per frame.",
+		  benchmarkEpochClear },
+		{ "layouts", "Writes the voxel fragments of the scene and gathers trilinear samples along rays in grids stored in the linear, Morton and 4^3 brick layouts, from 64^3 to 512^3, and prints their throughput.",
+		  benchmarkVoxelLayouts },
+		{ "accumulation", "Voxelizes the scene on the CPU at 64^3 and 256^3 with each fragment accumulation (CAS loop, private tiles, sorted fragments) using 1, 2, 4, ... threads, and prints the scaling.",
+		  benchmarkFragmentAccumulation },
+		{ "object-cache", "Builds a local space voxel cache of every object and, for a few frames of the objects spinning, compares voxelizing the scene on the CPU with stamping the caches from 64^3 to 256^3, and prints their time, memory, the share of the rasterized voxels stamped and the extra voxels stamped.",
+		  benchmarkObjectVoxelCache },
+		{ "dominant-axis", "Sorts the triangles of the scene by dominant axis like multipass voxelization does, rotates the objects, and prints the sorting and checking time and the vertices transformed per voxelization.",
+		  benchmarkDominantAxisPartition },
+		{ "world-vertices", "Transforms the vertices of the scene to world space with the SIMD and scalar kernels, and prints their throughput and the vertices transformed per frame.",
+		  benchmarkWorldVertexStream },
+		{ "transforms", "Updates hierarchies of 1k to 64k copies of the scene transforms with the transform store when all, a tenth or none of them move, and prints the time against recomputing every matrix with glm.",
+		  benchmarkTransformStore },
+		{ "upsampling", "Traces the indirect diffuse cones of the scene on the CPU per pixel and at 1/2 and 1/4 resolution with depth and normal aware upsampling, and prints their time and error.",
+		  benchmarkIndirectDiffuseUpsampling },
+		{ "temporal", "Accumulates the indirect diffuse cone patterns of the scene on the CPU for 24 frames with a still and a turning camera, and prints their cost and error against the 9 cones.",
+		  benchmarkTemporalIndirectDiffuse },
+		{ "deferred", "Counts the fragments a forward pass of the scene shades (in scene and reversed draw order) against the visible pixels, and prints the CPU time of their indirect diffuse cones.",
+		  benchmarkDeferredShading },
+	};
+	return benchmarks;
+}
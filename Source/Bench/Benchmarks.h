@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class BenchScene;
+
+/// <summary> Settings shared by the benchmarks. </summary>
+struct BenchOptions {
+	/// <summary> Voxel resolution of the benchmarks that run at a single one. </summary>
+	uint32_t voxelTextureSize = 64;
+};
+
+/// <summary> A benchmark of the headless voxel code, run on a scene by voxel_bench. </summary>
+struct Benchmark {
+	const char * name;
+	const char * description;
+	void (*run)(const BenchScene & scene, const BenchOptions & options);
+};
+
+namespace Benchmarks {
+	/// <summary> Every benchmark, in the order they run by default. </summary>
+	const std::vector<Benchmark> & getBenchmarks();
+}
@@ -0,0 +1,87 @@
+// voxel_bench: runs the benchmarks of the headless CPU voxel code on one of the demo scenes, without Metal.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BenchScene.h"
+#include "Benchmarks.h"
+
+#ifndef VOXEL_BENCH_ASSET_ROOT
+#define VOXEL_BENCH_ASSET_ROOT "."
+#endif
+
+namespace {
+
+void printUsage(const char * program)
+{
+	std::cout << "Usage: " << program << " [--scene NAME] [--size N] [--assets DIR] [--list] [BENCHMARK...]" << std::endl
+			  << "  --scene NAME  scene to load (";
+	for (const auto & name : BenchScene::getSceneNames())
+		std::cout << (&name == &BenchScene::getSceneNames().front() ? "" : ", ") << name;
+	std::cout << "), default: " << BenchScene::getSceneNames().front() << std::endl
+			  << "  --size N      voxel resolution of the single resolution benchmarks (power of 2), default: " << BenchOptions().voxelTextureSize << std::endl
+			  << "  --assets DIR  directory holding Assets/Models, default: " << VOXEL_BENCH_ASSET_ROOT << std::endl
+			  << "  --list        list the benchmarks" << std::endl
+			  << "Runs every benchmark if none is named." << std::endl;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+	std::string sceneName = BenchScene::getSceneNames().front(), assetRoot = VOXEL_BENCH_ASSET_ROOT;
+	BenchOptions options;
+	std::vector<const Benchmark *> selected;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!std::strcmp(argv[i], "--scene") && hasValue) {
+			sceneName = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--size") && hasValue) {
+			options.voxelTextureSize = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+			if (options.voxelTextureSize < 2 || (options.voxelTextureSize & (options.voxelTextureSize - 1))) {
+				std::cerr << "The voxel resolution must be a power of 2." << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!std::strcmp(argv[i], "--assets") && hasValue) {
+			assetRoot = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--list")) {
+			for (const auto & benchmark : Benchmarks::getBenchmarks())
+				std::cout << benchmark.name << ": " << benchmark.description << std::endl;
+			return EXIT_SUCCESS;
+		}
+		else if (!std::strcmp(argv[i], "--help") || argv[i][0] == '-') {
+			printUsage(argv[0]);
+			return std::strcmp(argv[i], "--help") ? EXIT_FAILURE : EXIT_SUCCESS;
+		}
+		else {
+			const Benchmark * found = nullptr;
+			for (const auto & benchmark : Benchmarks::getBenchmarks())
+				if (benchmark.name == std::string(argv[i])) found = &benchmark;
+			if (!found) {
+				std::cerr << "Unknown benchmark '" << argv[i] << "', see --list." << std::endl;
+				return EXIT_FAILURE;
+			}
+			selected.push_back(found);
+		}
+	}
+	if (selected.empty())
+		for (const auto & benchmark : Benchmarks::getBenchmarks()) selected.push_back(&benchmark);
+
+	BenchScene scene;
+	if (!scene.load(sceneName, assetRoot))
+		return EXIT_FAILURE;
+	std::cout << "Scene '" << sceneName << "': " << scene.input.objects.size() << " objects, " << scene.input.countTriangles() << " triangles." << std::endl;
+
+	for (const Benchmark * benchmark : selected) {
+		std::cout << std::endl << "[" << benchmark->name << "]" << std::endl;
+		benchmark->run(scene, options);
+	}
+	return EXIT_SUCCESS;
+}
@@ -13,6 +13,8 @@ public:
 		uint32_t layers = 1);
 	~FBO();
 	void activateAsTexture(id<MTLRenderCommandEncoder> encoder, uint32_t textureUnit = 0);
+	/// <summary> The color texture (resolved if multisampled), e.g. to read it in a compute pass. </summary>
+	id<MTLTexture> getColorTexture() const { return resolveTextureColorObject ? resolveTextureColorObject : textureColorObject; }
 	id<MTLRenderCommandEncoder> beginRenderPass(id<MTLCommandBuffer> commandBuffer,
 												MTLLoadAction load = MTLLoadActionClear,
 												bool keepColor = true,
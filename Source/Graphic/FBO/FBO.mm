@@ -80,7 +80,7 @@ void FBO::initRenderPass()
 
 void FBO::activateAsTexture(id<MTLRenderCommandEncoder> encoder, uint32_t textureUnit)
 {
-	auto texture = resolveTextureColorObject ? resolveTextureColorObject : textureColorObject;
+	auto texture = getColorTexture();
 	[encoder setVertexTexture:texture atIndex:textureUnit];
 	[encoder setFragmentTexture:texture atIndex:textureUnit];
 }
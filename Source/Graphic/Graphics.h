@@ -8,14 +8,18 @@
 #include "ComputePipelineCache.h"
 #include "../Scene/Scene.h"
 #include "Material/Material.h"
+#include "Material/MaterialSetting.h"
 #include "Camera/OrthographicCamera.h"
 #include "../Shape/Mesh.h"
-
-#define MAX_LIGHTS 1
+#include "Voxelization/BrickPagedVolume.h"
+#include "Voxelization/VoxelDirtyTracker.h"
+#include "Voxelization/VoxelLayout.h"
+#include "Voxelization/VoxelizationScheduler.h"
 
 class MeshRenderer;
 class Shape;
 class Texture3D;
+class VoxelClipmap;
 class FBO;
 
 /// <summary> A graphical context used for rendering. </summary>
@@ -40,14 +44,49 @@ public:
 	static constexpr uint32_t OBJECT_STATE_BINDING = 0;
 	static constexpr uint32_t APPSTATE_BINDING = 1;
 	static constexpr uint32_t VOXEL_PROJ_BINDING = 2;
+	static constexpr uint32_t VOXEL_REGION_BINDING = 3;
+	static constexpr uint32_t VOXEL_CLIPMAP_BINDING = 4;
+	static constexpr uint32_t VOXEL_OCCUPANCY_BINDING = 5;
+	static constexpr uint32_t MATERIAL_INDEX_BINDING = 6;
+	static constexpr uint32_t MATERIAL_TABLE_BINDING = 7;
 	static constexpr uint32_t VERTEX_BUFFER_BINDING = 8;
 	static constexpr uint32_t INDEX_BUFFER_BINDING = 9;
 	static constexpr uint32_t TRI_DOMINANT_BUFFER_BINDING = 10;
 	static constexpr uint32_t VOXEL_ATOMIC_BUFFER_BINDING = 11;
+	static constexpr uint32_t VOXEL_NORMAL_ATOMIC_BUFFER_BINDING = 12;
+	static constexpr uint32_t VOXEL_EMISSIVE_ATOMIC_BUFFER_BINDING = 13;
+	static constexpr uint32_t VOXEL_OCCUPIED_MASK_BINDING = 14;
+	static constexpr uint32_t VOXEL_OCCUPIED_LIST_BINDING = 15;
 	static constexpr uint32_t COMPUTE_PARAM_START_IDX = 16;
 
+	/// Layout of the occupied voxel list, same as in common.metal
+	static constexpr uint32_t VOXEL_OCCUPIED_LIST_HEADER = 4;
+	static constexpr uint32_t INJECT_LIGHT_THREADGROUP_SIZE = 64;
+
 	static constexpr int VOXEL_RENDER_TARGET_SAMPLES = 8;
 
+	/// Frames the CPU encodes ahead of the GPU at most (the renderer waits for the oldest one to complete), so a buffer
+	/// written by the CPU is free again after this many other writes
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+	/// Range of the voxel resolution
+	static constexpr uint32_t MIN_VOXEL_TEXTURE_SIZE = 32;
+	static constexpr uint32_t MAX_VOXEL_TEXTURE_SIZE = 512;
+
+	/// Function constant index selecting the voxel G-buffer output of the voxelization shader
+	static constexpr uint32_t VOXELIZE_GBUFFER_CONSTANT = 3;
+	/// Function constant index selecting the clipmap level output of the voxelization shader
+	static constexpr uint32_t VOXELIZE_CLIPMAP_CONSTANT = 4;
+	/// Function constant index selecting the screen G-buffer output of the cone tracing shader
+	static constexpr uint32_t SCENE_GBUFFER_CONSTANT = 5;
+	/// Function constant index selecting the upsampled indirect diffuse light in the cone tracing shader
+	static constexpr uint32_t UPSAMPLED_INDIRECT_DIFFUSE_CONSTANT = 6;
+	/// Function constant index selecting the fullscreen deferred lighting pass of the cone tracing shader
+	static constexpr uint32_t DEFERRED_LIGHTING_CONSTANT = 7;
+
+	/// Number of voxel clipmap cascades (VOXEL_CLIPMAP_LEVELS in common.metal)
+	static constexpr uint32_t VOXEL_CLIPMAP_LEVELS = 4;
+
 	Graphics() : computePipelineCache(*this) {}
 
 	/// <summary> Initializes rendering. </summary>
@@ -68,6 +107,19 @@ public:
 	// Rendering.
 	// ----------------
 	Settings &settings() { return globalConstants; }
+	// Trace the indirect diffuse cones once per block of indirectDiffuseScale x indirectDiffuseScale pixels
+	// (1, 2 or 4), in a compute pass over a screen G-buffer (normal and distance to the camera of each pixel).
+	// The cone tracing pass upsamples the result with weights that follow the depth and normal edges. 1 traces
+	// them per fragment.
+	uint32_t indirectDiffuseScale = 2;
+	// Trace 3 of the 9 indirect diffuse cones per block of pixels each frame, rotating the pattern from frame to
+	// frame, and accumulate the result in a history reprojected with the previous camera (clamped to the light of the
+	// neighbouring blocks so that it doesn't ghost). Also runs the low resolution pass when indirectDiffuseScale is 1.
+	bool temporalIndirectDiffuse = false;
+	// Deferred shading: the scene is only rasterized into the screen G-buffer (normal, distance to the camera and
+	// material index of each pixel), then a fullscreen pass traces the cones once per visible pixel instead of once
+	// per fragment that passes the depth test. The lighting pass shades one sample per pixel (no multisampled edges).
+	bool deferredShading = false;
 
 	// ----------------
 	// Voxelization parameters.
@@ -76,11 +128,65 @@ public:
 	bool regenerateMipmapQueued = true;
 	bool automaticallyVoxelize = true;
 	bool voxelizationQueued = true;
-	int voxelizationSparsity = 1; // Number of ticks between mipmap generation.
+	// Hash the objects, materials and lights every frame, and skip voxelization and mip generation when they are the
+	// same as at the last voxelization (e.g. paused animation): the frame only pays for cone tracing then.
+	bool skipUnchangedVoxelization = true;
+	// GPU time per frame (milliseconds) that voxelization may take. When set, each full re-voxelization is spread
+	// over as many frames as needed, into a back voxel texture that is swapped in once complete. 0 voxelizes
+	// the whole scene within the frame. Multipass lit voxelization only.
+	float voxelizationFrameBudget = 0;
+	// How time sliced voxelization cuts the work: slabs of the volume, or subsets of the objects.
+	VoxelizationScheduler::Mode voxelizationSlicing = VoxelizationScheduler::Mode::SLABS;
+	uint32_t getVoxelizationCycleFrames() const { return voxelizationScheduler.getLastCycleFrames(); }
 	bool useComputeShaderToGenMip = true;
-	// (voxelization sparsity gives unstable framerates, so not sure if it's worth it in interactive applications.)
+	// Voxelize material data (voxel G-buffer) and inject direct light in a separate compute pass.
+	// Light injection runs every frame, the scene is only re-rasterized when voxelization is due.
+	bool decoupledLightInjection = false;
+	// Only clear and re-voxelize the bricks covered by the old and new bounds of the objects that changed
+	// since the last voxelization, then update the mip texels above those bricks only. Multipass voxelization only.
+	bool partialVoxelization = true;
+	// Voxelize camera centered clipmap cascades instead of the [-1, 1] cube. Every frame, each cascade only voxelizes
+	// the slabs that scrolled in and the objects that changed. Multipass voxelization only, lit voxels only.
+	bool useVoxelClipmap = false;
+	// Also build six directional mip chains (+X, -X, +Y, -Y, +Z, -Z) by compositing opacity along each axis,
+	// so thin walls don't leak at coarse levels. Cones blend the three faces they look at, and fewer, wider
+	// diffuse cones are traced. Not used by the clipmap cascades.
+	bool anisotropicVoxels = false;
+	// Also keep an R8 opacity mip chain next to the voxel texture. Shadow cones only need opacity, so they read it
+	// instead of the RGBA8 voxels: 4 times less bandwidth. Not used by the clipmap cascades.
+	bool separateOpacityVolume = false;
+	// Track which 8^3 bricks of the voxel texture the objects cover (a BrickPagedVolume page table, bricks are
+	// allocated and freed at each voxelization), and only clear and generate the mips of those.
+	// Multipass lit voxelization only.
+	bool residentBricksOnly = false;
+	// Add the indirect diffuse light reflected by the voxels to the injected light: a bounce pass traces the diffuse
+	// cones at 1/8 of the occupied voxels per frame, so each cycle of 8 frames adds one bounce, until the lighting
+	// settles. Decoupled light injection only (the voxel normals are needed).
+	bool multiBounce = false;
+	// Voxelization marks the 8^3 bricks it writes to in a bitmask, and mip generation doesn't sample the empty ones.
+	// The bits are cleared along with the whole voxel texture only, so partial re-voxelizations keep them conservative.
+	// Not used by time sliced voxelization (the bits wouldn't match the swapped in texture) nor the clipmap cascades.
+	bool skipEmptyBricksInMips = true;
+	// Order of the voxels in the atomic buffers of single pass voxelization. The fragments of a triangle land rows
+	// (size voxels) or slices (size^2 voxels) apart in the LINEAR layout, MORTON and BRICK4 keep them closer together.
+	// The copy to the voxel texture reads the same layout.
+	VoxelLayout voxelBufferLayout = VoxelLayout::LINEAR;
 	// This parameter is immutable after setup
 	bool isSinglePassVoxelization() const { return singlePassVoxelization; }
+	uint32_t getVoxelTextureSize() const { return voxelTextureSize; }
+
+	/// <summary> Changes the voxel resolution (a power of 2 between MIN_VOXEL_TEXTURE_SIZE and MAX_VOXEL_TEXTURE_SIZE).
+	/// Every voxel resource is reallocated and the scene is voxelized again on the next frame. </summary>
+	void setVoxelTextureSize(uint32_t size);
+	/// <summary> GPU memory taken by the voxel resources at a given resolution, with the optional features that are
+	/// on now: the resources of a feature are only allocated while it is on. </summary>
+	size_t getVoxelMemoryUsage(uint32_t size) const;
+	/// <summary> Largest resolution whose voxel resources fit in a memory budget (MIN_VOXEL_TEXTURE_SIZE if none does). </summary>
+	uint32_t pickVoxelTextureSize(size_t memoryBudget) const;
+	// Share of the GPU's recommended working set the voxel resources may take. Picks the resolution at init.
+	float voxelMemoryBudgetFraction = 0.125f;
+	/// <summary> Resident bricks of the voxel texture as of the last voxelization (with residentBricksOnly), to size brick pools. </summary>
+	const BrickPagedVolume::Stats & getVoxelBrickStats() const { return voxelBricks->getStats(); }
 
 	~Graphics();
 private:
@@ -100,8 +206,14 @@ private:
 		// Debug state
 		int32_t state;
 
-		uint32_t padding[3];
+		uint32_t voxelClipmap;
+		uint32_t anisotropicVoxels;
+		uint32_t opacityVolume;
+		uint32_t voxelBufferLayout;
+		uint32_t indirectDiffuseScale;
+		uint32_t padding[2]; // Metal rounds AppState up to the alignment of its matrices.
 	};
+	static_assert(sizeof(GlobalUniformData) % 16 == 0, "GlobalUniformData must be as large as AppState in common.metal");
 
 	// ----------------
 	// Rendering.
@@ -112,12 +224,18 @@ private:
 					 unsigned int viewportWidth,
 					 unsigned int viewportHeight);
 	void renderQueue(id<MTLRenderCommandEncoder> encoder, const RenderingQueue &renderingQueue) const;
+	/// <summary> Same as renderQueue for one projection pass of multipass voxelization. </summary>
+	void renderVoxelizationPass(id<MTLRenderCommandEncoder> encoder, const RenderingQueue &renderingQueue, uint32_t axis) const;
 	void genDominantAxisList(id<MTLComputeCommandEncoder> encoder, const RenderingQueue &renderingQueue) const;
 	void updateGlobalConstants(Scene & renderingScene);
 	void uploadGlobalConstants(id<MTLRenderCommandEncoder> encoder) const;
 
 	GlobalUniformData globalConstants;
 
+	/// <summary> Brings the matrices of the renderers (and of their children) up to date once per frame: the
+	/// transform store that owns them only recomputes the ones that moved. </summary>
+	void updateTransforms();
+
 	// ----------------
 	// Metal resources
 	// ----------------
@@ -134,24 +252,168 @@ private:
 	// ----------------
 	Material * voxelConeTracingMaterial;
 
+	// ----------------
+	// Low resolution indirect diffuse.
+	// ----------------
+	Material * voxelConeTracingUpsampledMaterial;
+	Material * sceneGBufferMaterial;
+	FBO * sceneGBufferFbo = nullptr; // Octahedral normal, distance to the camera and material index of each pixel.
+	id<MTLTexture> lowGBufferTextures[2] = { nil, nil }; // Sample of the screen G-buffer picked in each block of pixels, this frame's and the previous one's.
+	id<MTLTexture> lowPositionTexture = nil; // World position of those samples.
+	id<MTLTexture> lowIndirectDiffuseTexture = nil; // Diffuse cones traced at those samples.
+	uint32_t lowIndirectDiffuseScale = 0; // Scale the textures above were created for.
+	id<MTLComputePipelineState> traceIndirectDiffusePipelineState;
+
+	// --- Temporal accumulation. ---
+	id<MTLTexture> lowHistoryTextures[2] = { nil, nil }; // Accumulated light (a: frames), this frame's and the previous one's.
+	uint32_t lowCurrentIndex = 0; // Of lowGBufferTextures and lowHistoryTextures written this frame.
+	bool lowHistoryValid = false; // Whether the previous frame accumulated a history with the same targets.
+	uint32_t indirectDiffuseFrame = 0; // Picks the cone patterns.
+	glm::mat4 previousViewProjection;
+	glm::vec3 previousCameraPosition;
+	id<MTLComputePipelineState> accumulateIndirectDiffusePipelineState;
+	void initIndirectDiffuse();
+	/// <summary> (Re)creates the targets when the viewport or indirectDiffuseScale changed. </summary>
+	void updateIndirectDiffuseTargets(unsigned int viewportWidth, unsigned int viewportHeight);
+	/// <summary> Traces the indirect diffuse cones of each block of pixels of the screen G-buffer (and accumulates
+	/// them with temporalIndirectDiffuse). </summary>
+	void traceIndirectDiffuse(id<MTLCommandBuffer> commandBuffer);
+
+	// --- Deferred shading. ---
+	Material * deferredLightingMaterial;
+	Material * deferredLightingUpsampledMaterial;
+	std::vector<MaterialSetting> materialTable; // Material of each renderer drawn into the screen G-buffer, by index.
+	id<MTLBuffer> materialTableBuffer = nil;
+	/// <summary> Renders the screen G-buffer (resized to the viewport) and uploads the material table. </summary>
+	void renderSceneGBuffer(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene,
+							unsigned int viewportWidth, unsigned int viewportHeight);
+
 	// ----------------
 	// Voxelization.
 	// ----------------
 	bool singlePassVoxelization = false;
-	int ticksSinceLastVoxelization = voxelizationSparsity;
-	uint32_t voxelTextureSize = 64; // Must be set to a power of 2.
+	uint32_t voxelTextureSize = 64; // Must be set to a power of 2. Picked from the memory budget at init.
 	OrthographicCamera voxelCamera;
 	Material * voxelizationMaterial;
 	Texture3D * voxelTexture = nullptr;
+	// +X, -X, +Y, -Y, +Z, -Z. Level i matches level i + 1 of voxelTexture. Null while anisotropicVoxels is off.
+	Texture3D * voxelAnisotropicTextures[6] = {};
+	bool voxelAnisotropicTexturesValid = false; // Whether their mips were generated since they were allocated.
+	/// <summary> Directional texture of a face, or the voxel texture in its place while anisotropicVoxels is off (the
+	/// shaders only sample the bound textures of the features that are on). </summary>
+	Texture3D * getAnisotropicTexture(uint32_t face) const;
+	Texture3D * voxelOpacityTexture = nullptr; // R8, alpha of voxelTexture. Null while separateOpacityVolume is off.
+	bool voxelOpacityTextureValid = false; // Whether it was generated since it was allocated.
 	void initVoxelization();
-	id<MTLRenderCommandEncoder> setupVoxelWritingPass(id<MTLCommandBuffer> commandBuffer);
-	void voxelize(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, bool clearVoxelizationFirst = true);
+	void initVoxelResources();
+	void releaseVoxelResources();
+	/// <summary> Allocates the resources of the optional voxel features that were turned on and releases the ones of
+	/// the features that were turned off. Called at the start of every frame, before any pass reads them. </summary>
+	void updateVoxelFeatureResources();
+	id<MTLRenderCommandEncoder> setupVoxelWritingPass(id<MTLCommandBuffer> commandBuffer, Material * material, const VoxelRegion & region);
+	void voxelize(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, const VoxelRegion & region, bool clearVoxelizationFirst = true);
 	void voxelizeSinglePass(id<MTLCommandBuffer> commandBuffer,
 							Scene & renderingScene,
-							bool clearVoxelizationFirst);
+							bool clearVoxelizationFirst,
+							bool gBuffer);
 	void voxelizeMultiPass(id<MTLCommandBuffer> commandBuffer,
-						   Scene & renderingScene,
-						   bool clearVoxelizationFirst);
+						   const RenderingQueue & candidates,
+						   const VoxelRegion & region,
+						   bool clearVoxelizationFirst,
+						   bool gBuffer,
+						   const std::vector<glm::ivec3> * bricks = nullptr);
+	void generateVoxelMips(id<MTLCommandBuffer> commandBuffer, const VoxelRegion & region,
+						   const std::vector<glm::ivec3> * bricks = nullptr);
+
+	// ----------------
+	// Time sliced voxelization.
+	// ----------------
+	VoxelizationScheduler voxelizationScheduler;
+	bool voxelizedTimeSliced = false;
+	// Target of the cycle in progress, swapped with voxelTexture when complete. Null while not time sliced.
+	Texture3D * voxelBackTexture = nullptr;
+	/// <summary> Whether full re-voxelizations are time sliced with the current settings. </summary>
+	bool isTimeSliced() const { return voxelizationFrameBudget > 0 && !singlePassVoxelization && !decoupledLightInjection; }
+	/// <summary> Voxelizes the next slice of the current cycle within voxelizationFrameBudget. </summary>
+	void voxelizeTimeSliced(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, uint64_t sceneHash);
+	uint64_t timeSlicedCycleHash = 0; // Scene hash when the cycle in progress started.
+
+	// ----------------
+	// Change detection.
+	// ----------------
+	uint64_t voxelizedSceneHash = 0; // Scene hash at the last complete voxelization, 0 if unknown.
+	/// <summary> VoxelSceneHash of the enabled objects, their materials, the lights and the voxel settings. </summary>
+	uint64_t computeSceneHash(Scene & renderingScene) const;
+
+	// ----------------
+	// Brick residency.
+	// ----------------
+	BrickPagedVolume * voxelBricks = nullptr; // Residency only, the voxels stay in voxelTexture.
+	bool voxelBricksValid = false; // Whether the residency was tracked at the previous voxelization too.
+	/// <summary> Makes the bricks covered by the enabled objects resident. </summary>
+	void updateVoxelBricks(Scene & renderingScene);
+	/// <summary> Bricks to clear and mip: the ones that are resident or were just freed, within a region. </summary>
+	std::vector<glm::ivec3> getUpdatedBricks(const VoxelRegion & region) const;
+
+	// ----------------
+	// Brick occupancy.
+	// ----------------
+	id<MTLBuffer> voxelOccupancyBuffer = nil; // One bit per 8^3 brick of voxelTexture, same layout as VoxelBrickOccupancy.
+	bool voxelOccupancyValid = false; // Whether the bits were cleared along with voxelTexture and cover all its voxels.
+
+	// ----------------
+	// Partial re-voxelization.
+	// ----------------
+	VoxelDirtyTracker dirtyTracker;
+	/// <summary> Region of the voxel texture that must be re-voxelized this time. </summary>
+	VoxelRegion updateDirtyRegion(Scene & renderingScene);
+
+	// ----------------
+	// Voxel clipmap.
+	// ----------------
+	Material * voxelizationClipmapMaterial;
+	VoxelClipmap * voxelClipmap = nullptr;
+	std::vector<Texture3D *> voxelClipmapTextures; // Empty while useVoxelClipmap is off.
+	/// <summary> Texture of a cascade, or the voxel texture in its place while the cascades are off: the shaders only
+	/// sample the cascades when voxelClipmap is set, but every bound texture must exist. </summary>
+	Texture3D * getClipmapTexture(uint32_t level) const;
+	void initVoxelClipmap();
+	void voxelizeClipmap(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene);
+	void voxelizeClipmapRegion(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, uint32_t level, const VoxelRegion & region);
+
+	// ----------------
+	// Voxel G-buffer & light injection.
+	// ----------------
+	Material * voxelizationGBufferMaterial;
+	Texture3D * voxelAlbedoTexture = nullptr;
+	Texture3D * voxelNormalTexture = nullptr;
+	Texture3D * voxelEmissiveTexture = nullptr;
+	id<MTLBuffer> voxelNormalAtomicBuffer = nil;
+	id<MTLBuffer> voxelEmissiveAtomicBuffer = nil;
+	// Voxels written since the last full clear of the G-buffer, appended by voxelization (see VOXEL_OCCUPIED_LIST_HEADER).
+	// The mask has one bit per voxel, so that each is listed once. Light injection is dispatched over the list only.
+	id<MTLBuffer> voxelOccupiedMaskBuffer = nil;
+	id<MTLBuffer> voxelOccupiedListBuffer = nil;
+	bool voxelOccupiedListCleared = false;
+	id<MTLComputePipelineState> prepareInjectLightPipelineState;
+	id<MTLComputePipelineState> injectLightPipelineState;
+	void initVoxelGBuffer();
+	/// <summary> Empties the occupied voxel list, before voxelizing the whole G-buffer from scratch. </summary>
+	void clearOccupiedVoxelList(id<MTLBlitCommandEncoder> blitEncoder);
+	void injectLight(id<MTLCommandBuffer> commandBuffer);
+
+	// ----------------
+	// Multi-bounce.
+	// ----------------
+	// Bounce cycles run after a change, enough for the lighting to converge.
+	static constexpr uint32_t MULTI_BOUNCE_SETTLE_FRAMES = 4 * 8;
+	Texture3D * voxelBounceTexture = nullptr; // First level only, light reflected by each voxel. Null while multi-bounce is off.
+	bool voxelBounceTextureCleared = false;
+	id<MTLComputePipelineState> injectBouncePipelineState;
+	uint32_t bounceSubset = 0; // Subset of the voxels traced next, one voxel per 2x2x2 block.
+	uint32_t bounceFramesLeft = 0;
+	/// <summary> Traces the bounce of the next subset of the voxels, from the current radiance mips. </summary>
+	void injectBounce(id<MTLCommandBuffer> commandBuffer);
 
 	// ----------------
 	// Voxelization visualization.
@@ -3,6 +3,8 @@
 // Stdlib.
 #include <queue>
 #include <algorithm>
+#include <cstring>
+#include <iostream>
 #include <vector>
 
 // External.
@@ -22,6 +24,10 @@
 #include "Renderer/MeshRenderer.h"
 #include "../Utility/ObjLoader.h"
 #include "../Shape/Shape.h"
+#include "../Shape/TransformStore.h"
+#include "Voxelization/VoxelBrickOccupancy.h"
+#include "Voxelization/VoxelClipmap.h"
+#include "Voxelization/VoxelSceneHash.h"
 
 namespace
 {
@@ -42,6 +48,61 @@ MTLViewport viewport(uint32_t viewportWidth, uint32_t viewportHeight)
 {
 	return viewport(0, 0, viewportWidth, viewportHeight);
 }
+
+struct VoxelRegionUniformData
+{
+	uint32_t min[4];
+	uint32_t max[4];
+};
+
+struct VoxelClipmapLevelUniformData
+{
+	float minCorner[4]; // w: voxel size
+	int32_t origin[4];
+};
+
+VoxelClipmapLevelUniformData voxelClipmapLevelData(const VoxelClipmap::Level & level)
+{
+	const glm::vec3 minCorner = level.minCorner();
+	return {
+		{ minCorner.x, minCorner.y, minCorner.z, level.voxelSize },
+		{ level.origin.x, level.origin.y, level.origin.z, 0 }
+	};
+}
+
+// InjectLightParams in voxel_compute_kernels.metal.
+struct InjectLightUniformData
+{
+	uint32_t multiBounce;
+};
+
+// BounceParams in voxel_cone_tracing.metal.
+struct BounceUniformData
+{
+	uint32_t subset[4];
+};
+
+// IndirectDiffuseParams in voxel_cone_tracing.metal.
+struct IndirectDiffuseUniformData
+{
+	glm::mat4 inverseViewProjection;
+	glm::mat4 previousViewProjection;
+	float previousCameraPosition[4];
+	uint32_t temporal[4];
+};
+
+// Scissor rectangle of a voxel region when projected on an axis (see projectOnAxis in voxelization.metal).
+MTLScissorRect voxelRegionScissor(const VoxelRegion & region, uint32_t axis, uint32_t voxelTextureSize)
+{
+	const uint32_t u = (axis + 1) % 3, v = (axis + 2) % 3;
+	MTLScissorRect rect;
+	rect.x = region.min[u];
+	rect.width = region.max[u] - region.min[u];
+	// Window y goes down while the projected axis goes up.
+	rect.y = voxelTextureSize - region.max[v];
+	rect.height = region.max[v] - region.min[v];
+	return rect;
+}
 }
 
 // ----------------------
@@ -57,7 +118,14 @@ void Graphics::init(id<MTLDevice> _metalDevice, unsigned int viewportWidth, unsi
 	initMetalResources();
 
 	voxelConeTracingMaterial = MaterialStore::getInstance().findMaterialWithName("voxel_cone_tracing");
+	initIndirectDiffuse();
 	voxelCamera = OrthographicCamera(viewportWidth / float(viewportHeight));
+
+	// Largest voxel resolution whose resources fit in a share of what this GPU should use.
+	const size_t voxelMemoryBudget = size_t(metalDevice.recommendedMaxWorkingSetSize * voxelMemoryBudgetFraction);
+	voxelTextureSize = pickVoxelTextureSize(voxelMemoryBudget);
+	std::cout << "Voxel resolution: " << voxelTextureSize << "^3 (" << getVoxelMemoryUsage(voxelTextureSize) / (1024 * 1024)
+			  << " MB, budget " << voxelMemoryBudget / (1024 * 1024) << " MB)" << std::endl;
 	initVoxelization();
 	initVoxelVisualization(viewportWidth, viewportHeight);
 }
@@ -80,14 +148,57 @@ void Graphics::render(id<MTLCommandBuffer> commandBuffer,
 {
 	// Update global constants
 	updateGlobalConstants(renderingScene);
+	updateTransforms();
+	updateVoxelFeatureResources();
+
+	// Transform the vertices of the objects that moved, once for all the passes below.
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled)
+		renderer->updateWorldVertices();
 
 	// Voxelize.
-	bool voxelizeNow = voxelizationQueued || (automaticallyVoxelize && voxelizationSparsity > 0 && ++ticksSinceLastVoxelization >= voxelizationSparsity);
-	if (voxelizeNow) {
-		voxelize(commandBuffer, renderingScene, true);
-		ticksSinceLastVoxelization = 0;
+	const bool timeSliced = isTimeSliced();
+	if (voxelizedTimeSliced && !timeSliced) {
+		// The dirty tracker kept following the objects, but the voxels are from the last complete cycle.
+		voxelizationQueued = true;
+	}
+	voxelizedTimeSliced = timeSliced;
+	// Nothing the voxels depend on changed since the last voxelization (e.g. paused animation).
+	// Multiple bounces still need a few cycles of light injection to settle after a change.
+	const uint64_t sceneHash = computeSceneHash(renderingScene);
+	if (voxelizationQueued || sceneHash != voxelizedSceneHash)
+		bounceFramesLeft = MULTI_BOUNCE_SETTLE_FRAMES;
+	const bool bouncesSettling = multiBounce && decoupledLightInjection && bounceFramesLeft > 0;
+	const bool sceneUnchanged = skipUnchangedVoxelization && !voxelizationQueued && sceneHash == voxelizedSceneHash;
+	if (useVoxelClipmap) {
+		// The cascades follow the camera, so they are updated every frame. The cost stays small since only
+		// the newly exposed slabs and the changed objects are voxelized.
+		voxelizeClipmap(commandBuffer, renderingScene);
+	}
+	else if (timeSliced && automaticallyVoxelize && !voxelizationQueued) {
+		voxelizeTimeSliced(commandBuffer, renderingScene, sceneHash);
+	}
+	else if (sceneUnchanged && bouncesSettling) {
+		// The voxel G-buffer is up to date, only the bounces are injected again.
+		injectLight(commandBuffer);
+		generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+	}
+	else if (sceneUnchanged) {
+		// The voxels are up to date, only a mip chain that was just enabled may be missing.
+		if (regenerateMipmapQueued)
+			generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+	}
+	else if (voxelizationQueued || automaticallyVoxelize) {
+		voxelize(commandBuffer, renderingScene, updateDirtyRegion(renderingScene), true);
+		voxelizedSceneHash = sceneHash;
+		// A queued voxelization must be complete right away, time slicing starts over after it.
+		voxelizationScheduler.restart();
 		voxelizationQueued = false;
 	}
+	else if (decoupledLightInjection) {
+		// Geometry didn't get re-rasterized, but the lights may have moved.
+		injectLight(commandBuffer);
+		generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+	}
 
 	// Render.
 	backbufferRenderPassDesc.colorAttachments[0].clearColor = MTLClearColorMake(0, 0, 0, 1);
@@ -113,16 +224,32 @@ void Graphics::renderScene(id<MTLCommandBuffer> commandBuffer,
 						   Scene & renderingScene,
 						   unsigned int viewportWidth, unsigned int viewportHeight)
 {
+	const bool upsampledIndirectDiffuse = (indirectDiffuseScale > 1 || temporalIndirectDiffuse) && globalConstants.indirectDiffuseLight;
+	if (upsampledIndirectDiffuse || deferredShading)
+		renderSceneGBuffer(commandBuffer, renderingScene, viewportWidth, viewportHeight);
+	if (upsampledIndirectDiffuse) {
+		updateIndirectDiffuseTargets(viewportWidth, viewportHeight);
+		traceIndirectDiffuse(commandBuffer);
+	}
+	else {
+		// The history would be stale by the next time.
+		lowHistoryValid = false;
+	}
+
 	// Start rendering encoding
 	auto encoder = [commandBuffer renderCommandEncoderWithDescriptor:backbufferRenderPassDesc];
 
 	// Fetch references.
-	Material * material = voxelConeTracingMaterial;
+	Material * material;
+	if (deferredShading)
+		material = upsampledIndirectDiffuse ? deferredLightingUpsampledMaterial : deferredLightingMaterial;
+	else
+		material = upsampledIndirectDiffuse ? voxelConeTracingUpsampledMaterial : voxelConeTracingMaterial;
 	material->activate(encoder);
 
 	// Graphics settings
 	[encoder setViewport:viewport(viewportWidth, viewportHeight)];
-	[encoder setDepthStencilState:depthEnabledState];
+	[encoder setDepthStencilState:deferredShading ? depthDisabledState : depthEnabledState];
 	[encoder setFrontFacingWinding:MTLWindingCounterClockwise];
 	[encoder setCullMode:MTLCullModeBack];
 
@@ -132,12 +259,181 @@ void Graphics::renderScene(id<MTLCommandBuffer> commandBuffer,
 	// Bind voxel texture
 	voxelTexture->activate(encoder, 2);
 
+	// Bind directional voxel textures. Always bound, like the cascades.
+	for (uint32_t i = 0; i < 6; ++i)
+		getAnisotropicTexture(i)->activate(encoder, 9 + i);
+	// The voxel texture stands in for the opacity volume while it is off, the shader doesn't sample it then.
+	(voxelOpacityTexture ? voxelOpacityTexture : voxelTexture)->activate(encoder, 15);
+
+	// Bind voxel clipmap cascades. Always bound (see getClipmapTexture), the shader decides which voxels to use.
+	VoxelClipmapLevelUniformData clipmapData[VOXEL_CLIPMAP_LEVELS];
+	for (uint32_t i = 0; i < VOXEL_CLIPMAP_LEVELS; ++i) {
+		getClipmapTexture(i)->activate(encoder, 5 + i);
+		clipmapData[i] = voxelClipmapLevelData(voxelClipmap->getLevel(i));
+	}
+	[encoder setFragmentBytes:clipmapData length:sizeof(clipmapData) atIndex:VOXEL_CLIPMAP_BINDING];
+
+	// Bind the low resolution indirect diffuse light and the samples it was traced at.
+	if (upsampledIndirectDiffuse) {
+		[encoder setFragmentTexture:temporalIndirectDiffuse ? lowHistoryTextures[lowCurrentIndex] : lowIndirectDiffuseTexture atIndex:16];
+		[encoder setFragmentTexture:lowGBufferTextures[lowCurrentIndex] atIndex:17];
+	}
+
 	// Render.
-	renderQueue(encoder, renderingScene.renderers);
+	if (deferredShading) {
+		// One fullscreen quad: each pixel is shaded once, whatever the overdraw of the scene.
+		sceneGBufferFbo->activateAsTexture(encoder, 18);
+		[encoder setFragmentBuffer:materialTableBuffer offset:0 atIndex:MATERIAL_TABLE_BINDING];
+		quadMeshRenderer->render(encoder);
+	}
+	else
+		renderQueue(encoder, renderingScene.renderers);
 
 	[encoder endEncoding];
 }
 
+void Graphics::renderSceneGBuffer(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene,
+								  unsigned int viewportWidth, unsigned int viewportHeight)
+{
+	if (!sceneGBufferFbo || sceneGBufferFbo->width != viewportWidth || sceneGBufferFbo->height != viewportHeight) {
+		if (sceneGBufferFbo) delete sceneGBufferFbo;
+		sceneGBufferFbo = new FBO(viewportWidth, viewportHeight, MTLPixelFormatRGBA32Float, MTLPixelFormatDepth32Float);
+	}
+
+	// Same rasterization as the cone tracing pass without multisampling.
+	auto renderEncoder = sceneGBufferFbo->beginRenderPass(commandBuffer);
+#ifdef DEBUG
+	renderEncoder.label = @"Screen G-buffer";
+#endif
+	sceneGBufferMaterial->activate(renderEncoder);
+	uploadGlobalConstants(renderEncoder);
+	[renderEncoder setFrontFacingWinding:MTLWindingCounterClockwise];
+	[renderEncoder setCullMode:MTLCullModeBack];
+	[renderEncoder setDepthStencilState:depthEnabledState];
+	[renderEncoder setViewport:viewport(sceneGBufferFbo->width, sceneGBufferFbo->height)];
+
+	// Each renderer writes the index of its material in the material table.
+	materialTable.clear();
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled) {
+		const uint32_t materialIndex = uint32_t(materialTable.size());
+		materialTable.push_back(renderer->materialSetting ? *renderer->materialSetting : MaterialSetting());
+		[renderEncoder setFragmentBytes:&materialIndex length:sizeof(materialIndex) atIndex:MATERIAL_INDEX_BINDING];
+		renderer->render(renderEncoder);
+	}
+	[renderEncoder endEncoding];
+
+	// The table only changes with the materials: a new buffer then, the frames in flight keep reading the old one.
+	if (materialTable.empty())
+		materialTable.emplace_back();
+	const size_t tableLength = materialTable.size() * sizeof(MaterialSetting);
+	if (materialTableBuffer == nil || materialTableBuffer.length != tableLength
+		|| memcmp(materialTableBuffer.contents, materialTable.data(), tableLength) != 0)
+		materialTableBuffer = [metalDevice newBufferWithBytes:materialTable.data() length:tableLength options:MTLResourceStorageModeShared];
+}
+
+void Graphics::initIndirectDiffuse()
+{
+	voxelConeTracingUpsampledMaterial = MaterialStore::getInstance().findMaterialWithName("voxel_cone_tracing_upsampled");
+	sceneGBufferMaterial = MaterialStore::getInstance().findMaterialWithName("scene_gbuffer");
+
+	deferredLightingMaterial = MaterialStore::getInstance().findMaterialWithName("voxel_cone_tracing_deferred");
+	deferredLightingUpsampledMaterial = MaterialStore::getInstance().findMaterialWithName("voxel_cone_tracing_deferred_upsampled");
+
+	assert(voxelConeTracingUpsampledMaterial != nullptr);
+	assert(sceneGBufferMaterial != nullptr);
+	assert(deferredLightingMaterial != nullptr);
+	assert(deferredLightingUpsampledMaterial != nullptr);
+
+	auto coneTracingLibrary = computePipelineCache.getLibrary("Shaders/VoxelConeTracing/voxel_cone_tracing");
+	traceIndirectDiffusePipelineState = computePipelineCache.getComputeShader("voxel_traceIndirectDiffuse", coneTracingLibrary, "traceIndirectDiffuse");
+	accumulateIndirectDiffusePipelineState = computePipelineCache.getComputeShader("voxel_accumulateIndirectDiffuse", coneTracingLibrary, "accumulateIndirectDiffuse");
+}
+
+void Graphics::updateIndirectDiffuseTargets(unsigned int viewportWidth, unsigned int viewportHeight)
+{
+	// One texel per block of pixels, the last blocks may be partial.
+	const NSUInteger lowWidth = (viewportWidth + indirectDiffuseScale - 1) / indirectDiffuseScale;
+	const NSUInteger lowHeight = (viewportHeight + indirectDiffuseScale - 1) / indirectDiffuseScale;
+	if (lowIndirectDiffuseTexture && lowIndirectDiffuseTexture.width == lowWidth && lowIndirectDiffuseTexture.height == lowHeight
+		&& lowIndirectDiffuseScale == indirectDiffuseScale)
+		return;
+
+	MTLTextureDescriptor *texDesc = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA16Float
+																					 width:lowWidth
+																					height:lowHeight
+																				 mipmapped:NO];
+	texDesc.storageMode = MTLStorageModePrivate;
+	texDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+	for (uint32_t i = 0; i < 2; ++i) {
+		lowGBufferTextures[i] = [metalDevice newTextureWithDescriptor:texDesc];
+		lowHistoryTextures[i] = [metalDevice newTextureWithDescriptor:texDesc];
+	}
+	lowIndirectDiffuseTexture = [metalDevice newTextureWithDescriptor:texDesc];
+	texDesc.pixelFormat = MTLPixelFormatRGBA32Float;
+	lowPositionTexture = [metalDevice newTextureWithDescriptor:texDesc];
+	lowIndirectDiffuseScale = indirectDiffuseScale;
+	lowHistoryValid = false;
+}
+
+void Graphics::traceIndirectDiffuse(id<MTLCommandBuffer> commandBuffer)
+{
+	// Diffuse cones of each block of pixels.
+	auto computeEncoder = [commandBuffer computeCommandEncoder];
+#ifdef DEBUG
+	computeEncoder.label = @"Low resolution indirect diffuse";
+#endif
+	[computeEncoder setComputePipelineState:traceIndirectDiffusePipelineState];
+	[computeEncoder setBytes:&globalConstants length:sizeof(globalConstants) atIndex:APPSTATE_BINDING];
+	voxelTexture->activate(computeEncoder, 2);
+	for (uint32_t i = 0; i < 6; ++i)
+		getAnisotropicTexture(i)->activate(computeEncoder, 9 + i);
+	VoxelClipmapLevelUniformData clipmapData[VOXEL_CLIPMAP_LEVELS];
+	for (uint32_t i = 0; i < VOXEL_CLIPMAP_LEVELS; ++i) {
+		getClipmapTexture(i)->activate(computeEncoder, 5 + i);
+		clipmapData[i] = voxelClipmapLevelData(voxelClipmap->getLevel(i));
+	}
+	[computeEncoder setBytes:clipmapData length:sizeof(clipmapData) atIndex:VOXEL_CLIPMAP_BINDING];
+	// This frame writes the targets the previous one read.
+	lowCurrentIndex = 1 - lowCurrentIndex;
+	[computeEncoder setTexture:sceneGBufferFbo->getColorTexture() atIndex:16];
+	[computeEncoder setTexture:lowGBufferTextures[lowCurrentIndex] atIndex:17];
+	[computeEncoder setTexture:lowIndirectDiffuseTexture atIndex:18];
+	[computeEncoder setTexture:lowPositionTexture atIndex:19];
+
+	const glm::mat4 viewProjection = globalConstants.P * globalConstants.V;
+	IndirectDiffuseUniformData params = {
+		glm::inverse(viewProjection),
+		previousViewProjection,
+		{ previousCameraPosition.x, previousCameraPosition.y, previousCameraPosition.z, 1.0f },
+		{ temporalIndirectDiffuse, indirectDiffuseFrame, lowHistoryValid, 0 }
+	};
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:COMPUTE_PARAM_START_IDX];
+
+	const MTLSize threadsPerThreadgroup = MTLSizeMake(8, 8, 1);
+	const MTLSize groups = MTLSizeMake((lowIndirectDiffuseTexture.width + threadsPerThreadgroup.width - 1) / threadsPerThreadgroup.width,
+									   (lowIndirectDiffuseTexture.height + threadsPerThreadgroup.height - 1) / threadsPerThreadgroup.height,
+									   1);
+	[computeEncoder dispatchThreadgroups:groups threadsPerThreadgroup:threadsPerThreadgroup];
+
+	if (temporalIndirectDiffuse) {
+		// Blend this frame's cone patterns into the reprojected history.
+		[computeEncoder setComputePipelineState:accumulateIndirectDiffusePipelineState];
+		[computeEncoder setTexture:lowGBufferTextures[lowCurrentIndex] atIndex:16];
+		[computeEncoder setTexture:lowPositionTexture atIndex:17];
+		[computeEncoder setTexture:lowIndirectDiffuseTexture atIndex:18];
+		[computeEncoder setTexture:lowGBufferTextures[1 - lowCurrentIndex] atIndex:19];
+		[computeEncoder setTexture:lowHistoryTextures[1 - lowCurrentIndex] atIndex:20];
+		[computeEncoder setTexture:lowHistoryTextures[lowCurrentIndex] atIndex:21];
+		[computeEncoder dispatchThreadgroups:groups threadsPerThreadgroup:threadsPerThreadgroup];
+
+		++indirectDiffuseFrame;
+		previousViewProjection = viewProjection;
+		previousCameraPosition = globalConstants.cameraPosition;
+	}
+	lowHistoryValid = temporalIndirectDiffuse;
+	[computeEncoder endEncoding];
+}
+
 void Graphics::updateGlobalConstants(Scene &renderingScene)
 {
 	// Debug state
@@ -155,6 +451,11 @@ void Graphics::updateGlobalConstants(Scene &renderingScene)
 
 	// Texture info
 	globalConstants.voxelTextureSize = voxelTextureSize;
+	globalConstants.voxelClipmap = useVoxelClipmap;
+	globalConstants.anisotropicVoxels = anisotropicVoxels;
+	globalConstants.opacityVolume = separateOpacityVolume;
+	globalConstants.voxelBufferLayout = uint32_t(voxelBufferLayout);
+	globalConstants.indirectDiffuseScale = indirectDiffuseScale;
 }
 
 void Graphics::uploadGlobalConstants(id<MTLRenderCommandEncoder> encoder) const
@@ -163,16 +464,26 @@ void Graphics::uploadGlobalConstants(id<MTLRenderCommandEncoder> encoder) const
 	[encoder setFragmentBytes:&globalConstants length:sizeof(globalConstants) atIndex:APPSTATE_BINDING];
 }
 
-void Graphics::renderQueue(id<MTLRenderCommandEncoder> encoder, const RenderingQueue &renderingQueue) const
+void Graphics::updateTransforms()
 {
-	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled)
-		renderingQueue[i]->transform.updateTransformMatrix();
+	// The renderers write their transforms to the store directly, only the ones that changed are recomputed.
+	TransformStore::getInstance().update();
+}
 
+void Graphics::renderQueue(id<MTLRenderCommandEncoder> encoder, const RenderingQueue &renderingQueue) const
+{
 	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled) {
 		renderingQueue[i]->render(encoder);
 	}
 }
 
+void Graphics::renderVoxelizationPass(id<MTLRenderCommandEncoder> encoder, const RenderingQueue &renderingQueue, uint32_t axis) const
+{
+	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled) {
+		renderingQueue[i]->renderVoxelizationPass(encoder, axis);
+	}
+}
+
 void Graphics::genDominantAxisList(id<MTLComputeCommandEncoder> encoder, const RenderingQueue &renderingQueue) const
 {
 	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled) {
@@ -189,13 +500,35 @@ void Graphics::initVoxelization()
 
 	assert(voxelizationMaterial != nullptr);
 
+	initVoxelGBuffer();
+	initVoxelClipmap();
+
+	initVoxelResources();
+}
+
+void Graphics::initVoxelResources()
+{
+	const NSUInteger atomicBufferLength = 4 * NSUInteger(voxelTextureSize) * voxelTextureSize * voxelTextureSize;
+
 	// Voxel texture
 	voxelTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize);
 
+	// Voxel clipmap. The first cascade covers the same [-1, 1] extent as the voxel texture.
+	voxelClipmap = new VoxelClipmap(VOXEL_CLIPMAP_LEVELS, voxelTextureSize, 1.0f);
+
+	// Brick residency of the voxel texture, starts over with the new texture.
+	voxelBricks = new BrickPagedVolume(voxelTextureSize, false);
+	voxelBricksValid = false;
+
+	// Brick occupancy of the voxel texture, valid after the next full voxelization.
+	voxelOccupancyBuffer = [metalDevice newBufferWithLength:VoxelBrickOccupancy(voxelTextureSize).getMemoryUsage()
+													options:MTLResourceStorageModePrivate];
+	voxelOccupancyValid = false;
+
 	// Voxel atomic buffer is needed if raster order group is not supported
 	if (singlePassVoxelization)
 	{
-		voxelAtomicBuffer = [metalDevice newBufferWithLength: 4 * voxelTextureSize * voxelTextureSize * voxelTextureSize
+		voxelAtomicBuffer = [metalDevice newBufferWithLength:atomicBufferLength
 													 options:MTLResourceStorageModePrivate];
 	}
 
@@ -209,7 +542,388 @@ void Graphics::initVoxelization()
 								   VOXEL_RENDER_TARGET_SAMPLES);
 }
 
-id<MTLRenderCommandEncoder> Graphics::setupVoxelWritingPass(id<MTLCommandBuffer> commandBuffer)
+void Graphics::releaseVoxelResources()
+{
+	// Command buffers still in flight keep their own references to the Metal objects.
+	delete voxelTexture;
+	delete voxelBackTexture;
+	voxelBackTexture = nullptr;
+	for (auto & texture : voxelAnisotropicTextures) { delete texture; texture = nullptr; }
+	delete voxelOpacityTexture;
+	voxelOpacityTexture = nullptr;
+	delete voxelAlbedoTexture;
+	delete voxelNormalTexture;
+	delete voxelEmissiveTexture;
+	delete voxelBounceTexture;
+	voxelBounceTexture = nullptr;
+	for (auto * texture : voxelClipmapTextures) delete texture;
+	delete voxelClipmap;
+	delete voxelBricks;
+	delete dummyVoxelizationFbo;
+	voxelTexture = voxelAlbedoTexture = voxelNormalTexture = voxelEmissiveTexture = nullptr;
+	voxelClipmapTextures.clear();
+	voxelClipmap = nullptr;
+	voxelBricks = nullptr;
+	dummyVoxelizationFbo = nullptr;
+	voxelAtomicBuffer = voxelNormalAtomicBuffer = voxelEmissiveAtomicBuffer = nil;
+	voxelOccupancyBuffer = nil;
+	voxelOccupiedMaskBuffer = voxelOccupiedListBuffer = nil;
+}
+
+void Graphics::updateVoxelFeatureResources()
+{
+	const NSUInteger atomicBufferLength = 4 * NSUInteger(voxelTextureSize) * voxelTextureSize * voxelTextureSize;
+
+	// Voxel G-buffer. Material data only needs the first level. Radiance mips are still generated from voxelTexture.
+	if (decoupledLightInjection && voxelAlbedoTexture == nullptr) {
+		voxelAlbedoTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize, 1);
+		voxelNormalTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize, 1);
+		voxelEmissiveTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize, 1);
+		if (singlePassVoxelization) {
+			// Voxel G-buffer albedo shares voxelAtomicBuffer with the regular voxelization.
+			voxelNormalAtomicBuffer = [metalDevice newBufferWithLength:atomicBufferLength
+															   options:MTLResourceStorageModePrivate];
+			voxelEmissiveAtomicBuffer = [metalDevice newBufferWithLength:atomicBufferLength
+																 options:MTLResourceStorageModePrivate];
+		}
+		voxelOccupiedMaskBuffer = [metalDevice newBufferWithLength:atomicBufferLength / 32
+														   options:MTLResourceStorageModePrivate];
+		voxelOccupiedListBuffer = [metalDevice newBufferWithLength:atomicBufferLength + 4 * VOXEL_OCCUPIED_LIST_HEADER
+														   options:MTLResourceStorageModePrivate];
+		voxelOccupiedListCleared = false;
+		// Empty until the next voxelization.
+		voxelizationQueued = true;
+	}
+	else if (!decoupledLightInjection && voxelAlbedoTexture != nullptr) {
+		// Command buffers still in flight keep their own references to the Metal objects.
+		delete voxelAlbedoTexture;
+		delete voxelNormalTexture;
+		delete voxelEmissiveTexture;
+		voxelAlbedoTexture = voxelNormalTexture = voxelEmissiveTexture = nullptr;
+		voxelNormalAtomicBuffer = voxelEmissiveAtomicBuffer = nil;
+		voxelOccupiedMaskBuffer = voxelOccupiedListBuffer = nil;
+	}
+
+	// Multi-bounce light, needs the voxel G-buffer.
+	const bool bounce = multiBounce && decoupledLightInjection;
+	if (bounce && voxelBounceTexture == nullptr) {
+		voxelBounceTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize, 1);
+		voxelBounceTextureCleared = false;
+	}
+	else if (!bounce && voxelBounceTexture != nullptr) {
+		delete voxelBounceTexture;
+		voxelBounceTexture = nullptr;
+	}
+
+	// Back voxel texture of time sliced voxelization.
+	if (isTimeSliced() && voxelBackTexture == nullptr) {
+		voxelBackTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize);
+		// A cycle can only target the new texture from its start.
+		voxelizationScheduler.restart();
+	}
+	else if (!isTimeSliced() && voxelBackTexture != nullptr) {
+		delete voxelBackTexture;
+		voxelBackTexture = nullptr;
+	}
+
+	// Directional voxel textures start at the second level of the voxel texture.
+	if (anisotropicVoxels && voxelAnisotropicTextures[0] == nullptr) {
+		for (auto & texture : voxelAnisotropicTextures)
+			texture = new Texture3D(voxelTextureSize / 2, voxelTextureSize / 2, voxelTextureSize / 2, 6);
+		voxelAnisotropicTexturesValid = false;
+		regenerateMipmapQueued = true;
+	}
+	else if (!anisotropicVoxels && voxelAnisotropicTextures[0] != nullptr) {
+		for (auto & texture : voxelAnisotropicTextures) { delete texture; texture = nullptr; }
+	}
+
+	// Opacity volume for the shadow cones.
+	if (separateOpacityVolume && voxelOpacityTexture == nullptr) {
+		voxelOpacityTexture = new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize, 0, MTLPixelFormatR8Unorm);
+		voxelOpacityTextureValid = false;
+		regenerateMipmapQueued = true;
+	}
+	else if (!separateOpacityVolume && voxelOpacityTexture != nullptr) {
+		delete voxelOpacityTexture;
+		voxelOpacityTexture = nullptr;
+	}
+
+	// Voxel clipmap cascades.
+	if (useVoxelClipmap && voxelClipmapTextures.empty()) {
+		for (uint32_t i = 0; i < VOXEL_CLIPMAP_LEVELS; ++i)
+			voxelClipmapTextures.push_back(new Texture3D(voxelTextureSize, voxelTextureSize, voxelTextureSize));
+		// Invalidates every cascade.
+		voxelizationQueued = true;
+	}
+	else if (!useVoxelClipmap && !voxelClipmapTextures.empty()) {
+		for (auto * texture : voxelClipmapTextures) delete texture;
+		voxelClipmapTextures.clear();
+	}
+}
+
+void Graphics::setVoxelTextureSize(uint32_t size)
+{
+	assert(size >= MIN_VOXEL_TEXTURE_SIZE && size <= MAX_VOXEL_TEXTURE_SIZE && (size & (size - 1)) == 0);
+	if (size == voxelTextureSize)
+		return;
+
+	releaseVoxelResources();
+	voxelTextureSize = size;
+	initVoxelResources();
+
+	// Everything must be voxelized again at the new resolution.
+	voxelizationQueued = true;
+	regenerateMipmapQueued = true;
+}
+
+size_t Graphics::getVoxelMemoryUsage(uint32_t size) const
+{
+	const size_t texelBytes = 4 * size_t(size) * size * size;
+
+	// Texture3D mip chains are capped to 7 levels.
+	size_t mipChainBytes = 0;
+	for (uint32_t level = 0; level < 7 && (size >> level) > 0; ++level)
+		mipChainBytes += texelBytes >> (3 * level);
+
+	size_t bytes = mipChainBytes;							// voxel texture
+	if (isTimeSliced())
+		bytes += mipChainBytes;								// back texture of time sliced voxelization
+	if (anisotropicVoxels)
+		bytes += 6 * (mipChainBytes - texelBytes);			// directional voxel textures
+	if (separateOpacityVolume)
+		bytes += mipChainBytes / 4;							// R8 opacity volume
+	if (multiBounce && decoupledLightInjection)
+		bytes += texelBytes;								// multi-bounce light
+	if (useVoxelClipmap)
+		bytes += VOXEL_CLIPMAP_LEVELS * mipChainBytes;		// clipmap cascades
+	if (singlePassVoxelization)
+		bytes += texelBytes;								// atomic buffer
+	if (decoupledLightInjection) {
+		bytes += (singlePassVoxelization ? 5 : 3) * texelBytes; // voxel G-buffer, and its normal and emissive atomic buffers
+		bytes += texelBytes + texelBytes / 32;				// occupied voxel list and its mask
+	}
+	bytes += VoxelBrickOccupancy(size).getMemoryUsage();	// brick occupancy
+	bytes += 4 * size_t(size) * size * VOXEL_RENDER_TARGET_SAMPLES; // dummy render target
+	return bytes;
+}
+
+uint32_t Graphics::pickVoxelTextureSize(size_t memoryBudget) const
+{
+	uint32_t size = MAX_VOXEL_TEXTURE_SIZE;
+	while (size > MIN_VOXEL_TEXTURE_SIZE && getVoxelMemoryUsage(size) > memoryBudget)
+		size /= 2;
+	return size;
+}
+
+void Graphics::initVoxelGBuffer()
+{
+	voxelizationGBufferMaterial = MaterialStore::getInstance().findMaterialWithName("voxelization_gbuffer");
+
+	assert(voxelizationGBufferMaterial != nullptr);
+
+	auto library = computePipelineCache.getLibrary("Shaders/Voxelization/voxel_compute_kernels");
+	injectLightPipelineState = computePipelineCache.getComputeShader("voxel_injectLight", library, "injectLight");
+	prepareInjectLightPipelineState = computePipelineCache.getComputeShader("voxel_prepareInjectLight", library, "prepareInjectLight");
+
+	auto coneTracingLibrary = computePipelineCache.getLibrary("Shaders/VoxelConeTracing/voxel_cone_tracing");
+	injectBouncePipelineState = computePipelineCache.getComputeShader("voxel_injectBounce", coneTracingLibrary, "injectBounce");
+}
+
+void Graphics::initVoxelClipmap()
+{
+	voxelizationClipmapMaterial = MaterialStore::getInstance().findMaterialWithName("voxelization_clipmap");
+
+	assert(voxelizationClipmapMaterial != nullptr);
+}
+
+Texture3D * Graphics::getAnisotropicTexture(uint32_t face) const
+{
+	return voxelAnisotropicTextures[face] ? voxelAnisotropicTextures[face] : voxelTexture;
+}
+
+Texture3D * Graphics::getClipmapTexture(uint32_t level) const
+{
+	return voxelClipmapTextures.empty() ? voxelTexture : voxelClipmapTextures[level];
+}
+
+void Graphics::voxelizeClipmap(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene)
+{
+	// Changed objects are tracked the same way as for partial re-voxelization, but in world space.
+	updateDirtyRegion(renderingScene);
+	if (voxelizationQueued || !partialVoxelization || dirtyTracker.pointLightsChanged())
+	{
+		// Lit voxels depend on the lights everywhere.
+		voxelClipmap->invalidate();
+	}
+	voxelizationQueued = false;
+	voxelClipmap->update(renderingScene.renderingCamera->position, dirtyTracker.getDirtyWorldBounds());
+
+	auto computeEncoder = [commandBuffer computeCommandEncoder];
+	genDominantAxisList(computeEncoder, renderingScene.renderers);
+	[computeEncoder endEncoding];
+
+	for (uint32_t level = 0; level < VOXEL_CLIPMAP_LEVELS; ++level)
+	{
+		const auto & regions = voxelClipmap->getUpdateRegions(level);
+		if (regions.empty())
+			continue;
+
+		// Clear then voxelize each region. A later region overlapping an earlier one clears and rewrites
+		// the overlap entirely, so the result is still right.
+		Texture3D * texture = voxelClipmapTextures[level];
+		for (auto & region : regions)
+		{
+			computeEncoder = [commandBuffer computeCommandEncoder];
+			float clearColor[4] = { 0, 0, 0, 0 };
+			for (auto & texels : voxelClipmap->toroidalRegions(level, region))
+				texture->clear(computeEncoder, clearColor, texels);
+			[computeEncoder endEncoding];
+
+			voxelizeClipmapRegion(commandBuffer, renderingScene, level, region);
+		}
+
+		computeEncoder = [commandBuffer computeCommandEncoder];
+		for (auto & region : regions)
+			for (auto & texels : voxelClipmap->toroidalRegions(level, region))
+				texture->generateMips(computeEncoder, texels);
+		[computeEncoder endEncoding];
+	}
+}
+
+void Graphics::voxelizeClipmapRegion(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, uint32_t level, const VoxelRegion & region)
+{
+	const VoxelClipmapLevelUniformData levelData = voxelClipmapLevelData(voxelClipmap->getLevel(level));
+
+	// Same as voxelizeMultiPass, the region is in window voxels so the scissor still applies.
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		auto renderEncoder = setupVoxelWritingPass(commandBuffer, voxelizationClipmapMaterial, region);
+#ifdef DEBUG
+		renderEncoder.label = [NSString stringWithFormat:@"Voxel clipmap %u writing pass %u", level, i];
+#endif
+		[renderEncoder setViewport:viewport(voxelTextureSize, voxelTextureSize)];
+		[renderEncoder setScissorRect:voxelRegionScissor(region, i, voxelTextureSize)];
+		[renderEncoder setVertexBytes:&levelData length:sizeof(levelData) atIndex:VOXEL_CLIPMAP_BINDING];
+		[renderEncoder setFragmentBytes:&levelData length:sizeof(levelData) atIndex:VOXEL_CLIPMAP_BINDING];
+
+		voxelClipmapTextures[level]->activate(renderEncoder, 2);
+
+		renderVoxelizationPass(renderEncoder, renderingScene.renderers, i);
+
+		[renderEncoder endEncoding];
+	}
+}
+
+void Graphics::clearOccupiedVoxelList(id<MTLBlitCommandEncoder> blitEncoder)
+{
+	[blitEncoder fillBuffer:voxelOccupiedMaskBuffer range:NSMakeRange(0, voxelOccupiedMaskBuffer.length) value:0];
+	[blitEncoder fillBuffer:voxelOccupiedListBuffer range:NSMakeRange(0, 4 * VOXEL_OCCUPIED_LIST_HEADER) value:0];
+	voxelOccupiedListCleared = true;
+}
+
+void Graphics::injectLight(id<MTLCommandBuffer> commandBuffer)
+{
+	if (multiBounce && bounceFramesLeft > 0) {
+		// Traced from the mips of the previous injection, so every cycle over the subsets adds a bounce.
+		injectBounce(commandBuffer);
+		--bounceFramesLeft;
+	}
+
+	if (!voxelOccupiedListCleared) {
+		// No voxelization wrote the G-buffer yet.
+		auto blitEncoder = [commandBuffer blitCommandEncoder];
+		clearOccupiedVoxelList(blitEncoder);
+		[blitEncoder endEncoding];
+	}
+
+	auto computeEncoder = [commandBuffer computeCommandEncoder];
+#ifdef DEBUG
+	computeEncoder.label = @"Voxel light injection";
+#endif
+	// The voxel count of the list is only known on the GPU, the dispatch size is written there too.
+	[computeEncoder setBuffer:voxelOccupiedListBuffer offset:0 atIndex:VOXEL_OCCUPIED_LIST_BINDING];
+	[computeEncoder setComputePipelineState:prepareInjectLightPipelineState];
+	[computeEncoder dispatchThreadgroups:MTLSizeMake(1, 1, 1) threadsPerThreadgroup:MTLSizeMake(1, 1, 1)];
+
+	[computeEncoder setComputePipelineState:injectLightPipelineState];
+	[computeEncoder setBytes:&globalConstants length:sizeof(globalConstants) atIndex:APPSTATE_BINDING];
+	voxelAlbedoTexture->activate(computeEncoder, 0);
+	voxelNormalTexture->activate(computeEncoder, 1);
+	voxelEmissiveTexture->activate(computeEncoder, 2);
+	voxelTexture->activate(computeEncoder, 3);
+	// The albedo stands in for the bounce light while multi-bounce is off, the kernel doesn't read it then.
+	(voxelBounceTexture ? voxelBounceTexture : voxelAlbedoTexture)->activate(computeEncoder, 4);
+	InjectLightUniformData params = { voxelBounceTexture != nullptr && voxelBounceTextureCleared };
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:COMPUTE_PARAM_START_IDX];
+
+	[computeEncoder dispatchThreadgroupsWithIndirectBuffer:voxelOccupiedListBuffer
+									  indirectBufferOffset:sizeof(uint32_t)
+									 threadsPerThreadgroup:MTLSizeMake(INJECT_LIGHT_THREADGROUP_SIZE, 1, 1)];
+	[computeEncoder endEncoding];
+}
+
+void Graphics::injectBounce(id<MTLCommandBuffer> commandBuffer)
+{
+	auto computeEncoder = [commandBuffer computeCommandEncoder];
+#ifdef DEBUG
+	computeEncoder.label = @"Voxel bounce injection";
+#endif
+	if (!voxelBounceTextureCleared) {
+		// Voxels that were not traced yet must not add anything.
+		float clearColor[4] = { 0, 0, 0, 0 };
+		voxelBounceTexture->clear(computeEncoder, clearColor, 0);
+		voxelBounceTextureCleared = true;
+	}
+
+	[computeEncoder setComputePipelineState:injectBouncePipelineState];
+	[computeEncoder setBytes:&globalConstants length:sizeof(globalConstants) atIndex:APPSTATE_BINDING];
+	voxelTexture->activate(computeEncoder, 2);
+	for (uint32_t i = 0; i < 6; ++i)
+		getAnisotropicTexture(i)->activate(computeEncoder, 9 + i);
+	VoxelClipmapLevelUniformData clipmapData[VOXEL_CLIPMAP_LEVELS];
+	for (uint32_t i = 0; i < VOXEL_CLIPMAP_LEVELS; ++i) {
+		getClipmapTexture(i)->activate(computeEncoder, 5 + i);
+		clipmapData[i] = voxelClipmapLevelData(voxelClipmap->getLevel(i));
+	}
+	[computeEncoder setBytes:clipmapData length:sizeof(clipmapData) atIndex:VOXEL_CLIPMAP_BINDING];
+	voxelAlbedoTexture->activate(computeEncoder, 16);
+	voxelNormalTexture->activate(computeEncoder, 17);
+	voxelBounceTexture->activate(computeEncoder, 18);
+
+	BounceUniformData params = { { bounceSubset & 1, (bounceSubset >> 1) & 1, bounceSubset >> 2, 0 } };
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:COMPUTE_PARAM_START_IDX];
+	voxelBounceTexture->dispatchFirstLevel(computeEncoder, injectBouncePipelineState, 2);
+	[computeEncoder endEncoding];
+
+	bounceSubset = (bounceSubset + 1) % 8;
+}
+
+VoxelRegion Graphics::updateDirtyRegion(Scene & renderingScene)
+{
+	// Always keep the tracker up to date, so that switching partial voxelization on starts from the right state.
+	dirtyTracker.beginFrame(voxelTextureSize);
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled) {
+		dirtyTracker.addObject(renderer,
+							   renderer->transform.getTransformMatrix(),
+							   renderer->localBoundsMin,
+							   renderer->localBoundsMax,
+							   renderer->materialSetting ? *renderer->materialSetting : MaterialSetting());
+	}
+	dirtyTracker.setPointLights(renderingScene.pointLights);
+	VoxelRegion region = dirtyTracker.endFrame();
+
+	const VoxelRegion fullRegion = VoxelRegion::full(voxelTextureSize);
+	if (!partialVoxelization || singlePassVoxelization || voxelizationQueued)
+		return fullRegion;
+
+	// Lit voxels depend on the lights everywhere. The voxel G-buffer doesn't.
+	if (!decoupledLightInjection && dirtyTracker.pointLightsChanged())
+		return fullRegion;
+
+	return region;
+}
+
+id<MTLRenderCommandEncoder> Graphics::setupVoxelWritingPass(id<MTLCommandBuffer> commandBuffer, Material * material, const VoxelRegion & region)
 {
 	// Activate the dummy framebuffer. We won't store color in it. Just
 	// use it to make use of rasterizer stage.
@@ -217,7 +931,6 @@ id<MTLRenderCommandEncoder> Graphics::setupVoxelWritingPass(id<MTLCommandBuffer>
 															   MTLLoadActionDontCare,
 															   false, false, 1);
 
-	Material * material = voxelizationMaterial;
 	material->activate(renderEncoder);
 
 	// Settings.
@@ -225,27 +938,181 @@ id<MTLRenderCommandEncoder> Graphics::setupVoxelWritingPass(id<MTLCommandBuffer>
 	[renderEncoder setCullMode:MTLCullModeNone];
 	[renderEncoder setDepthStencilState:depthDisabledState];
 
+	VoxelRegionUniformData regionData = {
+		{ uint32_t(region.min.x), uint32_t(region.min.y), uint32_t(region.min.z), 0 },
+		{ uint32_t(region.max.x), uint32_t(region.max.y), uint32_t(region.max.z), 0 }
+	};
+	[renderEncoder setFragmentBytes:&regionData length:sizeof(regionData) atIndex:VOXEL_REGION_BINDING];
+	[renderEncoder setFragmentBuffer:voxelOccupancyBuffer offset:0 atIndex:VOXEL_OCCUPANCY_BINDING];
+
 	return renderEncoder;
 }
 
 void Graphics::voxelize(id<MTLCommandBuffer> commandBuffer,
-						Scene & renderingScene, bool clearVoxelization)
+						Scene & renderingScene, const VoxelRegion & region, bool clearVoxelization)
 {
-	if (singlePassVoxelization)
+	if (region.empty() && !decoupledLightInjection && !regenerateMipmapQueued)
 	{
-		voxelizeSinglePass(commandBuffer, renderingScene, clearVoxelization);
+		// Nothing changed since the last voxelization.
+		return;
+	}
+
+	// Brick residency starts being used at the second voxelization that tracks it: the bricks of the previous
+	// one must be known to clear what moved out of them.
+	const bool trackBricks = residentBricksOnly && !singlePassVoxelization && !decoupledLightInjection;
+	if (trackBricks)
+		updateVoxelBricks(renderingScene);
+	std::vector<glm::ivec3> bricks;
+	if (trackBricks && voxelBricksValid)
+		bricks = getUpdatedBricks(regenerateMipmapQueued ? VoxelRegion::full(voxelTextureSize) : region);
+	const std::vector<glm::ivec3> * updatedBricks = trackBricks && voxelBricksValid ? &bricks : nullptr;
+	voxelBricksValid = trackBricks;
+
+	// Objects far apart don't make the space between them dirty: only the bricks of their old and new bounds are
+	// cleared and mipped, so a small moving object costs its own size. The other paths rewrite the whole volume.
+	const bool fullRegion = region.volume() == size_t(voxelTextureSize) * voxelTextureSize * voxelTextureSize;
+	if (!updatedBricks && !fullRegion && !region.empty() && !singlePassVoxelization && !decoupledLightInjection &&
+		!regenerateMipmapQueued)
+	{
+		bricks = dirtyTracker.getDirtyBricks();
+		updatedBricks = &bricks;
+	}
+
+	if (clearVoxelization && fullRegion)
+	{
+		// Everything is voxelized again, from an empty texture.
+		auto blitEncoder = [commandBuffer blitCommandEncoder];
+		[blitEncoder fillBuffer:voxelOccupancyBuffer range:NSMakeRange(0, voxelOccupancyBuffer.length) value:0];
+		if (decoupledLightInjection)
+			clearOccupiedVoxelList(blitEncoder);
+		[blitEncoder endEncoding];
+		voxelOccupancyValid = true;
+	}
+
+	if (region.empty())
+	{
+		// Nothing to rasterize.
+	}
+	else if (singlePassVoxelization)
+	{
+		voxelizeSinglePass(commandBuffer, renderingScene, clearVoxelization, decoupledLightInjection);
+	}
+	else
+	{
+		voxelizeMultiPass(commandBuffer, renderingScene.renderers, region, clearVoxelization, decoupledLightInjection, updatedBricks);
+	}
+
+	if (decoupledLightInjection)
+	{
+		// Injection relights every voxel, so every mip must be updated.
+		injectLight(commandBuffer);
+		generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
 	}
 	else
 	{
-		voxelizeMultiPass(commandBuffer, renderingScene, clearVoxelization);
+		generateVoxelMips(commandBuffer, regenerateMipmapQueued ? VoxelRegion::full(voxelTextureSize) : region, updatedBricks);
 	}
+}
 
-	// Mipmap generation
+void Graphics::voxelizeTimeSliced(id<MTLCommandBuffer> commandBuffer, Scene & renderingScene, uint64_t sceneHash)
+{
+	if (!voxelizationScheduler.isCycleActive()) {
+		if (skipUnchangedVoxelization && sceneHash == voxelizedSceneHash) {
+			// The last complete cycle started from the same scene, no need for another one.
+			if (regenerateMipmapQueued)
+				generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+			return;
+		}
+		timeSlicedCycleHash = sceneHash;
+	}
+
+	// Keeps the object bounds up to date, to skip the objects outside of the slab.
+	updateDirtyRegion(renderingScene);
+	// The bricks tracked by the previous voxelization and the brick occupancy don't match the voxels anymore.
+	voxelBricksValid = false;
+	voxelOccupancyValid = false;
+
+	RenderingQueue renderers;
+	std::vector<size_t> triangles;
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled) {
+		renderers.push_back(renderer);
+		triangles.push_back(renderer->mesh->indices.size() / 3);
+	}
+	const auto mode = voxelizationSlicing;
+	const auto slice = voxelizationScheduler.nextSlice(mode, voxelizationFrameBudget, voxelTextureSize, triangles);
+	const RenderingQueue sliceRenderers(renderers.begin() + slice.firstObject,
+										renderers.begin() + slice.firstObject + slice.objectCount);
+
+	// The slice gets its own command buffer to measure its GPU time. Being committed first, it runs before the frame.
+	id<MTLCommandBuffer> sliceCommandBuffer = [commandBuffer.commandQueue commandBuffer];
+	std::swap(voxelTexture, voxelBackTexture);
+	voxelizeMultiPass(sliceCommandBuffer, sliceRenderers, slice.region, slice.clear, false);
+	std::swap(voxelTexture, voxelBackTexture);
+
+	if (@available(macOS 10.15, iOS 10.3, *)) {
+		VoxelizationScheduler * scheduler = &voxelizationScheduler;
+		const double work = slice.work;
+		[sliceCommandBuffer addCompletedHandler:^(id<MTLCommandBuffer> buffer) {
+			scheduler->reportSliceTime(mode, work, 1000.0 * (buffer.GPUEndTime - buffer.GPUStartTime));
+		}];
+	}
+	[sliceCommandBuffer commit];
+
+	if (slice.last) {
+		// The back texture is complete, it becomes the sampled one. Changes made during the cycle may be
+		// missing from it, so it only matches the scene at the start of the cycle.
+		std::swap(voxelTexture, voxelBackTexture);
+		voxelizedSceneHash = timeSlicedCycleHash;
+		generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+	}
+	else if (regenerateMipmapQueued) {
+		generateVoxelMips(commandBuffer, VoxelRegion::full(voxelTextureSize));
+	}
+}
+
+uint64_t Graphics::computeSceneHash(Scene & renderingScene) const
+{
+	VoxelSceneHash hash;
+	hash.add(voxelTextureSize);
+	hash.add(uint32_t(decoupledLightInjection));
+	hash.add(uint32_t(multiBounce));
+	// World matrices, up to date since updateTransforms ran earlier in the frame.
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled)
+		hash.addObject(renderer, renderer->transform.getTransformMatrix(), renderer->materialSetting ? *renderer->materialSetting : MaterialSetting());
+	hash.addPointLights(renderingScene.pointLights);
+	return hash.get();
+}
+
+void Graphics::updateVoxelBricks(Scene & renderingScene)
+{
+	std::vector<VoxelRegion> regions;
+	for (auto * renderer : renderingScene.renderers) if (renderer->enabled)
+		regions.push_back(dirtyTracker.getBounds(renderer));
+	voxelBricks->updateResidency(regions);
+}
+
+std::vector<glm::ivec3> Graphics::getUpdatedBricks(const VoxelRegion & region) const
+{
+	const int brickSize = int(BrickPagedVolume::BRICK_SIZE);
+	std::vector<glm::ivec3> bricks;
+	for (auto & brick : voxelBricks->getUpdatedBricks())
+		if (region.intersects(VoxelRegion(brick * brickSize, (brick + 1) * brickSize)))
+			bricks.push_back(brick);
+	return bricks;
+}
+
+void Graphics::generateVoxelMips(id<MTLCommandBuffer> commandBuffer, const VoxelRegion & region,
+								 const std::vector<glm::ivec3> * bricks)
+{
 	if (automaticallyRegenerateMipmap || regenerateMipmapQueued) {
 		if (useComputeShaderToGenMip)
 		{
 			auto computeEncoder = [commandBuffer computeCommandEncoder];
-			voxelTexture->generateMips(computeEncoder);
+			if (bricks)
+				voxelTexture->generateMips(computeEncoder, *bricks);
+			else
+				voxelTexture->generateMips(computeEncoder, region,
+										   skipEmptyBricksInMips && voxelOccupancyValid ? voxelOccupancyBuffer : nil);
 			[computeEncoder endEncoding];
 		}
 		else
@@ -255,37 +1122,69 @@ void Graphics::voxelize(id<MTLCommandBuffer> commandBuffer,
 			[blitEncoder endEncoding];
 		}
 
+		if (anisotropicVoxels || separateOpacityVolume)
+		{
+			auto computeEncoder = [commandBuffer computeCommandEncoder];
+			if (anisotropicVoxels) {
+				// Textures that were just allocated are generated whole.
+				voxelTexture->generateAnisotropicMips(computeEncoder, voxelAnisotropicTextures,
+													  voxelAnisotropicTexturesValid ? region : VoxelRegion::full(voxelTextureSize));
+				voxelAnisotropicTexturesValid = true;
+			}
+			if (separateOpacityVolume) {
+				voxelTexture->generateOpacity(computeEncoder, voxelOpacityTexture,
+											  voxelOpacityTextureValid ? region : VoxelRegion::full(voxelTextureSize));
+				voxelOpacityTextureValid = true;
+			}
+			[computeEncoder endEncoding];
+		}
+
 		regenerateMipmapQueued = false;
 	}
 }
 
 void Graphics::voxelizeSinglePass(id<MTLCommandBuffer> commandBuffer,
 								  Scene & renderingScene,
-								  bool clearVoxelizationFirst)
+								  bool clearVoxelizationFirst,
+								  bool gBuffer)
 {
 	id<MTLComputeCommandEncoder> computeEncoder = nil;
 	// Clear voxel texture
 	if (clearVoxelizationFirst) {
 		computeEncoder = [commandBuffer computeCommandEncoder];
 		float clearColor[4] = { 0, 0, 0, 0 };
-		// Only clear levels starting from 1. The first level will be filled ourselves
-		voxelTexture->clear(computeEncoder, clearColor, 1);
+		// Only clear levels starting from 1. The first level will be filled ourselves, except for the voxels
+		// light injection skips with the G-buffer
+		voxelTexture->clear(computeEncoder, clearColor, gBuffer ? 0 : 1);
 		[computeEncoder endEncoding];
 
 		// Clear atomic buffer
 		auto blitEncoder = [commandBuffer blitCommandEncoder];
 		[blitEncoder fillBuffer:voxelAtomicBuffer range:NSMakeRange(0, voxelAtomicBuffer.length) value:0];
+		if (gBuffer)
+		{
+			[blitEncoder fillBuffer:voxelNormalAtomicBuffer range:NSMakeRange(0, voxelNormalAtomicBuffer.length) value:0];
+			[blitEncoder fillBuffer:voxelEmissiveAtomicBuffer range:NSMakeRange(0, voxelEmissiveAtomicBuffer.length) value:0];
+		}
 		[blitEncoder endEncoding];
 	}
 
 	// Single pass voxelization only works with atomic buffer.
 	// Using raster order groups with texture write won't work correctly due to cross plane race condition.
 	// In vertex shader, project the triangles to their dominant axis' plane.
-	auto renderEncoder = setupVoxelWritingPass(commandBuffer);
+	auto renderEncoder = setupVoxelWritingPass(commandBuffer, gBuffer ? voxelizationGBufferMaterial : voxelizationMaterial,
+											   VoxelRegion::full(voxelTextureSize));
 
 	[renderEncoder setViewport:viewport(voxelTextureSize, voxelTextureSize)];
 	// Output buffer
 	[renderEncoder setFragmentBuffer:voxelAtomicBuffer offset:0 atIndex:VOXEL_ATOMIC_BUFFER_BINDING];
+	if (gBuffer)
+	{
+		[renderEncoder setFragmentBuffer:voxelNormalAtomicBuffer offset:0 atIndex:VOXEL_NORMAL_ATOMIC_BUFFER_BINDING];
+		[renderEncoder setFragmentBuffer:voxelEmissiveAtomicBuffer offset:0 atIndex:VOXEL_EMISSIVE_ATOMIC_BUFFER_BINDING];
+		[renderEncoder setFragmentBuffer:voxelOccupiedMaskBuffer offset:0 atIndex:VOXEL_OCCUPIED_MASK_BINDING];
+		[renderEncoder setFragmentBuffer:voxelOccupiedListBuffer offset:0 atIndex:VOXEL_OCCUPIED_LIST_BINDING];
+	}
 
 	// Rasterize the scene
 	renderQueue(renderEncoder, renderingScene.renderers);
@@ -294,40 +1193,111 @@ void Graphics::voxelizeSinglePass(id<MTLCommandBuffer> commandBuffer,
 
 	// Copy data from buffer to voxel texture.
 	computeEncoder = [commandBuffer computeCommandEncoder];
-	voxelTexture->copyFirstLevelFromBuffer(computeEncoder, voxelAtomicBuffer);
+	if (gBuffer)
+	{
+		voxelAlbedoTexture->copyFirstLevelFromBuffer(computeEncoder, voxelAtomicBuffer, voxelBufferLayout);
+		voxelNormalTexture->copyFirstLevelFromBuffer(computeEncoder, voxelNormalAtomicBuffer, voxelBufferLayout);
+		voxelEmissiveTexture->copyFirstLevelFromBuffer(computeEncoder, voxelEmissiveAtomicBuffer, voxelBufferLayout);
+	}
+	else
+	{
+		voxelTexture->copyFirstLevelFromBuffer(computeEncoder, voxelAtomicBuffer, voxelBufferLayout);
+	}
 	[computeEncoder endEncoding];
 }
 void Graphics::voxelizeMultiPass(id<MTLCommandBuffer> commandBuffer,
-								 Scene & renderingScene,
-								 bool clearVoxelizationFirst)
+								 const RenderingQueue & candidates,
+								 const VoxelRegion & region,
+								 bool clearVoxelizationFirst,
+								 bool gBuffer,
+								 const std::vector<glm::ivec3> * bricks)
 {
+	const bool fullRegion = region.volume() == size_t(voxelTextureSize) * voxelTextureSize * voxelTextureSize;
+
+	// Only the renderers touching the region (and one of the bricks, if any) need to be rasterized again.
+	auto touchesBricks = [bricks](const VoxelRegion & bounds) {
+		const int brickSize = int(BrickPagedVolume::BRICK_SIZE);
+		for (auto & brick : *bricks)
+			if (bounds.intersects(VoxelRegion(brick * brickSize, (brick + 1) * brickSize)))
+				return true;
+		return false;
+	};
+	RenderingQueue renderers;
+	for (auto * renderer : candidates) {
+		const VoxelRegion bounds = dirtyTracker.getBounds(renderer);
+		if (fullRegion || (bounds.intersects(region) && (!bricks || touchesBricks(bounds))))
+			renderers.push_back(renderer);
+	}
+
 	id<MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
 	// Clear voxel texture
-	if (clearVoxelizationFirst) {
+	if (bricks && !gBuffer) {
+		// Everything outside of these bricks is already empty.
+		float clearColor[4] = { 0, 0, 0, 0 };
+		voxelTexture->clear(computeEncoder, clearColor, *bricks);
+	}
+	else if (!fullRegion) {
+		// Partial re-voxelization: the region is cleared even when accumulating, otherwise
+		// the old voxels of the objects that moved would stay.
+		float clearColor[4] = { 0, 0, 0, 0 };
+		if (gBuffer)
+		{
+			voxelAlbedoTexture->clear(computeEncoder, clearColor, region);
+			voxelNormalTexture->clear(computeEncoder, clearColor, region);
+			voxelEmissiveTexture->clear(computeEncoder, clearColor, region);
+		}
+		else
+		{
+			voxelTexture->clear(computeEncoder, clearColor, region);
+		}
+	}
+	else if (clearVoxelizationFirst) {
 		float clearColor[4] = { 0, 0, 0, 0 };
-		voxelTexture->clear(computeEncoder, clearColor, 0);
+		if (gBuffer)
+		{
+			// Light injection only writes the listed voxels of the radiance texture's first level.
+			voxelTexture->clear(computeEncoder, clearColor, 0);
+			voxelAlbedoTexture->clear(computeEncoder, clearColor, 0);
+			voxelNormalTexture->clear(computeEncoder, clearColor, 0);
+			voxelEmissiveTexture->clear(computeEncoder, clearColor, 0);
+		}
+		else
+		{
+			voxelTexture->clear(computeEncoder, clearColor, 0);
+		}
 	}
 
 	// Multipass:
 	// Generate dominant axist list for every triangle
-	genDominantAxisList(computeEncoder, renderingScene.renderers);
+	genDominantAxisList(computeEncoder, renderers);
 	[computeEncoder endEncoding];
 
 	// We render in 3 passes. Each pass project the object onto a basic X/Y/Z plane
 	for (uint32_t i = 0; i < 3; ++i)
 	{
-		auto renderEncoder = setupVoxelWritingPass(commandBuffer);
+		auto renderEncoder = setupVoxelWritingPass(commandBuffer, gBuffer ? voxelizationGBufferMaterial : voxelizationMaterial, region);
 #ifdef DEBUG
 		renderEncoder.label = [NSString stringWithFormat:@"Voxel writing pass %u", i];
 #endif
 		[renderEncoder setViewport:viewport(voxelTextureSize, voxelTextureSize)];
-		[renderEncoder setVertexBytes:&i length:sizeof(i) atIndex:VOXEL_PROJ_BINDING];
+		[renderEncoder setScissorRect:voxelRegionScissor(region, i, voxelTextureSize)];
 
 		// Output 3D Texture.
-		voxelTexture->activate(renderEncoder, 2);
+		if (gBuffer)
+		{
+			voxelAlbedoTexture->activate(renderEncoder, 2);
+			voxelNormalTexture->activate(renderEncoder, 3);
+			voxelEmissiveTexture->activate(renderEncoder, 4);
+			[renderEncoder setFragmentBuffer:voxelOccupiedMaskBuffer offset:0 atIndex:VOXEL_OCCUPIED_MASK_BINDING];
+			[renderEncoder setFragmentBuffer:voxelOccupiedListBuffer offset:0 atIndex:VOXEL_OCCUPIED_LIST_BINDING];
+		}
+		else
+		{
+			voxelTexture->activate(renderEncoder, 2);
+		}
 
-		// Rasterize the scene
-		renderQueue(renderEncoder, renderingScene.renderers);
+		// Rasterize the scene, the renderers set the projection direction
+		renderVoxelizationPass(renderEncoder, renderers, i);
 
 		// End the render pass to make sure the voxel writing is visible to next projection pass
 		[renderEncoder endEncoding];
@@ -421,9 +1391,9 @@ Graphics::~Graphics()
 {
 	if (vvfbo1) delete vvfbo1;
 	if (vvfbo2) delete vvfbo2;
-	if (dummyVoxelizationFbo) delete dummyVoxelizationFbo;
+	if (sceneGBufferFbo) delete sceneGBufferFbo;
 	if (quadMeshRenderer) delete quadMeshRenderer;
 	if (cubeMeshRenderer) delete cubeMeshRenderer;
 	if (cubeShape) delete cubeShape;
-	if (voxelTexture) delete voxelTexture;
+	releaseVoxelResources();
 }
@@ -3,6 +3,11 @@
 #include <iostream>
 #include <string>
 
+#include <glm.hpp>
+
+// Maximum number of point lights taken into account by the shaders and the CPU voxel paths.
+#define MAX_LIGHTS 1
+
 /// <summary> A simple point light. </summary>
 class PointLight {
 public:
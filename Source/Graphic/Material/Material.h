@@ -10,6 +10,9 @@
 /// <summary> Represents a material that references shaders, blending settings, etc. </summary>
 class Material {
 public:
+	/// <summary> Extra boolean function constants (index -> value) used to specialize the shaders. </summary>
+	using FunctionConstants = std::unordered_map<uint32_t, bool>;
+
 	~Material();
 	Material(const std::string & _name,
 			 const std::string & shaderFile,
@@ -19,7 +22,8 @@ public:
 			 uint32_t samples = 1,
 			 uint32_t rasterSamples = 1,
 			 bool blending = true,
-			 bool enableColorWrite = false
+			 bool enableColorWrite = false,
+			 const FunctionConstants & extraConstants = {}
 			 );
 	/// <summary> Apply this material to the render command
 	void activate(id<MTLRenderCommandEncoder> encoder);
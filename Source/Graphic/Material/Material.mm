@@ -21,7 +21,8 @@ Material::Material(const std::string & _name,
 				   uint32_t samples,
 				   uint32_t rasterSamples,
 				   bool blending,
-				   bool disableColorWrite)
+				   bool disableColorWrite,
+				   const FunctionConstants & extraConstants)
 	: name(_name)
 {
 	// Setup descriptor
@@ -59,6 +60,12 @@ Material::Material(const std::string & _name,
 	BOOL singlepassVoxelization = Application::getInstance().graphics.isSinglePassVoxelization();
 	[shaderConstants setConstantValue:&singlepassVoxelization type:MTLDataTypeBool atIndex:2];
 
+	for (auto & constant : extraConstants)
+	{
+		BOOL value = constant.second;
+		[shaderConstants setConstantValue:&value type:MTLDataTypeBool atIndex:constant.first];
+	}
+
 	// Load shaders
 	auto library = Shader::loadMetalLibrary(metalDevice, shaderFile);
 	desc.vertexFunction = Shader::loadShader(library, shaderConstants, "VS");
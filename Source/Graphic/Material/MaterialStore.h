@@ -4,7 +4,7 @@
 
 #include <Metal/Metal.h>
 
-class Material;
+#include "Material.h"
 
 /// <summary> Manages all loaded materials and shader programs. </summary>
 class MaterialStore {
@@ -20,7 +20,8 @@ public:
 						uint32_t samples = 1,
 						uint32_t rasterSamples = 1,
 						bool blending = true,
-						bool enableColorWrite = false
+						bool enableColorWrite = false,
+						const Material::FunctionConstants & extraConstants = {}
 						);
 	~MaterialStore();
 private:
@@ -18,6 +18,30 @@ MaterialStore::MaterialStore()
 				   false,
 				   true
 				   );
+	// Same shaders, but writes material data to the voxel G-buffer. Light is injected later by a compute pass.
+	AddNewMaterial("voxelization_gbuffer",
+				   "Voxelization/voxelization",
+				   MTLPixelFormatRGBA8Unorm,
+				   MTLPixelFormatInvalid,
+				   MTLPixelFormatInvalid,
+				   Graphics::VOXEL_RENDER_TARGET_SAMPLES,
+				   Graphics::VOXEL_RENDER_TARGET_SAMPLES,
+				   false,
+				   true,
+				   { { Graphics::VOXELIZE_GBUFFER_CONSTANT, true } }
+				   );
+	// Same shaders, but writes into a clipmap level.
+	AddNewMaterial("voxelization_clipmap",
+				   "Voxelization/voxelization",
+				   MTLPixelFormatRGBA8Unorm,
+				   MTLPixelFormatInvalid,
+				   MTLPixelFormatInvalid,
+				   Graphics::VOXEL_RENDER_TARGET_SAMPLES,
+				   Graphics::VOXEL_RENDER_TARGET_SAMPLES,
+				   false,
+				   true,
+				   { { Graphics::VOXELIZE_CLIPMAP_CONSTANT, true } }
+				   );
 
 	// Voxelization visualization.
 	AddNewMaterial("voxel_visualization",
@@ -42,6 +66,53 @@ MaterialStore::MaterialStore()
 				   MTLPixelFormatInvalid,
 				   Application::MSAA_SAMPLES,
 				   Application::MSAA_SAMPLES);
+	// Same shaders, but the indirect diffuse light is traced at a lower resolution and upsampled.
+	AddNewMaterial("voxel_cone_tracing_upsampled",
+				   "VoxelConeTracing/voxel_cone_tracing",
+				   MTLPixelFormatBGRA8Unorm,
+				   MTLPixelFormatDepth32Float,
+				   MTLPixelFormatInvalid,
+				   Application::MSAA_SAMPLES,
+				   Application::MSAA_SAMPLES,
+				   true,
+				   false,
+				   { { Graphics::UPSAMPLED_INDIRECT_DIFFUSE_CONSTANT, true } }
+				   );
+	// Same shaders, but a fullscreen quad shades the surface of each pixel of the screen G-buffer (deferred lighting).
+	AddNewMaterial("voxel_cone_tracing_deferred",
+				   "VoxelConeTracing/voxel_cone_tracing",
+				   MTLPixelFormatBGRA8Unorm,
+				   MTLPixelFormatDepth32Float,
+				   MTLPixelFormatInvalid,
+				   Application::MSAA_SAMPLES,
+				   Application::MSAA_SAMPLES,
+				   true,
+				   false,
+				   { { Graphics::DEFERRED_LIGHTING_CONSTANT, true } }
+				   );
+	AddNewMaterial("voxel_cone_tracing_deferred_upsampled",
+				   "VoxelConeTracing/voxel_cone_tracing",
+				   MTLPixelFormatBGRA8Unorm,
+				   MTLPixelFormatDepth32Float,
+				   MTLPixelFormatInvalid,
+				   Application::MSAA_SAMPLES,
+				   Application::MSAA_SAMPLES,
+				   true,
+				   false,
+				   { { Graphics::DEFERRED_LIGHTING_CONSTANT, true }, { Graphics::UPSAMPLED_INDIRECT_DIFFUSE_CONSTANT, true } }
+				   );
+	// Same shaders, but writes the normal, the distance to the camera and the material index of each pixel (screen G-buffer).
+	AddNewMaterial("scene_gbuffer",
+				   "VoxelConeTracing/voxel_cone_tracing",
+				   MTLPixelFormatRGBA32Float,
+				   MTLPixelFormatDepth32Float,
+				   MTLPixelFormatInvalid,
+				   1,
+				   1,
+				   false,
+				   false,
+				   { { Graphics::SCENE_GBUFFER_CONSTANT, true } }
+				   );
 }
 
 void MaterialStore::AddNewMaterial(const std::string &name,
@@ -52,7 +123,8 @@ void MaterialStore::AddNewMaterial(const std::string &name,
 								   uint32_t samples,
 								   uint32_t rasterSamples,
 								   bool blending,
-								   bool enableColorWrite)
+								   bool enableColorWrite,
+								   const Material::FunctionConstants & extraConstants)
 {
 	const std::string shaderPath = "Shaders/";
 	materials.push_back(new Material(name,
@@ -63,7 +135,8 @@ void MaterialStore::AddNewMaterial(const std::string &name,
 									 samples,
 									 rasterSamples,
 									 blending,
-									 enableColorWrite
+									 enableColorWrite,
+									 extraConstants
 									 ));
 }
 
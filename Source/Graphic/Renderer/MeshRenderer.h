@@ -1,15 +1,18 @@
 #pragma once
 
-#include "../../Shape/Transform.h"
+#include "../../Shape/TransformHandle.h"
 #include "../Material/MaterialSetting.h"
 
 #include <string>
+#include <vector>
 #include <Metal/Metal.h>
 
 #include <gtc/type_ptr.hpp>
 #include <glm.hpp>
 
 class Mesh;
+class DominantAxisPartition;
+class WorldVertexStream;
 
 /// <summary> A renderer that can be used to render a mesh. </summary>
 class MeshRenderer {
@@ -18,9 +21,12 @@ public:
 	bool tweakable = false; // Automatically adds a window for this mesh renderer.
 	std::string name = "Mesh renderer"; // Is displayed in the tweak bar.
 
-	Transform transform;
+	TransformHandle transform; // Owned by TransformStore::getInstance().
 	Mesh * mesh;
 
+	// Object space bounding box of the mesh.
+	glm::vec3 localBoundsMin, localBoundsMax;
+
 	// Constr/destr.
 	MeshRenderer(Mesh *, MaterialSetting * = nullptr);
 	~MeshRenderer();
@@ -29,9 +35,19 @@ public:
 	MaterialSetting * materialSetting = nullptr;
 	void render(id<MTLRenderCommandEncoder> encoder);
 
+	/// <summary> Transforms the vertices to world space if the transform changed (or every frame if the mesh isn't
+	/// static). Called once per frame before any pass: all the passes then read the world space vertices. </summary>
+	void updateWorldVertices();
+
 	// Generate dominant axis list for the triangles of this mesh
 	void computeDominantAxis(id<MTLComputeCommandEncoder> encoder);
+
+	/// <summary> Draws the triangles of one projection pass of multipass voxelization: only the range of that axis
+	/// when the index buffer of the mesh is presorted by dominant axis, every triangle otherwise (the vertex shader
+	/// culls the ones of the other axes). </summary>
+	void renderVoxelizationPass(id<MTLRenderCommandEncoder> encoder, uint32_t axis);
 private:
+	void bindObjectState(id<MTLRenderCommandEncoder> encoder, id<MTLBuffer> indexBuffer);
 	void setupMeshRenderer(bool initDominantAxisBuffer);
 	void reuploadIndexDataToGPU(bool initDominantAxisBuffer);
 	void reuploadVertexDataToGPU();
@@ -39,4 +55,16 @@ private:
 
 	// Compute shader to generate dominant axis of each triangle
 	id<MTLComputePipelineState> dominantAxisCompute;
+
+	// Static meshes voxelized in multiple passes: indices sorted by dominant axis for the current rotation,
+	// so that each pass only draws its range (see computeDominantAxis).
+	DominantAxisPartition * axisPartition = nullptr;
+	id<MTLBuffer> axisSortedEbo = nil;
+
+	// World space vertices of the current transform, nil until updateWorldVertices() is called. Written in place in
+	// a ring of Graphics::MAX_FRAMES_IN_FLIGHT persistent buffers, so that the frames in flight keep reading theirs.
+	WorldVertexStream * worldVertexStream = nullptr;
+	std::vector<id<MTLBuffer>> worldVbos;
+	size_t worldVboIndex = 0;
+	id<MTLBuffer> worldVbo = nil;
 };
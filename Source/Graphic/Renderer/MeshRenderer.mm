@@ -8,9 +8,13 @@
 #include "../../Time/Time.h"
 #include "../../Graphic/Graphics.h"
 #include "../../Graphic/Lighting/PointLight.h"
+#include "../../Graphic/Voxelization/DominantAxisPartition.h"
+#include "../../Graphic/Voxelization/WorldVertexStream.h"
 
 #include <TargetConditionals.h>
 #include <cassert>
+#include <cstring>
+#include <limits>
 
 #if TARGET_OS_OSX || TARGET_OS_MACCATALYST
 constexpr MTLResourceOptions kDefaultBufferStorageMode = MTLResourceStorageModeManaged;
@@ -23,6 +27,17 @@ struct ObjectStateUniformData
 	glm::mat4 model;
 	glm::mat4 modelInverseTranspose;
 	MaterialSetting material;
+	uint32_t worldSpaceVertices = 0;
+	uint32_t padding[3]; // Metal rounds the struct up to the alignment of its matrices.
+};
+static_assert(sizeof(MaterialSetting) == 12 * sizeof(float), "MaterialSetting must have the layout of Material in common.metal");
+static_assert(sizeof(ObjectStateUniformData) % 16 == 0, "ObjectStateUniformData must be as large as ObjectState in common.metal");
+
+// Mirrors VoxelProjectionDir in voxelization.metal.
+struct VoxelProjectionUniformData
+{
+	uint32_t direction;
+	uint32_t presorted; // The triangles drawn all have this dominant axis.
 };
 
 MeshRenderer::MeshRenderer(Mesh * _mesh, MaterialSetting * _materialSetting)
@@ -32,8 +47,19 @@ MeshRenderer::MeshRenderer(Mesh * _mesh, MaterialSetting * _materialSetting)
 
 	mesh = _mesh;
 
+	localBoundsMin = glm::vec3(std::numeric_limits<float>::max());
+	localBoundsMax = glm::vec3(-std::numeric_limits<float>::max());
+	for (auto & vertex : mesh->vertexData) {
+		localBoundsMin = glm::min(localBoundsMin, vertex.position);
+		localBoundsMax = glm::max(localBoundsMax, vertex.position);
+	}
+
 	// Dominant axis buffer will be needed for multipass voxelization
-	setupMeshRenderer(!Application::getInstance().graphics.isSinglePassVoxelization());
+	const bool multiPassVoxelization = !Application::getInstance().graphics.isSinglePassVoxelization();
+	setupMeshRenderer(multiPassVoxelization);
+
+	if (multiPassVoxelization && mesh->staticMesh)
+		axisPartition = new DominantAxisPartition(mesh->vertexData, mesh->indices);
 }
 
 void MeshRenderer::setupMeshRenderer(bool initDominantAxisBuffer)
@@ -53,15 +79,45 @@ void MeshRenderer::setupMeshRenderer(bool initDominantAxisBuffer)
 MeshRenderer::~MeshRenderer()
 {
 	if (materialSetting != nullptr) delete materialSetting;
+	if (axisPartition != nullptr) delete axisPartition;
+	if (worldVertexStream != nullptr) delete worldVertexStream;
 }
 
-void MeshRenderer::render(id<MTLRenderCommandEncoder> encoder)
+void MeshRenderer::updateWorldVertices()
+{
+	if (worldVertexStream == nullptr)
+		worldVertexStream = new WorldVertexStream();
+
+	auto stats = worldVertexStream->update(mesh->vertexData, transform.getTransformMatrix(),
+										   transform.getInverseTransposeTransformMatrix(), mesh->staticMesh);
+	if (stats.vertices == 0)
+		return;
+
+	// The next buffer of the ring rather than the current one, which the frames in flight may still read.
+	const auto & vertices = worldVertexStream->getVertices();
+	const NSUInteger length = vertices.size() * sizeof(VertexData);
+	worldVbos.resize(Graphics::MAX_FRAMES_IN_FLIGHT, nil);
+	worldVboIndex = (worldVboIndex + 1) % worldVbos.size();
+	id<MTLBuffer> & buffer = worldVbos[worldVboIndex];
+	if (buffer == nil || buffer.length < length) {
+		id<MTLDevice> metalDevice = Application::getInstance().graphics.getMetalDevice();
+		buffer = [metalDevice newBufferWithLength:length options:kDefaultBufferStorageMode];
+	}
+	memcpy(buffer.contents, vertices.data(), length);
+#if TARGET_OS_OSX || TARGET_OS_MACCATALYST
+	[buffer didModifyRange:NSMakeRange(0, length)];
+#endif
+	worldVbo = buffer;
+}
+
+void MeshRenderer::bindObjectState(id<MTLRenderCommandEncoder> encoder, id<MTLBuffer> indexBuffer)
 {
 	ObjectStateUniformData uniformData;
 	uniformData.model = transform.getTransformMatrix();
 	uniformData.modelInverseTranspose = transform.getInverseTransposeTransformMatrix();
 	if (materialSetting)
 		uniformData.material = *materialSetting;
+	uniformData.worldSpaceVertices = worldVbo != nil;
 
 	[encoder setVertexBytes:&uniformData
 					 length:sizeof(uniformData)
@@ -71,11 +127,11 @@ void MeshRenderer::render(id<MTLRenderCommandEncoder> encoder)
 					   length:sizeof(uniformData)
 					  atIndex:Graphics::OBJECT_STATE_BINDING];
 
-	[encoder setVertexBuffer:mesh->vbo
+	[encoder setVertexBuffer:worldVbo ? worldVbo : mesh->vbo
 					  offset:0
 					 atIndex:Graphics::VERTEX_BUFFER_BINDING];
 
-	[encoder setVertexBuffer:mesh->ebo
+	[encoder setVertexBuffer:indexBuffer
 					  offset:0
 					 atIndex:Graphics::INDEX_BUFFER_BINDING];
 
@@ -86,6 +142,11 @@ void MeshRenderer::render(id<MTLRenderCommandEncoder> encoder)
 						  offset:0
 						 atIndex:Graphics::TRI_DOMINANT_BUFFER_BINDING];
 	}
+}
+
+void MeshRenderer::render(id<MTLRenderCommandEncoder> encoder)
+{
+	bindObjectState(encoder, mesh->ebo);
 
 	// We read the index buffer inside vertex shader directly instead of using drawIndexedPrimitive
 	[encoder drawPrimitives:MTLPrimitiveTypeTriangle
@@ -93,8 +154,46 @@ void MeshRenderer::render(id<MTLRenderCommandEncoder> encoder)
 				vertexCount:mesh->indices.size()];
 }
 
+void MeshRenderer::renderVoxelizationPass(id<MTLRenderCommandEncoder> encoder, uint32_t axis)
+{
+	const bool presorted = axisPartition && axisPartition->isValid();
+	VoxelProjectionUniformData projection = { axis, presorted ? 1u : 0u };
+	[encoder setVertexBytes:&projection length:sizeof(projection) atIndex:Graphics::VOXEL_PROJ_BINDING];
+
+	if (!presorted)
+	{
+		render(encoder);
+		return;
+	}
+
+	const auto & range = axisPartition->getRange(axis);
+	if (range.triangleCount == 0)
+		return;
+
+	bindObjectState(encoder, axisSortedEbo);
+	[encoder drawPrimitives:MTLPrimitiveTypeTriangle
+				vertexStart:3 * range.firstTriangle
+				vertexCount:3 * range.triangleCount];
+}
+
 void MeshRenderer::computeDominantAxis(id<MTLComputeCommandEncoder> encoder)
 {
+	if (axisPartition)
+	{
+		// The presorted ranges replace the dominant axis list as long as no triangle changes axis.
+		auto stats = axisPartition->update(transform.getTransformMatrix());
+		if (stats.sorted)
+		{
+			id<MTLDevice> metalDevice = Application::getInstance().graphics.getMetalDevice();
+			const auto & indices = axisPartition->getIndices();
+			axisSortedEbo = [metalDevice newBufferWithBytes:indices.data()
+													 length:(indices.size() * sizeof(unsigned int))
+													options:kDefaultBufferStorageMode];
+		}
+		if (axisPartition->isValid())
+			return;
+	}
+
 	// Generate dominant axis list for triangles inside mesh
 	assert(dominantAxisCompute);
 
@@ -103,6 +202,7 @@ void MeshRenderer::computeDominantAxis(id<MTLComputeCommandEncoder> encoder)
 	uniformData.modelInverseTranspose = transform.getInverseTransposeTransformMatrix();
 	if (materialSetting)
 		uniformData.material = *materialSetting;
+	uniformData.worldSpaceVertices = worldVbo != nil;
 
 	uint32_t triangles = (uint32_t)(mesh->indices.size() / 3);
 	[encoder setComputePipelineState:dominantAxisCompute];
@@ -114,7 +214,7 @@ void MeshRenderer::computeDominantAxis(id<MTLComputeCommandEncoder> encoder)
 			   length:sizeof(uniformData)
 			  atIndex:Graphics::OBJECT_STATE_BINDING];
 
-	[encoder setBuffer:mesh->vbo
+	[encoder setBuffer:worldVbo ? worldVbo : mesh->vbo
 				offset:0
 			   atIndex:Graphics::VERTEX_BUFFER_BINDING];
 
@@ -4,24 +4,51 @@
 
 #include <Metal/Metal.h>
 
+#include "Voxelization/VoxelLayout.h"
+#include "Voxelization/VoxelRegion.h"
+
 /// <summary> A 3D texture wrapper class. This texture is used for shader writing, not for rendering.</summary>
 class Texture3D {
 public:
 
 	/// <summary> Activates this texture and passes it on to a texture unit on the GPU. </summary>
 	void activate(id<MTLRenderCommandEncoder> encoder, uint32_t textureUnit = 0);
+	void activate(id<MTLComputeCommandEncoder> encoder, uint32_t textureUnit = 0);
+
+	/// <summary> Dispatches one thread per texel of the first level using the currently bound compute pipeline,
+	/// or per block of step^3 texels. </summary>
+	void dispatchFirstLevel(id<MTLComputeCommandEncoder> encoder, id<MTLComputePipelineState> pipelineState, uint32_t step = 1);
 
 	/// <summary> Clears this texture using a given clear color. </summary>
 	void clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], uint32_t startLevel);
+	/// <summary> Clears a region of the first level only. </summary>
+	void clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], const VoxelRegion & region);
+	/// <summary> Clears a list of 8^3 bricks (in brick coordinates) of the first level only. </summary>
+	void clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], const std::vector<glm::ivec3> & bricks);
 
 	/// <summary> Generate mipmaps
 	void generateMips(id<MTLBlitCommandEncoder> encoder);
 	void generateMips(id<MTLComputeCommandEncoder> encoder);
+	/// <summary> Only regenerate the mip texels covering a region of the first level. With a brick occupancy buffer
+	/// (one bit per 8^3 brick of the first level, see VoxelBrickOccupancy), the empty bricks are not sampled. </summary>
+	void generateMips(id<MTLComputeCommandEncoder> encoder, const VoxelRegion & region, id<MTLBuffer> brickOccupancy = nil);
+	/// <summary> Only regenerate the mip texels covering a list of 8^3 bricks (in brick coordinates) of the first level. </summary>
+	void generateMips(id<MTLComputeCommandEncoder> encoder, const std::vector<glm::ivec3> & bricks);
+
+	/// <summary> Rebuilds the six directional volumes (+X, -X, +Y, -Y, +Z, -Z) over a region of the first level.
+	/// Their first level, half the size of this texture, stands for this texture's second level. </summary>
+	void generateAnisotropicMips(id<MTLComputeCommandEncoder> encoder, Texture3D * const directions[6], const VoxelRegion & region);
+
+	/// <summary> Copies the alpha of a region of the first level into an R8 texture of the same size, then updates its mips. </summary>
+	void generateOpacity(id<MTLComputeCommandEncoder> encoder, Texture3D * opacity, const VoxelRegion & region);
 
-	/// Copy RGBA8 pixel from buffer to texture
-	void copyFirstLevelFromBuffer(id<MTLComputeCommandEncoder> encoder, id<MTLBuffer> buffer);
+	/// Copy RGBA8 pixel from buffer to texture, the buffer storing them in the given layout
+	void copyFirstLevelFromBuffer(id<MTLComputeCommandEncoder> encoder, id<MTLBuffer> buffer,
+								  VoxelLayout layout = VoxelLayout::LINEAR);
 
-	Texture3D(const uint32_t width, const uint32_t height, const uint32_t depth);
+	/// <summary> mipLevels = 0 means a full mip chain (up to 7 levels). </summary>
+	Texture3D(const uint32_t width, const uint32_t height, const uint32_t depth, const uint32_t mipLevels = 0,
+			  const MTLPixelFormat pixelFormat = MTLPixelFormatRGBA8Unorm);
 private:
 	void initTexture();
 	void initComputeShader();
@@ -30,6 +57,8 @@ private:
 						 const MTLSize &dimensions);
 
 	uint32_t width, height, depth;
+	uint32_t mipLevels;
+	MTLPixelFormat pixelFormat;
 
 	id<MTLTexture> textureObject;
 	std::vector<id<MTLTexture>> textureObjectViews;
@@ -37,4 +66,7 @@ private:
 	id<MTLComputePipelineState> clearPipelineState;
 	id<MTLComputePipelineState> copyBufferPipelineState;
 	id<MTLComputePipelineState> genMipPipelineState;
+	id<MTLComputePipelineState> clearBricksPipelineState;
+	id<MTLComputePipelineState> genAnisotropicMipPipelineState;
+	id<MTLComputePipelineState> extractOpacityPipelineState;
 };
@@ -2,6 +2,7 @@
 #include "Material/Shader.h"
 #include "../Application.h"
 
+#include <algorithm>
 #include <vector>
 #include <cmath>
 
@@ -11,14 +12,60 @@ struct GenMipUniformData
 {
 	uint32_t srcLevel;
 	uint32_t numMipmapsToGenerate;
-	uint32_t padding[2];
+	uint32_t useGroupOffsets;
+	uint32_t useBrickOccupancy;
+	uint32_t dstOffset[4];
 };
+
+struct AnisotropicMipUniformData
+{
+	uint32_t dstOffset[4];
+};
+
+struct ExtractOpacityUniformData
+{
+	uint32_t offset[4];
+};
+
+struct ClearUniformData
+{
+	float color[4];
+	uint32_t offset[4];
+};
+
+// Thread group size of generate3DMipmaps along each axis.
+constexpr uint32_t kGenMipGroupSize = 8;
+constexpr uint32_t kBrickSize = 8;
+
+// Binds a list of coordinates (one uint4 each) to a compute buffer slot.
+void setCoordinateList(id<MTLComputeCommandEncoder> encoder, const std::vector<glm::ivec3> & coordinates, NSUInteger index)
+{
+	std::vector<uint32_t> data;
+	data.reserve(coordinates.size() * 4);
+	for (auto & c : coordinates)
+		data.insert(data.end(), { uint32_t(c.x), uint32_t(c.y), uint32_t(c.z), 0 });
+
+	const NSUInteger length = data.size() * sizeof(uint32_t);
+	if (length <= 4096)
+	{
+		[encoder setBytes:data.data() length:length atIndex:index];
+	}
+	else
+	{
+		// setBytes is limited to 4KB.
+		id<MTLDevice> metalDevice = Application::getInstance().graphics.getMetalDevice();
+		id<MTLBuffer> buffer = [metalDevice newBufferWithBytes:data.data() length:length options:MTLResourceStorageModeShared];
+		[encoder setBuffer:buffer offset:0 atIndex:index];
+	}
+}
 }
 
 Texture3D::Texture3D(const uint32_t _width,
 					 const uint32_t _height,
-					 const uint32_t _depth) :
-	width(_width), height(_height), depth(_depth)
+					 const uint32_t _depth,
+					 const uint32_t _mipLevels,
+					 const MTLPixelFormat _pixelFormat) :
+	width(_width), height(_height), depth(_depth), mipLevels(_mipLevels), pixelFormat(_pixelFormat)
 {
 	initTexture();
 	initComputeShader();
@@ -31,13 +78,15 @@ void Texture3D::initTexture()
 	// Generate texture on GPU.
 	auto texDesc = [[MTLTextureDescriptor alloc] init];
 	texDesc.textureType = MTLTextureType3D;
-	texDesc.pixelFormat = MTLPixelFormatRGBA8Unorm;
+	texDesc.pixelFormat = pixelFormat;
 	texDesc.width = width;
 	texDesc.height = height;
 	texDesc.depth = depth;
 	// Only support up to 7 mipmap levels
 	texDesc.mipmapLevelCount = 1 + std::max((uint32_t)log2(width), (uint32_t)log2(height));
 	texDesc.mipmapLevelCount = std::min<NSUInteger>(7, texDesc.mipmapLevelCount);
+	if (mipLevels)
+		texDesc.mipmapLevelCount = std::min<NSUInteger>(mipLevels, texDesc.mipmapLevelCount);
 	texDesc.storageMode = MTLStorageModePrivate;
 	texDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite | MTLTextureUsagePixelFormatView;
 
@@ -63,6 +112,9 @@ void Texture3D::initComputeShader()
 	clearPipelineState = graphics.getComputeCache().getComputeShader("voxel_clear", library, "clear");
 	copyBufferPipelineState = graphics.getComputeCache().getComputeShader("voxel_copyFromBuffer", library, "copyRgba8Buffer");
 	genMipPipelineState = graphics.getComputeCache().getComputeShader("voxel_genMip", library, "generate3DMipmaps");
+	clearBricksPipelineState = graphics.getComputeCache().getComputeShader("voxel_clearBricks", library, "clearBricks");
+	genAnisotropicMipPipelineState = graphics.getComputeCache().getComputeShader("voxel_genAnisotropicMip", library, "generateAnisotropicMip");
+	extractOpacityPipelineState = graphics.getComputeCache().getComputeShader("voxel_extractOpacity", library, "extractOpacity");
 }
 
 void Texture3D::activate(id<MTLRenderCommandEncoder> encoder, uint32_t textureUnit)
@@ -71,6 +123,17 @@ void Texture3D::activate(id<MTLRenderCommandEncoder> encoder, uint32_t textureUn
 	[encoder setFragmentTexture:textureObject atIndex:textureUnit];
 }
 
+void Texture3D::activate(id<MTLComputeCommandEncoder> encoder, uint32_t textureUnit)
+{
+	[encoder setTexture:textureObject atIndex:textureUnit];
+}
+
+void Texture3D::dispatchFirstLevel(id<MTLComputeCommandEncoder> encoder, id<MTLComputePipelineState> pipelineState, uint32_t step)
+{
+	dispatchCompute(encoder, pipelineState.threadExecutionWidth,
+					MTLSizeMake((width + step - 1) / step, (height + step - 1) / step, (depth + step - 1) / step));
+}
+
 void Texture3D::dispatchCompute(id<MTLComputeCommandEncoder> computeEncoder,
 								NSUInteger warpSize,
 								const MTLSize &dimensions)
@@ -102,8 +165,11 @@ void Texture3D::dispatchCompute(id<MTLComputeCommandEncoder> computeEncoder,
 
 void Texture3D::clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], uint32_t startLevel)
 {
+	ClearUniformData params = {};
+	std::copy(clearColor, clearColor + 4, params.color);
+
 	[computeEncoder setComputePipelineState:clearPipelineState];
-	[computeEncoder setBytes:clearColor length:4 * sizeof(float) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
 
 	for (uint32_t i = startLevel; i < textureObjectViews.size(); ++i)
 	{
@@ -116,6 +182,44 @@ void Texture3D::clear(id<MTLComputeCommandEncoder> computeEncoder, float clearCo
 }
 
 
+void Texture3D::clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], const VoxelRegion & region)
+{
+	if (region.empty())
+		return;
+
+	ClearUniformData params = {};
+	std::copy(clearColor, clearColor + 4, params.color);
+	params.offset[0] = region.min.x;
+	params.offset[1] = region.min.y;
+	params.offset[2] = region.min.z;
+
+	[computeEncoder setComputePipelineState:clearPipelineState];
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+	[computeEncoder setTexture:textureObjectViews[0] atIndex:0];
+
+	auto extent = region.extent();
+	dispatchCompute(computeEncoder,
+					clearPipelineState.threadExecutionWidth,
+					MTLSizeMake(extent.x, extent.y, extent.z));
+}
+
+void Texture3D::clear(id<MTLComputeCommandEncoder> computeEncoder, float clearColor[4], const std::vector<glm::ivec3> & bricks)
+{
+	if (bricks.empty())
+		return;
+
+	ClearUniformData params = {};
+	std::copy(clearColor, clearColor + 4, params.color);
+
+	[computeEncoder setComputePipelineState:clearBricksPipelineState];
+	[computeEncoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+	setCoordinateList(computeEncoder, bricks, Graphics::COMPUTE_PARAM_START_IDX + 1);
+	[computeEncoder setTexture:textureObjectViews[0] atIndex:0];
+
+	[computeEncoder dispatchThreadgroups:MTLSizeMake(bricks.size(), 1, 1)
+				   threadsPerThreadgroup:MTLSizeMake(kBrickSize, kBrickSize, kBrickSize)];
+}
+
 void Texture3D::generateMips(id<MTLBlitCommandEncoder> encoder)
 {
 	[encoder generateMipmapsForTexture:textureObject];
@@ -123,10 +227,25 @@ void Texture3D::generateMips(id<MTLBlitCommandEncoder> encoder)
 
 void Texture3D::generateMips(id<MTLComputeCommandEncoder> encoder)
 {
-	GenMipUniformData options;
+	generateMips(encoder, VoxelRegion(glm::ivec3(0), glm::ivec3(width, height, depth)));
+}
+
+void Texture3D::generateMips(id<MTLComputeCommandEncoder> encoder, const VoxelRegion & region, id<MTLBuffer> brickOccupancy)
+{
+	if (region.empty())
+		return;
+
+	GenMipUniformData options = {};
+	options.useBrickOccupancy = brickOccupancy != nil;
 	// Compute shader verstion
 	[encoder setComputePipelineState:genMipPipelineState];
 	[encoder setTexture:textureObject atIndex:0];
+	// Unused without group offsets, but must be bound.
+	[encoder setBytes:&options length:sizeof(options) atIndex:1];
+	if (brickOccupancy)
+		[encoder setBuffer:brickOccupancy offset:0 atIndex:2];
+	else
+		[encoder setBytes:&options length:sizeof(options) atIndex:2];
 
 	uint32_t maxMipsPerBatch = 4;
 
@@ -139,15 +258,24 @@ void Texture3D::generateMips(id<MTLComputeCommandEncoder> encoder)
 
 		options.numMipmapsToGenerate = std::min(remainMips, maxMipsPerBatch);
 
-		[encoder setBytes:&options length:sizeof(options) atIndex:0];
-
 		for (uint32_t i = 1; i <= options.numMipmapsToGenerate; ++i)
 		{
 			[encoder setTexture:textureObjectViews[options.srcLevel + i] atIndex:i];
 		}
 
-		auto threads = MTLSizeMake(firstMipView.width, firstMipView.height, firstMipView.depth);
-		auto groupSize = MTLSizeMake(8, 8, 8);
+		// Region of the first generated level, starting at a thread group boundary.
+		VoxelRegion dstRegion = region.atLevel(options.srcLevel + 1);
+		dstRegion.min = (dstRegion.min / int(kGenMipGroupSize)) * int(kGenMipGroupSize);
+		dstRegion.max = glm::min(dstRegion.max, glm::ivec3(firstMipView.width, firstMipView.height, firstMipView.depth));
+		options.dstOffset[0] = dstRegion.min.x;
+		options.dstOffset[1] = dstRegion.min.y;
+		options.dstOffset[2] = dstRegion.min.z;
+
+		[encoder setBytes:&options length:sizeof(options) atIndex:0];
+
+		auto extent = glm::max(dstRegion.extent(), glm::ivec3(1));
+		auto threads = MTLSizeMake(extent.x, extent.y, extent.z);
+		auto groupSize = MTLSizeMake(kGenMipGroupSize, kGenMipGroupSize, kGenMipGroupSize);
 
 		auto groups = MTLSizeMake((threads.width + groupSize.width - 1) / groupSize.width,
 								  (threads.height + groupSize.height - 1) / groupSize.height,
@@ -160,11 +288,118 @@ void Texture3D::generateMips(id<MTLComputeCommandEncoder> encoder)
 	}
 }
 
-void Texture3D::copyFirstLevelFromBuffer(id<MTLComputeCommandEncoder> encoder, id<MTLBuffer> buffer)
+void Texture3D::generateMips(id<MTLComputeCommandEncoder> encoder, const std::vector<glm::ivec3> & bricks)
+{
+	if (bricks.empty())
+		return;
+
+	GenMipUniformData options = {};
+	options.useGroupOffsets = 1;
+	[encoder setComputePipelineState:genMipPipelineState];
+	[encoder setTexture:textureObject atIndex:0];
+	// Unused without brick occupancy, but must be bound.
+	[encoder setBytes:&options length:sizeof(options) atIndex:2];
+
+	uint32_t maxMipsPerBatch = 4;
+	uint32_t remainMips = (uint32_t)textureObject.mipmapLevelCount - 1;
+	options.srcLevel    = 0;
+
+	std::vector<glm::ivec3> groups;
+	while (remainMips)
+	{
+		options.numMipmapsToGenerate = std::min(remainMips, maxMipsPerBatch);
+
+		for (uint32_t i = 1; i <= options.numMipmapsToGenerate; ++i)
+		{
+			[encoder setTexture:textureObjectViews[options.srcLevel + i] atIndex:i];
+		}
+
+		// A thread group covers 8^3 texels of the first generated level, i.e. 2^(srcLevel + 1) bricks per axis.
+		groups.clear();
+		for (auto & brick : bricks)
+			groups.push_back((brick >> int(options.srcLevel + 1)) * int(kGenMipGroupSize));
+		std::sort(groups.begin(), groups.end(), [](const glm::ivec3 & a, const glm::ivec3 & b) {
+			return a.z != b.z ? a.z < b.z : a.y != b.y ? a.y < b.y : a.x < b.x;
+		});
+		groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+
+		[encoder setBytes:&options length:sizeof(options) atIndex:0];
+		setCoordinateList(encoder, groups, 1);
+
+		[encoder dispatchThreadgroups:MTLSizeMake(groups.size(), 1, 1)
+				threadsPerThreadgroup:MTLSizeMake(kGenMipGroupSize, kGenMipGroupSize, kGenMipGroupSize)];
+
+		remainMips -= options.numMipmapsToGenerate;
+		options.srcLevel += options.numMipmapsToGenerate;
+	}
+}
+
+void Texture3D::generateAnisotropicMips(id<MTLComputeCommandEncoder> encoder, Texture3D * const directions[6], const VoxelRegion & region)
+{
+	if (region.empty())
+		return;
+
+	[encoder setComputePipelineState:genAnisotropicMipPipelineState];
+
+	for (uint32_t level = 0; level < directions[0]->textureObjectViews.size(); ++level)
+	{
+		// The first directional level is built from this texture's first level, the next ones from the previous directional level.
+		for (uint32_t d = 0; d < 6; ++d)
+		{
+			[encoder setTexture:level == 0 ? textureObjectViews[0] : directions[d]->textureObjectViews[level - 1] atIndex:d];
+			[encoder setTexture:directions[d]->textureObjectViews[level] atIndex:6 + d];
+		}
+
+		auto dstView = directions[0]->textureObjectViews[level];
+		VoxelRegion dstRegion = region.atLevel(level + 1);
+		dstRegion.max = glm::min(dstRegion.max, glm::ivec3(dstView.width, dstView.height, dstView.depth));
+
+		AnisotropicMipUniformData params = {};
+		params.dstOffset[0] = dstRegion.min.x;
+		params.dstOffset[1] = dstRegion.min.y;
+		params.dstOffset[2] = dstRegion.min.z;
+		[encoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+
+		auto extent = glm::max(dstRegion.extent(), glm::ivec3(1));
+		dispatchCompute(encoder,
+						genAnisotropicMipPipelineState.threadExecutionWidth,
+						MTLSizeMake(extent.x, extent.y, extent.z));
+	}
+}
+
+void Texture3D::generateOpacity(id<MTLComputeCommandEncoder> encoder, Texture3D * opacity, const VoxelRegion & region)
+{
+	if (region.empty())
+		return;
+
+	[encoder setComputePipelineState:extractOpacityPipelineState];
+	[encoder setTexture:textureObjectViews[0] atIndex:0];
+	[encoder setTexture:opacity->textureObjectViews[0] atIndex:1];
+
+	ExtractOpacityUniformData params = {};
+	params.offset[0] = region.min.x;
+	params.offset[1] = region.min.y;
+	params.offset[2] = region.min.z;
+	[encoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+
+	auto extent = region.extent();
+	dispatchCompute(encoder,
+					extractOpacityPipelineState.threadExecutionWidth,
+					MTLSizeMake(extent.x, extent.y, extent.z));
+
+	// The RGBA8 mip kernel works on any float format.
+	opacity->generateMips(encoder, region);
+}
+
+void Texture3D::copyFirstLevelFromBuffer(id<MTLComputeCommandEncoder> encoder, id<MTLBuffer> buffer, VoxelLayout layout)
 {
 	[encoder setComputePipelineState:copyBufferPipelineState];
 	[encoder setTexture:textureObject atIndex:0];
 	[encoder setBuffer:buffer offset:0 atIndex:0];
 
+	// copyRgba8Buffer's CopyBufferParams
+	const uint32_t params = uint32_t(layout);
+	[encoder setBytes:&params length:sizeof(params) atIndex:Graphics::COMPUTE_PARAM_START_IDX];
+
 	dispatchCompute(encoder, copyBufferPipelineState.threadExecutionWidth, MTLSizeMake(width, height, depth));
 }
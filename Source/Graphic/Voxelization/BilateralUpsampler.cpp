@@ -0,0 +1,71 @@
+#include "BilateralUpsampler.h"
+
+#include <cmath>
+
+#include "ScreenGBuffer.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+constexpr float BilateralUpsampler::DEPTH_TOLERANCE;
+constexpr float BilateralUpsampler::NORMAL_POWER;
+constexpr float BilateralUpsampler::MIN_WEIGHT;
+
+BilateralUpsampler::BilateralUpsampler(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+glm::vec3 BilateralUpsampler::upsamplePixel(const ScreenGBuffer & low, const std::vector<glm::vec3> & lowLight, uint32_t scale,
+											const glm::vec2 & pixelCenter, const glm::vec3 & normal, float distance)
+{
+	// Low resolution pixel i is centered on full resolution pixel (i + 0.5) * scale.
+	const glm::vec2 f = pixelCenter / float(scale) - 0.5f;
+	const glm::vec2 base = glm::floor(f);
+	const glm::vec2 t = f - base;
+	const glm::ivec2 last(int(low.getWidth()) - 1, int(low.getHeight()) - 1);
+
+	glm::vec3 sum(0.0f), fallback(0.0f);
+	float total = 0.0f, bestGeometric = -1.0f;
+	for (int corner = 0; corner < 4; ++corner)
+	{
+		const glm::ivec2 offset(corner & 1, corner >> 1);
+		const glm::ivec2 p = glm::clamp(glm::ivec2(base) + offset, glm::ivec2(0), last);
+		const ScreenGBuffer::Sample & sample = low.at(uint32_t(p.x), uint32_t(p.y));
+		if (!sample.covered())
+			continue;
+
+		const float bilinear = (offset.x ? t.x : 1.0f - t.x) * (offset.y ? t.y : 1.0f - t.y);
+		const float depthWeight = std::exp(-std::abs(sample.distance - distance) / (DEPTH_TOLERANCE * distance));
+		const float normalWeight = std::pow(std::max(glm::dot(sample.normal, normal), 0.0f), NORMAL_POWER);
+		const float geometric = depthWeight * normalWeight;
+		const glm::vec3 & value = lowLight[size_t(p.y) * low.getWidth() + p.x];
+		if (geometric > bestGeometric)
+		{
+			bestGeometric = geometric;
+			fallback = value;
+		}
+		sum += bilinear * geometric * value;
+		total += bilinear * geometric;
+	}
+	return total > MIN_WEIGHT ? sum / total : fallback;
+}
+
+BilateralUpsampler::Stats BilateralUpsampler::upsample(const ScreenGBuffer & low, const std::vector<glm::vec3> & lowLight,
+													   const ScreenGBuffer & full, uint32_t scale, std::vector<glm::vec3> & light) const
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+	stats.pixels = size_t(full.getWidth()) * full.getHeight();
+	const double startTime = Time::currentTime();
+
+	light.assign(stats.pixels, glm::vec3(0.0f));
+	threadPool.parallelFor(full.getHeight(), 4, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t y = begin; y < end; ++y)
+			for (uint32_t x = 0; x < full.getWidth(); ++x)
+			{
+				const ScreenGBuffer::Sample & sample = full.at(x, uint32_t(y));
+				if (sample.covered())
+					light[y * full.getWidth() + x] = upsamplePixel(low, lowLight, scale, glm::vec2(x + 0.5f, y + 0.5f), sample.normal, sample.distance);
+			}
+	});
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
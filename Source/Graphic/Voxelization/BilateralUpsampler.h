@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+class ScreenGBuffer;
+class ThreadPool;
+
+/// <summary> CPU version of upsampleIndirectDiffuse in voxel_cone_tracing.metal: joint bilateral upsampling of the
+/// indirect diffuse light traced at half or quarter resolution. Each full resolution pixel blends the 4 nearest low
+/// resolution pixels with their bilinear weights, times how close their distance to the camera and their normal are
+/// to its own, so that light doesn't bleed across depth or orientation edges. Keep them in sync. </summary>
+class BilateralUpsampler {
+public:
+	/// <summary> Distance difference, relative to the distance of the pixel, at which a sample weighs 1/e. </summary>
+	static constexpr float DEPTH_TOLERANCE = 0.05f;
+	/// <summary> Exponent of the cosine between the normals. </summary>
+	static constexpr float NORMAL_POWER = 8.0f;
+	/// <summary> Below this total weight, the sample with the best geometric weight is used as is. </summary>
+	static constexpr float MIN_WEIGHT = 1e-4f;
+
+	struct Stats {
+		size_t pixels = 0;
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double pixelsPerSecond() const { return seconds > 0 ? pixels / seconds : 0; }
+	};
+
+	explicit BilateralUpsampler(ThreadPool & threadPool);
+
+	/// <summary> Upsamples light traced at the pixels of low (low = full.downsample(scale), one value per pixel of low)
+	/// to every covered pixel of full. Uncovered pixels get black. </summary>
+	Stats upsample(const ScreenGBuffer & low, const std::vector<glm::vec3> & lowLight, const ScreenGBuffer & full, uint32_t scale,
+				   std::vector<glm::vec3> & light) const;
+
+	/// <summary> One full resolution pixel (pixelCenter in full resolution pixels) of the given normal and distance. </summary>
+	static glm::vec3 upsamplePixel(const ScreenGBuffer & low, const std::vector<glm::vec3> & lowLight, uint32_t scale,
+								   const glm::vec2 & pixelCenter, const glm::vec3 & normal, float distance);
+
+private:
+	ThreadPool & threadPool;
+};
@@ -0,0 +1,229 @@
+#include "BrickPagedVolume.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "VoxelGrid.h"
+#include "VoxelMipChain.h"
+#include "../../Time/Time.h"
+
+namespace
+{
+// Texture3D only supports up to 7 mipmap levels.
+constexpr uint32_t kMaxLevels = 7;
+
+// The pool grows by this many bricks when the free list runs out.
+constexpr uint32_t kPoolGrowth = 64;
+}
+
+constexpr uint32_t BrickPagedVolume::BRICK_SIZE;
+constexpr uint32_t BrickPagedVolume::NO_BRICK;
+
+BrickPagedVolume::BrickPagedVolume(uint32_t _size, bool _storeVoxels) : size(_size), storeVoxels(_storeVoxels)
+{
+	assert(size >= BRICK_SIZE && (size & (size - 1)) == 0);
+
+	uint32_t levelCount = 1;
+	while ((size >> levelCount) > 0 && levelCount < kMaxLevels) ++levelCount;
+
+	levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		levels[i].size = std::max(1u, size >> i);
+		levels[i].pages = std::max(1u, levels[i].size / BRICK_SIZE);
+		levels[i].pageTable.assign(size_t(levels[i].pages) * levels[i].pages * levels[i].pages, NO_BRICK);
+	}
+	updateStats();
+}
+
+uint32_t BrickPagedVolume::allocateBrick()
+{
+	if (freeBricks.empty())
+	{
+		// Lowest indices on top, so that the pool fills from the start.
+		for (uint32_t i = 0; i < kPoolGrowth; ++i) freeBricks.push_back(poolBricks + kPoolGrowth - 1 - i);
+		poolBricks += kPoolGrowth;
+		if (storeVoxels) brickPool.resize(size_t(poolBricks) * BRICK_VOXELS);
+	}
+	const uint32_t brick = freeBricks.back();
+	freeBricks.pop_back();
+	return brick;
+}
+
+void BrickPagedVolume::freeBrick(uint32_t brick)
+{
+	freeBricks.push_back(brick);
+}
+
+BrickPagedVolume::Stats BrickPagedVolume::updateResidency(const std::vector<VoxelRegion> & regions)
+{
+	const double startTime = Time::currentTime();
+
+	// Residency wanted by each level, the coarser ones from their children.
+	std::vector<std::vector<uint8_t>> wanted(levels.size());
+	const int pages0 = int(levels[0].pages);
+	wanted[0].assign(levels[0].pageTable.size(), 0);
+	for (auto & region : regions) if (!region.empty())
+	{
+		const glm::ivec3 lo = glm::max(region.min / int(BRICK_SIZE), glm::ivec3(0));
+		const glm::ivec3 hi = glm::min((region.max - 1) / int(BRICK_SIZE), glm::ivec3(pages0 - 1));
+		for (int z = lo.z; z <= hi.z; ++z)
+			for (int y = lo.y; y <= hi.y; ++y)
+				for (int x = lo.x; x <= hi.x; ++x)
+					wanted[0][(size_t(z) * pages0 + y) * pages0 + x] = 1;
+	}
+	for (uint32_t level = 1; level < levels.size(); ++level)
+	{
+		const uint32_t pages = levels[level].pages;
+		const uint32_t childPages = levels[level - 1].pages;
+		const uint32_t ratio = childPages / pages;
+		wanted[level].assign(levels[level].pageTable.size(), 0);
+		for (uint32_t z = 0; z < childPages; ++z)
+			for (uint32_t y = 0; y < childPages; ++y)
+				for (uint32_t x = 0; x < childPages; ++x)
+					if (wanted[level - 1][(size_t(z) * childPages + y) * childPages + x])
+						wanted[level][(size_t(z / ratio) * pages + y / ratio) * pages + x / ratio] = 1;
+	}
+
+	// Bricks that must be cleared and mipped: the resident ones and the ones about to be freed.
+	updatedBricks.clear();
+	for (int z = 0; z < pages0; ++z)
+		for (int y = 0; y < pages0; ++y)
+			for (int x = 0; x < pages0; ++x)
+			{
+				const glm::ivec3 brick(x, y, z);
+				if (wanted[0][(size_t(z) * pages0 + y) * pages0 + x] || isResident(0, brick))
+					updatedBricks.push_back(brick);
+			}
+
+	stats.allocatedBricks = stats.freedBricks = 0;
+	for (uint32_t level = 0; level < levels.size(); ++level)
+	{
+		auto & pageTable = levels[level].pageTable;
+		for (size_t i = 0; i < pageTable.size(); ++i)
+		{
+			if (wanted[level][i] && pageTable[i] == NO_BRICK)
+			{
+				pageTable[i] = allocateBrick();
+				++stats.allocatedBricks;
+			}
+			else if (!wanted[level][i] && pageTable[i] != NO_BRICK)
+			{
+				freeBrick(pageTable[i]);
+				pageTable[i] = NO_BRICK;
+				++stats.freedBricks;
+			}
+		}
+	}
+
+	updateStats();
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+BrickPagedVolume::Stats BrickPagedVolume::voxelize(const std::vector<VoxelFragment> & fragments)
+{
+	assert(storeVoxels);
+	const double startTime = Time::currentTime();
+
+	// One region per occupied brick.
+	std::vector<VoxelRegion> regions;
+	{
+		const uint32_t pages = levels[0].pages;
+		std::vector<uint8_t> occupied(levels[0].pageTable.size(), 0);
+		for (auto & fragment : fragments)
+		{
+			const glm::ivec3 brick = glm::ivec3(fragment.x(), fragment.y(), fragment.z()) / int(BRICK_SIZE);
+			uint8_t & o = occupied[(size_t(brick.z) * pages + brick.y) * pages + brick.x];
+			if (o) continue;
+			o = 1;
+			regions.emplace_back(brick * int(BRICK_SIZE), (brick + 1) * int(BRICK_SIZE));
+		}
+	}
+	updateResidency(regions);
+
+	// Only the resident bricks are cleared, the other ones don't exist.
+	for (auto & brick : updatedBricks)
+		if (isResident(0, brick))
+			std::fill_n(brickVoxels(page(0, brick)), BRICK_VOXELS, 0u);
+
+	for (auto & fragment : fragments)
+	{
+		const uint32_t x = fragment.x(), y = fragment.y(), z = fragment.z();
+		const uint32_t brick = page(0, glm::ivec3(x, y, z) / int(BRICK_SIZE));
+		VoxelGrid::atomicMaxRgba8(&brickVoxels(brick)[brickIndex(x, y, z)], fragment.rgba8);
+	}
+
+	generateMips();
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+void BrickPagedVolume::generateMips()
+{
+	assert(storeVoxels);
+	for (uint32_t level = 1; level < levels.size(); ++level)
+	{
+		const Level & dst = levels[level];
+		const uint32_t srcLast = levels[level - 1].size - 1;
+		const uint32_t extent = std::min(dst.size, BRICK_SIZE);
+		for (uint32_t pz = 0; pz < dst.pages; ++pz)
+			for (uint32_t py = 0; py < dst.pages; ++py)
+				for (uint32_t px = 0; px < dst.pages; ++px)
+				{
+					const glm::ivec3 brick(px, py, pz);
+					if (!isResident(level, brick))
+						continue;
+
+					uint32_t * voxels = brickVoxels(page(level, brick));
+					for (uint32_t z = pz * BRICK_SIZE; z < pz * BRICK_SIZE + extent; ++z)
+						for (uint32_t y = py * BRICK_SIZE; y < py * BRICK_SIZE + extent; ++y)
+							for (uint32_t x = px * BRICK_SIZE; x < px * BRICK_SIZE + extent; ++x)
+							{
+								uint32_t texels[8];
+								for (int c = 0; c < 8; ++c)
+									texels[c] = fetch(level - 1,
+													  std::min(2 * x + (c & 1), srcLast),
+													  std::min(2 * y + ((c >> 1) & 1), srcLast),
+													  std::min(2 * z + (c >> 2), srcLast));
+								voxels[brickIndex(x, y, z)] = VoxelMipChain::averageRgba8(texels);
+							}
+				}
+	}
+}
+
+uint32_t BrickPagedVolume::fetch(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+{
+	const uint32_t brick = page(level, glm::ivec3(x, y, z) / int(BRICK_SIZE));
+	if (brick == NO_BRICK || !storeVoxels)
+		return 0;
+	return brickPool[size_t(brick) * BRICK_VOXELS + brickIndex(x, y, z)];
+}
+
+glm::vec4 BrickPagedVolume::textureLod(const glm::vec3 & coordinate, float mipmapLevel) const
+{
+	const float lod = glm::clamp(mipmapLevel, 0.0f, float(levels.size() - 1));
+	const uint32_t level0 = uint32_t(std::floor(lod));
+	const uint32_t level1 = std::min(level0 + 1, (uint32_t)levels.size() - 1);
+
+	auto sampleLevel = [&](uint32_t i) {
+		return VoxelMipChain::sampleTrilinear(coordinate, levels[i].size, [&](int x, int y, int z) { return fetch(i, x, y, z); });
+	};
+
+	const glm::vec4 a = sampleLevel(level0);
+	const float f = lod - float(level0);
+	return f > 0.0f && level1 != level0 ? glm::mix(a, sampleLevel(level1), f) : a;
+}
+
+void BrickPagedVolume::updateStats()
+{
+	const size_t brickBytes = BRICK_VOXELS * sizeof(uint32_t);
+	stats.poolBricks = poolBricks;
+	stats.residentBricks = poolBricks - freeBricks.size();
+	stats.residentBytes = stats.residentBricks * brickBytes;
+	stats.poolBytes = size_t(poolBricks) * brickBytes;
+	stats.pageTableBytes = 0;
+	for (auto & level : levels) stats.pageTableBytes += level.pageTable.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "CpuVoxelizer.h"
+#include "VoxelRegion.h"
+
+/// <summary> Two-level voxel volume: every mip level has a coarse page table of 8^3 bricks, and only the
+/// occupied bricks are stored, in a brick pool shared by all levels. Bricks come from a free list and are
+/// allocated and freed at each voxelization, so clearing and mip generation only touch resident bricks.
+/// Without voxel storage it only tracks residency, e.g. to know which bricks of the dense voxel Texture3D
+/// need to be cleared and mipped. </summary>
+class BrickPagedVolume {
+public:
+	/// <summary> Voxels per brick edge. </summary>
+	static constexpr uint32_t BRICK_SIZE = 8;
+	static constexpr uint32_t BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+	static constexpr uint32_t NO_BRICK = 0xffffffff;
+
+	struct Stats {
+		size_t residentBricks = 0;	// Over all levels.
+		size_t poolBricks = 0;		// Capacity of the brick pool, resident + free.
+		size_t allocatedBricks = 0;	// By the last update.
+		size_t freedBricks = 0;		// By the last update.
+		size_t residentBytes = 0;	// Voxels of the resident bricks.
+		size_t poolBytes = 0;		// Voxels of the whole pool (what a GPU pool must be sized to).
+		size_t pageTableBytes = 0;
+		double seconds = 0;
+	};
+
+	/// <summary> Size must be a power of 2, at least BRICK_SIZE. Same level count as Texture3D (capped to 7 levels). </summary>
+	BrickPagedVolume(uint32_t size, bool storeVoxels = true);
+
+	/// <summary> Makes the bricks covered by a list of first level regions resident, and the others free.
+	/// A coarser brick is resident if any of its children is. Returns the stats of the update. </summary>
+	Stats updateResidency(const std::vector<VoxelRegion> & regions);
+
+	/// <summary> Voxelizes a fragment list (requires voxel storage): updates the residency from the fragments,
+	/// clears the resident bricks, max-blends the fragments and regenerates the mips of the resident bricks. </summary>
+	Stats voxelize(const std::vector<VoxelFragment> & fragments);
+
+	/// <summary> Rebuilds the resident bricks of every mip level with the same 2x2x2 box filter as VoxelMipChain. </summary>
+	void generateMips();
+
+	/// <summary> First level bricks (in brick coordinates) that are resident, or were freed by the last update:
+	/// the only ones whose voxels may be non zero or stale. </summary>
+	const std::vector<glm::ivec3> & getUpdatedBricks() const { return updatedBricks; }
+
+	uint32_t getSize() const { return size; }
+	uint32_t getLevelCount() const { return (uint32_t)levels.size(); }
+	bool isResident(uint32_t level, const glm::ivec3 & brick) const { return page(level, brick) != NO_BRICK; }
+	const Stats & getStats() const { return stats; }
+
+	/// <summary> RGBA8 texel of a level, transparent black outside the resident bricks. Coordinates must be inside the level. </summary>
+	uint32_t fetch(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const;
+
+	/// <summary> Same as textureLod in common.metal (and VoxelMipChain::textureLod). Coordinates are in [0, 1]. </summary>
+	glm::vec4 textureLod(const glm::vec3 & coordinate, float mipmapLevel) const;
+
+private:
+	struct Level {
+		uint32_t size;		// Voxels per edge.
+		uint32_t pages;		// Bricks per edge.
+		std::vector<uint32_t> pageTable;
+	};
+
+	uint32_t & page(uint32_t level, const glm::ivec3 & brick)
+	{
+		const Level & l = levels[level];
+		return levels[level].pageTable[(size_t(brick.z) * l.pages + brick.y) * l.pages + brick.x];
+	}
+	uint32_t page(uint32_t level, const glm::ivec3 & brick) const { return const_cast<BrickPagedVolume *>(this)->page(level, brick); }
+
+	uint32_t * brickVoxels(uint32_t brick) { return &brickPool[size_t(brick) * BRICK_VOXELS]; }
+	static uint32_t brickIndex(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return ((z % BRICK_SIZE) * BRICK_SIZE + y % BRICK_SIZE) * BRICK_SIZE + x % BRICK_SIZE;
+	}
+
+	// Free list pool allocator.
+	uint32_t allocateBrick();
+	void freeBrick(uint32_t brick);
+
+	void updateStats();
+
+	uint32_t size;
+	bool storeVoxels;
+	std::vector<Level> levels;
+	std::vector<uint32_t> brickPool;
+	std::vector<uint32_t> freeBricks;
+	uint32_t poolBricks = 0;
+	std::vector<glm::ivec3> updatedBricks;
+	Stats stats;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glm.hpp>
+
+#include "VoxelLighting.h"
+
+// CPU mirror of the cone tracing functions of Shaders/VoxelConeTracing/voxel_cone_tracing.metal
+// for the [-1, 1] voxel volume. Keep them in sync.
+namespace CpuConeTracer {
+
+constexpr float MIPMAP_HARDCAP = 5.4f;
+constexpr float DIFFUSE_INDIRECT_FACTOR = 0.52f;
+constexpr float DIFFUSE_CONE_SPREAD = 0.325f;
+constexpr float MULTI_BOUNCE_FACTOR = 0.25f;
+
+/// <summary> Same as traceShadowCone: soft shadow blend (1 = lit) between a surface point and a light.
+/// opacity(coordinate, mipmapLevel) returns the voxel opacity in [0, 1] at a [0, 1] volume coordinate,
+/// e.g. VoxelMipChain::textureLod(...).a or VoxelOpacityVolume::textureLod. </summary>
+template <typename OpacityFunction>
+float traceShadowCone(const glm::vec3 & position, const glm::vec3 & normal, const glm::vec3 & direction,
+					  float targetDistance, uint32_t voxelTextureSize, const OpacityFunction & opacity)
+{
+	const float voxelSize = 1.0f / voxelTextureSize;
+	const glm::vec3 from = position + normal * 0.05f;
+
+	float acc = 0;
+	float dist = 3 * voxelSize;
+	const float stop = targetDistance - 16 * voxelSize;
+
+	while (dist < stop && acc < 1) {
+		const glm::vec3 c = from + dist * direction;
+		if (glm::any(glm::greaterThanEqual(glm::abs(c), glm::vec3(1.0f)))) break;
+		const glm::vec3 coordinate = 0.5f * c + 0.5f;
+		const float l = dist * dist;
+		const float s = 0.5f * opacity(coordinate, l) + 0.03f * opacity(coordinate, 2 * l);
+		acc += (1 - acc) * s;
+		dist += 0.9f * voxelSize * (1 + 0.05f * l);
+	}
+
+	const float x = glm::clamp(acc * 1.4f, 0.0f, 1.0f);
+	return 1 - std::pow(x * x * (3 - 2 * x), 1.0f / 1.4f);
+}
+
+/// <summary> Same as traceDiffuseVoxelCone: radiance gathered by a diffuse cone. voxels(coordinate, mipmapLevel)
+/// returns the RGBA voxel in [0, 1] at a [0, 1] volume coordinate, e.g. VoxelMipChain::textureLod. </summary>
+template <typename VoxelFunction>
+glm::vec3 traceDiffuseCone(const glm::vec3 & from, glm::vec3 direction, float coneSpread,
+						   uint32_t voxelTextureSize, const VoxelFunction & voxels)
+{
+	const float voxelSize = 1.0f / voxelTextureSize;
+	direction = glm::normalize(direction);
+
+	glm::vec4 acc(0.0f);
+	float dist = 0.1953125f;
+
+	while (dist < 1.414213f && acc.a < 1) {
+		const glm::vec3 c = from + dist * direction;
+		const float radius = 2 * coneSpread * dist / voxelSize;
+		const float level = std::log2(radius);
+		const glm::vec3 coordinate = 0.5f * c + 0.5f;
+		if (glm::any(glm::greaterThanEqual(glm::abs(coordinate), glm::vec3(1.0f)))) break;
+		const glm::vec4 voxel = voxels(coordinate, std::min(MIPMAP_HARDCAP, level));
+		acc += VoxelLighting::attenuate(dist) * voxel * ((1 - voxel.a) * (1 - voxel.a));
+		dist += radius * voxelSize;
+	}
+	return glm::pow(glm::vec3(acc) * 2.0f, glm::vec3(1.5f));
+}
+
+/// <summary> Same as traceDiffuseCones: sum of the 9 diffuse cones of a surface point (isotropic voxels). </summary>
+template <typename VoxelFunction>
+glm::vec3 traceDiffuseCones(const glm::vec3 & position, const glm::vec3 & normal, uint32_t voxelTextureSize, const VoxelFunction & voxels)
+{
+	const float ANGLE_MIX = 0.5f;
+	const float CONE_OFFSET = -0.01f;
+	const float voxelSize = 1.0f / voxelTextureSize;
+
+	// Same base as orthogonal() in the shader.
+	const glm::vec3 u = glm::normalize(normal);
+	const glm::vec3 v(0.99146f, 0.11664f, 0.05832f);
+	const glm::vec3 ortho = glm::normalize(std::abs(glm::dot(u, v)) > 0.99999f ? glm::cross(u, glm::vec3(0, 1, 0)) : glm::cross(u, v));
+	const glm::vec3 ortho2 = glm::normalize(glm::cross(ortho, normal));
+	const glm::vec3 corner = 0.5f * (ortho + ortho2);
+	const glm::vec3 corner2 = 0.5f * (ortho - ortho2);
+
+	const glm::vec3 origin = position + normal * (1 + 4 * 0.707106f) * voxelSize;
+	auto cone = [&](const glm::vec3 & offset, const glm::vec3 & direction) {
+		return traceDiffuseCone(origin + CONE_OFFSET * offset, direction, DIFFUSE_CONE_SPREAD, voxelTextureSize, voxels);
+	};
+
+	glm::vec3 acc = cone(normal, normal);
+	acc += cone(ortho, glm::mix(normal, ortho, ANGLE_MIX));
+	acc += cone(-ortho, glm::mix(normal, -ortho, ANGLE_MIX));
+	acc += cone(ortho2, glm::mix(normal, ortho2, ANGLE_MIX));
+	acc += cone(-ortho2, glm::mix(normal, -ortho2, ANGLE_MIX));
+	acc += cone(corner, glm::mix(normal, corner, ANGLE_MIX));
+	acc += cone(-corner, glm::mix(normal, -corner, ANGLE_MIX));
+	acc += cone(corner2, glm::mix(normal, corner2, ANGLE_MIX));
+	acc += cone(-corner2, glm::mix(normal, -corner2, ANGLE_MIX));
+	return acc;
+}
+
+/// <summary> Same as traceDiffuseConePattern: estimate of traceDiffuseCones from the front cone, one side cone and one
+/// corner cone, the base turned by rotation + pattern * 90 degrees (pattern < 4). The average of the 4 patterns is
+/// traceDiffuseCones with its base turned by rotation. </summary>
+template <typename VoxelFunction>
+glm::vec3 traceDiffuseConePattern(const glm::vec3 & position, const glm::vec3 & normal, uint32_t pattern, float rotation,
+								  uint32_t voxelTextureSize, const VoxelFunction & voxels)
+{
+	const float ANGLE_MIX = 0.5f;
+	const float CONE_OFFSET = -0.01f;
+	const float voxelSize = 1.0f / voxelTextureSize;
+
+	const glm::vec3 u = glm::normalize(normal);
+	const glm::vec3 v(0.99146f, 0.11664f, 0.05832f);
+	const glm::vec3 ortho = glm::normalize(std::abs(glm::dot(u, v)) > 0.99999f ? glm::cross(u, glm::vec3(0, 1, 0)) : glm::cross(u, v));
+	const glm::vec3 ortho2 = glm::normalize(glm::cross(ortho, normal));
+	const float angle = rotation + float(pattern) * 1.57079633f;
+	const glm::vec3 side = std::cos(angle) * ortho + std::sin(angle) * ortho2;
+	const glm::vec3 side2 = std::cos(angle) * ortho2 - std::sin(angle) * ortho;
+	const glm::vec3 corner = 0.5f * (side + side2);
+
+	const glm::vec3 origin = position + normal * (1 + 4 * 0.707106f) * voxelSize;
+	auto cone = [&](const glm::vec3 & offset, const glm::vec3 & direction) {
+		return traceDiffuseCone(origin + CONE_OFFSET * offset, direction, DIFFUSE_CONE_SPREAD, voxelTextureSize, voxels);
+	};
+
+	glm::vec3 acc = cone(normal, normal);
+	acc += 4.0f * cone(side, glm::mix(normal, side, ANGLE_MIX));
+	acc += 4.0f * cone(corner, glm::mix(normal, corner, ANGLE_MIX));
+	return acc;
+}
+
+}
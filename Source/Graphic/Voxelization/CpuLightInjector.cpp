@@ -0,0 +1,93 @@
+#include "CpuLightInjector.h"
+
+#include "CpuConeTracer.h"
+#include "VoxelGBuffer.h"
+#include "VoxelGrid.h"
+#include "VoxelLighting.h"
+#include "VoxelMipChain.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+namespace
+{
+constexpr size_t kVoxelGrainSize = 4096;
+// Each voxel traces 9 cones, much smaller batches balance better.
+constexpr size_t kBounceGrainSize = 64;
+}
+
+constexpr uint32_t CpuLightInjector::BOUNCE_SUBSETS;
+
+CpuLightInjector::CpuLightInjector(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+CpuLightInjector::Stats CpuLightInjector::inject(const VoxelGBuffer & gBuffer, const std::vector<PointLight> & pointLights, VoxelGrid & radiance,
+												 const VoxelGrid * bounce)
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+	stats.voxels = gBuffer.occupied.size();
+	const double startTime = Time::currentTime();
+
+	const uint32_t size = gBuffer.getSize();
+	const float invSize = 1.0f / size;
+
+	threadPool.parallelFor(gBuffer.occupied.size(), kVoxelGrainSize, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			const uint32_t voxelIndex = gBuffer.occupied[i];
+			const uint32_t x = voxelIndex % size, y = (voxelIndex / size) % size, z = voxelIndex / (size * size);
+			const glm::vec3 worldPosition = (glm::vec3(x, y, z) + 0.5f) * invSize * 2.0f - 1.0f;
+
+			const glm::vec4 albedo = VoxelGrid::rgba8ToVec4(gBuffer.albedo.data()[voxelIndex]) / 255.0f;
+			const glm::vec4 normal = VoxelGrid::rgba8ToVec4(gBuffer.normal.data()[voxelIndex]) / 255.0f;
+			const glm::vec4 emissive = VoxelGrid::rgba8ToVec4(gBuffer.emissive.data()[voxelIndex]) / 255.0f;
+
+			glm::vec4 res = 255.0f * VoxelLighting::injectedRadiance(worldPosition, albedo, normal, emissive, pointLights);
+			if (bounce)
+				res += glm::vec4(glm::vec3(VoxelGrid::rgba8ToVec4(bounce->data()[voxelIndex])), 0.0f);
+			radiance.data()[voxelIndex] = VoxelGrid::vec4ToRgba8(res);
+		}
+	});
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+CpuLightInjector::Stats CpuLightInjector::injectBounce(const VoxelGBuffer & gBuffer, const VoxelMipChain & radiance, uint32_t subset, VoxelGrid & bounce)
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+	const double startTime = Time::currentTime();
+
+	const uint32_t size = gBuffer.getSize();
+	const float invSize = 1.0f / size;
+
+	std::vector<uint32_t> voxels;
+	for (uint32_t voxelIndex : gBuffer.occupied)
+	{
+		const uint32_t x = voxelIndex % size, y = (voxelIndex / size) % size, z = voxelIndex / (size * size);
+		if (bounceSubset(x, y, z) == subset)
+			voxels.push_back(voxelIndex);
+	}
+	stats.voxels = voxels.size();
+
+	auto sample = [&](const glm::vec3 & coordinate, float mipmapLevel) { return radiance.textureLod(coordinate, mipmapLevel); };
+	threadPool.parallelFor(voxels.size(), kBounceGrainSize, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			const uint32_t voxelIndex = voxels[i];
+			const uint32_t x = voxelIndex % size, y = (voxelIndex / size) % size, z = voxelIndex / (size * size);
+			const glm::vec3 worldPosition = (glm::vec3(x, y, z) + 0.5f) * invSize * 2.0f - 1.0f;
+
+			const glm::vec4 albedo = VoxelGrid::rgba8ToVec4(gBuffer.albedo.data()[voxelIndex]) / 255.0f;
+			const glm::vec4 normal = VoxelGrid::rgba8ToVec4(gBuffer.normal.data()[voxelIndex]) / 255.0f;
+			const glm::vec3 indirect = CpuConeTracer::traceDiffuseCones(worldPosition, glm::normalize(VoxelLighting::decodeVoxelNormal(normal)),
+																		size, sample);
+
+			const glm::vec3 color = CpuConeTracer::MULTI_BOUNCE_FACTOR * CpuConeTracer::DIFFUSE_INDIRECT_FACTOR * glm::vec3(albedo) * indirect;
+			bounce.data()[voxelIndex] = VoxelGrid::vec4ToRgba8(255.0f * glm::vec4(color, 1.0f));
+		}
+	});
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
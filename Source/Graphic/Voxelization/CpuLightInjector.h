@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "../Lighting/PointLight.h"
+
+class ThreadPool;
+class VoxelGBuffer;
+class VoxelGrid;
+class VoxelMipChain;
+
+/// <summary> CPU version of the injectLight kernel: lights the occupied voxels of a voxel G-buffer
+/// and writes the result to a radiance grid. Only the voxels of VoxelGBuffer::occupied are visited,
+/// so moving a light costs O(surface voxels) instead of re-voxelizing the scene.
+/// Also the CPU version of the injectBounce kernel, which adds further bounces of indirect light. </summary>
+class CpuLightInjector {
+public:
+	struct Stats {
+		size_t voxels = 0;
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double voxelsPerSecond() const { return seconds > 0 ? voxels / seconds : 0; }
+	};
+
+	/// <summary> The bounce pass traces one of this many interleaved subsets of the voxels per call:
+	/// the voxels at the same position in every 2x2x2 block. </summary>
+	static constexpr uint32_t BOUNCE_SUBSETS = 8;
+	static uint32_t bounceSubset(uint32_t x, uint32_t y, uint32_t z) { return (x & 1) | ((y & 1) << 1) | ((z & 1) << 2); }
+
+	explicit CpuLightInjector(ThreadPool & threadPool);
+
+	/// <summary> Voxels that are not in the occupied list are left untouched: clear the radiance grid
+	/// whenever the G-buffer was re-voxelized. The bounce grid, if any, is added to the direct light. </summary>
+	Stats inject(const VoxelGBuffer & gBuffer, const std::vector<PointLight> & pointLights, VoxelGrid & radiance,
+				 const VoxelGrid * bounce = nullptr);
+
+	/// <summary> Traces the indirect diffuse cones (same cone set as indirectDiffuseLight) through the radiance mips
+	/// at the occupied voxels of one subset (subset < BOUNCE_SUBSETS), and stores the light they reflect
+	/// (albedo * indirect diffuse) in the bounce grid. Injecting again with that grid adds one bounce, so calling
+	/// this for each subset in turn, re-injecting and regenerating the mips in between, converges to multi-bounce lighting. </summary>
+	Stats injectBounce(const VoxelGBuffer & gBuffer, const VoxelMipChain & radiance, uint32_t subset, VoxelGrid & bounce);
+
+private:
+	ThreadPool & threadPool;
+};
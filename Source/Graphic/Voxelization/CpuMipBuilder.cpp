@@ -0,0 +1,373 @@
+#include "CpuMipBuilder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+#include "VoxelBrickOccupancy.h"
+#include "VoxelMipChain.h"
+#include "VoxelSimd.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+namespace
+{
+constexpr uint32_t kTileTexels = CpuMipBuilder::TILE_SIZE * CpuMipBuilder::TILE_SIZE * CpuMipBuilder::TILE_SIZE;
+
+// One RGBA float texel per operation, the same arithmetic as the kernel: RGBA8 reads are c / 255, the 8 texels
+// are summed in the kernel's order then divided by 8, writes are clamped, scaled by 255 and rounded to nearest even.
+struct ScalarOps {
+	struct Texel { float c[4]; };
+
+	static Texel fromRgba8(uint32_t value)
+	{
+		Texel t;
+		for (int i = 0; i < 4; ++i) t.c[i] = float((value >> (8 * i)) & 0xff) / 255.0f;
+		return t;
+	}
+
+	static uint32_t toRgba8(const Texel & t)
+	{
+		uint32_t result = 0;
+		for (int i = 0; i < 4; ++i)
+			result |= uint32_t(std::nearbyint(std::min(std::max(t.c[i], 0.0f), 1.0f) * 255.0f)) << (8 * i);
+		return result;
+	}
+
+	static Texel average(const Texel texels[8])
+	{
+		Texel t = texels[0];
+		for (int j = 1; j < 8; ++j)
+			for (int i = 0; i < 4; ++i) t.c[i] += texels[j].c[i];
+		for (int i = 0; i < 4; ++i) t.c[i] *= 0.125f;
+		return t;
+	}
+
+	static Texel load(const float * p) { return { { p[0], p[1], p[2], p[3] } }; }
+	static void store(float * p, const Texel & t) { std::copy(t.c, t.c + 4, p); }
+};
+
+#if VOXEL_SIMD_AVX2 || VOXEL_SIMD_SSE2
+struct SimdOps {
+	using Texel = __m128;
+
+	static Texel fromRgba8(uint32_t value)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(value)), zero), zero);
+		return _mm_div_ps(_mm_cvtepi32_ps(c), _mm_set1_ps(255.0f));
+	}
+
+	static uint32_t toRgba8(Texel t)
+	{
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		const __m128i c = _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(255.0f)));
+		return uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(c, c), c)));
+	}
+
+	static Texel average(const Texel texels[8])
+	{
+		Texel t = texels[0];
+		for (int j = 1; j < 8; ++j) t = _mm_add_ps(t, texels[j]);
+		return _mm_mul_ps(t, _mm_set1_ps(0.125f));
+	}
+
+	static Texel load(const float * p) { return _mm_load_ps(p); }
+	static void store(float * p, Texel t) { _mm_store_ps(p, t); }
+};
+#elif VOXEL_SIMD_NEON
+struct SimdOps {
+	using Texel = float32x4_t;
+
+	static Texel fromRgba8(uint32_t value)
+	{
+		const uint16x8_t c = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(value)));
+		return vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(c))), vdupq_n_f32(255.0f));
+	}
+
+	static uint32_t toRgba8(Texel t)
+	{
+		const float32x4_t clamped = vminq_f32(vmaxq_f32(t, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+		const uint16x4_t c = vmovn_u32(vcvtnq_u32_f32(vmulq_f32(clamped, vdupq_n_f32(255.0f))));
+		return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(c, c))), 0);
+	}
+
+	static Texel average(const Texel texels[8])
+	{
+		Texel t = texels[0];
+		for (int j = 1; j < 8; ++j) t = vaddq_f32(t, texels[j]);
+		return vmulq_f32(t, vdupq_n_f32(0.125f));
+	}
+
+	static Texel load(const float * p) { return vld1q_f32(p); }
+	static void store(float * p, Texel t) { vst1q_f32(p, t); }
+};
+#else
+using SimdOps = ScalarOps;
+#endif
+
+// Offsets of the kernel's texel1..texel8, in units of the reduction stride.
+const int kCornerOffsets[8][3] = {
+	{ 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 0 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+};
+
+struct Batch {
+	const VoxelGrid * src;
+	VoxelGrid * dst[CpuMipBuilder::LEVELS_PER_BATCH];
+	uint32_t srcLevel;
+	uint32_t levelCount;
+	uint32_t firstSize;		// Of dst[0].
+};
+
+#if VOXEL_SIMD_AVX2
+// Two adjacent texels of the first level at once, rows point to the 4 source texels of each row (x0, x1, x0', x1').
+inline void firstLevelPair(const uint32_t * rows[4], float * out0, float * out1, uint32_t * dst)
+{
+	__m256 x0[4], x1[4];
+	for (int r = 0; r < 4; ++r)
+	{
+		const __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[r]));
+		const __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(texels));
+		const __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_unpackhi_epi64(texels, texels)));
+		x0[r] = _mm256_div_ps(_mm256_permute2f128_ps(lo, hi, 0x20), _mm256_set1_ps(255.0f));
+		x1[r] = _mm256_div_ps(_mm256_permute2f128_ps(lo, hi, 0x31), _mm256_set1_ps(255.0f));
+	}
+	// Rows are (y0, z0), (y1, z0), (y0, z1), (y1, z1), summed in the kernel's order.
+	__m256 sum = x0[0];
+	sum = _mm256_add_ps(sum, x1[0]);
+	sum = _mm256_add_ps(sum, x0[1]);
+	sum = _mm256_add_ps(sum, x0[2]);
+	sum = _mm256_add_ps(sum, x1[1]);
+	sum = _mm256_add_ps(sum, x1[2]);
+	sum = _mm256_add_ps(sum, x0[3]);
+	sum = _mm256_add_ps(sum, x1[3]);
+	sum = _mm256_mul_ps(sum, _mm256_set1_ps(0.125f));
+	_mm_store_ps(out0, _mm256_castps256_ps128(sum));
+	_mm_store_ps(out1, _mm256_extractf128_ps(sum, 1));
+
+	const __m256 clamped = _mm256_min_ps(_mm256_max_ps(sum, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+	const __m256i c = _mm256_cvtps_epi32(_mm256_mul_ps(clamped, _mm256_set1_ps(255.0f)));
+	const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+	_mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(words, words));
+}
+#endif
+
+// One 8^3 tile of the first level of a batch (one thread group of the kernel), tile is its first texel.
+template <typename Ops>
+void buildTile(const Batch & batch, const glm::uvec3 & tile, float * shared)
+{
+	using Texel = typename Ops::Texel;
+	const uint32_t n = std::min(CpuMipBuilder::TILE_SIZE, batch.firstSize);
+	const uint32_t srcLast = batch.src->getSize() - 1;
+	auto sharedIndex = [](uint32_t x, uint32_t y, uint32_t z) {
+		return ((z * CpuMipBuilder::TILE_SIZE + y) * CpuMipBuilder::TILE_SIZE + x) * 4;
+	};
+
+	// First level: trilinear sample at the texel center, i.e. the average of the 8 source texels.
+	for (uint32_t z = 0; z < n; ++z)
+		for (uint32_t y = 0; y < n; ++y)
+		{
+			const glm::uvec3 g(tile.x, tile.y + y, tile.z + z);
+			const uint32_t sy[2] = { std::min(2 * g.y, srcLast), std::min(2 * g.y + 1, srcLast) };
+			const uint32_t sz[2] = { std::min(2 * g.z, srcLast), std::min(2 * g.z + 1, srcLast) };
+			uint32_t x = 0;
+#if VOXEL_SIMD_AVX2
+			if (std::is_same<Ops, SimdOps>::value)
+			{
+				const uint32_t * rows[4] = {
+					&batch.src->data()[batch.src->index(2 * g.x, sy[0], sz[0])], &batch.src->data()[batch.src->index(2 * g.x, sy[1], sz[0])],
+					&batch.src->data()[batch.src->index(2 * g.x, sy[0], sz[1])], &batch.src->data()[batch.src->index(2 * g.x, sy[1], sz[1])]
+				};
+				uint32_t * dst = &batch.dst[0]->data()[batch.dst[0]->index(g.x, g.y, g.z)];
+				for (; x + 2 <= n; x += 2)
+				{
+					const uint32_t * pair[4] = { rows[0] + 2 * x, rows[1] + 2 * x, rows[2] + 2 * x, rows[3] + 2 * x };
+					firstLevelPair(pair, &shared[sharedIndex(x, y, z)], &shared[sharedIndex(x + 1, y, z)], dst + x);
+				}
+			}
+#endif
+			for (; x < n; ++x)
+			{
+				const uint32_t sx[2] = { std::min(2 * (g.x + x), srcLast), std::min(2 * (g.x + x) + 1, srcLast) };
+				Texel texels[8];
+				for (int c = 0; c < 8; ++c)
+					texels[c] = Ops::fromRgba8(batch.src->load(sx[kCornerOffsets[c][0]], sy[kCornerOffsets[c][1]], sz[kCornerOffsets[c][2]]));
+				const Texel texel = Ops::average(texels);
+				Ops::store(&shared[sharedIndex(x, y, z)], texel);
+				batch.dst[0]->store(g.x + x, g.y, g.z, Ops::toRgba8(texel));
+			}
+		}
+
+	// Next levels: reduce the unquantized texels in place, like the kernel's shared memory.
+	for (uint32_t level = 1; level < batch.levelCount; ++level)
+	{
+		const uint32_t stride = 1u << (level - 1);
+		const uint32_t srcSize = std::max(batch.firstSize >> (level - 1), 1u);
+		for (uint32_t z = 0; z < n; z += 2 * stride)
+			for (uint32_t y = 0; y < n; y += 2 * stride)
+				for (uint32_t x = 0; x < n; x += 2 * stride)
+				{
+					const glm::uvec3 g = tile + glm::uvec3(x, y, z);
+					const glm::bvec3 atEdge = glm::equal(g >> (level - 1), glm::uvec3(srcSize - 1));
+
+					// Same fallbacks as OUT_OF_BOUND_CHECK.
+					auto loadAt = [&](int c) {
+						return Ops::load(&shared[sharedIndex(x + kCornerOffsets[c][0] * stride, y + kCornerOffsets[c][1] * stride,
+															 z + kCornerOffsets[c][2] * stride)]);
+					};
+					Texel texels[8];
+					texels[0] = loadAt(0);
+					texels[1] = atEdge.x ? texels[0] : loadAt(1);
+					texels[2] = atEdge.y ? texels[0] : loadAt(2);
+					texels[3] = atEdge.z ? texels[0] : loadAt(3);
+					texels[4] = atEdge.x || atEdge.y ? texels[1] : loadAt(4);
+					texels[5] = atEdge.x || atEdge.z ? texels[1] : loadAt(5);
+					texels[6] = atEdge.y || atEdge.z ? texels[2] : loadAt(6);
+					texels[7] = atEdge.x || atEdge.y || atEdge.z ? texels[4] : loadAt(7);
+
+					const Texel texel = Ops::average(texels);
+					Ops::store(&shared[sharedIndex(x, y, z)], texel);
+					const glm::uvec3 d = g >> level;
+					batch.dst[level]->store(d.x, d.y, d.z, Ops::toRgba8(texel));
+				}
+	}
+}
+
+// Every texel of the tile is zero at every level of the batch.
+void clearTile(const Batch & batch, const glm::uvec3 & tile)
+{
+	const uint32_t n = std::min(CpuMipBuilder::TILE_SIZE, batch.firstSize);
+	for (uint32_t level = 0; level < batch.levelCount; ++level)
+	{
+		VoxelGrid & dst = *batch.dst[level];
+		const glm::uvec3 lo = tile >> level;
+		const uint32_t extent = std::max(n >> level, 1u);
+		for (uint32_t z = lo.z; z < lo.z + extent; ++z)
+			for (uint32_t y = lo.y; y < lo.y + extent; ++y)
+				std::fill_n(&dst.data()[dst.index(lo.x, y, z)], extent, 0u);
+	}
+}
+
+// Tiles (first texel) of the first level of a batch, z-major. Without regions, every tile.
+std::vector<glm::uvec3> listTiles(const Batch & batch, const std::vector<VoxelRegion> * regions)
+{
+	const int tiles = int((batch.firstSize + CpuMipBuilder::TILE_SIZE - 1) / CpuMipBuilder::TILE_SIZE);
+	std::vector<glm::uvec3> result;
+	if (!regions)
+	{
+		result.reserve(size_t(tiles) * tiles * tiles);
+		for (int z = 0; z < tiles; ++z)
+			for (int y = 0; y < tiles; ++y)
+				for (int x = 0; x < tiles; ++x)
+					result.push_back(glm::uvec3(x, y, z) * CpuMipBuilder::TILE_SIZE);
+		return result;
+	}
+
+	for (auto & region : *regions)
+	{
+		const VoxelRegion texels = region.atLevel(batch.srcLevel + 1);
+		if (texels.empty())
+			continue;
+		const glm::ivec3 lo = glm::clamp(texels.min / int(CpuMipBuilder::TILE_SIZE), glm::ivec3(0), glm::ivec3(tiles - 1));
+		const glm::ivec3 hi = glm::clamp((texels.max - 1) / int(CpuMipBuilder::TILE_SIZE), glm::ivec3(0), glm::ivec3(tiles - 1));
+		for (int z = lo.z; z <= hi.z; ++z)
+			for (int y = lo.y; y <= hi.y; ++y)
+				for (int x = lo.x; x <= hi.x; ++x)
+					result.push_back(glm::uvec3(x, y, z) * CpuMipBuilder::TILE_SIZE);
+	}
+	// Overlapping regions share tiles.
+	std::sort(result.begin(), result.end(), [](const glm::uvec3 & a, const glm::uvec3 & b) {
+		return a.z != b.z ? a.z < b.z : a.y != b.y ? a.y < b.y : a.x < b.x;
+	});
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
+
+template <typename Ops>
+void buildBatch(ThreadPool & threadPool, const Batch & batch, const std::vector<glm::uvec3> & tiles, size_t grainSize,
+				const VoxelBrickOccupancy * occupancy, CpuMipBuilder::Stats & stats)
+{
+	// A texel of the first level covers scale^3 voxels of level 0.
+	const int scale = 1 << (batch.srcLevel + 1);
+	std::atomic<size_t> emptyTiles{ 0 };
+	threadPool.parallelFor(tiles.size(), grainSize, [&](size_t begin, size_t end, unsigned int) {
+		alignas(32) float shared[kTileTexels * 4];
+		for (size_t i = begin; i < end; ++i)
+		{
+			const glm::uvec3 & tile = tiles[i];
+			const glm::ivec3 voxels = glm::ivec3(tile) * scale;
+			if (occupancy && !occupancy->isOccupied(VoxelRegion(voxels, voxels + int(CpuMipBuilder::TILE_SIZE) * scale)))
+			{
+				clearTile(batch, tile);
+				++emptyTiles;
+			}
+			else
+			{
+				buildTile<Ops>(batch, tile, shared);
+			}
+		}
+	});
+	stats.tiles += tiles.size();
+	stats.emptyTiles += emptyTiles;
+}
+}
+
+constexpr uint32_t CpuMipBuilder::LEVELS_PER_BATCH;
+constexpr uint32_t CpuMipBuilder::TILE_SIZE;
+
+CpuMipBuilder::CpuMipBuilder(ThreadPool & _threadPool) : threadPool(_threadPool)
+{
+}
+
+CpuMipBuilder::Stats CpuMipBuilder::build(VoxelMipChain & mipChain, bool useSimd, const VoxelBrickOccupancy * occupancy)
+{
+	return buildTiles(mipChain, nullptr, useSimd, occupancy);
+}
+
+CpuMipBuilder::Stats CpuMipBuilder::update(VoxelMipChain & mipChain, const std::vector<VoxelRegion> & regions, bool useSimd,
+										   const VoxelBrickOccupancy * occupancy)
+{
+	return buildTiles(mipChain, &regions, useSimd, occupancy);
+}
+
+CpuMipBuilder::Stats CpuMipBuilder::buildTiles(VoxelMipChain & mipChain, const std::vector<VoxelRegion> * regions, bool useSimd,
+											   const VoxelBrickOccupancy * occupancy)
+{
+	assert((mipChain.getSize() & (mipChain.getSize() - 1)) == 0);
+	assert(!occupancy || occupancy->getSize() == mipChain.getSize());
+	const double startTime = Time::currentTime();
+
+	Stats stats;
+	// Same batches as Texture3D::generateMips.
+	for (uint32_t srcLevel = 0; srcLevel + 1 < mipChain.getLevelCount(); srcLevel += LEVELS_PER_BATCH)
+	{
+		Batch batch;
+		batch.src = &mipChain.level(srcLevel);
+		batch.srcLevel = srcLevel;
+		batch.levelCount = std::min(LEVELS_PER_BATCH, mipChain.getLevelCount() - 1 - srcLevel);
+		for (uint32_t i = 0; i < batch.levelCount; ++i) batch.dst[i] = &mipChain.level(srcLevel + 1 + i);
+		batch.firstSize = batch.dst[0]->getSize();
+
+		const std::vector<glm::uvec3> tiles = listTiles(batch, regions);
+		if (srcLevel == 0)
+		{
+			// The level 0 voxels read by the tiles.
+			const size_t tileVoxels = 2 * std::min(TILE_SIZE, batch.firstSize);
+			stats.voxels = tiles.size() * tileVoxels * tileVoxels * tileVoxels;
+		}
+
+		// The whole volume goes by z-slabs of tiles, a list of tiles by a few tiles.
+		const uint32_t tilesPerAxis = (batch.firstSize + TILE_SIZE - 1) / TILE_SIZE;
+		const size_t grainSize = regions ? 4 : size_t(tilesPerAxis) * tilesPerAxis;
+		if (useSimd)
+			buildBatch<SimdOps>(threadPool, batch, tiles, grainSize, occupancy, stats);
+		else
+			buildBatch<ScalarOps>(threadPool, batch, tiles, grainSize, occupancy, stats);
+	}
+
+	stats.threads = threadPool.size();
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelRegion.h"
+
+class ThreadPool;
+class VoxelBrickOccupancy;
+class VoxelMipChain;
+
+/// <summary> CPU version of the generate3DMipmaps kernel, for offline baking and headless validation: builds the mip
+/// levels of a VoxelMipChain with the same 2x2x2 box filter, up to 4 levels per batch. Like a thread group, each 8^3
+/// tile of the first level of a batch keeps its filtered texels unquantized (the kernel's shared memory) and reduces
+/// them to the next levels of the batch, with the same edge clamping, so the result is bit-compatible with the kernel.
+/// Only the next batch starts from RGBA8 texels again (VoxelMipChain::generateMips requantizes every level, so its
+/// texels can differ by one). Texels are filtered with SIMD (AVX2, SSE2 or NEON, scalar otherwise) and z-slabs of
+/// tiles are spread over the threads. </summary>
+class CpuMipBuilder {
+public:
+	static constexpr uint32_t LEVELS_PER_BATCH = 4;
+	/// <summary> Texels per tile edge, the thread group size of the kernel. </summary>
+	static constexpr uint32_t TILE_SIZE = 8;
+
+	struct Stats {
+		size_t voxels = 0;		// Of the first level, read by the tiles of the first batch.
+		size_t tiles = 0;
+		size_t emptyTiles = 0;	// Skipped thanks to the brick occupancy.
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double voxelsPerSecond() const { return seconds > 0 ? voxels / seconds : 0; }
+	};
+
+	explicit CpuMipBuilder(ThreadPool & threadPool);
+
+	/// <summary> Rebuilds every level from the first one. The size must be a power of 2.
+	/// Without SIMD, the scalar path runs instead (same result), e.g. to validate or compare them.
+	/// With the brick occupancy of the first level, the tiles covering empty bricks only are written as zeros
+	/// without reading their source texels (same result as long as the occupancy is conservative). </summary>
+	Stats build(VoxelMipChain & mipChain, bool useSimd = true, const VoxelBrickOccupancy * occupancy = nullptr);
+
+	/// <summary> Incremental version of build(): only the mip texels covering regions of the first level (e.g. the dirty
+	/// regions of a partial re-voxelization) are rebuilt, by whole tiles, so they end up the same as after build().
+	/// The tiles of each batch come from the regions taken to its first level, the coarser the fewer. </summary>
+	Stats update(VoxelMipChain & mipChain, const std::vector<VoxelRegion> & regions, bool useSimd = true,
+				 const VoxelBrickOccupancy * occupancy = nullptr);
+
+private:
+	/// <summary> Without regions, every tile. </summary>
+	Stats buildTiles(VoxelMipChain & mipChain, const std::vector<VoxelRegion> * regions, bool useSimd,
+					 const VoxelBrickOccupancy * occupancy);
+
+	ThreadPool & threadPool;
+};
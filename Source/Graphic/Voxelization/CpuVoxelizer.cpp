@@ -0,0 +1,610 @@
+#include "CpuVoxelizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "EpochVoxelGrid.h"
+#include "VoxelBrickOccupancy.h"
+#include "VoxelGBuffer.h"
+#include "VoxelGrid.h"
+#include "VoxelLighting.h"
+#include "VoxelSimd.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+namespace
+{
+// Number of triangles a worker grabs at once.
+constexpr size_t kTriangleGrainSize = 64;
+constexpr size_t kVertexGrainSize = 4096;
+
+// Private tiles of the PRIVATE_TILES accumulation, the size of a VoxelBrickOccupancy brick.
+constexpr uint32_t kTileSize = 8;
+constexpr uint32_t kTileVoxels = kTileSize * kTileSize * kTileSize;
+// Key ranges of the SORTED_FRAGMENTS accumulation (at most), sorted and reduced independently.
+constexpr uint32_t kFragmentBucketBits = 10;
+
+/// Tiles a worker blended its fragments into, one per brick of the grid it wrote to.
+struct WorkerTiles
+{
+	std::unordered_map<uint32_t, uint32_t> tileOfBrick;
+	std::vector<uint32_t> bricks;	// Brick of each tile.
+	std::vector<uint32_t> voxels;	// kTileVoxels per tile.
+	uint32_t lastBrick = ~0u, lastTile = 0;
+
+	uint32_t * tile(uint32_t brick)
+	{
+		// Consecutive fragments mostly come from the same triangle, hence the same brick.
+		if (brick != lastBrick)
+		{
+			auto inserted = tileOfBrick.emplace(brick, uint32_t(bricks.size()));
+			if (inserted.second)
+			{
+				bricks.push_back(brick);
+				voxels.resize(voxels.size() + kTileVoxels, 0);
+			}
+			lastBrick = brick;
+			lastTile = inserted.first->second;
+		}
+		return &voxels[size_t(lastTile) * kTileVoxels];
+	}
+};
+
+/// Per triangle constants of the triangle/box overlap test from
+/// "Fast Parallel Surface and Solid Voxelization on GPUs" (Schwarz & Seidel 2010),
+/// for unit sized voxels.
+struct TriangleSetup
+{
+	glm::vec3 n;
+	float d1, d2;
+	// Edge functions of the XY, YZ and ZX projections.
+	glm::vec2 nXY[3], nYZ[3], nZX[3];
+	float dXY[3], dYZ[3], dZX[3];
+
+	bool init(const glm::vec3 v[3])
+	{
+		const glm::vec3 e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+		n = glm::cross(e[0], v[2] - v[0]);
+		if (glm::dot(n, n) <= 1e-20f)
+			return false; // Degenerate, the rasterizer would drop it too.
+
+		const glm::vec3 c(n.x > 0 ? 1.0f : 0.0f, n.y > 0 ? 1.0f : 0.0f, n.z > 0 ? 1.0f : 0.0f);
+		d1 = glm::dot(n, c - v[0]);
+		d2 = glm::dot(n, glm::vec3(1.0f) - c - v[0]);
+
+		const float signXY = n.z >= 0 ? 1.0f : -1.0f;
+		const float signYZ = n.x >= 0 ? 1.0f : -1.0f;
+		const float signZX = n.y >= 0 ? 1.0f : -1.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			nXY[i] = glm::vec2(-e[i].y, e[i].x) * signXY;
+			dXY[i] = -glm::dot(nXY[i], glm::vec2(v[i].x, v[i].y)) + std::max(0.0f, nXY[i].x) + std::max(0.0f, nXY[i].y);
+
+			nYZ[i] = glm::vec2(-e[i].z, e[i].y) * signYZ;
+			dYZ[i] = -glm::dot(nYZ[i], glm::vec2(v[i].y, v[i].z)) + std::max(0.0f, nYZ[i].x) + std::max(0.0f, nYZ[i].y);
+
+			nZX[i] = glm::vec2(-e[i].x, e[i].z) * signZX;
+			dZX[i] = -glm::dot(nZX[i], glm::vec2(v[i].z, v[i].x)) + std::max(0.0f, nZX[i].x) + std::max(0.0f, nZX[i].y);
+		}
+		return true;
+	}
+};
+
+/// Barycentric coordinates of the closest point on the triangle's plane, clamped to the triangle.
+glm::vec3 clampedBarycentrics(const glm::vec3 v[3], const glm::vec3 & p)
+{
+	const glm::vec3 e0 = v[1] - v[0], e1 = v[2] - v[0], ep = p - v[0];
+	const float d00 = glm::dot(e0, e0), d01 = glm::dot(e0, e1), d11 = glm::dot(e1, e1);
+	const float d20 = glm::dot(ep, e0), d21 = glm::dot(ep, e1);
+	const float denom = d00 * d11 - d01 * d01;
+	float b1 = (d11 * d20 - d01 * d21) / denom;
+	float b2 = (d00 * d21 - d01 * d20) / denom;
+	glm::vec3 b = glm::max(glm::vec3(1.0f - b1 - b2, b1, b2), glm::vec3(0.0f));
+	return b / (b.x + b.y + b.z);
+}
+
+// Standard 8x MSAA sample positions of the voxelization render target, in 1/16 pixel from the pixel center (y down).
+constexpr int kSamplePattern[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+// Vertices are snapped to 1/256 pixel before the coverage tests.
+constexpr int kSubpixelBits = 8;
+
+/// Dominant axis of a triangle, with the same tie breaking as VS in voxelization.metal.
+uint32_t singlePassDominantAxis(const glm::vec3 v[3])
+{
+	const glm::vec3 n = glm::abs(glm::cross(v[1] - v[0], v[2] - v[0]));
+	if (n.z > n.x && n.z > n.y)
+		return 2;
+	if (n.x > n.y && n.x > n.z)
+		return 0;
+	return 1;
+}
+
+/// Rasterizes a voxel space triangle like the single pass voxelization draw: projected onto the plane of its dominant
+/// axis in a size x size viewport (window y pointing down), the 8 samples of each pixel tested with the top-left rule.
+/// Calls pixel(barycentrics) for every pixel with a covered sample, with the barycentrics of the pixel center (not
+/// clamped, attributes are extrapolated like the GPU does).
+template <typename PixelFunction>
+void rasterizeSinglePass(const glm::vec3 v[3], uint32_t size, const PixelFunction & pixel)
+{
+	const uint32_t axis = singlePassDominantAxis(v);
+	const uint32_t u = (axis + 1) % 3, w = (axis + 2) % 3;
+	const int64_t one = int64_t(1) << kSubpixelBits;
+
+	glm::vec2 window[3];
+	int64_t fx[3], fy[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		window[i] = glm::vec2(v[i][u], float(size) - v[i][w]);
+		fx[i] = std::llround(double(window[i].x) * one);
+		fy[i] = std::llround(double(window[i].y) * one);
+	}
+	const int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+	if (area == 0)
+		return;
+	// No culling: both windings are rasterized, the edges are walked so that the inside is positive.
+	const int order[3] = { 0, area > 0 ? 1 : 2, area > 0 ? 2 : 1 };
+	int64_t edgeX[3], edgeY[3], edgeBias[3];
+	for (int e = 0; e < 3; ++e)
+	{
+		const int a = order[e], b = order[(e + 1) % 3];
+		edgeX[e] = fx[b] - fx[a];
+		edgeY[e] = fy[b] - fy[a];
+		// Samples exactly on an edge belong to the triangle only for top and left edges.
+		const bool topLeft = (edgeY[e] == 0 && edgeX[e] > 0) || edgeY[e] < 0;
+		edgeBias[e] = (topLeft ? 0 : -1) - edgeX[e] * fy[a] + edgeY[e] * fx[a];
+	}
+
+	const float windowArea = (window[1].x - window[0].x) * (window[2].y - window[0].y) - (window[1].y - window[0].y) * (window[2].x - window[0].x);
+	const int64_t minX = std::max<int64_t>(0, std::min(fx[0], std::min(fx[1], fx[2])) / one);
+	const int64_t minY = std::max<int64_t>(0, std::min(fy[0], std::min(fy[1], fy[2])) / one);
+	const int64_t maxX = std::min<int64_t>(size - 1, std::max(fx[0], std::max(fx[1], fx[2])) / one);
+	const int64_t maxY = std::min<int64_t>(size - 1, std::max(fy[0], std::max(fy[1], fy[2])) / one);
+	for (int64_t py = minY; py <= maxY; ++py)
+	{
+		for (int64_t px = minX; px <= maxX; ++px)
+		{
+			bool covered = false;
+			for (int s = 0; s < 8 && !covered; ++s)
+			{
+				const int64_t sx = px * one + one / 2 + kSamplePattern[s][0] * one / 16;
+				const int64_t sy = py * one + one / 2 + kSamplePattern[s][1] * one / 16;
+				covered = true;
+				for (int e = 0; e < 3 && covered; ++e)
+					covered = edgeX[e] * sy - edgeY[e] * sx + edgeBias[e] >= 0;
+			}
+			if (!covered)
+				continue;
+
+			const glm::vec2 c(float(px) + 0.5f, float(py) + 0.5f);
+			const glm::vec2 e1 = window[1] - window[0], e2 = window[2] - window[0], ec = c - window[0];
+			const float b1 = (ec.x * e2.y - ec.y * e2.x) / windowArea;
+			const float b2 = (e1.x * ec.y - e1.y * ec.x) / windowArea;
+			pixel(glm::vec3(1.0f - b1 - b2, b1, b2));
+		}
+	}
+}
+}
+
+CpuVoxelizer::CpuVoxelizer(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+const char * CpuVoxelizer::getAccumulationName(Accumulation accumulation)
+{
+	switch (accumulation)
+	{
+		case Accumulation::PRIVATE_TILES: return "private tiles";
+		case Accumulation::SORTED_FRAGMENTS: return "sorted fragments";
+		default: return "atomic";
+	}
+}
+
+const char * CpuVoxelizer::getCoverageName(Coverage coverage)
+{
+	return coverage == Coverage::SINGLE_PASS_RASTER ? "single pass raster" : "conservative";
+}
+
+void CpuVoxelizer::transformVertices(const VoxelizationInput & input, float voxelScale)
+{
+	voxelPositions.resize(input.objects.size());
+	worldNormals.resize(input.objects.size());
+
+	for (size_t o = 0; o < input.objects.size(); ++o)
+	{
+		const auto & object = input.objects[o];
+		const auto & vertices = *object.vertices;
+		const glm::mat3 normalMatrix = glm::mat3(object.modelInverseTranspose);
+		voxelPositions[o].resize(vertices.size());
+		worldNormals[o].resize(vertices.size());
+
+		threadPool.parallelFor(vertices.size(), kVertexGrainSize, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				// World space [-1, 1] -> voxel space [0, size].
+				glm::vec3 world = glm::vec3(object.model * glm::vec4(vertices[i].position, 1.0f));
+				voxelPositions[o][i] = (world * 0.5f + 0.5f) * voxelScale;
+				glm::vec3 normal = normalMatrix * vertices[i].normal;
+				float len2 = glm::dot(normal, normal);
+				worldNormals[o][i] = len2 > 0 ? normal / std::sqrt(len2) : normal;
+			}
+		});
+	}
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelize(const VoxelizationInput & input, VoxelGrid & grid, bool clearVoxelizationFirst,
+										   VoxelBrickOccupancy * occupancy)
+{
+	const double startTime = Time::currentTime();
+
+	if (clearVoxelizationFirst)
+	{
+		grid.clear();
+		if (occupancy) occupancy->clear();
+	}
+
+	Stats stats = voxelizeLit(input, grid, VoxelRegion::full(grid.getSize()), occupancy);
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelize(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region,
+										   VoxelBrickOccupancy * occupancy)
+{
+	const double startTime = Time::currentTime();
+
+	grid.clear(region);
+
+	Stats stats = voxelizeLit(input, grid, region, occupancy);
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelizeLit(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region,
+											  VoxelBrickOccupancy * occupancy)
+{
+	if (accumulation == Accumulation::PRIVATE_TILES)
+		return voxelizeLitTiles(input, grid, region, occupancy);
+	if (accumulation == Accumulation::SORTED_FRAGMENTS)
+		return voxelizeLitSorted(input, grid, region, occupancy);
+
+	auto writeFragment = [&](unsigned int, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 & worldPosition, const glm::vec3 & normal) {
+		glm::vec4 res = 255.0f * VoxelLighting::voxelRadiance(worldPosition, normal, material, input.pointLights);
+		grid.atomicMax(grid.index(x, y, z), VoxelGrid::vec4ToRgba8(res));
+		if (occupancy) occupancy->mark(x, y, z);
+	};
+	return rasterize(input, grid.getSize(), region, writeFragment);
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelizeLitTiles(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region,
+												   VoxelBrickOccupancy * occupancy)
+{
+	const uint32_t size = grid.getSize();
+	const uint32_t bricksPerAxis = (size + kTileSize - 1) / kTileSize;
+
+	// No atomics while rasterizing: each worker only blends into its own tiles.
+	std::vector<WorkerTiles> workerTiles(threadPool.size());
+	auto writeFragment = [&](unsigned int worker, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 & worldPosition, const glm::vec3 & normal) {
+		glm::vec4 res = 255.0f * VoxelLighting::voxelRadiance(worldPosition, normal, material, input.pointLights);
+		const uint32_t brick = ((z / kTileSize) * bricksPerAxis + y / kTileSize) * bricksPerAxis + x / kTileSize;
+		uint32_t & voxel = workerTiles[worker].tile(brick)[((z % kTileSize) * kTileSize + y % kTileSize) * kTileSize + x % kTileSize];
+		voxel = VoxelSimd::maxRgba8(voxel, VoxelGrid::vec4ToRgba8(res));
+	};
+	Stats stats = rasterize(input, size, region, writeFragment);
+
+	// Group the tiles by brick (brick, worker, tile), then reduce the bricks in parallel: each voxel of the grid
+	// is written by one thread only.
+	std::vector<uint64_t> tiles;
+	for (uint32_t worker = 0; worker < workerTiles.size(); ++worker)
+		for (uint32_t tile = 0; tile < workerTiles[worker].bricks.size(); ++tile)
+			tiles.push_back((uint64_t(workerTiles[worker].bricks[tile]) << 32) | (uint64_t(worker) << 24) | tile);
+	std::sort(tiles.begin(), tiles.end());
+	std::vector<size_t> groups;
+	for (size_t i = 0; i < tiles.size(); ++i)
+		if (i == 0 || (tiles[i] >> 32) != (tiles[i - 1] >> 32))
+			groups.push_back(i);
+	groups.push_back(tiles.size());
+
+	threadPool.parallelFor(groups.size() - 1, 16, [&](size_t begin, size_t end, unsigned int) {
+		uint32_t merged[kTileVoxels];
+		for (size_t g = begin; g < end; ++g)
+		{
+			std::fill_n(merged, kTileVoxels, 0u);
+			for (size_t i = groups[g]; i < groups[g + 1]; ++i)
+			{
+				const uint32_t * voxels = &workerTiles[(tiles[i] >> 24) & 0xff].voxels[size_t(tiles[i] & 0xffffff) * kTileVoxels];
+				for (uint32_t v = 0; v < kTileVoxels; ++v)
+					merged[v] = VoxelSimd::maxRgba8(merged[v], voxels[v]);
+			}
+
+			const uint32_t brick = uint32_t(tiles[groups[g]] >> 32);
+			const glm::uvec3 origin = glm::uvec3(brick % bricksPerAxis, (brick / bricksPerAxis) % bricksPerAxis,
+												 brick / (bricksPerAxis * bricksPerAxis)) * kTileSize;
+			for (uint32_t z = 0; z < kTileSize; ++z)
+				for (uint32_t y = 0; y < kTileSize; ++y)
+					for (uint32_t x = 0; x < kTileSize; ++x)
+					{
+						const uint32_t value = merged[(z * kTileSize + y) * kTileSize + x];
+						if (!value || origin.x + x >= size || origin.y + y >= size || origin.z + z >= size)
+							continue;
+						uint32_t & voxel = grid.data()[grid.index(origin.x + x, origin.y + y, origin.z + z)];
+						voxel = VoxelSimd::maxRgba8(voxel, value);
+					}
+			if (occupancy)
+				occupancy->mark(origin.x, origin.y, origin.z);
+		}
+	});
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelizeLitSorted(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region,
+													VoxelBrickOccupancy * occupancy)
+{
+	const uint32_t size = grid.getSize();
+
+	// Fragments as (voxel index << 32 | rgba8), so sorting them groups the fragments of each voxel.
+	std::vector<std::vector<uint64_t>> workerFragments(threadPool.size());
+	auto writeFragment = [&](unsigned int worker, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 & worldPosition, const glm::vec3 & normal) {
+		glm::vec4 res = 255.0f * VoxelLighting::voxelRadiance(worldPosition, normal, material, input.pointLights);
+		workerFragments[worker].push_back((uint64_t(grid.index(x, y, z)) << 32) | VoxelGrid::vec4ToRgba8(res));
+	};
+	Stats stats = rasterize(input, size, region, writeFragment);
+
+	// Bucket the fragments by the high bits of their voxel index: count per worker, then scatter in parallel.
+	uint32_t shift = 0;
+	while (((grid.getVoxelCount() - 1) >> shift) >= (size_t(1) << kFragmentBucketBits))
+		++shift;
+	const size_t bucketCount = ((grid.getVoxelCount() - 1) >> shift) + 1;
+	const size_t workers = workerFragments.size();
+	std::vector<size_t> offsets(workers * bucketCount, 0);
+	threadPool.parallelFor(workers, 1, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t w = begin; w < end; ++w)
+			for (uint64_t fragment : workerFragments[w])
+				++offsets[w * bucketCount + ((fragment >> 32) >> shift)];
+	});
+	std::vector<size_t> bucketStarts(bucketCount + 1, 0);
+	size_t offset = 0;
+	for (size_t b = 0; b < bucketCount; ++b)
+	{
+		bucketStarts[b] = offset;
+		for (size_t w = 0; w < workers; ++w)
+		{
+			const size_t count = offsets[w * bucketCount + b];
+			offsets[w * bucketCount + b] = offset;
+			offset += count;
+		}
+	}
+	bucketStarts[bucketCount] = offset;
+
+	std::vector<uint64_t> fragments(offset);
+	threadPool.parallelFor(workers, 1, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t w = begin; w < end; ++w)
+		{
+			for (uint64_t fragment : workerFragments[w])
+				fragments[offsets[w * bucketCount + ((fragment >> 32) >> shift)]++] = fragment;
+			std::vector<uint64_t>().swap(workerFragments[w]);
+		}
+	});
+
+	// Each bucket covers its own voxels: sort it and max blend each run of the same voxel once.
+	threadPool.parallelFor(bucketCount, 4, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			std::sort(fragments.begin() + bucketStarts[b], fragments.begin() + bucketStarts[b + 1]);
+			for (size_t i = bucketStarts[b]; i < bucketStarts[b + 1];)
+			{
+				const uint32_t voxelIndex = uint32_t(fragments[i] >> 32);
+				uint32_t value = 0;
+				for (; i < bucketStarts[b + 1] && uint32_t(fragments[i] >> 32) == voxelIndex; ++i)
+					value = VoxelSimd::maxRgba8(value, uint32_t(fragments[i]));
+				uint32_t & voxel = grid.data()[voxelIndex];
+				voxel = VoxelSimd::maxRgba8(voxel, value);
+				if (occupancy)
+				{
+					uint32_t x, y, z;
+					VoxelIndex::decode(grid.getLayout(), size, voxelIndex, x, y, z);
+					occupancy->mark(x, y, z);
+				}
+			}
+		}
+	});
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelize(const VoxelizationInput & input, EpochVoxelGrid & grid)
+{
+	const double startTime = Time::currentTime();
+
+	grid.clear();
+
+	auto writeFragment = [&](unsigned int, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 & worldPosition, const glm::vec3 & normal) {
+		glm::vec4 res = 255.0f * VoxelLighting::voxelRadiance(worldPosition, normal, material, input.pointLights);
+		grid.atomicMax(x, y, z, VoxelGrid::vec4ToRgba8(res));
+	};
+	Stats stats = rasterize(input, grid.getSize(), VoxelRegion::full(grid.getSize()), writeFragment);
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelizeGBuffer(const VoxelizationInput & input, VoxelGBuffer & gBuffer)
+{
+	const double startTime = Time::currentTime();
+
+	gBuffer.clear();
+	gBuffer.beginFragments(threadPool.size());
+
+	auto writeFragment = [&](unsigned int worker, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 &, const glm::vec3 & normal) {
+		// Material only: constant per object except for the normal.
+		gBuffer.writeFragment(worker, gBuffer.albedo.index(x, y, z),
+							  VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::gBufferAlbedo(material)),
+							  VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::encodeVoxelNormal(normal)),
+							  VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::gBufferEmissive(material)));
+	};
+	Stats stats = rasterize(input, gBuffer.getSize(), VoxelRegion::full(gBuffer.getSize()), writeFragment);
+	gBuffer.endFragments();
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+CpuVoxelizer::Stats CpuVoxelizer::voxelizeFragments(const VoxelizationInput & input, uint32_t size, std::vector<VoxelFragment> & fragments)
+{
+	const double startTime = Time::currentTime();
+
+	std::vector<std::vector<VoxelFragment>> fragmentsPerWorker(threadPool.size());
+	auto writeFragment = [&](unsigned int worker, const VoxelLighting::SurfaceMaterial & material, int x, int y, int z,
+							 const glm::vec3 & worldPosition, const glm::vec3 & normal) {
+		glm::vec4 res = 255.0f * VoxelLighting::voxelRadiance(worldPosition, normal, material, input.pointLights);
+		fragmentsPerWorker[worker].emplace_back(x, y, z, VoxelGrid::vec4ToRgba8(res));
+	};
+	Stats stats = rasterize(input, size, VoxelRegion::full(size), writeFragment);
+
+	fragments.clear();
+	fragments.reserve(stats.voxelWrites);
+	for (auto & list : fragmentsPerWorker)
+		fragments.insert(fragments.end(), list.begin(), list.end());
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+template <typename FragmentFunction>
+CpuVoxelizer::Stats CpuVoxelizer::rasterize(const VoxelizationInput & input, uint32_t size, const VoxelRegion & region, const FragmentFunction & writeFragment)
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+
+	const float voxelScale = float(size);
+	const glm::vec3 regionMin = glm::vec3(region.min), regionMax = glm::vec3(region.max - 1);
+	transformVertices(input, voxelScale);
+
+	// Prefix sum of triangle counts so that every worker can map a global triangle index back to its object.
+	std::vector<size_t> firstTriangle(input.objects.size() + 1, 0);
+	std::vector<VoxelLighting::SurfaceMaterial> materials;
+	materials.reserve(input.objects.size());
+	for (size_t o = 0; o < input.objects.size(); ++o)
+	{
+		firstTriangle[o + 1] = firstTriangle[o] + input.objects[o].indices->size() / 3;
+		materials.emplace_back(input.objects[o].material);
+	}
+	stats.triangles = firstTriangle.back();
+
+	std::vector<size_t> writesPerWorker(threadPool.size(), 0);
+
+	threadPool.parallelFor(stats.triangles, kTriangleGrainSize, [&](size_t begin, size_t end, unsigned int worker) {
+		size_t o = std::upper_bound(firstTriangle.begin(), firstTriangle.end(), begin) - firstTriangle.begin() - 1;
+		size_t writes = 0;
+
+		for (size_t t = begin; t < end; ++t)
+		{
+			while (t >= firstTriangle[o + 1]) ++o;
+			const auto & indices = *input.objects[o].indices;
+			const auto & positions = voxelPositions[o];
+			const auto & normals = worldNormals[o];
+			const size_t base = 3 * (t - firstTriangle[o]);
+			const unsigned int i0 = indices[base], i1 = indices[base + 1], i2 = indices[base + 2];
+			const glm::vec3 v[3] = { positions[i0], positions[i1], positions[i2] };
+
+			if (coverage == Coverage::SINGLE_PASS_RASTER)
+			{
+				rasterizeSinglePass(v, size, [&](const glm::vec3 & b) {
+					// Then FS: fragments outside the volume are dropped, the voxel is the one under the fragment.
+					const glm::vec3 worldPosition = (b.x * v[0] + b.y * v[1] + b.z * v[2]) / voxelScale * 2.0f - 1.0f;
+					if (glm::any(glm::greaterThanEqual(glm::abs(worldPosition), glm::vec3(1.0f))))
+						return;
+					const glm::ivec3 voxel = glm::ivec3(voxelScale * (0.5f * worldPosition + 0.5f));
+					if (glm::any(glm::lessThan(voxel, region.min)) || glm::any(glm::greaterThanEqual(voxel, region.max)))
+						return;
+					writeFragment(worker, materials[o], voxel.x, voxel.y, voxel.z, worldPosition, b.x * normals[i0] + b.y * normals[i1] + b.z * normals[i2]);
+					++writes;
+				});
+				continue;
+			}
+
+			// Voxel range covered by the triangle, limited to the region.
+			glm::vec3 lo = glm::floor(glm::min(v[0], glm::min(v[1], v[2])));
+			glm::vec3 hi = glm::floor(glm::max(v[0], glm::max(v[1], v[2])));
+			lo = glm::max(lo, regionMin);
+			hi = glm::min(hi, regionMax);
+			if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+				continue;
+
+			TriangleSetup tri;
+			if (!tri.init(v))
+				continue;
+
+			const float planeOffset = glm::dot(tri.n, v[0]);
+			const float invN2 = 1.0f / glm::dot(tri.n, tri.n);
+			const glm::vec3 geometricNormal = tri.n * std::sqrt(invN2);
+			const int x0 = int(lo.x), x1 = int(hi.x);
+
+			using namespace VoxelSimd;
+			const Float lanes = laneIndices();
+			const Float zero = set1(0.0f);
+			const Float lastX = set1(float(x1));
+
+			for (int z = int(lo.z); z <= int(hi.z); ++z)
+			{
+				for (int y = int(lo.y); y <= int(hi.y); ++y)
+				{
+					// YZ projection does not depend on x: reject the whole row at once.
+					bool rowOverlaps = true;
+					for (int i = 0; i < 3 && rowOverlaps; ++i)
+						rowOverlaps = tri.nYZ[i].x * y + tri.nYZ[i].y * z + tri.dYZ[i] >= 0;
+					if (!rowOverlaps)
+						continue;
+
+					const float rowPlane = tri.n.y * y + tri.n.z * z;
+					const Float planeD1 = set1(rowPlane + tri.d1), planeD2 = set1(rowPlane + tri.d2);
+					const Float nx = set1(tri.n.x);
+					Float edgeXYSlope[3], edgeXYRow[3], edgeZXSlope[3], edgeZXRow[3];
+					for (int i = 0; i < 3; ++i)
+					{
+						edgeXYSlope[i] = set1(tri.nXY[i].x);
+						edgeXYRow[i] = set1(tri.nXY[i].y * y + tri.dXY[i]);
+						edgeZXSlope[i] = set1(tri.nZX[i].y);
+						edgeZXRow[i] = set1(tri.nZX[i].x * z + tri.dZX[i]);
+					}
+
+					for (int xBase = x0; xBase <= x1; xBase += kWidth)
+					{
+						const Float x = add(set1(float(xBase)), lanes);
+						// Plane overlap: the box's critical corners lie on different sides of the plane.
+						Float mask = cmpLe(mul(madd(nx, x, planeD1), madd(nx, x, planeD2)), zero);
+						mask = maskAnd(mask, cmpLe(x, lastX));
+						for (int i = 0; i < 3; ++i)
+						{
+							mask = maskAnd(mask, cmpGe(madd(edgeXYSlope[i], x, edgeXYRow[i]), zero));
+							mask = maskAnd(mask, cmpGe(madd(edgeZXSlope[i], x, edgeZXRow[i]), zero));
+						}
+
+						for (uint32_t bits = moveMask(mask); bits; bits &= bits - 1)
+						{
+							const int vx = xBase + __builtin_ctz(bits);
+
+							// Shade at the voxel center projected onto the triangle, like a fragment would be.
+							glm::vec3 center(vx + 0.5f, y + 0.5f, z + 0.5f);
+							center -= tri.n * ((glm::dot(tri.n, center) - planeOffset) * invN2);
+							const glm::vec3 b = clampedBarycentrics(v, center);
+							glm::vec3 normal = b.x * normals[i0] + b.y * normals[i1] + b.z * normals[i2];
+							if (glm::dot(normal, normal) <= 0)
+								normal = geometricNormal;
+							const glm::vec3 worldPosition = center / voxelScale * 2.0f - 1.0f;
+
+							writeFragment(worker, materials[o], vx, y, z, worldPosition, normal);
+							++writes;
+						}
+					}
+				}
+			}
+		}
+
+		writesPerWorker[worker] += writes;
+	});
+
+	for (size_t writes : writesPerWorker) stats.voxelWrites += writes;
+	return stats;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelizationInput.h"
+#include "VoxelRegion.h"
+
+class EpochVoxelGrid;
+class ThreadPool;
+class VoxelBrickOccupancy;
+class VoxelGBuffer;
+class VoxelGrid;
+
+namespace VoxelLighting { struct SurfaceMaterial; }
+
+/// <summary> One voxelized fragment: packed voxel coordinates (10 bits each, up to 1024^3) and its RGBA8 value. </summary>
+struct VoxelFragment {
+	uint32_t position;
+	uint32_t rgba8;
+
+	VoxelFragment() = default;
+	VoxelFragment(uint32_t x, uint32_t y, uint32_t z, uint32_t value) : position(x | (y << 10) | (z << 20)), rgba8(value) {}
+
+	uint32_t x() const { return position & 0x3ff; }
+	uint32_t y() const { return (position >> 10) & 0x3ff; }
+	uint32_t z() const { return position >> 20; }
+};
+
+/// <summary> Portable (headless) voxelizer. Fragments are lit with the rules of FS in voxelization.metal,
+/// packed like vec4ToRgba8 and max blended into the grid. Which voxels a triangle writes depends on the coverage:
+/// by default it is conservatively voxelized (every voxel it overlaps, using SIMD), which is not what the GPU
+/// does, see Coverage. Triangles are spread over a thread pool. </summary>
+class CpuVoxelizer {
+public:
+	struct Stats {
+		size_t triangles = 0;
+		size_t voxelWrites = 0; // Number of triangle/voxel overlaps (= fragments written).
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double trianglesPerSecond() const { return seconds > 0 ? triangles / seconds : 0; }
+	};
+
+	/// <summary> How the lit fragments are max blended into a VoxelGrid. Same voxels either way, they differ in how
+	/// the threads deal with fragments landing on the same voxel (dense, overlapping triangles). </summary>
+	enum class Accumulation {
+		ATOMIC,				// CAS loop per fragment, like the atomic buffer path of voxelization.metal.
+		PRIVATE_TILES,		// Each worker blends into private 8^3 tiles, then the tiles of each brick are reduced.
+		SORTED_FRAGMENTS	// Each worker lists its fragments, they are bucketed and sorted by voxel, then each run is reduced.
+	};
+
+	/// <summary> Which voxels a triangle writes, and where its fragments are shaded. </summary>
+	enum class Coverage {
+		// Every voxel the triangle overlaps (no holes, up to one voxel thicker than the GPU), shaded at the voxel
+		// center projected onto the triangle.
+		CONSERVATIVE,
+		// Like Graphics::voxelizeSinglePass: the triangle is rasterized on its dominant axis plane with the 8x MSAA
+		// sample pattern, each covered pixel writes the one voxel under the pixel center, shaded there. No SIMD,
+		// meant to compare against the GPU voxels.
+		SINGLE_PASS_RASTER
+	};
+
+	explicit CpuVoxelizer(ThreadPool & threadPool);
+
+	/// <summary> Used by the next voxelize calls. CONSERVATIVE by default. </summary>
+	void setCoverage(Coverage _coverage) { coverage = _coverage; }
+	Coverage getCoverage() const { return coverage; }
+	static const char * getCoverageName(Coverage coverage);
+
+	/// <summary> Used by the next voxelize() calls into a VoxelGrid. ATOMIC by default. </summary>
+	void setAccumulation(Accumulation _accumulation) { accumulation = _accumulation; }
+	Accumulation getAccumulation() const { return accumulation; }
+	static const char * getAccumulationName(Accumulation accumulation);
+
+	/// <summary> Voxelizes the input into the grid. The grid maps to the [-1, 1] unit cube, same as the voxel texture.
+	/// Optionally marks the bricks written to in an occupancy mask of the same size (cleared along with the grid). </summary>
+	Stats voxelize(const VoxelizationInput & input, VoxelGrid & grid, bool clearVoxelizationFirst = true,
+				   VoxelBrickOccupancy * occupancy = nullptr);
+
+	/// <summary> Partial re-voxelization: clears the region and re-voxelizes only the voxels inside it.
+	/// The voxels of the region end up the same as after a full voxelize(). The occupancy bits are only added to. </summary>
+	Stats voxelize(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region,
+				   VoxelBrickOccupancy * occupancy = nullptr);
+
+	/// <summary> Same as voxelize() into an epoch tagged grid: starting a new epoch replaces the clear, and only the
+	/// bricks written to are reset. </summary>
+	Stats voxelize(const VoxelizationInput & input, EpochVoxelGrid & grid);
+
+	/// <summary> Voxelizes material data only (same as the "voxelization_gbuffer" material). The G-buffer is
+	/// cleared first, and its occupied list is filled by the fragments as they land. Use CpuLightInjector to light it. </summary>
+	Stats voxelizeGBuffer(const VoxelizationInput & input, VoxelGBuffer & gBuffer);
+
+	/// <summary> Outputs the lit fragments to a list instead of a dense grid (size^3 doesn't need to fit
+	/// in memory). The same voxel can appear several times, consumers max blend them. </summary>
+	Stats voxelizeFragments(const VoxelizationInput & input, uint32_t size, std::vector<VoxelFragment> & fragments);
+
+private:
+	/// <summary> Lit voxelization of a region, without clearing. </summary>
+	Stats voxelizeLit(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region, VoxelBrickOccupancy * occupancy);
+	/// <summary> voxelizeLit() with the PRIVATE_TILES and SORTED_FRAGMENTS accumulations. </summary>
+	Stats voxelizeLitTiles(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region, VoxelBrickOccupancy * occupancy);
+	Stats voxelizeLitSorted(const VoxelizationInput & input, VoxelGrid & grid, const VoxelRegion & region, VoxelBrickOccupancy * occupancy);
+
+	/// <summary> Finds every triangle/voxel overlap inside the region and calls
+	/// writeFragment(workerIndex, const SurfaceMaterial &, x, y, z, worldPosition, normal) for it, from any worker thread. </summary>
+	template <typename FragmentFunction>
+	Stats rasterize(const VoxelizationInput & input, uint32_t size, const VoxelRegion & region, const FragmentFunction & writeFragment);
+
+	void transformVertices(const VoxelizationInput & input, float voxelScale);
+
+	ThreadPool & threadPool;
+	Accumulation accumulation = Accumulation::ATOMIC;
+	Coverage coverage = Coverage::CONSERVATIVE;
+
+	// World space normals and voxel space positions of every object, reused between calls.
+	std::vector<std::vector<glm::vec3>> voxelPositions;
+	std::vector<std::vector<glm::vec3>> worldNormals;
+};
@@ -0,0 +1,112 @@
+#include "DominantAxisPartition.h"
+
+#include "../../Time/Time.h"
+
+constexpr uint32_t DominantAxisPartition::STABLE_UPDATES;
+
+DominantAxisPartition::DominantAxisPartition(const std::vector<VertexData> & _vertices, const std::vector<unsigned int> & _indices)
+	: vertices(_vertices), indices(_indices)
+{
+}
+
+uint32_t DominantAxisPartition::dominantAxis(const glm::mat3 & linear, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2)
+{
+	// Same as computeTriangleDominantAxis: the translation cancels out in the edges.
+	const glm::vec3 normal = glm::abs(glm::cross(linear * (p1 - p0), linear * (p2 - p0)));
+	if (normal.z > normal.x && normal.z > normal.y)
+		return 2;
+	if (normal.x > normal.y && normal.x > normal.z)
+		return 0;
+	return 1;
+}
+
+DominantAxisPartition::Stats DominantAxisPartition::update(const glm::mat4 & model)
+{
+	Stats stats;
+	stats.triangles = indices.size() / 3;
+	const double startTime = Time::currentTime();
+
+	const glm::mat3 current(model);
+	stableUpdates = current == lastLinear ? stableUpdates + 1 : 1;
+	lastLinear = current;
+
+	if (everSorted && current == sortedLinear)
+	{
+		valid = true;
+	}
+	else
+	{
+		if (everSorted && stableUpdates == 1)
+		{
+			// A new rotation or scale often keeps every triangle on its axis (e.g. a small rotation of a mesh
+			// made of axis aligned walls): the ranges stay valid without sorting.
+			stats.changedTriangles = countChangedTriangles(current);
+			valid = stats.changedTriangles == 0;
+			if (valid)
+				sortedLinear = current;
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid && (!everSorted || stableUpdates >= STABLE_UPDATES))
+		{
+			sort(current);
+			stats.sorted = true;
+		}
+	}
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+size_t DominantAxisPartition::countChangedTriangles(const glm::mat3 & linear) const
+{
+	size_t changed = 0;
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		const uint32_t end = ranges[axis].firstTriangle + ranges[axis].triangleCount;
+		for (uint32_t triangle = ranges[axis].firstTriangle; triangle < end; ++triangle)
+		{
+			const unsigned int * index = &sortedIndices[3 * triangle];
+			changed += dominantAxis(linear, vertices[index[0]].position, vertices[index[1]].position, vertices[index[2]].position) != axis;
+		}
+	}
+	return changed;
+}
+
+void DominantAxisPartition::sort(const glm::mat3 & linear)
+{
+	// Counting sort by axis, keeping the original order of the triangles within each range.
+	const size_t triangles = indices.size() / 3;
+	std::vector<uint8_t> axes(triangles);
+	uint32_t counts[3] = { 0, 0, 0 };
+	for (size_t triangle = 0; triangle < triangles; ++triangle)
+	{
+		const unsigned int * index = &indices[3 * triangle];
+		axes[triangle] = uint8_t(dominantAxis(linear, vertices[index[0]].position, vertices[index[1]].position, vertices[index[2]].position));
+		++counts[axes[triangle]];
+	}
+
+	uint32_t next[3];
+	for (uint32_t axis = 0, first = 0; axis < 3; first += counts[axis], ++axis)
+	{
+		ranges[axis].firstTriangle = first;
+		ranges[axis].triangleCount = counts[axis];
+		next[axis] = first;
+	}
+
+	sortedIndices.resize(3 * triangles);
+	for (size_t triangle = 0; triangle < triangles; ++triangle)
+	{
+		unsigned int * destination = &sortedIndices[3 * size_t(next[axes[triangle]]++)];
+		destination[0] = indices[3 * triangle];
+		destination[1] = indices[3 * triangle + 1];
+		destination[2] = indices[3 * triangle + 2];
+	}
+
+	sortedLinear = linear;
+	everSorted = true;
+	valid = true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../../Shape/VertexData.h"
+
+/// <summary> Index buffer of a static mesh reordered into three contiguous ranges of triangles by dominant axis (X, Y, Z,
+/// picked like computeTriangleDominantAxis does), so that each projection pass of multipass voxelization draws its own
+/// range instead of every triangle and culling two thirds of them in the vertex shader. The axes only depend on the
+/// linear part of the model matrix: update() checks them again when it changes, and re-sorts only once it has stayed
+/// the same for STABLE_UPDATES updates, so a spinning object keeps using the unsorted path. </summary>
+class DominantAxisPartition {
+public:
+	/// <summary> Updates with the same linear part needed before the triangles are re-sorted. </summary>
+	static constexpr uint32_t STABLE_UPDATES = 4;
+
+	struct Range {
+		uint32_t firstTriangle = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	struct Stats {
+		size_t triangles = 0;
+		size_t changedTriangles = 0;	// Triangles that are not in the range of their dominant axis any more.
+		bool sorted = false;			// Whether the indices were re-sorted (and must be uploaded again).
+		double seconds = 0;
+	};
+
+	DominantAxisPartition(const std::vector<VertexData> & vertices, const std::vector<unsigned int> & indices);
+
+	/// <summary> Dominant axis of a triangle transformed by a linear transform, same tie breaking as the shaders. </summary>
+	static uint32_t dominantAxis(const glm::mat3 & linear, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2);
+
+	/// <summary> Reports the model matrix of the mesh for this frame. </summary>
+	Stats update(const glm::mat4 & model);
+
+	/// <summary> Whether the ranges match the last model matrix given to update(), i.e. the projection passes can draw them. </summary>
+	bool isValid() const { return valid; }
+
+	/// <summary> The indices, ordered so that the triangles of each range are contiguous (X first, then Y, then Z). </summary>
+	const std::vector<unsigned int> & getIndices() const { return sortedIndices; }
+	const Range & getRange(uint32_t axis) const { return ranges[axis]; }
+
+private:
+	/// <summary> Number of triangles whose dominant axis differs from the one of their range. </summary>
+	size_t countChangedTriangles(const glm::mat3 & linear) const;
+	void sort(const glm::mat3 & linear);
+
+	const std::vector<VertexData> & vertices;
+	const std::vector<unsigned int> & indices;
+	std::vector<unsigned int> sortedIndices;
+	Range ranges[3];
+
+	bool valid = false;
+	bool everSorted = false;
+	glm::mat3 lastLinear = glm::mat3(0.0f);		// Linear part of the last model matrix.
+	glm::mat3 sortedLinear = glm::mat3(0.0f);	// The one the ranges were checked or sorted for.
+	uint32_t stableUpdates = 0;
+};
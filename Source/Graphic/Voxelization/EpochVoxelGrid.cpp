@@ -0,0 +1,101 @@
+#include "EpochVoxelGrid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "VoxelGrid.h"
+
+namespace
+{
+// Epoch of a brick being reset by a writer, the other writers of the brick wait for it.
+constexpr uint32_t kResettingEpoch = 0xffffffff;
+}
+
+constexpr uint32_t EpochVoxelGrid::BRICK_SIZE;
+constexpr uint32_t EpochVoxelGrid::BRICK_VOXELS;
+
+EpochVoxelGrid::EpochVoxelGrid(uint32_t _size) :
+	size(_size), bricksPerAxis(_size / BRICK_SIZE),
+	brickEpochs(size_t(bricksPerAxis) * bricksPerAxis * bricksPerAxis, 0),
+	voxels(size_t(_size) * _size * _size, 0)
+{
+	assert(size % BRICK_SIZE == 0);
+}
+
+void EpochVoxelGrid::clear()
+{
+	if (++epoch == kResettingEpoch)
+	{
+		// Wrapped around: old epochs could match again, make every brick stale for good.
+		std::fill(brickEpochs.begin(), brickEpochs.end(), 0u);
+		epoch = 1;
+	}
+}
+
+void EpochVoxelGrid::acquireBrick(size_t brick)
+{
+	uint32_t * brickEpoch = &brickEpochs[brick];
+	uint32_t current = __atomic_load_n(brickEpoch, __ATOMIC_ACQUIRE);
+	while (current != epoch)
+	{
+		// The first writer of the epoch resets the brick, the other ones wait until it is done.
+		if (current != kResettingEpoch &&
+			__atomic_compare_exchange_n(brickEpoch, &current, kResettingEpoch, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		{
+			std::fill_n(&voxels[brick * BRICK_VOXELS], BRICK_VOXELS, 0u);
+			__atomic_store_n(brickEpoch, epoch, __ATOMIC_RELEASE);
+			return;
+		}
+		std::this_thread::yield();
+		current = __atomic_load_n(brickEpoch, __ATOMIC_ACQUIRE);
+	}
+}
+
+void EpochVoxelGrid::atomicMax(uint32_t x, uint32_t y, uint32_t z, uint32_t rgba8)
+{
+	const size_t brick = brickOf(x, y, z);
+	acquireBrick(brick);
+	VoxelGrid::atomicMaxRgba8(&voxels[brick * BRICK_VOXELS + voxelInBrick(x, y, z)], rgba8);
+}
+
+size_t EpochVoxelGrid::countLiveBricks() const
+{
+	return std::count(brickEpochs.begin(), brickEpochs.end(), epoch);
+}
+
+size_t EpochVoxelGrid::countOccupied() const
+{
+	size_t count = 0;
+	for (size_t brick = 0; brick < brickEpochs.size(); ++brick)
+	{
+		if (brickEpochs[brick] != epoch)
+			continue;
+		const uint32_t * brickVoxels = &voxels[brick * BRICK_VOXELS];
+		count += BRICK_VOXELS - std::count(brickVoxels, brickVoxels + BRICK_VOXELS, 0u);
+	}
+	return count;
+}
+
+void EpochVoxelGrid::copyTo(VoxelGrid & grid) const
+{
+	assert(grid.getSize() == size);
+	uint32_t * dst = grid.data();
+	for (uint32_t bz = 0; bz < bricksPerAxis; ++bz)
+		for (uint32_t by = 0; by < bricksPerAxis; ++by)
+			for (uint32_t bx = 0; bx < bricksPerAxis; ++bx)
+			{
+				const size_t brick = (size_t(bz) * bricksPerAxis + by) * bricksPerAxis + bx;
+				const bool live = brickEpochs[brick] == epoch;
+				const uint32_t * src = &voxels[brick * BRICK_VOXELS];
+				for (uint32_t z = 0; z < BRICK_SIZE; ++z)
+					for (uint32_t y = 0; y < BRICK_SIZE; ++y)
+					{
+						uint32_t * row = &dst[grid.index(bx * BRICK_SIZE, by * BRICK_SIZE + y, bz * BRICK_SIZE + z)];
+						if (live)
+							std::copy_n(&src[(z * BRICK_SIZE + y) * BRICK_SIZE], BRICK_SIZE, row);
+						else
+							std::fill_n(row, BRICK_SIZE, 0u);
+					}
+			}
+}
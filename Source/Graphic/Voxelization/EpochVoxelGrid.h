@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class VoxelGrid;
+
+/// <summary> RGBA8 voxel volume that clears in O(1): voxels are stored by 8^3 bricks and each brick carries the epoch
+/// of its last write. clear() only starts a new epoch, a brick with an older epoch reads as empty, and the first write
+/// of an epoch resets the brick before writing to it. Voxelizing a scene then costs the bricks it touches instead of
+/// a full pass over the volume. </summary>
+class EpochVoxelGrid {
+public:
+	static constexpr uint32_t BRICK_SIZE = 8;
+	static constexpr uint32_t BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+	/// <summary> Size must be a multiple of BRICK_SIZE. Starts empty. </summary>
+	explicit EpochVoxelGrid(uint32_t size);
+
+	uint32_t getSize() const { return size; }
+	size_t getMemoryUsage() const { return voxels.size() * sizeof(uint32_t) + brickEpochs.size() * sizeof(uint32_t); }
+	uint32_t getEpoch() const { return epoch; }
+
+	/// <summary> Every voxel reads as empty afterwards. Not thread safe with writes. </summary>
+	void clear();
+
+	uint32_t load(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		const size_t brick = brickOf(x, y, z);
+		return brickEpochs[brick] == epoch ? voxels[brick * BRICK_VOXELS + voxelInBrick(x, y, z)] : 0;
+	}
+
+	/// <summary> Thread safe per channel max blend, same as VoxelGrid::atomicMax. </summary>
+	void atomicMax(uint32_t x, uint32_t y, uint32_t z, uint32_t rgba8);
+
+	/// <summary> Whether the brick was written to in the current epoch. </summary>
+	bool isBrickLive(uint32_t bx, uint32_t by, uint32_t bz) const
+	{
+		return brickEpochs[(size_t(bz) * bricksPerAxis + by) * bricksPerAxis + bx] == epoch;
+	}
+
+	size_t countLiveBricks() const;
+	size_t countOccupied() const;
+
+	/// <summary> Writes the voxels to a dense grid of the same size (stale bricks as zeros), e.g. to build mips. </summary>
+	void copyTo(VoxelGrid & grid) const;
+
+private:
+	size_t brickOf(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return (size_t(z / BRICK_SIZE) * bricksPerAxis + y / BRICK_SIZE) * bricksPerAxis + x / BRICK_SIZE;
+	}
+	static uint32_t voxelInBrick(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return ((z % BRICK_SIZE) * BRICK_SIZE + y % BRICK_SIZE) * BRICK_SIZE + x % BRICK_SIZE;
+	}
+
+	/// <summary> Makes a brick live in the current epoch, resetting its voxels if it wasn't. </summary>
+	void acquireBrick(size_t brick);
+
+	uint32_t size;
+	uint32_t bricksPerAxis;
+	uint32_t epoch = 1;				// Bricks start at epoch 0, i.e. stale.
+	std::vector<uint32_t> brickEpochs;
+	std::vector<uint32_t> voxels;	// By brick.
+};
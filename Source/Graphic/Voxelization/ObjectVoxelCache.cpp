@@ -0,0 +1,151 @@
+#include "ObjectVoxelCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "CpuVoxelizer.h"
+#include "VoxelGBuffer.h"
+#include "VoxelLighting.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+constexpr uint32_t ObjectVoxelCache::BRICK_SIZE;
+constexpr uint32_t ObjectVoxelCache::BRICK_VOXELS;
+constexpr uint32_t ObjectVoxelCache::SUBDIVISION;
+constexpr uint32_t ObjectVoxelCache::MAX_SIZE;
+
+ObjectVoxelCache::ObjectVoxelCache(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+void ObjectVoxelCache::build(const VoxelizationObject & object, float worldVoxelSize)
+{
+	glm::vec3 lo(INFINITY), hi(-INFINITY);
+	for (const auto & vertex : *object.vertices)
+	{
+		lo = glm::min(lo, vertex.position);
+		hi = glm::max(hi, vertex.position);
+	}
+
+	// Bounding cube of the object with a one voxel margin, in whole bricks.
+	voxelSize = worldVoxelSize / SUBDIVISION;
+	const float extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+	if (extent / voxelSize + 2 > MAX_SIZE)
+		voxelSize = extent / (MAX_SIZE - 2);
+	const uint32_t size = std::min(MAX_SIZE, (uint32_t(std::ceil(extent / voxelSize)) + 2 + BRICK_SIZE - 1) / BRICK_SIZE * BRICK_SIZE);
+	const uint32_t bricksPerAxis = size / BRICK_SIZE;
+	origin = lo - voxelSize;
+
+	// Voxelize the local geometry with a transform mapping the cube to the [-1, 1] volume of the voxelizer.
+	VoxelizationInput input;
+	VoxelizationObject local = object;
+	local.model = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f)) *
+				  glm::scale(glm::mat4(1.0f), glm::vec3(2.0f / (size * voxelSize))) *
+				  glm::translate(glm::mat4(1.0f), -origin);
+	local.modelInverseTranspose = glm::transpose(glm::inverse(local.model));
+	input.objects.push_back(local);
+
+	VoxelGBuffer gBuffer(size);
+	CpuVoxelizer(threadPool).voxelizeGBuffer(input, gBuffer);
+
+	// Keep the bricks holding anything.
+	bricks.clear();
+	normals.clear();
+	uint32_t brickNormals[BRICK_VOXELS];
+	for (uint32_t bz = 0; bz < bricksPerAxis; ++bz)
+		for (uint32_t by = 0; by < bricksPerAxis; ++by)
+			for (uint32_t bx = 0; bx < bricksPerAxis; ++bx)
+			{
+				uint32_t occupied = 0;
+				for (uint32_t z = 0; z < BRICK_SIZE; ++z)
+					for (uint32_t y = 0; y < BRICK_SIZE; ++y)
+						for (uint32_t x = 0; x < BRICK_SIZE; ++x)
+						{
+							const glm::uvec3 voxel = glm::uvec3(bx, by, bz) * BRICK_SIZE + glm::uvec3(x, y, z);
+							uint32_t & value = brickNormals[(z * BRICK_SIZE + y) * BRICK_SIZE + x];
+							value = gBuffer.normal.load(voxel.x, voxel.y, voxel.z);
+							occupied |= value;
+						}
+				if (!occupied)
+					continue;
+
+				bricks.push_back(glm::ivec3(bx, by, bz));
+				normals.insert(normals.end(), brickNormals, brickNormals + BRICK_VOXELS);
+			}
+}
+
+ObjectVoxelCache::Stats ObjectVoxelCache::stamp(const VoxelizationObject & object, VoxelGBuffer & gBuffer) const
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+	stats.bricks = bricks.size();
+	const double startTime = Time::currentTime();
+
+	const uint32_t worldSize = gBuffer.getSize();
+	// World voxel coordinates <-> cached voxel coordinates (voxel centers at integers on the cached side).
+	const glm::mat4 worldToVoxel = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f * worldSize)) *
+								   glm::translate(glm::mat4(1.0f), glm::vec3(1.0f));
+	const glm::mat4 localToCache = glm::translate(glm::mat4(1.0f), glm::vec3(-0.5f)) *
+								   glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / voxelSize)) *
+								   glm::translate(glm::mat4(1.0f), -origin);
+	const glm::mat4 cacheToWorld = worldToVoxel * object.model * glm::inverse(localToCache);
+	// A cached voxel is the unit cube around its center on the cached side. It is written to the world voxels it
+	// overlaps, so that no world voxel the cached surface passes through is missed. The overlap is tested on the axes
+	// of both grids only (separating axis test without the edge axes), which can only keep a few more voxels.
+	const glm::mat3 cacheToWorldLinear = glm::mat3(cacheToWorld);
+	const glm::mat3 worldToCacheLinear = glm::inverse(cacheToWorldLinear);
+	// Half extents of a cached voxel along the world axes, and of a world voxel along the cached axes.
+	const glm::vec3 halfExtent = 0.5f * (glm::abs(cacheToWorldLinear[0]) + glm::abs(cacheToWorldLinear[1]) + glm::abs(cacheToWorldLinear[2]));
+	const glm::vec3 worldHalfExtent = 0.5f * (glm::abs(worldToCacheLinear[0]) + glm::abs(worldToCacheLinear[1]) + glm::abs(worldToCacheLinear[2]));
+	const glm::vec3 overlapDistance = worldHalfExtent + 0.5f;
+	const glm::mat3 normalMatrix = glm::mat3(object.modelInverseTranspose);
+
+	const VoxelLighting::SurfaceMaterial material(object.material);
+	const uint32_t albedo = VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::gBufferAlbedo(material));
+	const uint32_t emissive = VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::gBufferEmissive(material));
+
+	std::vector<size_t> writesPerWorker(threadPool.size(), 0);
+	gBuffer.beginFragments(threadPool.size());
+	threadPool.parallelFor(bricks.size(), 4, [&](size_t begin, size_t end, unsigned int worker) {
+		for (size_t b = begin; b < end; ++b)
+		{
+			const glm::vec3 first = glm::vec3(bricks[b] * int(BRICK_SIZE));
+			const uint32_t * brickNormals = &normals[b * BRICK_VOXELS];
+			for (uint32_t z = 0; z < BRICK_SIZE; ++z)
+				for (uint32_t y = 0; y < BRICK_SIZE; ++y)
+				{
+					glm::vec3 center = glm::vec3(cacheToWorld * glm::vec4(first + glm::vec3(0, y, z), 1.0f));
+					for (uint32_t x = 0; x < BRICK_SIZE; ++x, center += cacheToWorldLinear[0])
+					{
+						const uint32_t encoded = brickNormals[(z * BRICK_SIZE + y) * BRICK_SIZE + x];
+						if (!encoded)
+							continue;
+
+						const glm::ivec3 worldFirst = glm::max(glm::ivec3(glm::floor(center - halfExtent)), glm::ivec3(0));
+						const glm::ivec3 worldLast = glm::min(glm::ivec3(glm::ceil(center + halfExtent)) - 1, glm::ivec3(int(worldSize) - 1));
+						if (glm::any(glm::greaterThan(worldFirst, worldLast)))
+							continue;
+
+						const glm::vec3 normal = normalMatrix * VoxelLighting::decodeVoxelNormal(VoxelGrid::rgba8ToVec4(encoded) / 255.0f);
+						const uint32_t worldNormal = VoxelGrid::vec4ToRgba8(255.0f * VoxelLighting::encodeVoxelNormal(normal));
+						for (int wz = worldFirst.z; wz <= worldLast.z; ++wz)
+							for (int wy = worldFirst.y; wy <= worldLast.y; ++wy)
+								for (int wx = worldFirst.x; wx <= worldLast.x; ++wx)
+								{
+									const glm::vec3 offset = worldToCacheLinear * (glm::vec3(wx, wy, wz) + 0.5f - center);
+									if (glm::any(glm::greaterThan(glm::abs(offset), overlapDistance)))
+										continue;
+									gBuffer.writeFragment(worker, gBuffer.albedo.index(wx, wy, wz), albedo, worldNormal, emissive);
+									++writesPerWorker[worker];
+								}
+					}
+				}
+		}
+	});
+	gBuffer.endFragments();
+
+	for (size_t writes : writesPerWorker)
+		stats.voxels += writes;
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
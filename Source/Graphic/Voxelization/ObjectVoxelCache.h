@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelizationInput.h"
+
+class ThreadPool;
+class VoxelGBuffer;
+
+/// <summary> Local space voxels of one rigid object, built once at load: its triangles are voxelized in object space, at
+/// twice the resolution of the world voxels, and only the occupied 8^3 bricks are kept (encoded normals, alpha = occupied).
+/// Each frame, stamp() writes the object into the world voxel G-buffer at its current transform from those voxels,
+/// without touching a triangle, so the cost follows the voxel footprint of the object instead of its triangle count.
+/// Material data comes from the object at stamp time, so materials can change too; only the geometry must stay the same. </summary>
+class ObjectVoxelCache {
+public:
+	static constexpr uint32_t BRICK_SIZE = 8;
+	static constexpr uint32_t BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+	/// <summary> Cached voxels per world voxel edge (at the scale given to build()). </summary>
+	static constexpr uint32_t SUBDIVISION = 2;
+	/// <summary> Largest number of cached voxels along the object's longest side. build() coarsens the voxels beyond. </summary>
+	static constexpr uint32_t MAX_SIZE = 256;
+
+	struct Stats {
+		size_t bricks = 0;
+		size_t voxels = 0;		// World voxels written.
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double voxelsPerSecond() const { return seconds > 0 ? voxels / seconds : 0; }
+	};
+
+	explicit ObjectVoxelCache(ThreadPool & threadPool);
+
+	/// <summary> Voxelizes the geometry of the object in its local space. worldVoxelSize is the size of a world voxel in
+	/// local units, e.g. 2 / (world grid size) divided by the scale of the object at load (the transform of the object is
+	/// ignored otherwise). </summary>
+	void build(const VoxelizationObject & object, float worldVoxelSize);
+
+	/// <summary> Writes the object at its current transform and material into a world voxel G-buffer (same [-1, 1]
+	/// mapping as CpuVoxelizer), blending like CpuVoxelizer::voxelizeGBuffer does. Conservative: each cached voxel is
+	/// written to every world voxel it overlaps at the current transform, with its normal, so the result holds the voxels
+	/// rasterization writes plus a margin around the surface. Doesn't clear the G-buffer, so that several objects can be
+	/// stamped one after the other: the voxels it occupies first are appended to its occupied list. </summary>
+	Stats stamp(const VoxelizationObject & object, VoxelGBuffer & gBuffer) const;
+
+	float getVoxelSize() const { return voxelSize; }
+	size_t getBrickCount() const { return bricks.size(); }
+	size_t getMemoryUsage() const { return bricks.size() * sizeof(glm::ivec3) + normals.size() * sizeof(uint32_t); }
+
+private:
+	ThreadPool & threadPool;
+
+	glm::vec3 origin = glm::vec3(0.0f);	// Local position of the corner of voxel (0, 0, 0).
+	float voxelSize = 1.0f;				// Of the cached voxels, in local units.
+	std::vector<glm::ivec3> bricks;		// Positions of the stored bricks, in bricks.
+	std::vector<uint32_t> normals;		// BRICK_VOXELS per stored brick.
+};
@@ -0,0 +1,143 @@
+#include "ScreenGBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct ClipVertex {
+	glm::vec4 clip;
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+// Triangles are clipped where they get this close to the plane of the camera.
+constexpr float NEAR_W = 1e-3f;
+
+ClipVertex mixVertices(const ClipVertex & a, const ClipVertex & b, float t)
+{
+	return { glm::mix(a.clip, b.clip, t), glm::mix(a.position, b.position, t), glm::mix(a.normal, b.normal, t) };
+}
+
+} // namespace
+
+ScreenGBuffer::ScreenGBuffer(uint32_t _width, uint32_t _height)
+	: width(_width), height(_height), samples(size_t(_width) * _height)
+{
+}
+
+size_t ScreenGBuffer::getCoveredPixels() const
+{
+	return std::count_if(samples.begin(), samples.end(), [](const Sample & sample) { return sample.covered(); });
+}
+
+void ScreenGBuffer::clear()
+{
+	std::fill(samples.begin(), samples.end(), Sample());
+}
+
+void ScreenGBuffer::rasterize(const VoxelizationInput & input, const glm::mat4 & viewProjection, const glm::vec3 & cameraPosition,
+							  std::vector<Sample> * shadedFragments)
+{
+	auto drawTriangle = [&](const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2) {
+		const ClipVertex * vertices[3] = { &v0, &v1, &v2 };
+		glm::vec2 screen[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec4 & clip = vertices[i]->clip;
+			screen[i] = glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+		}
+		auto edge = [](const glm::vec2 & a, const glm::vec2 & b, const glm::vec2 & p) {
+			return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+		};
+		const float area = edge(screen[0], screen[1], screen[2]);
+		if (area == 0.0f)
+			return;
+
+		const glm::vec2 lo = glm::min(screen[0], glm::min(screen[1], screen[2]));
+		const glm::vec2 hi = glm::max(screen[0], glm::max(screen[1], screen[2]));
+		const int xFirst = std::max(0, int(std::floor(lo.x))), xLast = std::min(int(width) - 1, int(std::ceil(hi.x)));
+		const int yFirst = std::max(0, int(std::floor(lo.y))), yLast = std::min(int(height) - 1, int(std::ceil(hi.y)));
+		for (int y = yFirst; y <= yLast; ++y)
+			for (int x = xFirst; x <= xLast; ++x)
+			{
+				const glm::vec2 p(x + 0.5f, y + 0.5f);
+				glm::vec3 b(edge(screen[1], screen[2], p), edge(screen[2], screen[0], p), edge(screen[0], screen[1], p));
+				b /= area;
+				if (b.x < 0.0f || b.y < 0.0f || b.z < 0.0f)
+					continue;
+
+				// Perspective correct weights.
+				b /= glm::vec3(v0.clip.w, v1.clip.w, v2.clip.w);
+				b /= b.x + b.y + b.z;
+				const glm::vec3 position = b.x * v0.position + b.y * v1.position + b.z * v2.position;
+				const float distance = glm::length(position - cameraPosition);
+				Sample & sample = at(uint32_t(x), uint32_t(y));
+				if (sample.covered() && sample.distance <= distance)
+					continue;
+
+				sample.position = position;
+				sample.normal = glm::normalize(b.x * v0.normal + b.y * v1.normal + b.z * v2.normal);
+				sample.distance = distance;
+				if (shadedFragments)
+					shadedFragments->push_back(sample);
+			}
+	};
+
+	for (const auto & object : input.objects)
+	{
+		const auto & vertices = *object.vertices;
+		const auto & indices = *object.indices;
+		const glm::mat3 normalMatrix(object.modelInverseTranspose);
+
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			ClipVertex triangle[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				const VertexData & vertex = vertices[indices[t + i]];
+				triangle[i].position = glm::vec3(object.model * glm::vec4(vertex.position, 1.0f));
+				triangle[i].normal = normalMatrix * vertex.normal;
+				triangle[i].clip = viewProjection * glm::vec4(triangle[i].position, 1.0f);
+			}
+
+			// Counter clockwise when seen from the front, from the world positions so it doesn't depend on the projection.
+			const glm::vec3 faceNormal = glm::cross(triangle[1].position - triangle[0].position, triangle[2].position - triangle[0].position);
+			if (glm::dot(faceNormal, cameraPosition - triangle[0].position) <= 0.0f)
+				continue;
+
+			// Clip against the near plane: at most 4 vertices remain, drawn as a fan.
+			ClipVertex polygon[4];
+			int count = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				const ClipVertex & a = triangle[i], & b = triangle[(i + 1) % 3];
+				const float da = a.clip.w - NEAR_W, db = b.clip.w - NEAR_W;
+				if (da >= 0.0f)
+					polygon[count++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+					polygon[count++] = mixVertices(a, b, da / (da - db));
+			}
+			for (int i = 1; i + 1 < count; ++i)
+				drawTriangle(polygon[0], polygon[i], polygon[i + 1]);
+		}
+	}
+}
+
+ScreenGBuffer ScreenGBuffer::downsample(uint32_t scale) const
+{
+	ScreenGBuffer low((width + scale - 1) / scale, (height + scale - 1) / scale);
+	for (uint32_t y = 0; y < low.height; ++y)
+		for (uint32_t x = 0; x < low.width; ++x)
+		{
+			Sample & closest = low.at(x, y);
+			for (uint32_t sy = y * scale; sy < std::min(height, (y + 1) * scale); ++sy)
+				for (uint32_t sx = x * scale; sx < std::min(width, (x + 1) * scale); ++sx)
+				{
+					const Sample & sample = at(sx, sy);
+					if (sample.covered() && (!closest.covered() || sample.distance < closest.distance))
+						closest = sample;
+				}
+		}
+	return low;
+}
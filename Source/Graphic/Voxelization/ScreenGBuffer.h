@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelizationInput.h"
+
+/// <summary> CPU counterpart of the screen G-buffer of Graphics ("scene_gbuffer" material): the closest surface seen
+/// by each pixel, with its world position, normal and distance to the camera. The GPU texture only keeps the normal, the
+/// distance and the material index (the position is reconstructed from the pixel ray); this one also keeps the position,
+/// so that headless tools can trace cones from the pixels. </summary>
+class ScreenGBuffer {
+public:
+	struct Sample {
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float distance = 0.0f; // 0 where no surface was drawn.
+
+		bool covered() const { return distance > 0.0f; }
+	};
+
+	ScreenGBuffer(uint32_t width, uint32_t height);
+
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	size_t getCoveredPixels() const;
+
+	Sample & at(uint32_t x, uint32_t y) { return samples[size_t(y) * width + x]; }
+	const Sample & at(uint32_t x, uint32_t y) const { return samples[size_t(y) * width + x]; }
+
+	void clear();
+
+	/// <summary> Draws the objects with a depth test and back face culling (counter clockwise front faces), like
+	/// the G-buffer pass does. Triangles are clipped against the near plane, attributes are perspective correct and
+	/// sampled at the pixel centers. shadedFragments, when given, gets every fragment that passes the depth test when it
+	/// is drawn: the fragments a forward pass without a depth pre-pass shades, in the order of input. </summary>
+	void rasterize(const VoxelizationInput & input, const glm::mat4 & viewProjection, const glm::vec3 & cameraPosition,
+				   std::vector<Sample> * shadedFragments = nullptr);
+
+	/// <summary> One sample per scale x scale block of pixels, as picked by the traceIndirectDiffuse kernel: the closest
+	/// covered sample of the block, so that the low resolution pixels stay on the foreground at edges. </summary>
+	ScreenGBuffer downsample(uint32_t scale) const;
+
+private:
+	uint32_t width, height;
+	std::vector<Sample> samples;
+};
@@ -0,0 +1,281 @@
+#include "SparseVoxelOctree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "VoxelGrid.h"
+#include "VoxelMipChain.h"
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+namespace
+{
+constexpr size_t kFragmentGrainSize = 16384;
+constexpr size_t kNodeGrainSize = 16;
+
+// Texture3D only supports up to 7 mipmap levels.
+constexpr uint32_t kMaxLevels = 7;
+
+uint32_t log2(uint32_t value)
+{
+	uint32_t result = 0;
+	while ((value >> (result + 1)) > 0) ++result;
+	return result;
+}
+}
+
+SparseVoxelOctree::SparseVoxelOctree(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+std::vector<VoxelFragment> SparseVoxelOctree::gatherFragments(const VoxelGrid & grid)
+{
+	std::vector<VoxelFragment> fragments;
+	for (uint32_t z = 0; z < grid.getSize(); ++z)
+		for (uint32_t y = 0; y < grid.getSize(); ++y)
+			for (uint32_t x = 0; x < grid.getSize(); ++x)
+				if (uint32_t value = grid.load(x, y, z))
+					fragments.emplace_back(x, y, z, value);
+	return fragments;
+}
+
+size_t SparseVoxelOctree::getMemoryUsage() const
+{
+	size_t bytes = nodes.size() * sizeof(Node) + brickPool.size() * sizeof(uint32_t);
+	for (auto & level : topLevels) bytes += level.size() * sizeof(uint32_t);
+	return bytes;
+}
+
+SparseVoxelOctree::Stats SparseVoxelOctree::build(const std::vector<VoxelFragment> & fragments, uint32_t _size)
+{
+	assert(_size >= BRICK_SIZE && (_size & (_size - 1)) == 0);
+
+	Stats stats;
+	stats.threads = threadPool.size();
+	stats.fragments = fragments.size();
+	const double startTime = Time::currentTime();
+
+	size = _size;
+	maxDepth = log2(size / BRICK_SIZE);
+	levelCount = std::min(kMaxLevels, log2(size) + 1);
+
+	// Top-down: subdivide the nodes touched by fragments, one depth at a time.
+	std::vector<uint32_t> leafOfFragment;
+	std::vector<glm::uvec3> nodeCoordinates;
+	buildNodes(fragments, leafOfFragment, nodeCoordinates);
+
+	// First level: max blend the fragments into the leaf bricks.
+	threadPool.parallelFor(fragments.size(), kFragmentGrainSize, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			const VoxelFragment & fragment = fragments[i];
+			const uint32_t brick = nodes[leafOfFragment[i]].brick;
+			VoxelGrid::atomicMaxRgba8(brickVoxel(brick, fragment.x() & (BRICK_SIZE - 1), fragment.y() & (BRICK_SIZE - 1),
+												 fragment.z() & (BRICK_SIZE - 1)), fragment.rgba8);
+		}
+	});
+
+	// Bottom-up: coarser levels.
+	filterInnerBricks();
+	buildTopLevels();
+	fillBorders(nodeCoordinates);
+
+	stats.nodes = nodes.size();
+	stats.bricks = getBrickCount();
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+void SparseVoxelOctree::buildNodes(const std::vector<VoxelFragment> & fragments, std::vector<uint32_t> & nodeOfFragment,
+								   std::vector<glm::uvec3> & nodeCoordinates)
+{
+	nodes.assign(1, Node());
+	nodeCoordinates.assign(1, glm::uvec3(0));
+	firstNodeOfDepth.assign(1, 0);
+	nodeOfFragment.assign(fragments.size(), 0);
+
+	uint32_t brickCount = 0;
+	std::vector<uint8_t> touched;
+	for (uint32_t depth = 0; ; ++depth)
+	{
+		const uint32_t begin = firstNodeOfDepth[depth], end = (uint32_t)nodes.size();
+
+		// Flag the nodes of this depth that contain fragments.
+		touched.assign(end - begin, 0);
+		threadPool.parallelFor(fragments.size(), kFragmentGrainSize, [&](size_t first, size_t last, unsigned int) {
+			for (size_t i = first; i < last; ++i)
+				__atomic_store_n(&touched[nodeOfFragment[i] - begin], 1, __ATOMIC_RELAXED);
+		});
+
+		// Give them a brick and, above the leaves, 8 children.
+		for (uint32_t n = begin; n < end; ++n) if (touched[n - begin]) {
+			nodes[n].brick = brickCount++;
+			if (depth == maxDepth)
+				continue;
+			nodes[n].children = (uint32_t)nodes.size();
+			for (uint32_t octant = 0; octant < 8; ++octant)
+				nodeCoordinates.push_back(2u * nodeCoordinates[n] + glm::uvec3(octant & 1, (octant >> 1) & 1, octant >> 2));
+			nodes.resize(nodes.size() + 8);
+		}
+		// The children were appended right after this depth.
+		firstNodeOfDepth.push_back(end);
+
+		if (depth == maxDepth)
+			break;
+
+		// Move every fragment one depth down.
+		const uint32_t shift = log2(BRICK_SIZE) + (maxDepth - depth - 1);
+		threadPool.parallelFor(fragments.size(), kFragmentGrainSize, [&](size_t first, size_t last, unsigned int) {
+			for (size_t i = first; i < last; ++i)
+			{
+				const VoxelFragment & fragment = fragments[i];
+				const uint32_t octant = ((fragment.x() >> shift) & 1) | (((fragment.y() >> shift) & 1) << 1) | (((fragment.z() >> shift) & 1) << 2);
+				nodeOfFragment[i] = nodes[nodeOfFragment[i]].children + octant;
+			}
+		});
+	}
+
+	brickPool.assign(size_t(brickCount) * BRICK_VOXELS, 0);
+}
+
+void SparseVoxelOctree::filterInnerBricks()
+{
+	for (uint32_t depth = maxDepth; depth-- > 0;)
+	{
+		const uint32_t begin = firstNodeOfDepth[depth], end = firstNodeOfDepth[depth + 1];
+		threadPool.parallelFor(end - begin, kNodeGrainSize, [&](size_t first, size_t last, unsigned int) {
+			for (size_t n = begin + first; n < begin + last; ++n)
+			{
+				const Node & node = nodes[n];
+				if (node.brick == NO_BRICK)
+					continue;
+				for (int z = 0; z < int(BRICK_SIZE); ++z)
+					for (int y = 0; y < int(BRICK_SIZE); ++y)
+						for (int x = 0; x < int(BRICK_SIZE); ++x)
+						{
+							const int half = BRICK_SIZE / 2;
+							const Node & child = nodes[node.children + (x / half) + 2 * (y / half) + 4 * (z / half)];
+							if (child.brick == NO_BRICK)
+								continue; // Already transparent black.
+							const int cx = 2 * (x % half), cy = 2 * (y % half), cz = 2 * (z % half);
+							uint32_t texels[8];
+							for (int c = 0; c < 8; ++c)
+								texels[c] = *brickVoxel(child.brick, cx + (c & 1), cy + ((c >> 1) & 1), cz + (c >> 2));
+							*brickVoxel(node.brick, x, y, z) = VoxelMipChain::averageRgba8(texels);
+						}
+			}
+		});
+	}
+}
+
+void SparseVoxelOctree::buildTopLevels()
+{
+	topLevels.clear();
+	for (uint32_t level = maxDepth + 1; level < levelCount; ++level)
+	{
+		const uint32_t levelSize = size >> level;
+		std::vector<uint32_t> texels(size_t(levelSize) * levelSize * levelSize);
+		for (uint32_t z = 0; z < levelSize; ++z)
+			for (uint32_t y = 0; y < levelSize; ++y)
+				for (uint32_t x = 0; x < levelSize; ++x)
+				{
+					uint32_t children[8];
+					for (int c = 0; c < 8; ++c)
+						children[c] = fetch(level - 1, 2 * x + (c & 1), 2 * y + ((c >> 1) & 1), 2 * z + (c >> 2));
+					texels[(size_t(z) * levelSize + y) * levelSize + x] = VoxelMipChain::averageRgba8(children);
+				}
+		topLevels.push_back(std::move(texels));
+	}
+}
+
+void SparseVoxelOctree::fillBorders(const std::vector<glm::uvec3> & nodeCoordinates)
+{
+	// Borders are copies of the neighbor texels of the same level, clamped to the edge of the volume.
+	for (uint32_t depth = 0; depth <= maxDepth; ++depth)
+	{
+		const uint32_t level = maxDepth - depth;
+		const int last = int(size >> level) - 1;
+		const uint32_t begin = firstNodeOfDepth[depth], end = firstNodeOfDepth[depth + 1];
+		threadPool.parallelFor(end - begin, kNodeGrainSize, [&](size_t first, size_t lastNode, unsigned int) {
+			for (size_t n = begin + first; n < begin + lastNode; ++n)
+			{
+				const uint32_t brick = nodes[n].brick;
+				if (brick == NO_BRICK)
+					continue;
+				const glm::ivec3 origin = glm::ivec3(nodeCoordinates[n]) * int(BRICK_SIZE);
+				for (int z = -1; z <= int(BRICK_SIZE); ++z)
+					for (int y = -1; y <= int(BRICK_SIZE); ++y)
+						for (int x = -1; x <= int(BRICK_SIZE); ++x)
+						{
+							const bool interior = x >= 0 && y >= 0 && z >= 0 &&
+												  x < int(BRICK_SIZE) && y < int(BRICK_SIZE) && z < int(BRICK_SIZE);
+							if (interior)
+								continue;
+							const glm::ivec3 p = glm::clamp(origin + glm::ivec3(x, y, z), glm::ivec3(0), glm::ivec3(last));
+							*brickVoxel(brick, x, y, z) = fetch(level, p.x, p.y, p.z);
+						}
+			}
+		});
+	}
+}
+
+const SparseVoxelOctree::Node * SparseVoxelOctree::findNode(uint32_t depth, const glm::uvec3 & nodeCoordinate) const
+{
+	const Node * node = &nodes[0];
+	for (uint32_t bit = depth; bit-- > 0;)
+	{
+		if (node->children == 0)
+			return nullptr;
+		const uint32_t octant = ((nodeCoordinate.x >> bit) & 1) | (((nodeCoordinate.y >> bit) & 1) << 1) | (((nodeCoordinate.z >> bit) & 1) << 2);
+		node = &nodes[node->children + octant];
+	}
+	return node;
+}
+
+uint32_t SparseVoxelOctree::fetch(uint32_t level, int x, int y, int z) const
+{
+	if (level > maxDepth)
+	{
+		const uint32_t levelSize = size >> level;
+		return topLevels[level - maxDepth - 1][(size_t(z) * levelSize + y) * levelSize + x];
+	}
+
+	const Node * node = findNode(maxDepth - level, glm::uvec3(x, y, z) / BRICK_SIZE);
+	if (!node || node->brick == NO_BRICK)
+		return 0;
+	const int mask = BRICK_SIZE - 1;
+	return brickVoxel(node->brick, x & mask, y & mask, z & mask);
+}
+
+glm::vec4 SparseVoxelOctree::sampleLevel(uint32_t level, const glm::vec3 & coordinate) const
+{
+	const uint32_t levelSize = size >> level;
+	auto fetchLevel = [&](int x, int y, int z) { return fetch(level, x, y, z); };
+	if (level > maxDepth || nodes.empty())
+		return VoxelMipChain::sampleTrilinear(coordinate, levelSize, fetchLevel);
+
+	// Fast path: the 2x2x2 footprint lies in the brick (with its border) of the node containing the coordinate.
+	const glm::ivec3 texel = glm::clamp(glm::ivec3(glm::floor(coordinate * float(levelSize))), glm::ivec3(0), glm::ivec3(int(levelSize) - 1));
+	const glm::uvec3 nodeCoordinate = glm::uvec3(texel) / BRICK_SIZE;
+	const Node * node = findNode(maxDepth - level, nodeCoordinate);
+	if (!node || node->brick == NO_BRICK)
+	{
+		// Empty node, but the neighbors may still contribute.
+		return VoxelMipChain::sampleTrilinear(coordinate, levelSize, fetchLevel);
+	}
+
+	const glm::ivec3 origin = glm::ivec3(nodeCoordinate) * int(BRICK_SIZE);
+	return VoxelMipChain::sampleTrilinear(coordinate, levelSize, [&](int x, int y, int z) {
+		return brickVoxel(node->brick, x - origin.x, y - origin.y, z - origin.z);
+	});
+}
+
+glm::vec4 SparseVoxelOctree::textureLod(const glm::vec3 & coordinate, float mipmapLevel) const
+{
+	const float lod = glm::clamp(mipmapLevel, 0.0f, float(levelCount - 1));
+	const uint32_t level0 = uint32_t(std::floor(lod));
+	const uint32_t level1 = std::min(level0 + 1, levelCount - 1);
+
+	const glm::vec4 a = sampleLevel(level0, coordinate);
+	const float f = lod - float(level0);
+	return f > 0.0f && level1 != level0 ? glm::mix(a, sampleLevel(level1, coordinate), f) : a;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "CpuVoxelizer.h"
+
+class ThreadPool;
+class VoxelGrid;
+
+/// <summary> Sparse alternative to the dense voxel Texture3D: an octree whose nodes point to 8^3 voxel
+/// bricks stored in a brick pool, with a one voxel border so that trilinear filtering never needs
+/// to look at the neighbor bricks. Node depth d holds mip level (maxDepth - d), i.e. leaves hold the
+/// first level and inner nodes hold the coarser levels. Levels coarser than the root brick are dense.
+/// Empty space costs nothing besides the nodes of its parent. </summary>
+class SparseVoxelOctree {
+public:
+	/// <summary> Voxels per brick edge, without the border. </summary>
+	static constexpr uint32_t BRICK_SIZE = 8;
+	/// <summary> Voxels per brick edge in the brick pool, with a one voxel border on each side. </summary>
+	static constexpr uint32_t BRICK_STRIDE = BRICK_SIZE + 2;
+	static constexpr uint32_t BRICK_VOXELS = BRICK_STRIDE * BRICK_STRIDE * BRICK_STRIDE;
+	static constexpr uint32_t NO_BRICK = 0xffffffff;
+
+	struct Stats {
+		size_t fragments = 0;
+		size_t nodes = 0;
+		size_t bricks = 0;
+		unsigned int threads = 1;
+		double seconds = 0;
+	};
+
+	explicit SparseVoxelOctree(ThreadPool & threadPool);
+
+	/// <summary> Builds the octree top-down from a voxel fragment list, then fills the bricks bottom-up
+	/// (same 2x2x2 box filter as VoxelMipChain). Size must be a power of 2, at least BRICK_SIZE. </summary>
+	Stats build(const std::vector<VoxelFragment> & fragments, uint32_t size);
+
+	/// <summary> Fragment list of the non empty voxels of a dense grid. </summary>
+	static std::vector<VoxelFragment> gatherFragments(const VoxelGrid & grid);
+
+	uint32_t getSize() const { return size; }
+	uint32_t getLevelCount() const { return levelCount; }
+	size_t getNodeCount() const { return nodes.size(); }
+	size_t getBrickCount() const { return brickPool.size() / BRICK_VOXELS; }
+	size_t getMemoryUsage() const;
+
+	/// <summary> RGBA8 texel of a level, transparent black in empty space. Coordinates must be inside the level. </summary>
+	uint32_t fetch(uint32_t level, int x, int y, int z) const;
+
+	/// <summary> Same as textureLod in common.metal (and VoxelMipChain::textureLod). Coordinates are in [0, 1]. </summary>
+	glm::vec4 textureLod(const glm::vec3 & coordinate, float mipmapLevel) const;
+
+private:
+	struct Node {
+		uint32_t children = 0; // Index of the first of the 8 child nodes, 0 if the node has none.
+		uint32_t brick = NO_BRICK;
+	};
+
+	/// <summary> Node of a depth containing the given node coordinates, or nullptr in empty space. </summary>
+	const Node * findNode(uint32_t depth, const glm::uvec3 & nodeCoordinate) const;
+	glm::vec4 sampleLevel(uint32_t level, const glm::vec3 & coordinate) const;
+
+	uint32_t * brickVoxel(uint32_t brick, int x, int y, int z)
+	{
+		return &brickPool[size_t(brick) * BRICK_VOXELS + (size_t(z + 1) * BRICK_STRIDE + (y + 1)) * BRICK_STRIDE + (x + 1)];
+	}
+	uint32_t brickVoxel(uint32_t brick, int x, int y, int z) const
+	{
+		return brickPool[size_t(brick) * BRICK_VOXELS + (size_t(z + 1) * BRICK_STRIDE + (y + 1)) * BRICK_STRIDE + (x + 1)];
+	}
+
+	void buildNodes(const std::vector<VoxelFragment> & fragments, std::vector<uint32_t> & leafOfFragment,
+					std::vector<glm::uvec3> & nodeCoordinates);
+	void filterInnerBricks();
+	void buildTopLevels();
+	void fillBorders(const std::vector<glm::uvec3> & nodeCoordinates);
+
+	ThreadPool & threadPool;
+
+	uint32_t size = 0;
+	uint32_t maxDepth = 0;   // Depth of the leaves.
+	uint32_t levelCount = 0;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> firstNodeOfDepth; // Nodes are stored depth by depth.
+	std::vector<uint32_t> brickPool;
+	std::vector<std::vector<uint32_t>> topLevels; // Dense levels coarser than the root brick.
+};
@@ -0,0 +1,119 @@
+#include "TemporalAccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../Time/Time.h"
+#include "../../Utility/ThreadPool.h"
+
+constexpr uint32_t TemporalAccumulator::CONE_PATTERNS;
+constexpr float TemporalAccumulator::DEPTH_TOLERANCE;
+constexpr float TemporalAccumulator::NORMAL_THRESHOLD;
+constexpr float TemporalAccumulator::MAX_FRAMES;
+
+TemporalAccumulator::TemporalAccumulator(ThreadPool & _threadPool) : threadPool(_threadPool) {}
+
+float TemporalAccumulator::patternRotation(uint32_t frame)
+{
+	// Golden ratio sequence over a quarter turn, the patterns cover the other quarters.
+	const float cycle = float(frame / CONE_PATTERNS);
+	return (cycle * 0.618034f - std::floor(cycle * 0.618034f)) * 1.57079633f;
+}
+
+glm::vec2 TemporalAccumulator::reproject(const glm::vec3 & position, const glm::mat4 & viewProjection, uint32_t width, uint32_t height)
+{
+	const glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+	if (clip.w <= 0.0f)
+		return glm::vec2(-1.0f);
+	return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+}
+
+void TemporalAccumulator::reset()
+{
+	historyValid = false;
+}
+
+TemporalAccumulator::Stats TemporalAccumulator::accumulate(const ScreenGBuffer & gBuffer, const std::vector<glm::vec3> & frameLight,
+														   const glm::mat4 & viewProjection, const glm::vec3 & cameraPosition)
+{
+	Stats stats;
+	stats.threads = threadPool.size();
+	const uint32_t width = gBuffer.getWidth(), height = gBuffer.getHeight();
+	stats.pixels = size_t(width) * height;
+	const double startTime = Time::currentTime();
+
+	if (previousGBuffer.getWidth() != width || previousGBuffer.getHeight() != height)
+		historyValid = false;
+	nextHistory.assign(stats.pixels, glm::vec4(0.0f));
+	light.assign(stats.pixels, glm::vec3(0.0f));
+
+	std::vector<size_t> reprojected(threadPool.size(), 0);
+	threadPool.parallelFor(height, 4, [&](size_t begin, size_t end, unsigned int worker) {
+		for (uint32_t y = uint32_t(begin); y < end; ++y)
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const ScreenGBuffer::Sample & sample = gBuffer.at(x, y);
+				if (!sample.covered())
+					continue;
+				const size_t index = size_t(y) * width + x;
+				const glm::vec3 & current = frameLight[index];
+
+				// Range of the light of this frame around the pixel: all the cone patterns are in it.
+				glm::vec3 lo = current, hi = current;
+				for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, height - 1); ++ny)
+					for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, width - 1); ++nx)
+						if (gBuffer.at(nx, ny).covered())
+						{
+							lo = glm::min(lo, frameLight[size_t(ny) * width + nx]);
+							hi = glm::max(hi, frameLight[size_t(ny) * width + nx]);
+						}
+
+				// Bilinear fetch of the history at the previous position of the surface, skipping the samples of other surfaces.
+				glm::vec4 previous(0.0f);
+				float total = 0.0f;
+				if (historyValid)
+				{
+					const glm::vec2 f = reproject(sample.position, previousViewProjection, width, height) - 0.5f;
+					const glm::vec2 base = glm::floor(f);
+					const glm::vec2 t = f - base;
+					const float expectedDistance = glm::length(sample.position - previousCameraPosition);
+					for (int corner = 0; corner < 4; ++corner)
+					{
+						const glm::ivec2 offset(corner & 1, corner >> 1);
+						const glm::ivec2 p = glm::ivec2(base) + offset;
+						if (p.x < 0 || p.y < 0 || p.x >= int(width) || p.y >= int(height))
+							continue;
+						const ScreenGBuffer::Sample & old = previousGBuffer.at(uint32_t(p.x), uint32_t(p.y));
+						if (!old.covered() || std::abs(old.distance - expectedDistance) > DEPTH_TOLERANCE * expectedDistance
+							|| glm::dot(old.normal, sample.normal) < NORMAL_THRESHOLD)
+							continue;
+						const float weight = (offset.x ? t.x : 1.0f - t.x) * (offset.y ? t.y : 1.0f - t.y);
+						previous += weight * history[size_t(p.y) * width + p.x];
+						total += weight;
+					}
+				}
+
+				glm::vec4 result(current, 1.0f);
+				if (total > 1e-3f)
+				{
+					previous /= total;
+					const float frames = std::min(previous.a + 1.0f, MAX_FRAMES);
+					result = glm::vec4(glm::mix(glm::clamp(glm::vec3(previous), lo, hi), current, 1.0f / frames), frames);
+					++reprojected[worker];
+				}
+				nextHistory[index] = result;
+				light[index] = glm::vec3(result);
+			}
+	});
+
+	history.swap(nextHistory);
+	previousGBuffer = gBuffer;
+	previousViewProjection = viewProjection;
+	previousCameraPosition = cameraPosition;
+	historyValid = true;
+
+	for (size_t count : reprojected)
+		stats.reprojected += count;
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "ScreenGBuffer.h"
+
+class ThreadPool;
+
+/// <summary> CPU version of accumulateIndirectDiffuse in voxel_cone_tracing.metal: temporal accumulation of the
+/// indirect diffuse light when each frame only traces one cone pattern per pixel (CpuConeTracer::traceDiffuseConePattern,
+/// 3 cones instead of 9). The history of the previous frame is reprojected with its view projection matrix, the
+/// samples whose surface doesn't match (disocclusion, other distance or normal) are rejected, and what remains is
+/// clamped to the range of the light of the 3x3 neighbourhood of this frame before being blended in, so that moving
+/// objects and the camera don't leave ghosts. Keep them in sync. </summary>
+class TemporalAccumulator {
+public:
+	/// <summary> Rotations of the cone pattern, interleaved over the pixels so that each 3x3 neighbourhood has all of them. </summary>
+	static constexpr uint32_t CONE_PATTERNS = 4;
+	/// <summary> Largest distance difference, relative to the distance of the pixel, of a history sample on the same surface. </summary>
+	static constexpr float DEPTH_TOLERANCE = 0.05f;
+	/// <summary> Smallest cosine between the normals of a history sample on the same surface. </summary>
+	static constexpr float NORMAL_THRESHOLD = 0.9f;
+	/// <summary> Frames the history can count: the light of a new frame weighs at least 1 / MAX_FRAMES. </summary>
+	static constexpr float MAX_FRAMES = 16.0f;
+
+	struct Stats {
+		size_t pixels = 0;
+		size_t reprojected = 0;	// Pixels that kept some history.
+		unsigned int threads = 1;
+		double seconds = 0;
+
+		double pixelsPerSecond() const { return seconds > 0 ? pixels / seconds : 0; }
+	};
+
+	explicit TemporalAccumulator(ThreadPool & threadPool);
+
+	/// <summary> Cone pattern traced at a pixel in a frame. </summary>
+	static uint32_t conePattern(uint32_t x, uint32_t y, uint32_t frame) { return (frame + x + 2 * y) % CONE_PATTERNS; }
+	/// <summary> Rotation of the cone patterns in a frame, changed after each cycle of CONE_PATTERNS frames. </summary>
+	static float patternRotation(uint32_t frame);
+	/// <summary> Pixel coordinates (pixel centers at + 0.5) of a world position in a viewport of the given size. </summary>
+	static glm::vec2 reproject(const glm::vec3 & position, const glm::mat4 & viewProjection, uint32_t width, uint32_t height);
+
+	/// <summary> Blends the light traced this frame (one value per pixel of gBuffer) into the history, which then
+	/// becomes the history of the next frame. The history is dropped when the size of gBuffer changes. </summary>
+	Stats accumulate(const ScreenGBuffer & gBuffer, const std::vector<glm::vec3> & frameLight,
+					 const glm::mat4 & viewProjection, const glm::vec3 & cameraPosition);
+	void reset();
+
+	/// <summary> Accumulated light of the last frame, one value per pixel. </summary>
+	const std::vector<glm::vec3> & getLight() const { return light; }
+
+private:
+	ThreadPool & threadPool;
+
+	ScreenGBuffer previousGBuffer = ScreenGBuffer(0, 0);
+	std::vector<glm::vec4> history, nextHistory; // rgb: light, a: frames accumulated.
+	std::vector<glm::vec3> light;
+	glm::mat4 previousViewProjection = glm::mat4(1.0f);
+	glm::vec3 previousCameraPosition = glm::vec3(0.0f);
+	bool historyValid = false;
+};
@@ -0,0 +1,52 @@
+#include "VoxelBrickOccupancy.h"
+
+#include <algorithm>
+
+#include "VoxelGrid.h"
+
+constexpr uint32_t VoxelBrickOccupancy::BRICK_SIZE;
+
+VoxelBrickOccupancy::VoxelBrickOccupancy(uint32_t _size) :
+	size(_size), bricksPerAxis(std::max(1u, _size / BRICK_SIZE)), words((getBrickCount() + 31) / 32, 0)
+{
+}
+
+void VoxelBrickOccupancy::clear()
+{
+	std::fill(words.begin(), words.end(), 0u);
+}
+
+void VoxelBrickOccupancy::build(const VoxelGrid & grid)
+{
+	clear();
+	const uint32_t * voxels = grid.data();
+	for (uint32_t z = 0; z < size; ++z)
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			const uint32_t * row = &voxels[grid.index(0, y, z)];
+			for (uint32_t x = 0; x < size; ++x)
+				if (row[x]) mark(x, y, z);
+		}
+}
+
+bool VoxelBrickOccupancy::isOccupied(const VoxelRegion & region) const
+{
+	const VoxelRegion clamped = region.intersection(VoxelRegion::full(size));
+	if (clamped.empty())
+		return false;
+
+	const glm::ivec3 lo = clamped.min / int(BRICK_SIZE);
+	const glm::ivec3 hi = glm::min((clamped.max - 1) / int(BRICK_SIZE), glm::ivec3(int(bricksPerAxis) - 1));
+	for (int z = lo.z; z <= hi.z; ++z)
+		for (int y = lo.y; y <= hi.y; ++y)
+			for (int x = lo.x; x <= hi.x; ++x)
+				if (isBrickOccupied(x, y, z)) return true;
+	return false;
+}
+
+size_t VoxelBrickOccupancy::countOccupied() const
+{
+	size_t count = 0;
+	for (uint32_t word : words) count += __builtin_popcount(word);
+	return count;
+}
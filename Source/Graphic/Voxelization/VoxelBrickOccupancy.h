@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelRegion.h"
+
+class VoxelGrid;
+
+/// <summary> One bit per 8^3 brick of a voxel volume, set when anything was voxelized into the brick. Same layout as the
+/// brick occupancy buffer written by voxelization.metal: bit (i % 32) of word i / 32, with i the linear brick index.
+/// Bits are only cleared along with the whole volume, so after partial re-voxelizations they stay conservative
+/// (a set bit may cover an empty brick, an empty brick never has its bit set). Mip generation uses it to skip
+/// the empty parts of the volume. </summary>
+class VoxelBrickOccupancy {
+public:
+	static constexpr uint32_t BRICK_SIZE = 8;
+
+	/// <summary> Size of the voxel volume, a multiple of BRICK_SIZE or smaller than it. </summary>
+	explicit VoxelBrickOccupancy(uint32_t size);
+
+	uint32_t getSize() const { return size; }
+	uint32_t getBricksPerAxis() const { return bricksPerAxis; }
+	size_t getBrickCount() const { return size_t(bricksPerAxis) * bricksPerAxis * bricksPerAxis; }
+	size_t getMemoryUsage() const { return words.size() * sizeof(uint32_t); }
+
+	void clear();
+
+	/// <summary> Thread safe, marks the brick of voxel (x, y, z). </summary>
+	void mark(uint32_t x, uint32_t y, uint32_t z)
+	{
+		const size_t i = brickIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+		const uint32_t bit = 1u << (i & 31);
+		// Most fragments land in an already marked brick, skip the atomic for them.
+		if (!(__atomic_load_n(&words[i >> 5], __ATOMIC_RELAXED) & bit))
+			__atomic_fetch_or(&words[i >> 5], bit, __ATOMIC_RELAXED);
+	}
+
+	/// <summary> Marks every brick holding a non zero voxel of a grid of the same size, after clearing. </summary>
+	void build(const VoxelGrid & grid);
+
+	bool isBrickOccupied(uint32_t bx, uint32_t by, uint32_t bz) const
+	{
+		const size_t i = brickIndex(bx, by, bz);
+		return (words[i >> 5] >> (i & 31)) & 1;
+	}
+
+	/// <summary> Whether any brick touching a region of the first level is occupied. </summary>
+	bool isOccupied(const VoxelRegion & region) const;
+
+	size_t countOccupied() const;
+
+	const uint32_t * data() const { return words.data(); }
+
+private:
+	size_t brickIndex(uint32_t bx, uint32_t by, uint32_t bz) const
+	{
+		return (size_t(bz) * bricksPerAxis + by) * bricksPerAxis + bx;
+	}
+
+	uint32_t size;
+	uint32_t bricksPerAxis;
+	std::vector<uint32_t> words;
+};
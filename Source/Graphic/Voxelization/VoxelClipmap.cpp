@@ -0,0 +1,133 @@
+#include "VoxelClipmap.h"
+
+#include <cassert>
+#include <cstdlib>
+
+VoxelClipmap::VoxelClipmap(uint32_t levelCount, uint32_t _size, float baseExtent)
+	: size(_size), levels(levelCount), updateRegions(levelCount)
+{
+	assert(size >= uint32_t(2 * SCROLL_STEP) && (size & (size - 1)) == 0);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		levels[i].voxelSize = 2.0f * baseExtent * float(1 << i) / float(size);
+		levels[i].origin = windowOrigin(glm::vec3(0.0f), levels[i].voxelSize);
+	}
+}
+
+glm::ivec3 VoxelClipmap::windowOrigin(const glm::vec3 & center, float voxelSize) const
+{
+	const glm::ivec3 centerVoxel = glm::ivec3(glm::floor(center / (voxelSize * SCROLL_STEP) + 0.5f)) * SCROLL_STEP;
+	return centerVoxel - int(size / 2);
+}
+
+glm::mat4 VoxelClipmap::Level::worldToVolume(uint32_t size) const
+{
+	const float scale = 2.0f / (voxelSize * float(size));
+	glm::mat4 result(scale);
+	result[3] = glm::vec4(-minCorner() * scale - 1.0f, 1.0f);
+	return result;
+}
+
+VoxelRegion VoxelClipmap::Level::fromWorldBounds(const WorldBounds & bounds, uint32_t size) const
+{
+	// One voxel margin for conservative rasterization, like VoxelRegion::fromWorldBounds.
+	const glm::vec3 lo = glm::floor(bounds.min / voxelSize) - glm::vec3(origin) - 1.0f;
+	const glm::vec3 hi = glm::floor(bounds.max / voxelSize) - glm::vec3(origin) + 2.0f;
+	const VoxelRegion region(glm::ivec3(glm::clamp(lo, 0.0f, float(size))),
+							 glm::ivec3(glm::clamp(hi, 0.0f, float(size))));
+	return region.aligned(SCROLL_STEP, size);
+}
+
+void VoxelClipmap::update(const glm::vec3 & center, const std::vector<WorldBounds> & dirtyBounds)
+{
+	const VoxelRegion fullRegion = VoxelRegion::full(size);
+	const int extent = int(size);
+
+	for (uint32_t i = 0; i < levels.size(); ++i)
+	{
+		Level & level = levels[i];
+		std::vector<VoxelRegion> & regions = updateRegions[i];
+		regions.clear();
+
+		const glm::ivec3 origin = windowOrigin(center, level.voxelSize);
+		const glm::ivec3 delta = origin - level.origin;
+		level.origin = origin;
+
+		if (fullUpdate || glm::any(glm::greaterThanEqual(glm::abs(delta), glm::ivec3(extent))))
+		{
+			regions.push_back(fullRegion);
+			continue;
+		}
+
+		// Slabs that scrolled in. Each one excludes the previous ones so that no voxel is done twice.
+		VoxelRegion remaining = fullRegion;
+		for (int axis = 0; axis < 3; ++axis) if (delta[axis] != 0)
+		{
+			VoxelRegion slab = remaining;
+			if (delta[axis] > 0)
+				slab.min[axis] = remaining.max[axis] = extent - delta[axis];
+			else
+				slab.max[axis] = remaining.min[axis] = -delta[axis];
+			regions.push_back(slab);
+		}
+
+		// Objects that changed in the part of the window that was already voxelized.
+		VoxelRegion dirtyRegion;
+		for (auto & bounds : dirtyBounds)
+			dirtyRegion = dirtyRegion.merged(level.fromWorldBounds(bounds, size).intersection(remaining));
+		if (!dirtyRegion.empty())
+			regions.push_back(dirtyRegion);
+
+		// Clearing everything is cheaper than many small regions covering most of the window.
+		size_t volume = 0;
+		for (auto & region : regions) volume += region.volume();
+		if (volume * 2 > fullRegion.volume())
+			regions.assign(1, fullRegion);
+	}
+
+	fullUpdate = false;
+}
+
+std::vector<VoxelRegion> VoxelClipmap::toroidalRegions(uint32_t level, const VoxelRegion & windowRegion) const
+{
+	std::vector<VoxelRegion> result;
+	if (windowRegion.empty())
+		return result;
+
+	// Per axis, one or two texel ranges.
+	const int extent = int(size);
+	int ranges[3][2][2];
+	int rangeCount[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const int length = windowRegion.max[axis] - windowRegion.min[axis];
+		const int start = (windowRegion.min[axis] + levels[level].origin[axis]) & (extent - 1);
+		if (length >= extent)
+		{
+			ranges[axis][0][0] = 0;
+			ranges[axis][0][1] = extent;
+			rangeCount[axis] = 1;
+		}
+		else if (start + length <= extent)
+		{
+			ranges[axis][0][0] = start;
+			ranges[axis][0][1] = start + length;
+			rangeCount[axis] = 1;
+		}
+		else
+		{
+			ranges[axis][0][0] = start;
+			ranges[axis][0][1] = extent;
+			ranges[axis][1][0] = 0;
+			ranges[axis][1][1] = start + length - extent;
+			rangeCount[axis] = 2;
+		}
+	}
+
+	for (int z = 0; z < rangeCount[2]; ++z)
+		for (int y = 0; y < rangeCount[1]; ++y)
+			for (int x = 0; x < rangeCount[0]; ++x)
+				result.emplace_back(glm::ivec3(ranges[0][x][0], ranges[1][y][0], ranges[2][z][0]),
+									glm::ivec3(ranges[0][x][1], ranges[1][y][1], ranges[2][z][1]));
+	return result;
+}
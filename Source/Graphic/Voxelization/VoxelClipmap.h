@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelRegion.h"
+
+/// <summary> Camera centered cascades of voxel volumes. Every level has the same resolution but twice
+/// the extent of the previous one, so the voxelized space grows exponentially at constant memory.
+/// Each level is stored toroidally: world voxel w lives at texel (w mod size), so when the window
+/// moves only the newly exposed slabs have to be cleared and voxelized again.
+/// Regions returned by this class are in window voxels ([0, size) from the window min corner);
+/// toroidalRegions() converts them to texels. </summary>
+class VoxelClipmap {
+public:
+	/// <summary> Windows move by multiples of this many voxels, so that the first mip levels of a
+	/// window don't mix voxels of both sides of the wrap. </summary>
+	static constexpr int SCROLL_STEP = 8;
+
+	struct Level {
+		/// <summary> World voxel coordinate of the window min corner. </summary>
+		glm::ivec3 origin = glm::ivec3(0);
+		float voxelSize = 0;
+
+		glm::vec3 minCorner() const { return glm::vec3(origin) * voxelSize; }
+
+		/// <summary> Maps world space to the [-1, 1] volume space of the window, i.e. the space
+		/// the voxelization shaders (and CpuVoxelizer) work in. </summary>
+		glm::mat4 worldToVolume(uint32_t size) const;
+
+		/// <summary> Window voxels touched by anything inside the world space box, brick aligned. </summary>
+		VoxelRegion fromWorldBounds(const WorldBounds & bounds, uint32_t size) const;
+	};
+
+	/// <summary> The first level covers baseExtent around the center in each direction, like the
+	/// [-1, 1] voxel volume does with a base extent of 1. Size must be a power of 2. </summary>
+	VoxelClipmap(uint32_t levelCount, uint32_t size, float baseExtent);
+
+	uint32_t getLevelCount() const { return (uint32_t)levels.size(); }
+	uint32_t getSize() const { return size; }
+	const Level & getLevel(uint32_t level) const { return levels[level]; }
+
+	/// <summary> Centers the windows on a position (the camera) and collects, per level, the window
+	/// regions to re-voxelize: the slabs that scrolled in, plus the voxels covered by the world space
+	/// boxes that changed (see VoxelDirtyTracker::getDirtyWorldBounds). </summary>
+	void update(const glm::vec3 & center, const std::vector<WorldBounds> & dirtyBounds);
+
+	/// <summary> Regions collected by the last update(). The full window after invalidate(). </summary>
+	const std::vector<VoxelRegion> & getUpdateRegions(uint32_t level) const { return updateRegions[level]; }
+
+	/// <summary> Forces the next update to re-voxelize every level entirely. </summary>
+	void invalidate() { fullUpdate = true; }
+
+	/// <summary> Texel boxes covering a window region of a level, split where it wraps around (up to 8). </summary>
+	std::vector<VoxelRegion> toroidalRegions(uint32_t level, const VoxelRegion & windowRegion) const;
+
+private:
+	glm::ivec3 windowOrigin(const glm::vec3 & center, float voxelSize) const;
+
+	uint32_t size;
+	std::vector<Level> levels;
+	std::vector<std::vector<VoxelRegion>> updateRegions;
+	bool fullUpdate = true;
+};
@@ -0,0 +1,130 @@
+#include "VoxelDirtyTracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+void VoxelDirtyTracker::beginFrame(uint32_t _gridSize)
+{
+	if (gridSize != _gridSize)
+	{
+		// Cached voxel bounds are in the old resolution.
+		objects.clear();
+		fullUpdate = true;
+	}
+	gridSize = _gridSize;
+	dirtyRegion = VoxelRegion();
+	dirtyRegions.clear();
+	dirtyWorldBounds.clear();
+	++frame;
+}
+
+void VoxelDirtyTracker::addObject(const void * key, const glm::mat4 & model,
+								  const glm::vec3 & localMin, const glm::vec3 & localMax,
+								  const MaterialSetting & material)
+{
+	auto it = objects.find(key);
+	if (it != objects.end() && it->second.model == model &&
+		std::memcmp(&it->second.material, &material, sizeof(MaterialSetting)) == 0)
+	{
+		it->second.lastFrame = frame;
+		return;
+	}
+
+	glm::vec3 worldMin, worldMax;
+	transformBounds(model, localMin, localMax, worldMin, worldMax);
+
+	ObjectState state;
+	state.model = model;
+	state.material = material;
+	state.bounds = VoxelRegion::fromWorldBounds(worldMin, worldMax, gridSize);
+	state.worldBounds.min = worldMin;
+	state.worldBounds.max = worldMax;
+	state.lastFrame = frame;
+
+	dirtyRegion = dirtyRegion.merged(state.bounds);
+	dirtyRegions.push_back(state.bounds);
+	dirtyWorldBounds.push_back(state.worldBounds);
+	if (it != objects.end())
+	{
+		dirtyRegion = dirtyRegion.merged(it->second.bounds);
+		dirtyRegions.push_back(it->second.bounds);
+		dirtyWorldBounds.push_back(it->second.worldBounds);
+		it->second = state;
+	}
+	else
+	{
+		objects.emplace(key, state);
+	}
+}
+
+void VoxelDirtyTracker::setPointLights(const std::vector<PointLight> & pointLights)
+{
+	lightsChanged = pointLights.size() != lights.size() ||
+					std::memcmp(pointLights.data(), lights.data(), pointLights.size() * sizeof(PointLight)) != 0;
+	lights = pointLights;
+}
+
+VoxelRegion VoxelDirtyTracker::endFrame()
+{
+	// Objects that were not reported this frame got disabled or removed.
+	for (auto it = objects.begin(); it != objects.end();)
+	{
+		if (it->second.lastFrame != frame)
+		{
+			dirtyRegion = dirtyRegion.merged(it->second.bounds);
+			dirtyRegions.push_back(it->second.bounds);
+			dirtyWorldBounds.push_back(it->second.worldBounds);
+			it = objects.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	dirtyRegion = dirtyRegion.aligned(BRICK_SIZE, gridSize);
+
+	const size_t gridVolume = size_t(gridSize) * gridSize * gridSize;
+	if (fullUpdate || dirtyRegion.volume() * 2 > gridVolume)
+	{
+		dirtyRegion = VoxelRegion::full(gridSize);
+		dirtyRegions.assign(1, dirtyRegion);
+	}
+	else
+	{
+		dirtyRegions.erase(std::remove_if(dirtyRegions.begin(), dirtyRegions.end(),
+										  [](const VoxelRegion & region) { return region.empty(); }), dirtyRegions.end());
+		for (auto & region : dirtyRegions) region = region.aligned(BRICK_SIZE, gridSize);
+	}
+
+	fullUpdate = false;
+	return dirtyRegion;
+}
+
+std::vector<glm::ivec3> VoxelDirtyTracker::getDirtyBricks() const
+{
+	const int bricksPerAxis = std::max(1, int(gridSize) / BRICK_SIZE);
+	std::vector<uint8_t> marked(size_t(bricksPerAxis) * bricksPerAxis * bricksPerAxis, 0);
+	std::vector<glm::ivec3> bricks;
+	for (auto & region : dirtyRegions)
+	{
+		const glm::ivec3 lo = region.min / BRICK_SIZE;
+		const glm::ivec3 hi = glm::min((region.max - 1) / BRICK_SIZE, glm::ivec3(bricksPerAxis - 1));
+		for (int z = lo.z; z <= hi.z; ++z)
+			for (int y = lo.y; y <= hi.y; ++y)
+				for (int x = lo.x; x <= hi.x; ++x)
+				{
+					uint8_t & m = marked[(size_t(z) * bricksPerAxis + y) * bricksPerAxis + x];
+					if (m) continue;
+					m = 1;
+					bricks.emplace_back(x, y, z);
+				}
+	}
+	return bricks;
+}
+
+VoxelRegion VoxelDirtyTracker::getBounds(const void * key) const
+{
+	auto it = objects.find(key);
+	return it != objects.end() ? it->second.bounds : VoxelRegion();
+}
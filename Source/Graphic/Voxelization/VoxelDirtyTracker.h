@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelRegion.h"
+#include "../Lighting/PointLight.h"
+#include "../Material/MaterialSetting.h"
+
+/// <summary> Remembers the transform, material and voxel bounds of every voxelized object between
+/// frames, so that only the bricks covered by the old and new bounds of the objects that changed need
+/// to be cleared and re-voxelized. Objects are identified by an opaque key (e.g. their MeshRenderer). </summary>
+class VoxelDirtyTracker {
+public:
+	/// <summary> Dirty regions are grown to multiples of this many voxels. </summary>
+	static constexpr int BRICK_SIZE = 8;
+
+	/// <summary> Starts collecting the objects of a frame for a grid of the given size. </summary>
+	void beginFrame(uint32_t gridSize);
+
+	/// <summary> Reports an enabled object. Bounds are the object space bounding box of its mesh. </summary>
+	void addObject(const void * key, const glm::mat4 & model,
+				   const glm::vec3 & localMin, const glm::vec3 & localMax,
+				   const MaterialSetting & material);
+
+	void setPointLights(const std::vector<PointLight> & pointLights);
+
+	/// <summary> Returns the brick aligned union of the old and new bounds of every object that was added,
+	/// moved, changed its material or disappeared since the previous frame. Empty if nothing changed.
+	/// The full grid is returned after invalidate(), a grid size change, or when the dirty part is
+	/// larger than half of the grid (clearing everything is cheaper then). </summary>
+	VoxelRegion endFrame();
+
+	/// <summary> Whether the point lights differ from the previous frame. Lit voxels are stale everywhere then. </summary>
+	bool pointLightsChanged() const { return lightsChanged; }
+
+	/// <summary> Brick aligned old and new voxel bounds of the objects that changed this frame (valid after endFrame()),
+	/// the full grid when endFrame() returned it. Unlike the region returned by endFrame(), they don't cover the
+	/// space between objects that are far apart, so updating only them (e.g. the mips) costs the size of the objects. </summary>
+	const std::vector<VoxelRegion> & getDirtyRegions() const { return dirtyRegions; }
+	/// <summary> The 8^3 bricks (in brick coordinates) covered by the dirty regions, each once. </summary>
+	std::vector<glm::ivec3> getDirtyBricks() const;
+
+	/// <summary> World space old and new bounds of the objects that changed this frame (valid after endFrame()),
+	/// for volumes that don't use the [-1, 1] mapping, e.g. VoxelClipmap. </summary>
+	const std::vector<WorldBounds> & getDirtyWorldBounds() const { return dirtyWorldBounds; }
+
+	/// <summary> Current voxel bounds of an object reported this frame. </summary>
+	VoxelRegion getBounds(const void * key) const;
+
+	/// <summary> Forces the next frame to be fully re-voxelized. </summary>
+	void invalidate() { fullUpdate = true; }
+
+private:
+	struct ObjectState {
+		glm::mat4 model;
+		MaterialSetting material;
+		VoxelRegion bounds;
+		WorldBounds worldBounds;
+		uint64_t lastFrame = 0;
+	};
+
+	std::unordered_map<const void *, ObjectState> objects;
+	std::vector<PointLight> lights;
+	VoxelRegion dirtyRegion;
+	std::vector<VoxelRegion> dirtyRegions;
+	std::vector<WorldBounds> dirtyWorldBounds;
+	uint32_t gridSize = 0;
+	uint64_t frame = 0;
+	bool fullUpdate = true;
+	bool lightsChanged = true;
+};
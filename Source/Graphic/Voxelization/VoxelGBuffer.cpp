@@ -0,0 +1,30 @@
+#include "VoxelGBuffer.h"
+
+VoxelGBuffer::VoxelGBuffer(uint32_t size) : albedo(size), normal(size), emissive(size) {}
+
+size_t VoxelGBuffer::getMemoryUsage() const
+{
+	return albedo.getMemoryUsage() + normal.getMemoryUsage() + emissive.getMemoryUsage() +
+		   occupied.capacity() * sizeof(uint32_t);
+}
+
+void VoxelGBuffer::clear()
+{
+	albedo.clear();
+	normal.clear();
+	emissive.clear();
+	occupied.clear();
+}
+
+void VoxelGBuffer::beginFragments(unsigned int workers)
+{
+	workerOccupied.resize(workers);
+	for (auto & voxels : workerOccupied)
+		voxels.clear();
+}
+
+void VoxelGBuffer::endFragments()
+{
+	for (const auto & voxels : workerOccupied)
+		occupied.insert(occupied.end(), voxels.begin(), voxels.end());
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelGrid.h"
+
+/// <summary> CPU counterpart of the voxel G-buffer textures (albedo, normal, emissive) filled by the
+/// "voxelization_gbuffer" material. Light is added afterwards by CpuLightInjector. </summary>
+class VoxelGBuffer {
+public:
+	explicit VoxelGBuffer(uint32_t size);
+
+	uint32_t getSize() const { return albedo.getSize(); }
+	size_t getMemoryUsage() const;
+
+	void clear();
+
+	/// <summary> Prepares one occupied list per thread that will call writeFragment(). </summary>
+	void beginFragments(unsigned int workers);
+	/// <summary> Blends a fragment like the "voxelization_gbuffer" material, from any worker thread. The fragment that
+	/// occupies a voxel first (its normal had alpha 0) appends it to the list of its worker, like the GPU appends
+	/// it to the occupied voxel buffer: no pass over the whole volume is needed to find them. </summary>
+	void writeFragment(unsigned int worker, size_t voxelIndex, uint32_t albedoValue, uint32_t normalValue, uint32_t emissiveValue)
+	{
+		albedo.atomicMax(voxelIndex, albedoValue);
+		if (!(normal.atomicExchange(voxelIndex, normalValue) & 0xff000000))
+			workerOccupied[worker].push_back(uint32_t(voxelIndex));
+		emissive.atomicMax(voxelIndex, emissiveValue);
+	}
+	/// <summary> Appends the voxels occupied by the fragments since beginFragments() to the occupied list. </summary>
+	void endFragments();
+
+	VoxelGrid albedo;   // Alpha premultiplied diffuse + specular reflectance, alpha = opacity. Max blended.
+	VoxelGrid normal;   // Encoded with VoxelLighting::encodeVoxelNormal. Last writer wins, like the GPU.
+	VoxelGrid emissive; // Alpha premultiplied emission. Max blended.
+
+	std::vector<uint32_t> occupied; // Linear indices of the voxels with an encoded normal, in no particular order.
+
+private:
+	std::vector<std::vector<uint32_t>> workerOccupied;
+};
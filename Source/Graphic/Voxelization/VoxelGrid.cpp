@@ -0,0 +1,80 @@
+#include "VoxelGrid.h"
+#include "VoxelSimd.h"
+
+#include <algorithm>
+#include <cassert>
+
+VoxelGrid::VoxelGrid(uint32_t _size, VoxelLayout _layout) : size(_size), layout(_layout), voxels(size_t(_size) * _size * _size, 0)
+{
+	assert(layout == VoxelLayout::LINEAR || (size & (size - 1)) == 0);
+}
+
+void VoxelGrid::atomicMaxRgba8(uint32_t * voxel, uint32_t rgba8)
+{
+	uint32_t prevValue = __atomic_load_n(voxel, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		uint32_t newValue = VoxelSimd::maxRgba8(prevValue, rgba8);
+		if (newValue == prevValue)
+			return;
+		if (__atomic_compare_exchange_n(voxel, &prevValue, newValue, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return;
+	}
+}
+
+void VoxelGrid::clear(uint32_t rgba8)
+{
+	std::fill(voxels.begin(), voxels.end(), rgba8);
+}
+
+void VoxelGrid::clear(const VoxelRegion & region, uint32_t rgba8)
+{
+	for (int z = region.min.z; z < region.max.z; ++z)
+		for (int y = region.min.y; y < region.max.y; ++y)
+		{
+			if (layout == VoxelLayout::LINEAR)
+				std::fill_n(voxels.begin() + index(region.min.x, y, z), region.max.x - region.min.x, rgba8);
+			else
+				for (int x = region.min.x; x < region.max.x; ++x)
+					voxels[index(x, y, z)] = rgba8;
+		}
+}
+
+size_t VoxelGrid::countOccupied() const
+{
+	return voxels.size() - std::count(voxels.begin(), voxels.end(), 0u);
+}
+
+void VoxelGrid::copyTo(VoxelGrid & grid) const
+{
+	assert(grid.size == size);
+	if (grid.layout == layout)
+	{
+		grid.voxels = voxels;
+		return;
+	}
+
+	// Walk the destination in order, decoding a row of coordinates at a time.
+	std::vector<uint32_t> indices(size), x(size), y(size), z(size);
+	for (size_t first = 0; first < grid.voxels.size(); first += size)
+	{
+		for (uint32_t i = 0; i < size; ++i)
+			indices[i] = uint32_t(first + i);
+		VoxelIndex::decode(grid.layout, size, indices.data(), x.data(), y.data(), z.data(), size);
+		VoxelIndex::encode(layout, size, x.data(), y.data(), z.data(), indices.data(), size);
+		for (uint32_t i = 0; i < size; ++i)
+			grid.voxels[first + i] = voxels[indices[i]];
+	}
+}
+
+glm::vec4 VoxelGrid::rgba8ToVec4(uint32_t val)
+{
+	return glm::vec4(val & 0xff, (val >> 8) & 0xff, (val >> 16) & 0xff, (val >> 24) & 0xff);
+}
+
+uint32_t VoxelGrid::vec4ToRgba8(const glm::vec4 &val)
+{
+	// Saturates like the shader.
+	glm::uvec4 ival = glm::uvec4(glm::clamp(val, glm::vec4(0.0f), glm::vec4(255.0f)));
+	return ival.x | (ival.y << 8) | (ival.z << 16) | (ival.w << 24);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelLayout.h"
+#include "VoxelRegion.h"
+
+/// <summary> A dense RGBA8 voxel volume living in system memory. This is the CPU counterpart of
+/// the first level of the voxel Texture3D (and of the voxel atomic buffer used by single pass voxelization).
+/// The voxels can be stored in another layout than LINEAR, e.g. to keep the neighbors of a voxel closer in memory,
+/// but the code walking rows of data() (mip generation, opacity, occupancy, light injection) expects LINEAR. </summary>
+class VoxelGrid {
+public:
+	/// <summary> Creates a size x size x size grid cleared to transparent black. </summary>
+	explicit VoxelGrid(uint32_t size, VoxelLayout layout = VoxelLayout::LINEAR);
+
+	uint32_t getSize() const { return size; }
+	VoxelLayout getLayout() const { return layout; }
+	size_t getVoxelCount() const { return voxels.size(); }
+	size_t getMemoryUsage() const { return voxels.size() * sizeof(uint32_t); }
+
+	/// <summary> Index of a voxel in data(), same as voxelBufferIndex in common.metal. </summary>
+	size_t index(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return layout == VoxelLayout::LINEAR ? (size_t(z) * size + y) * size + x : VoxelIndex::encode(layout, size, x, y, z);
+	}
+
+	uint32_t load(uint32_t x, uint32_t y, uint32_t z) const { return voxels[index(x, y, z)]; }
+	void store(uint32_t x, uint32_t y, uint32_t z, uint32_t rgba8) { voxels[index(x, y, z)] = rgba8; }
+
+	/// <summary> Thread safe per channel max blend, same as the CAS loop in voxelization.metal. </summary>
+	void atomicMax(size_t voxelIndex, uint32_t rgba8) { atomicMaxRgba8(&voxels[voxelIndex], rgba8); }
+	static void atomicMaxRgba8(uint32_t * voxel, uint32_t rgba8);
+
+	/// <summary> Thread safe overwrite (last writer wins), same as atomic_store in voxelization.metal. </summary>
+	void atomicStore(size_t voxelIndex, uint32_t rgba8) { __atomic_store_n(&voxels[voxelIndex], rgba8, __ATOMIC_RELAXED); }
+	/// <summary> atomicStore() that returns the previous value, same as atomic_exchange in voxelization.metal. </summary>
+	uint32_t atomicExchange(size_t voxelIndex, uint32_t rgba8) { return __atomic_exchange_n(&voxels[voxelIndex], rgba8, __ATOMIC_RELAXED); }
+
+	void clear(uint32_t rgba8 = 0);
+	void clear(const VoxelRegion & region, uint32_t rgba8 = 0);
+
+	/// <summary> Number of voxels with a non zero value. </summary>
+	size_t countOccupied() const;
+
+	/// <summary> Copies the voxels to a grid of the same size, converting them to its layout. </summary>
+	void copyTo(VoxelGrid & grid) const;
+
+	uint32_t *data() { return voxels.data(); }
+	const uint32_t *data() const { return voxels.data(); }
+
+	// Packing helpers, mirror rgba8ToVec4/vec4ToRgba8 in common.metal (values in [0, 255]).
+	static glm::vec4 rgba8ToVec4(uint32_t value);
+	static uint32_t vec4ToRgba8(const glm::vec4 &value);
+private:
+	uint32_t size;
+	VoxelLayout layout;
+	std::vector<uint32_t> voxels;
+};
@@ -0,0 +1,151 @@
+#include "VoxelLayout.h"
+#include "VoxelSimd.h"
+
+namespace
+{
+// Integer lanes for the batch helpers, same width as VoxelSimd::Float.
+#if VOXEL_SIMD_AVX2
+using UInt = __m256i;
+
+inline UInt load(const uint32_t * p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+inline void store(uint32_t * p, UInt v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+inline UInt set1(uint32_t v) { return _mm256_set1_epi32(int(v)); }
+inline UInt bitAnd(UInt a, UInt b) { return _mm256_and_si256(a, b); }
+inline UInt bitOr(UInt a, UInt b) { return _mm256_or_si256(a, b); }
+inline UInt shiftLeft(UInt a, uint32_t n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(int(n))); }
+inline UInt shiftRight(UInt a, uint32_t n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(int(n))); }
+#elif VOXEL_SIMD_SSE2
+using UInt = __m128i;
+
+inline UInt load(const uint32_t * p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+inline void store(uint32_t * p, UInt v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+inline UInt set1(uint32_t v) { return _mm_set1_epi32(int(v)); }
+inline UInt bitAnd(UInt a, UInt b) { return _mm_and_si128(a, b); }
+inline UInt bitOr(UInt a, UInt b) { return _mm_or_si128(a, b); }
+inline UInt shiftLeft(UInt a, uint32_t n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(int(n))); }
+inline UInt shiftRight(UInt a, uint32_t n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(int(n))); }
+#elif VOXEL_SIMD_NEON
+using UInt = uint32x4_t;
+
+inline UInt load(const uint32_t * p) { return vld1q_u32(p); }
+inline void store(uint32_t * p, UInt v) { vst1q_u32(p, v); }
+inline UInt set1(uint32_t v) { return vdupq_n_u32(v); }
+inline UInt bitAnd(UInt a, UInt b) { return vandq_u32(a, b); }
+inline UInt bitOr(UInt a, UInt b) { return vorrq_u32(a, b); }
+inline UInt shiftLeft(UInt a, uint32_t n) { return vshlq_u32(a, vdupq_n_s32(int32_t(n))); }
+inline UInt shiftRight(UInt a, uint32_t n) { return vshlq_u32(a, vdupq_n_s32(-int32_t(n))); }
+#else
+using UInt = uint32_t;
+
+inline UInt load(const uint32_t * p) { return *p; }
+inline void store(uint32_t * p, UInt v) { *p = v; }
+inline UInt set1(uint32_t v) { return v; }
+inline UInt bitAnd(UInt a, UInt b) { return a & b; }
+inline UInt bitOr(UInt a, UInt b) { return a | b; }
+inline UInt shiftLeft(UInt a, uint32_t n) { return a << n; }
+inline UInt shiftRight(UInt a, uint32_t n) { return a >> n; }
+#endif
+
+constexpr size_t kLanes = sizeof(UInt) / sizeof(uint32_t);
+
+// Magic number versions of VoxelIndex::spreadBits3 / compactBits3 over every lane (no vector pdep / pext).
+inline UInt spreadLanes(UInt v)
+{
+	v = bitAnd(v, set1(0x3ff));
+	v = bitAnd(bitOr(v, shiftLeft(v, 16)), set1(0x030000ff));
+	v = bitAnd(bitOr(v, shiftLeft(v, 8)), set1(0x0300f00f));
+	v = bitAnd(bitOr(v, shiftLeft(v, 4)), set1(0x030c30c3));
+	v = bitAnd(bitOr(v, shiftLeft(v, 2)), set1(0x09249249));
+	return v;
+}
+
+inline UInt compactLanes(UInt v)
+{
+	v = bitAnd(v, set1(0x09249249));
+	v = bitAnd(bitOr(v, shiftRight(v, 2)), set1(0x030c30c3));
+	v = bitAnd(bitOr(v, shiftRight(v, 4)), set1(0x0300f00f));
+	v = bitAnd(bitOr(v, shiftRight(v, 8)), set1(0x030000ff));
+	v = bitAnd(bitOr(v, shiftRight(v, 16)), set1(0x000003ff));
+	return v;
+}
+
+inline UInt brick4EncodeLanes(uint32_t shift, UInt x, UInt y, UInt z)
+{
+	const UInt three = set1(3);
+	UInt brick = bitOr(shiftLeft(shiftRight(z, 2), shift), shiftRight(y, 2));
+	brick = bitOr(shiftLeft(brick, shift), shiftRight(x, 2));
+	UInt voxel = bitOr(shiftLeft(bitAnd(z, three), 4), shiftLeft(bitAnd(y, three), 2));
+	return bitOr(shiftLeft(brick, 6), bitOr(voxel, bitAnd(x, three)));
+}
+
+inline void brick4DecodeLanes(uint32_t shift, UInt index, UInt & x, UInt & y, UInt & z)
+{
+	const UInt three = set1(3), mask = set1((1u << shift) - 1);
+	const UInt brick = shiftRight(index, 6);
+	x = bitOr(shiftLeft(bitAnd(brick, mask), 2), bitAnd(index, three));
+	y = bitOr(shiftLeft(bitAnd(shiftRight(brick, shift), mask), 2), bitAnd(shiftRight(index, 2), three));
+	z = bitOr(shiftLeft(shiftRight(brick, 2 * shift), 2), bitAnd(shiftRight(index, 4), three));
+}
+}
+
+namespace VoxelIndex {
+
+void encode(VoxelLayout layout, uint32_t size, const uint32_t * x, const uint32_t * y, const uint32_t * z,
+			uint32_t * indices, size_t count)
+{
+	const uint32_t shift = brick4Shift(size);
+	size_t i = 0;
+	if (layout != VoxelLayout::LINEAR)
+	{
+		for (; i + kLanes <= count; i += kLanes)
+		{
+			const UInt vx = load(&x[i]), vy = load(&y[i]), vz = load(&z[i]);
+			if (layout == VoxelLayout::MORTON)
+				store(&indices[i], bitOr(spreadLanes(vx), bitOr(shiftLeft(spreadLanes(vy), 1), shiftLeft(spreadLanes(vz), 2))));
+			else
+				store(&indices[i], brick4EncodeLanes(shift, vx, vy, vz));
+		}
+	}
+	for (; i < count; ++i)
+		indices[i] = uint32_t(VoxelIndex::encode(layout, size, x[i], y[i], z[i]));
+}
+
+void decode(VoxelLayout layout, uint32_t size, const uint32_t * indices, uint32_t * x, uint32_t * y, uint32_t * z,
+			size_t count)
+{
+	const uint32_t shift = brick4Shift(size);
+	size_t i = 0;
+	if (layout != VoxelLayout::LINEAR)
+	{
+		for (; i + kLanes <= count; i += kLanes)
+		{
+			const UInt index = load(&indices[i]);
+			UInt vx, vy, vz;
+			if (layout == VoxelLayout::MORTON)
+			{
+				vx = compactLanes(index);
+				vy = compactLanes(shiftRight(index, 1));
+				vz = compactLanes(shiftRight(index, 2));
+			}
+			else
+				brick4DecodeLanes(shift, index, vx, vy, vz);
+			store(&x[i], vx);
+			store(&y[i], vy);
+			store(&z[i], vz);
+		}
+	}
+	for (; i < count; ++i)
+		VoxelIndex::decode(layout, size, indices[i], x[i], y[i], z[i]);
+}
+
+const char * name(VoxelLayout layout)
+{
+	switch (layout)
+	{
+		case VoxelLayout::MORTON: return "Morton";
+		case VoxelLayout::BRICK4: return "4^3 bricks";
+		default: return "linear";
+	}
+}
+
+} // namespace VoxelIndex
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/// <summary> Order of the voxels in memory. The values match voxelBufferIndex in common.metal. </summary>
+enum class VoxelLayout : uint32_t {
+	LINEAR = 0,	// z * size^2 + y * size + x, rows along x.
+	MORTON = 1,	// Z-order curve: the bits of x, y and z interleaved.
+	BRICK4 = 2	// 4^3 bricks in linear order, each storing its voxels in linear order (256 bytes of RGBA8 voxels).
+};
+
+/// <summary> Maps voxel coordinates to indices of a size^3 volume stored in a given layout, and back.
+/// MORTON and BRICK4 need a power of 2 size (up to 1024), so every index stays below size^3. </summary>
+namespace VoxelIndex {
+
+constexpr uint32_t BRICK4_SIZE = 4;
+
+/// <summary> Spreads the 10 low bits of v to every third bit. </summary>
+inline uint32_t spreadBits3(uint32_t v)
+{
+#if defined(__BMI2__)
+	return _pdep_u32(v, 0x09249249);
+#else
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+#endif
+}
+
+/// <summary> Inverse of spreadBits3: gathers every third bit. </summary>
+inline uint32_t compactBits3(uint32_t v)
+{
+#if defined(__BMI2__)
+	return _pext_u32(v, 0x09249249);
+#else
+	v &= 0x09249249;
+	v = (v | (v >> 2)) & 0x030c30c3;
+	v = (v | (v >> 4)) & 0x0300f00f;
+	v = (v | (v >> 8)) & 0x030000ff;
+	v = (v | (v >> 16)) & 0x000003ff;
+	return v;
+#endif
+}
+
+inline uint32_t mortonEncode(uint32_t x, uint32_t y, uint32_t z)
+{
+	return spreadBits3(x) | (spreadBits3(y) << 1) | (spreadBits3(z) << 2);
+}
+
+inline void mortonDecode(uint32_t index, uint32_t & x, uint32_t & y, uint32_t & z)
+{
+	x = compactBits3(index);
+	y = compactBits3(index >> 1);
+	z = compactBits3(index >> 2);
+}
+
+/// <summary> log2 of the bricks per axis, i.e. log2(size) - 2. </summary>
+inline uint32_t brick4Shift(uint32_t size)
+{
+	return size > BRICK4_SIZE ? uint32_t(__builtin_ctz(size)) - 2 : 0;
+}
+
+inline uint32_t brick4Encode(uint32_t shift, uint32_t x, uint32_t y, uint32_t z)
+{
+	const uint32_t brick = ((((z >> 2) << shift) | (y >> 2)) << shift) | (x >> 2);
+	return (brick << 6) | ((z & 3) << 4) | ((y & 3) << 2) | (x & 3);
+}
+
+inline void brick4Decode(uint32_t shift, uint32_t index, uint32_t & x, uint32_t & y, uint32_t & z)
+{
+	const uint32_t brick = index >> 6, mask = (1u << shift) - 1;
+	x = ((brick & mask) << 2) | (index & 3);
+	y = (((brick >> shift) & mask) << 2) | ((index >> 2) & 3);
+	z = ((brick >> (2 * shift)) << 2) | ((index >> 4) & 3);
+}
+
+inline size_t encode(VoxelLayout layout, uint32_t size, uint32_t x, uint32_t y, uint32_t z)
+{
+	switch (layout)
+	{
+		case VoxelLayout::MORTON: return mortonEncode(x, y, z);
+		case VoxelLayout::BRICK4: return brick4Encode(brick4Shift(size), x, y, z);
+		default: return (size_t(z) * size + y) * size + x;
+	}
+}
+
+inline void decode(VoxelLayout layout, uint32_t size, size_t index, uint32_t & x, uint32_t & y, uint32_t & z)
+{
+	switch (layout)
+	{
+		case VoxelLayout::MORTON: mortonDecode(uint32_t(index), x, y, z); break;
+		case VoxelLayout::BRICK4: brick4Decode(brick4Shift(size), uint32_t(index), x, y, z); break;
+		default:
+			x = uint32_t(index % size);
+			y = uint32_t((index / size) % size);
+			z = uint32_t(index / (size_t(size) * size));
+			break;
+	}
+}
+
+/// <summary> Batch versions of encode() and decode(), several coordinates per instruction with AVX2, SSE2 or NEON
+/// (scalar otherwise). </summary>
+void encode(VoxelLayout layout, uint32_t size, const uint32_t * x, const uint32_t * y, const uint32_t * z,
+			uint32_t * indices, size_t count);
+void decode(VoxelLayout layout, uint32_t size, const uint32_t * indices, uint32_t * x, uint32_t * y, uint32_t * z,
+			size_t count);
+
+const char * name(VoxelLayout layout);
+
+} // namespace VoxelIndex
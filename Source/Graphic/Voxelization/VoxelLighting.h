@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../Lighting/PointLight.h"
+#include "../Material/MaterialSetting.h"
+
+// CPU mirror of the lighting rules used by FS in Shaders/Voxelization/voxelization.metal
+// and injectLight in Shaders/Voxelization/voxel_compute_kernels.metal
+// (both share Shaders/Voxelization/voxel_lighting.metal). Keep them in sync.
+namespace VoxelLighting {
+
+constexpr float POINT_LIGHT_INTENSITY = 1.0f;
+constexpr float DIST_FACTOR = 1.1f;
+constexpr float CONSTANT = 1.0f;
+constexpr float LINEAR = 0.0f;
+constexpr float QUADRATIC = 1.0f;
+
+/// <summary> Returns an attenuation factor given a distance. </summary>
+inline float attenuate(float dist)
+{
+	dist *= DIST_FACTOR;
+	return 1.0f / (CONSTANT + LINEAR * dist + QUADRATIC * dist * dist);
+}
+
+/// <summary> Diffuse contribution of a point light at a surface point. </summary>
+inline glm::vec3 calculatePointLight(const glm::vec3 & worldPosition, const glm::vec3 & normal, const PointLight & light)
+{
+	const glm::vec3 direction = glm::normalize(light.position - worldPosition);
+	const float distanceToLight = glm::distance(light.position, worldPosition);
+	const float attenuation = attenuate(distanceToLight);
+	const float d = std::max(glm::dot(glm::normalize(normal), direction), 0.0f);
+	return d * POINT_LIGHT_INTENSITY * attenuation * light.color;
+}
+
+/// <summary> Material constants of a voxelized surface, evaluated once per object. </summary>
+struct SurfaceMaterial {
+	glm::vec3 reflectance; // diff + spec in the shader.
+	glm::vec3 emission;
+	float alpha;
+
+	explicit SurfaceMaterial(const MaterialSetting & material)
+	{
+		reflectance = material.diffuseReflectivity * material.diffuseColor +
+					  material.specularReflectivity * material.specularColor;
+		emission = glm::clamp(material.emissivity, 0.0f, 1.0f) * material.diffuseColor;
+		alpha = std::pow(1.0f - material.transparency, 4.0f); // For soft shadows to work better with transparent materials.
+	}
+};
+
+/// <summary> Sum of the diffuse contributions of all point lights. </summary>
+inline glm::vec3 calculatePointLights(const glm::vec3 & worldPosition, const glm::vec3 & normal, const std::vector<PointLight> & pointLights)
+{
+	glm::vec3 color(0.0f);
+	const size_t maxLights = std::min<size_t>(pointLights.size(), MAX_LIGHTS);
+	for (size_t i = 0; i < maxLights; ++i) color += calculatePointLight(worldPosition, normal, pointLights[i]);
+	return color;
+}
+
+/// <summary> Voxel value in [0, 1] as written by the voxelization fragment shader. </summary>
+inline glm::vec4 voxelRadiance(const glm::vec3 & worldPosition, const glm::vec3 & normal,
+							   const SurfaceMaterial & material, const std::vector<PointLight> & pointLights)
+{
+	glm::vec3 color = calculatePointLights(worldPosition, normal, pointLights);
+	color = material.reflectance * color + material.emission;
+	return material.alpha * glm::vec4(color, 1.0f);
+}
+
+// ---- Voxel G-buffer (decoupled light injection) ----
+
+/// <summary> Albedo written to the voxel G-buffer, alpha premultiplied. </summary>
+inline glm::vec4 gBufferAlbedo(const SurfaceMaterial & material) { return material.alpha * glm::vec4(material.reflectance, 1.0f); }
+
+/// <summary> Emission written to the voxel G-buffer, alpha premultiplied. </summary>
+inline glm::vec4 gBufferEmissive(const SurfaceMaterial & material) { return glm::vec4(material.alpha * material.emission, 1.0f); }
+
+/// <summary> Normal <-> [0, 1] encoding. Alpha marks the voxel as occupied. </summary>
+inline glm::vec4 encodeVoxelNormal(const glm::vec3 & normal) { return glm::vec4(0.5f * glm::normalize(normal) + 0.5f, 1.0f); }
+inline glm::vec3 decodeVoxelNormal(const glm::vec4 & encoded) { return glm::vec3(encoded) * 2.0f - 1.0f; }
+
+/// <summary> Radiance in [0, 1] computed from G-buffer values (all in [0, 1]), as done by the light injection kernel. </summary>
+inline glm::vec4 injectedRadiance(const glm::vec3 & worldPosition, const glm::vec4 & albedo, const glm::vec4 & encodedNormal,
+								  const glm::vec4 & emissive, const std::vector<PointLight> & pointLights)
+{
+	glm::vec3 color = glm::vec3(albedo) * calculatePointLights(worldPosition, decodeVoxelNormal(encodedNormal), pointLights) + glm::vec3(emissive);
+	return glm::vec4(color, albedo.a);
+}
+
+} // namespace VoxelLighting
@@ -0,0 +1,76 @@
+#include "VoxelMipChain.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Texture3D only supports up to 7 mipmap levels.
+constexpr uint32_t kMaxLevels = 7;
+}
+
+VoxelMipChain::VoxelMipChain(uint32_t size)
+{
+	uint32_t levelCount = 1;
+	while ((size >> levelCount) > 0 && levelCount < kMaxLevels) ++levelCount;
+
+	levels.reserve(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+		levels.emplace_back(std::max(1u, size >> i));
+}
+
+size_t VoxelMipChain::getMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (auto & grid : levels) bytes += grid.getMemoryUsage();
+	return bytes;
+}
+
+uint32_t VoxelMipChain::averageRgba8(const uint32_t texels[8])
+{
+	uint32_t result = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 8)
+	{
+		uint32_t sum = 0;
+		for (int i = 0; i < 8; ++i) sum += (texels[i] >> shift) & 0xff;
+		result |= ((sum + 4) / 8) << shift;
+	}
+	return result;
+}
+
+void VoxelMipChain::generateMips()
+{
+	for (uint32_t i = 1; i < levels.size(); ++i)
+	{
+		const VoxelGrid & src = levels[i - 1];
+		VoxelGrid & dst = levels[i];
+		const uint32_t srcLast = src.getSize() - 1;
+		for (uint32_t z = 0; z < dst.getSize(); ++z)
+			for (uint32_t y = 0; y < dst.getSize(); ++y)
+				for (uint32_t x = 0; x < dst.getSize(); ++x)
+				{
+					uint32_t texels[8];
+					for (int c = 0; c < 8; ++c)
+						texels[c] = src.load(std::min(2 * x + (c & 1), srcLast),
+											 std::min(2 * y + ((c >> 1) & 1), srcLast),
+											 std::min(2 * z + (c >> 2), srcLast));
+					dst.store(x, y, z, averageRgba8(texels));
+				}
+	}
+}
+
+glm::vec4 VoxelMipChain::textureLod(const glm::vec3 & coordinate, float mipmapLevel) const
+{
+	const float lod = glm::clamp(mipmapLevel, 0.0f, float(levels.size() - 1));
+	const uint32_t level0 = uint32_t(std::floor(lod));
+	const uint32_t level1 = std::min(level0 + 1, (uint32_t)levels.size() - 1);
+
+	auto sampleLevel = [&](uint32_t i) {
+		const VoxelGrid & grid = levels[i];
+		return sampleTrilinear(coordinate, grid.getSize(), [&](int x, int y, int z) { return grid.load(x, y, z); });
+	};
+
+	const glm::vec4 a = sampleLevel(level0);
+	const float f = lod - float(level0);
+	return f > 0.0f && level1 != level0 ? glm::mix(a, sampleLevel(level1), f) : a;
+}
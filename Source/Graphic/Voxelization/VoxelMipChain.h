@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "VoxelGrid.h"
+
+/// <summary> Dense RGBA8 voxel volume with its mip levels, the CPU counterpart of the voxel Texture3D.
+/// Serves as the reference for the sparse representations and the CPU cone tracing code. </summary>
+class VoxelMipChain {
+public:
+	/// <summary> Same level count as Texture3D: a full chain, capped to 7 levels. </summary>
+	explicit VoxelMipChain(uint32_t size);
+
+	uint32_t getSize() const { return levels[0].getSize(); }
+	uint32_t getLevelCount() const { return (uint32_t)levels.size(); }
+	size_t getMemoryUsage() const;
+
+	VoxelGrid & level(uint32_t i) { return levels[i]; }
+	const VoxelGrid & level(uint32_t i) const { return levels[i]; }
+
+	/// <summary> Rebuilds every level from the first one with a 2x2x2 box filter. </summary>
+	void generateMips();
+
+	/// <summary> Same as textureLod in common.metal: trilinear filtering within and between levels,
+	/// clamped to edge. Coordinates are in [0, 1], the result is in [0, 1]. </summary>
+	glm::vec4 textureLod(const glm::vec3 & coordinate, float mipmapLevel) const;
+
+	/// <summary> Rounded average of 8 RGBA8 texels, used by every CPU mip builder. </summary>
+	static uint32_t averageRgba8(const uint32_t texels[8]);
+
+	/// <summary> Trilinear filtering of one level, fetch(x, y, z) returns the RGBA8 texel (already clamped to edge). </summary>
+	template <typename FetchFunction>
+	static glm::vec4 sampleTrilinear(const glm::vec3 & coordinate, uint32_t levelSize, const FetchFunction & fetch)
+	{
+		const glm::vec3 t = coordinate * float(levelSize) - 0.5f;
+		const glm::vec3 base = glm::floor(t);
+		const glm::vec3 f = t - base;
+		const glm::ivec3 i0 = glm::ivec3(base);
+		const int last = int(levelSize) - 1;
+
+		glm::vec4 result(0.0f);
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+			const glm::ivec3 p = glm::clamp(i0 + offset, glm::ivec3(0), glm::ivec3(last));
+			const glm::vec3 w = glm::mix(glm::vec3(1.0f) - f, f, glm::vec3(offset));
+			result += (w.x * w.y * w.z) * VoxelGrid::rgba8ToVec4(fetch(p.x, p.y, p.z));
+		}
+		return result / 255.0f;
+	}
+
+private:
+	std::vector<VoxelGrid> levels;
+};
@@ -0,0 +1,128 @@
+#include "VoxelOpacityVolume.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "VoxelGrid.h"
+
+namespace
+{
+// Texture3D only supports up to 7 mipmap levels.
+constexpr uint32_t kMaxLevels = 7;
+}
+
+VoxelOpacityVolume::VoxelOpacityVolume(uint32_t _size, Layout _layout) : layout(_layout), size(_size), levelCount(1)
+{
+	while ((size >> levelCount) > 0 && levelCount < kMaxLevels) ++levelCount;
+
+	bytes.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		const size_t texels = size_t(levelSize(i)) * levelSize(i) * levelSize(i);
+		bytes[i].assign(layout == Layout::R8 ? texels : (texels + 7) / 8, 0);
+	}
+}
+
+size_t VoxelOpacityVolume::getMemoryUsage() const
+{
+	size_t result = 0;
+	for (auto & level : bytes) result += level.size();
+	return result;
+}
+
+uint32_t VoxelOpacityVolume::load(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+{
+	const size_t i = index(level, x, y, z);
+	if (layout == Layout::R8)
+		return bytes[level][i];
+	return (bytes[level][i >> 3] >> (i & 7)) & 1 ? 255 : 0;
+}
+
+void VoxelOpacityVolume::store(uint32_t level, uint32_t x, uint32_t y, uint32_t z, uint32_t opacity)
+{
+	const size_t i = index(level, x, y, z);
+	if (layout == Layout::R8)
+		bytes[level][i] = uint8_t(opacity);
+	else if (opacity)
+		bytes[level][i >> 3] |= uint8_t(1 << (i & 7));
+	else
+		bytes[level][i >> 3] &= uint8_t(~(1 << (i & 7)));
+}
+
+void VoxelOpacityVolume::build(const VoxelGrid & grid)
+{
+	assert(grid.getSize() == size);
+
+	const uint32_t * voxels = grid.data();
+	const size_t count = grid.getVoxelCount();
+	std::vector<uint8_t> & first = bytes[0];
+	if (layout == Layout::R8)
+	{
+		for (size_t i = 0; i < count; ++i) first[i] = uint8_t(voxels[i] >> 24);
+	}
+	else
+	{
+		std::fill(first.begin(), first.end(), 0);
+		for (size_t i = 0; i < count; ++i)
+			if (voxels[i] >> 24) first[i >> 3] |= uint8_t(1 << (i & 7));
+	}
+	generateMips();
+}
+
+void VoxelOpacityVolume::generateMips()
+{
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		const uint32_t srcLast = levelSize(level - 1) - 1;
+		const uint32_t n = levelSize(level);
+		for (uint32_t z = 0; z < n; ++z)
+			for (uint32_t y = 0; y < n; ++y)
+				for (uint32_t x = 0; x < n; ++x)
+				{
+					uint32_t sum = 0, any = 0;
+					for (int c = 0; c < 8; ++c)
+					{
+						const uint32_t texel = load(level - 1,
+													std::min(2 * x + (c & 1), srcLast),
+													std::min(2 * y + ((c >> 1) & 1), srcLast),
+													std::min(2 * z + (c >> 2), srcLast));
+						sum += texel;
+						any |= texel;
+					}
+					// Same rounding as VoxelMipChain::averageRgba8.
+					store(level, x, y, z, layout == Layout::R8 ? (sum + 4) / 8 : any);
+				}
+	}
+}
+
+float VoxelOpacityVolume::sampleLevel(const glm::vec3 & coordinate, uint32_t level) const
+{
+	const uint32_t n = levelSize(level);
+	const glm::vec3 t = coordinate * float(n) - 0.5f;
+	const glm::vec3 base = glm::floor(t);
+	const glm::vec3 f = t - base;
+	const glm::ivec3 i0 = glm::ivec3(base);
+	const int last = int(n) - 1;
+
+	float result = 0.0f;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+		const glm::ivec3 p = glm::clamp(i0 + offset, glm::ivec3(0), glm::ivec3(last));
+		const glm::vec3 w = glm::mix(glm::vec3(1.0f) - f, f, glm::vec3(offset));
+		result += (w.x * w.y * w.z) * float(load(level, p.x, p.y, p.z));
+	}
+	return result / 255.0f;
+}
+
+float VoxelOpacityVolume::textureLod(const glm::vec3 & coordinate, float mipmapLevel) const
+{
+	const float lod = glm::clamp(mipmapLevel, 0.0f, float(levelCount - 1));
+	const uint32_t level0 = uint32_t(std::floor(lod));
+	const uint32_t level1 = std::min(level0 + 1, levelCount - 1);
+
+	const float a = sampleLevel(coordinate, level0);
+	const float f = lod - float(level0);
+	return f > 0.0f && level1 != level0 ? glm::mix(a, sampleLevel(coordinate, level1), f) : a;
+}
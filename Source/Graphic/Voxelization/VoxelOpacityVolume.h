@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+class VoxelGrid;
+
+/// <summary> Opacity only mip chain of a voxel volume, the CPU counterpart of the R8 opacity Texture3D that
+/// shadow cones read instead of the RGBA8 voxels. Two layouts:
+/// R8 keeps the alpha channel, its mips are the same as the alpha of VoxelMipChain.
+/// Bits keeps one occupancy bit per voxel, a coarser texel is set if any of its 8 children is. It is 32 times
+/// smaller than RGBA8 but only conservative: coarse levels are as opaque as their most occupied part. </summary>
+class VoxelOpacityVolume {
+public:
+	enum class Layout { R8, Bits };
+
+	/// <summary> Same level count as Texture3D: a full chain, capped to 7 levels. </summary>
+	VoxelOpacityVolume(uint32_t size, Layout layout);
+
+	Layout getLayout() const { return layout; }
+	uint32_t getSize() const { return size; }
+	uint32_t getLevelCount() const { return levelCount; }
+	size_t getMemoryUsage() const;
+	/// <summary> Bytes per texel, 1/8 for bits. </summary>
+	float getTexelSize() const { return layout == Layout::R8 ? 1.0f : 0.125f; }
+
+	/// <summary> Fills the first level from the alpha of a grid of the same size, then rebuilds the mips. </summary>
+	void build(const VoxelGrid & grid);
+	/// <summary> Rebuilds every level from the first one, with a 2x2x2 box filter (R8) or OR (bits). </summary>
+	void generateMips();
+
+	/// <summary> Opacity of a texel in [0, 255], 0 or 255 for bits. Coordinates must be inside the level. </summary>
+	uint32_t load(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const;
+
+	/// <summary> Same as textureLod(...).a in common.metal: trilinear filtering within and between levels,
+	/// clamped to edge. Coordinates are in [0, 1], the result is in [0, 1]. </summary>
+	float textureLod(const glm::vec3 & coordinate, float mipmapLevel) const;
+
+private:
+	uint32_t levelSize(uint32_t level) const { return size >> level ? size >> level : 1; }
+	size_t index(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+	{
+		const size_t n = levelSize(level);
+		return (z * n + y) * n + x;
+	}
+	void store(uint32_t level, uint32_t x, uint32_t y, uint32_t z, uint32_t opacity);
+	float sampleLevel(const glm::vec3 & coordinate, uint32_t level) const;
+
+	Layout layout;
+	uint32_t size;
+	uint32_t levelCount;
+	std::vector<std::vector<uint8_t>> bytes; // R8 texels, or bits packed 8 per byte in linear index order.
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm.hpp>
+
+/// <summary> Axis aligned box of voxels [min, max) of the first voxel level. </summary>
+struct VoxelRegion {
+	glm::ivec3 min = glm::ivec3(0);
+	glm::ivec3 max = glm::ivec3(0);
+
+	VoxelRegion() = default;
+	VoxelRegion(const glm::ivec3 & _min, const glm::ivec3 & _max) : min(_min), max(_max) {}
+
+	static VoxelRegion full(uint32_t size) { return VoxelRegion(glm::ivec3(0), glm::ivec3(int(size))); }
+
+	/// <summary> Voxels touched by anything inside the world space box, with a one voxel margin
+	/// for conservative rasterization. World [-1, 1] maps to voxels [0, size). </summary>
+	static VoxelRegion fromWorldBounds(const glm::vec3 & worldMin, const glm::vec3 & worldMax, uint32_t size)
+	{
+		const glm::vec3 lo = glm::floor((worldMin * 0.5f + 0.5f) * float(size)) - 1.0f;
+		const glm::vec3 hi = glm::floor((worldMax * 0.5f + 0.5f) * float(size)) + 2.0f;
+		return VoxelRegion(glm::ivec3(glm::clamp(lo, 0.0f, float(size))),
+						   glm::ivec3(glm::clamp(hi, 0.0f, float(size))));
+	}
+
+	bool empty() const { return max.x <= min.x || max.y <= min.y || max.z <= min.z; }
+	glm::ivec3 extent() const { return empty() ? glm::ivec3(0) : max - min; }
+	size_t volume() const { const glm::ivec3 e = extent(); return size_t(e.x) * e.y * e.z; }
+
+	bool intersects(const VoxelRegion & other) const
+	{
+		return !empty() && !other.empty() &&
+			   glm::all(glm::lessThan(min, other.max)) && glm::all(glm::lessThan(other.min, max));
+	}
+
+	/// <summary> Voxels inside both. </summary>
+	VoxelRegion intersection(const VoxelRegion & other) const
+	{
+		const VoxelRegion result(glm::max(min, other.min), glm::min(max, other.max));
+		return result.empty() ? VoxelRegion() : result;
+	}
+
+	/// <summary> Smallest region containing both. </summary>
+	VoxelRegion merged(const VoxelRegion & other) const
+	{
+		if (empty()) return other;
+		if (other.empty()) return *this;
+		return VoxelRegion(glm::min(min, other.min), glm::max(max, other.max));
+	}
+
+	/// <summary> Grows the region to multiples of blockSize, clamped to the grid. </summary>
+	VoxelRegion aligned(int blockSize, uint32_t size) const
+	{
+		if (empty()) return *this;
+		const glm::ivec3 lo = (min / blockSize) * blockSize;
+		const glm::ivec3 hi = ((max + blockSize - 1) / blockSize) * blockSize;
+		return VoxelRegion(lo, glm::min(hi, glm::ivec3(int(size))));
+	}
+
+	/// <summary> The region covering the same space at a given mip level (rounded outwards). </summary>
+	VoxelRegion atLevel(uint32_t level) const
+	{
+		if (empty()) return *this;
+		const int scale = 1 << level;
+		return VoxelRegion(min / scale, (max + scale - 1) / scale);
+	}
+};
+
+/// <summary> World space axis aligned box. </summary>
+struct WorldBounds {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+/// <summary> World space bounding box of a transformed object space box. </summary>
+inline void transformBounds(const glm::mat4 & model, const glm::vec3 & localMin, const glm::vec3 & localMax,
+							glm::vec3 & worldMin, glm::vec3 & worldMax)
+{
+	const glm::vec3 center = glm::vec3(model * glm::vec4(0.5f * (localMin + localMax), 1.0f));
+	const glm::vec3 halfExtent = 0.5f * (localMax - localMin);
+	// Extent of the box along each world axis: |M| * halfExtent.
+	glm::vec3 radius(0.0f);
+	for (int i = 0; i < 3; ++i)
+		radius += glm::abs(glm::vec3(model[i])) * halfExtent[i];
+	worldMin = center - radius;
+	worldMax = center + radius;
+}
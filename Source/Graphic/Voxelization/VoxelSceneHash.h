@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../Lighting/PointLight.h"
+#include "../Material/MaterialSetting.h"
+
+/// <summary> 64-bit FNV-1a hash of everything the voxels depend on: the enabled objects with their transform
+/// and material, and the point lights. Built every frame (a few hundred bytes per object), it tells whether
+/// the scene is the same as at the last voxelization, in which case voxelization and mips can be skipped. </summary>
+class VoxelSceneHash {
+public:
+	void add(const void * data, size_t size)
+	{
+		const uint8_t * bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * kPrime;
+	}
+
+	void add(uint32_t value) { add(&value, sizeof(value)); }
+	void add(float value) { add(&value, sizeof(value)); }
+	void add(const glm::vec3 & value) { add(&value[0], sizeof(float) * 3); }
+
+	/// <summary> Reports an enabled object with its world matrix (so that moving a parent changes the hash too).
+	/// Key identifies it (e.g. its MeshRenderer), so that swapping two objects changes the hash. </summary>
+	void addObject(const void * key, const glm::mat4 & model, const MaterialSetting & material)
+	{
+		add(&key, sizeof(key));
+		add(&model[0][0], sizeof(float) * 16);
+		// Field by field, the struct may contain padding.
+		add(material.diffuseColor);
+		add(material.specularColor);
+		add(material.specularReflectivity);
+		add(material.diffuseReflectivity);
+		add(material.emissivity);
+		add(material.specularDiffusion);
+		add(material.transparency);
+		add(material.refractiveIndex);
+	}
+
+	void addPointLights(const std::vector<PointLight> & pointLights)
+	{
+		add(uint32_t(pointLights.size()));
+		for (auto & light : pointLights)
+		{
+			add(light.position);
+			add(light.color);
+		}
+	}
+
+	uint64_t get() const { return hash; }
+
+private:
+	static constexpr uint64_t kOffsetBasis = 14695981039346656037ull;
+	static constexpr uint64_t kPrime = 1099511628211ull;
+
+	uint64_t hash = kOffsetBasis;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Thin SIMD wrapper used by the CPU voxel code. Picks AVX2 (8 lanes), SSE2 / NEON (4 lanes),
+// or a scalar fallback (1 lane) at compile time.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VOXEL_SIMD_AVX2 1
+#define VOXEL_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOXEL_SIMD_SSE2 1
+#define VOXEL_SIMD_WIDTH 4
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VOXEL_SIMD_NEON 1
+#define VOXEL_SIMD_WIDTH 4
+#else
+#define VOXEL_SIMD_WIDTH 1
+#endif
+
+namespace VoxelSimd {
+
+constexpr unsigned int kWidth = VOXEL_SIMD_WIDTH;
+
+#if VOXEL_SIMD_AVX2
+using Float = __m256;
+
+inline Float set1(float v) { return _mm256_set1_ps(v); }
+inline Float laneIndices() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+inline Float load(const float *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm256_storeu_ps(p, v); }
+inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float madd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+inline Float round(Float a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float cmpGe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline Float cmpLe(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline Float maskAnd(Float a, Float b) { return _mm256_and_ps(a, b); }
+inline uint32_t moveMask(Float m) { return (uint32_t)_mm256_movemask_ps(m); }
+#elif VOXEL_SIMD_SSE2
+using Float = __m128;
+
+inline Float set1(float v) { return _mm_set1_ps(v); }
+inline Float laneIndices() { return _mm_setr_ps(0, 1, 2, 3); }
+inline Float load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Float v) { _mm_storeu_ps(p, v); }
+inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float madd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+inline Float round(Float a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); } // |a| < 2^31.
+inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float cmpGe(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+inline Float cmpLe(Float a, Float b) { return _mm_cmple_ps(a, b); }
+inline Float maskAnd(Float a, Float b) { return _mm_and_ps(a, b); }
+inline uint32_t moveMask(Float m) { return (uint32_t)_mm_movemask_ps(m); }
+#elif VOXEL_SIMD_NEON
+using Float = float32x4_t;
+
+inline Float set1(float v) { return vdupq_n_f32(v); }
+inline Float laneIndices() { const float l[4] = { 0, 1, 2, 3 }; return vld1q_f32(l); }
+inline Float load(const float *p) { return vld1q_f32(p); }
+inline void store(float *p, Float v) { vst1q_f32(p, v); }
+inline Float add(Float a, Float b) { return vaddq_f32(a, b); }
+inline Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+inline Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+inline Float madd(Float a, Float b, Float c) { return vmlaq_f32(c, a, b); }
+inline Float div(Float a, Float b) { return vdivq_f32(a, b); }
+inline Float sqrt(Float a) { return vsqrtq_f32(a); }
+inline Float round(Float a) { return vrndnq_f32(a); }
+inline Float min(Float a, Float b) { return vminq_f32(a, b); }
+inline Float max(Float a, Float b) { return vmaxq_f32(a, b); }
+inline Float cmpGe(Float a, Float b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline Float cmpLe(Float a, Float b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+inline Float maskAnd(Float a, Float b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline uint32_t moveMask(Float m)
+{
+	const uint32_t shifts[4] = { 0, 1, 2, 3 };
+	uint32x4_t bits = vshlq_u32(vshrq_n_u32(vreinterpretq_u32_f32(m), 31), vreinterpretq_s32_u32(vld1q_u32(shifts)));
+	return vaddvq_u32(bits);
+}
+#else
+using Float = float;
+
+inline Float set1(float v) { return v; }
+inline Float laneIndices() { return 0.0f; }
+inline Float load(const float *p) { return *p; }
+inline void store(float *p, Float v) { *p = v; }
+inline Float add(Float a, Float b) { return a + b; }
+inline Float sub(Float a, Float b) { return a - b; }
+inline Float mul(Float a, Float b) { return a * b; }
+inline Float madd(Float a, Float b, Float c) { return a * b + c; }
+inline Float div(Float a, Float b) { return a / b; }
+inline Float sqrt(Float a) { return std::sqrt(a); }
+inline Float round(Float a) { return std::nearbyint(a); }
+inline Float min(Float a, Float b) { return a < b ? a : b; }
+inline Float max(Float a, Float b) { return a > b ? a : b; }
+// Masks are stored as 0.0f / 1.0f in the scalar path.
+inline Float cmpGe(Float a, Float b) { return a >= b ? 1.0f : 0.0f; }
+inline Float cmpLe(Float a, Float b) { return a <= b ? 1.0f : 0.0f; }
+inline Float maskAnd(Float a, Float b) { return a * b; }
+inline uint32_t moveMask(Float m) { return m != 0.0f ? 1u : 0u; }
+#endif
+
+/// <summary> Per channel maximum of two packed RGBA8 values. </summary>
+inline uint32_t maxRgba8(uint32_t a, uint32_t b)
+{
+#if VOXEL_SIMD_AVX2 || VOXEL_SIMD_SSE2
+	return (uint32_t)_mm_cvtsi128_si32(_mm_max_epu8(_mm_cvtsi32_si128((int)a), _mm_cvtsi32_si128((int)b)));
+#else
+	uint32_t result = 0;
+	for (uint32_t shift = 0; shift < 32; shift += 8)
+	{
+		uint32_t ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+		result |= (ca > cb ? ca : cb) << shift;
+	}
+	return result;
+#endif
+}
+
+} // namespace VoxelSimd
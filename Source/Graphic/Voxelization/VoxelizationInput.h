@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../../Shape/VertexData.h"
+#include "../Lighting/PointLight.h"
+#include "../Material/MaterialSetting.h"
+
+class Scene;
+
+/// <summary> One triangle mesh to voxelize, with the same per object state that MeshRenderer uploads to the GPU. </summary>
+struct VoxelizationObject {
+	const std::vector<VertexData> * vertices = nullptr;
+	const std::vector<unsigned int> * indices = nullptr;
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::mat4 modelInverseTranspose = glm::mat4(1.0f);
+	MaterialSetting material;
+};
+
+/// <summary> Everything the CPU voxelizer needs. Holds no Metal objects so it can be filled
+/// by headless tools as well as from a Scene. </summary>
+struct VoxelizationInput {
+	std::vector<VoxelizationObject> objects;
+	std::vector<PointLight> pointLights;
+
+	/// <summary> Total number of triangles over all objects. </summary>
+	size_t countTriangles() const
+	{
+		size_t triangles = 0;
+		for (const auto & object : objects) triangles += object.indices->size() / 3;
+		return triangles;
+	}
+
+	/// <summary> Gathers the enabled renderers and lights of a scene, same as Graphics::voxelize does. </summary>
+	static VoxelizationInput fromScene(Scene & scene);
+};
@@ -0,0 +1,25 @@
+#include "VoxelizationInput.h"
+
+#include "../../Scene/Scene.h"
+#include "../../Shape/Mesh.h"
+#include "../Renderer/MeshRenderer.h"
+
+VoxelizationInput VoxelizationInput::fromScene(Scene & scene)
+{
+	VoxelizationInput input;
+
+	for (auto * renderer : scene.renderers) if (renderer->enabled) {
+		VoxelizationObject object;
+		object.vertices = &renderer->mesh->vertexData;
+		object.indices = &renderer->mesh->indices;
+		object.model = renderer->transform.getTransformMatrix();
+		object.modelInverseTranspose = renderer->transform.getInverseTransposeTransformMatrix();
+		if (renderer->materialSetting)
+			object.material = *renderer->materialSetting;
+		input.objects.push_back(object);
+	}
+
+	input.pointLights = scene.pointLights;
+
+	return input;
+}
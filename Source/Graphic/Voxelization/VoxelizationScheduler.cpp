@@ -0,0 +1,84 @@
+#include "VoxelizationScheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+// Weight of a new measurement in the cost estimates.
+constexpr double kCostSmoothing = 0.25;
+}
+
+constexpr uint32_t VoxelizationScheduler::SLAB_GRANULARITY;
+
+double VoxelizationScheduler::getCost(Mode mode) const
+{
+	std::lock_guard<std::mutex> lock(costMutex);
+	return mode == Mode::SLABS ? millisecondsPerVoxel : millisecondsPerTriangle;
+}
+
+void VoxelizationScheduler::reportSliceTime(Mode mode, double work, double milliseconds)
+{
+	if (work <= 0 || milliseconds <= 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(costMutex);
+	double & cost = mode == Mode::SLABS ? millisecondsPerVoxel : millisecondsPerTriangle;
+	cost += kCostSmoothing * (milliseconds / work - cost);
+}
+
+VoxelizationScheduler::Slice VoxelizationScheduler::nextSlice(Mode mode, float frameBudgetMilliseconds, uint32_t gridSize,
+															  const std::vector<size_t> & objectTriangles)
+{
+	if (!cycleActive || mode != cycleMode || gridSize != cycleGridSize || objectTriangles.size() != cycleObjectCount)
+	{
+		cycleActive = true;
+		cycleMode = mode;
+		cycleGridSize = gridSize;
+		cycleObjectCount = objectTriangles.size();
+		nextLayer = 0;
+		nextObject = 0;
+		cycleFrames = 0;
+	}
+	++cycleFrames;
+
+	const double cost = getCost(mode);
+	Slice slice;
+	if (mode == Mode::SLABS)
+	{
+		// As many layers as the budget allows, at least one slab.
+		const double layerWork = double(gridSize) * gridSize;
+		uint32_t layers = uint32_t(frameBudgetMilliseconds / (cost * layerWork));
+		layers = std::max(SLAB_GRANULARITY, layers / SLAB_GRANULARITY * SLAB_GRANULARITY);
+		layers = std::min(layers, gridSize - nextLayer);
+
+		slice.region = VoxelRegion(glm::ivec3(0, 0, nextLayer), glm::ivec3(gridSize, gridSize, nextLayer + layers));
+		slice.objectCount = objectTriangles.size();
+		slice.work = layers * layerWork;
+		nextLayer += layers;
+		slice.last = nextLayer >= gridSize;
+	}
+	else
+	{
+		// As many objects as the budget allows, at least one. The first slice clears the whole target.
+		slice.region = VoxelRegion::full(gridSize);
+		slice.clear = nextObject == 0;
+		slice.firstObject = nextObject;
+		while (nextObject < objectTriangles.size())
+		{
+			const double work = slice.work + double(objectTriangles[nextObject]);
+			if (slice.objectCount > 0 && work * cost > frameBudgetMilliseconds)
+				break;
+			slice.work = work;
+			++slice.objectCount;
+			++nextObject;
+		}
+		slice.last = nextObject >= objectTriangles.size();
+	}
+
+	if (slice.last)
+	{
+		cycleActive = false;
+		lastCycleFrames = cycleFrames;
+	}
+	return slice;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "VoxelRegion.h"
+
+/// <summary> Spreads a full re-voxelization over several frames, so that each frame only voxelizes what
+/// fits in a GPU time budget. A cycle is cut either into slabs of the volume (along z) or into subsets of
+/// the objects. The voxels are written to a back target that replaces the sampled one once the cycle is
+/// complete (double buffering), so the sampled voxels are never partially voxelized.
+/// The cost model (milliseconds per voxel or per triangle) follows the measured time of the slices. </summary>
+class VoxelizationScheduler {
+public:
+	enum class Mode {
+		SLABS,		// Every object touching a slab of the volume.
+		OBJECTS		// A subset of the objects, in the whole volume.
+	};
+
+	struct Slice {
+		VoxelRegion region;			// Region to voxelize, the whole volume for OBJECTS.
+		size_t firstObject = 0;		// Objects to voxelize, all of them for SLABS.
+		size_t objectCount = 0;
+		bool clear = true;			// Whether the region of the target must be cleared first.
+		bool last = false;			// The target is complete after this slice.
+		double work = 0;			// Voxels (SLABS) or triangles (OBJECTS), for reportSliceTime.
+	};
+
+	/// <summary> Slabs are multiples of this many voxels thick (the dirty tracker brick size). </summary>
+	static constexpr uint32_t SLAB_GRANULARITY = 8;
+
+	/// <summary> Returns the next slice of the current cycle, starting a new cycle when the previous one is complete
+	/// or when the mode, grid size or object count changed. objectTriangles holds the triangle count of each object. </summary>
+	Slice nextSlice(Mode mode, float frameBudgetMilliseconds, uint32_t gridSize, const std::vector<size_t> & objectTriangles);
+
+	/// <summary> Updates the cost model with the measured GPU time of a slice. Thread safe, e.g. for command buffer completion handlers. </summary>
+	void reportSliceTime(Mode mode, double work, double milliseconds);
+
+	/// <summary> Drops the current cycle, the next slice starts a new one. </summary>
+	void restart() { cycleActive = false; }
+
+	/// <summary> Whether a cycle was started and is not complete yet. </summary>
+	bool isCycleActive() const { return cycleActive; }
+	/// <summary> Frames taken by the last complete cycle. </summary>
+	uint32_t getLastCycleFrames() const { return lastCycleFrames; }
+	/// <summary> Estimated milliseconds per voxel (SLABS) or per triangle (OBJECTS). </summary>
+	double getCost(Mode mode) const;
+
+private:
+	Mode cycleMode = Mode::SLABS;
+	bool cycleActive = false;
+	uint32_t cycleGridSize = 0;
+	size_t cycleObjectCount = 0;
+	uint32_t nextLayer = 0;
+	size_t nextObject = 0;
+	uint32_t cycleFrames = 0;
+	uint32_t lastCycleFrames = 0;
+
+	mutable std::mutex costMutex;
+	// Initial guesses: a 128^3 volume or 100k triangles in about 8 ms.
+	double millisecondsPerVoxel = 8.0 / (128 * 128 * 128);
+	double millisecondsPerTriangle = 8.0 / 100000;
+};
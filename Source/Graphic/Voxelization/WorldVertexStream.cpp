@@ -0,0 +1,204 @@
+#include "WorldVertexStream.h"
+#include "VoxelSimd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../Time/Time.h"
+
+namespace
+{
+// Normals of degenerate triangles can be zero, keep them finite.
+constexpr float kMinNormalLength2 = 1e-30f;
+
+// Converts VoxelSimd::kWidth interleaved vertices (6 floats each) to one register per component and back, with
+// in-register transposes.
+#if VOXEL_SIMD_AVX2
+// Each 128-bit half holds 4 vertices: the SSE2 transposes in both halves at once.
+inline __m256 loadHalves(const float * low, const float * high)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+inline __m128 loadPairs(const float * s)
+{
+	// Last 2 floats of the vertices at s, s + 6, s + 12 and s + 18, as 2 vectors of 4 floats.
+	return _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(s)), reinterpret_cast<const __m64 *>(s + 6));
+}
+
+inline void loadVertices(const float * s, __m256 c[6])
+{
+	const __m256 r0 = loadHalves(s, s + 24), r1 = loadHalves(s + 6, s + 30);
+	const __m256 r2 = loadHalves(s + 12, s + 36), r3 = loadHalves(s + 18, s + 42);
+	const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+	const __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+	c[0] = _mm256_shuffle_ps(t0, t2, 0x44);
+	c[1] = _mm256_shuffle_ps(t0, t2, 0xee);
+	c[2] = _mm256_shuffle_ps(t1, t3, 0x44);
+	c[3] = _mm256_shuffle_ps(t1, t3, 0xee);
+
+	const __m256 p01 = _mm256_insertf128_ps(_mm256_castps128_ps256(loadPairs(s + 4)), loadPairs(s + 28), 1);
+	const __m256 p23 = _mm256_insertf128_ps(_mm256_castps128_ps256(loadPairs(s + 16)), loadPairs(s + 40), 1);
+	c[4] = _mm256_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+	c[5] = _mm256_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+inline void storeVertices(float * s, const __m256 c[6])
+{
+	const __m256 t0 = _mm256_unpacklo_ps(c[0], c[1]), t1 = _mm256_unpackhi_ps(c[0], c[1]);
+	const __m256 t2 = _mm256_unpacklo_ps(c[2], c[3]), t3 = _mm256_unpackhi_ps(c[2], c[3]);
+	const __m256 rows[4] = { _mm256_shuffle_ps(t0, t2, 0x44), _mm256_shuffle_ps(t0, t2, 0xee),
+							 _mm256_shuffle_ps(t1, t3, 0x44), _mm256_shuffle_ps(t1, t3, 0xee) };
+	const __m256 p01 = _mm256_unpacklo_ps(c[4], c[5]), p23 = _mm256_unpackhi_ps(c[4], c[5]);
+	for (int half = 0; half < 2; ++half)
+	{
+		float * d = s + 24 * half;
+		for (int row = 0; row < 4; ++row)
+			_mm_storeu_ps(d + 6 * row, half ? _mm256_extractf128_ps(rows[row], 1) : _mm256_castps256_ps128(rows[row]));
+		const __m128 pairs01 = half ? _mm256_extractf128_ps(p01, 1) : _mm256_castps256_ps128(p01);
+		const __m128 pairs23 = half ? _mm256_extractf128_ps(p23, 1) : _mm256_castps256_ps128(p23);
+		_mm_storel_pi(reinterpret_cast<__m64 *>(d + 4), pairs01);
+		_mm_storeh_pi(reinterpret_cast<__m64 *>(d + 10), pairs01);
+		_mm_storel_pi(reinterpret_cast<__m64 *>(d + 16), pairs23);
+		_mm_storeh_pi(reinterpret_cast<__m64 *>(d + 22), pairs23);
+	}
+}
+#elif VOXEL_SIMD_SSE2
+inline __m128 loadPairs(const float * s)
+{
+	return _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(s)), reinterpret_cast<const __m64 *>(s + 6));
+}
+
+inline void loadVertices(const float * s, __m128 c[6])
+{
+	c[0] = _mm_loadu_ps(s);
+	c[1] = _mm_loadu_ps(s + 6);
+	c[2] = _mm_loadu_ps(s + 12);
+	c[3] = _mm_loadu_ps(s + 18);
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+	const __m128 p01 = loadPairs(s + 4), p23 = loadPairs(s + 16);
+	c[4] = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+	c[5] = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+inline void storeVertices(float * s, const __m128 c[6])
+{
+	__m128 r0 = c[0], r1 = c[1], r2 = c[2], r3 = c[3];
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(s, r0);
+	_mm_storeu_ps(s + 6, r1);
+	_mm_storeu_ps(s + 12, r2);
+	_mm_storeu_ps(s + 18, r3);
+	const __m128 p01 = _mm_unpacklo_ps(c[4], c[5]), p23 = _mm_unpackhi_ps(c[4], c[5]);
+	_mm_storel_pi(reinterpret_cast<__m64 *>(s + 4), p01);
+	_mm_storeh_pi(reinterpret_cast<__m64 *>(s + 10), p01);
+	_mm_storel_pi(reinterpret_cast<__m64 *>(s + 16), p23);
+	_mm_storeh_pi(reinterpret_cast<__m64 *>(s + 22), p23);
+}
+#elif VOXEL_SIMD_NEON
+// vld3q splits 4 vertices into (x, nx), (y, ny), (z, nz) pairs of 2 vertices, vuzp separates them.
+inline void loadVertices(const float * s, float32x4_t c[6])
+{
+	const float32x4x3_t a = vld3q_f32(s), b = vld3q_f32(s + 12);
+	for (int i = 0; i < 3; ++i)
+	{
+		c[i] = vuzp1q_f32(a.val[i], b.val[i]);
+		c[3 + i] = vuzp2q_f32(a.val[i], b.val[i]);
+	}
+}
+
+inline void storeVertices(float * s, const float32x4_t c[6])
+{
+	float32x4x3_t a, b;
+	for (int i = 0; i < 3; ++i)
+	{
+		a.val[i] = vzip1q_f32(c[i], c[3 + i]);
+		b.val[i] = vzip2q_f32(c[i], c[3 + i]);
+	}
+	vst3q_f32(s, a);
+	vst3q_f32(s + 12, b);
+}
+#else
+inline void loadVertices(const float * s, float c[6])
+{
+	for (int i = 0; i < 6; ++i)
+		c[i] = s[i];
+}
+
+inline void storeVertices(float * s, const float c[6])
+{
+	for (int i = 0; i < 6; ++i)
+		s[i] = c[i];
+}
+#endif
+}
+
+WorldVertexStream::Stats WorldVertexStream::update(const std::vector<VertexData> & localVertices, const glm::mat4 & _model,
+												   const glm::mat4 & modelInverseTranspose, bool staticGeometry)
+{
+	Stats stats;
+	if (valid && staticGeometry && _model == model && vertices.size() == localVertices.size())
+		return stats;
+
+	const double startTime = Time::currentTime();
+	vertices.resize(localVertices.size());
+	transform(localVertices.data(), localVertices.size(), _model, modelInverseTranspose, vertices.data());
+	model = _model;
+	valid = true;
+
+	stats.vertices = vertices.size();
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
+
+void WorldVertexStream::transform(const VertexData * in, size_t count, const glm::mat4 & model, const glm::mat4 & modelInverseTranspose,
+								  VertexData * out)
+{
+	using namespace VoxelSimd;
+	static_assert(sizeof(VertexData) == 6 * sizeof(float), "VertexData must be 2 packed vec3");
+
+	// Matrix elements broadcast to every lane: m[column][row].
+	Float m[4][3], n[3][3];
+	for (int column = 0; column < 4; ++column)
+		for (int row = 0; row < 3; ++row)
+			m[column][row] = set1(model[column][row]);
+	for (int column = 0; column < 3; ++column)
+		for (int row = 0; row < 3; ++row)
+			n[column][row] = set1(modelInverseTranspose[column][row]);
+	const Float minLength2 = set1(kMinNormalLength2);
+
+	size_t i = 0;
+	for (; i + kWidth <= count; i += kWidth)
+	{
+		// One register per component (position xyz, normal xyz) of kWidth vertices.
+		Float local[6], world[6];
+		loadVertices(reinterpret_cast<const float *>(&in[i]), local);
+		const Float px = local[0], py = local[1], pz = local[2];
+		const Float nx = local[3], ny = local[4], nz = local[5];
+		for (int row = 0; row < 3; ++row)
+		{
+			world[row] = madd(m[0][row], px, madd(m[1][row], py, madd(m[2][row], pz, m[3][row])));
+			world[3 + row] = madd(n[0][row], nx, madd(n[1][row], ny, mul(n[2][row], nz)));
+		}
+		const Float length2 = madd(world[3], world[3], madd(world[4], world[4], mul(world[5], world[5])));
+		const Float inverseLength = div(set1(1.0f), sqrt(max(length2, minLength2)));
+		for (int c = 3; c < 6; ++c)
+			world[c] = mul(world[c], inverseLength);
+
+		storeVertices(reinterpret_cast<float *>(&out[i]), world);
+	}
+	transformScalar(in + i, count - i, model, modelInverseTranspose, out + i);
+}
+
+void WorldVertexStream::transformScalar(const VertexData * in, size_t count, const glm::mat4 & model,
+										const glm::mat4 & modelInverseTranspose, VertexData * out)
+{
+	const glm::mat3 normalMatrix(modelInverseTranspose);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const glm::vec3 position = glm::vec3(model * glm::vec4(in[i].position, 1.0f));
+		const glm::vec3 normal = normalMatrix * in[i].normal;
+		out[i].position = position;
+		out[i].normal = normal / std::sqrt(std::max(glm::dot(normal, normal), kMinNormalLength2));
+	}
+}
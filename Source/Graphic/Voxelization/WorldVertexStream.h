@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../../Shape/VertexData.h"
+
+/// <summary> World space copy of the vertices of a mesh: positions transformed by the model matrix, normals by its
+/// inverse transpose and normalized. The passes of a frame (dominant axis, voxelization, cone tracing) read it instead
+/// of transforming every vertex again in each of them. update() only transforms the vertices again when the model
+/// matrix changed, so a static mesh that doesn't move is transformed once, or at every call when the vertices of the
+/// mesh themselves change. </summary>
+class WorldVertexStream {
+public:
+	struct Stats {
+		size_t vertices = 0;	// Vertices transformed, 0 if the stream was up to date.
+		double seconds = 0;
+
+		double verticesPerSecond() const { return seconds > 0 ? vertices / seconds : 0; }
+	};
+
+	/// <summary> Brings the stream up to date with the model matrix of the mesh. staticGeometry is Mesh::staticMesh. </summary>
+	Stats update(const std::vector<VertexData> & localVertices, const glm::mat4 & model, const glm::mat4 & modelInverseTranspose,
+				 bool staticGeometry);
+
+	/// <summary> Forces the next update() to transform the vertices. </summary>
+	void invalidate() { valid = false; }
+
+	const std::vector<VertexData> & getVertices() const { return vertices; }
+
+	/// <summary> Transforms count vertices, several per instruction with AVX2, SSE2 or NEON (scalar otherwise).
+	/// in and out may be the same array. </summary>
+	static void transform(const VertexData * in, size_t count, const glm::mat4 & model, const glm::mat4 & modelInverseTranspose,
+						  VertexData * out);
+	/// <summary> One vertex at a time with glm, same results up to rounding. </summary>
+	static void transformScalar(const VertexData * in, size_t count, const glm::mat4 & model, const glm::mat4 & modelInverseTranspose,
+								VertexData * out);
+
+private:
+	std::vector<VertexData> vertices;
+	glm::mat4 model = glm::mat4(1.0f);
+	bool valid = false;
+};
@@ -15,6 +15,7 @@
 {
 	id <MTLDevice> _device;
 	id <MTLCommandQueue> _commandQueue;
+	dispatch_semaphore_t _inFlightSemaphore;
 	BOOL initedScene;
 }
 
@@ -24,6 +25,7 @@
 	if(self)
 	{
 		_device = view.device;
+		_inFlightSemaphore = dispatch_semaphore_create(Graphics::MAX_FRAMES_IN_FLIGHT);
 		[self _loadMetalWithView:view];
 	}
 
@@ -47,9 +49,17 @@
 {
 	/// Per frame updates here
 
+	/// Wait for the oldest frame in flight, the buffers it reads get written again
+	dispatch_semaphore_wait(_inFlightSemaphore, DISPATCH_TIME_FOREVER);
+
 	id <MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
 	commandBuffer.label = @"MyCommand";
 
+	__block dispatch_semaphore_t blockSemaphore = _inFlightSemaphore;
+	[commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> buffer) {
+		dispatch_semaphore_signal(blockSemaphore);
+	}];
+
 	/// Delay getting the currentRenderPassDescriptor until we absolutely need it to avoid
 	///   holding onto the drawable and blocking the display pipeline any longer than necessary
 	MTLRenderPassDescriptor* renderPassDescriptor = view.currentRenderPassDescriptor;
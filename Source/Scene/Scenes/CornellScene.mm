@@ -21,9 +21,7 @@ void CornellScene::init(unsigned int viewportWidth, unsigned int viewportHeight)
 		renderers.push_back(new MeshRenderer(&(cornell->meshes[i])));
 	}
 	for (auto & r : renderers) {
-		r->transform.position -= glm::vec3(0.00f, 0.0f, 0);
-		r->transform.scale = glm::vec3(0.995f);
-		r->transform.updateTransformMatrix();
+		r->transform.setScale(glm::vec3(0.995f));
 	}
 
 	// Light sphere.
@@ -70,14 +68,11 @@ void CornellScene::update(float mouseXDelta, float mouseYDelta, bool buttonsPres
 	glm::vec3 r = glm::vec3(sinf(float(Time::time * 0.97)), sinf(float(Time::time * 0.45)), sinf(float(Time::time * 0.32)));
 
 	// Lighting.
-	renderers[lightSphereIndex]->transform.position = glm::vec3(0, 0.5, 0.1) + r * 0.1f;
-	renderers[lightSphereIndex]->transform.position.x *= 4.5f;
-	renderers[lightSphereIndex]->transform.position.z *= 4.5f;
-	renderers[lightSphereIndex]->transform.rotation = r;
-	renderers[lightSphereIndex]->transform.scale = glm::vec3(0.049f);
-	renderers[lightSphereIndex]->transform.updateTransformMatrix();
+	renderers[lightSphereIndex]->transform.setPosition((glm::vec3(0, 0.5, 0.1) + r * 0.1f) * glm::vec3(4.5f, 1.0f, 4.5f));
+	renderers[lightSphereIndex]->transform.setRotation(r);
+	renderers[lightSphereIndex]->transform.setScale(glm::vec3(0.049f));
 
-	pointLights[0].position = renderers[lightSphereIndex]->transform.position;
+	pointLights[0].position = renderers[lightSphereIndex]->transform.getPosition();
 	renderers[lightSphereIndex]->materialSetting->diffuseColor = pointLights[0].color;
 }
 
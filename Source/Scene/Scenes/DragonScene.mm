@@ -21,9 +21,7 @@ void DragonScene::init(unsigned int viewportWidth, unsigned int viewportHeight)
 	shapes.push_back(cornell);
 	for (unsigned int i = 0; i < cornell->meshes.size(); ++i) renderers.push_back(new MeshRenderer(&(cornell->meshes[i])));
 	for (auto & r : renderers) {
-		r->transform.position -= glm::vec3(0.00f, 0.0f, 0);
-		r->transform.scale = glm::vec3(0.995f);
-		r->transform.updateTransformMatrix();
+		r->transform.setScale(glm::vec3(0.995f));
 	}
 
 	renderers[0]->materialSetting = MaterialSetting::Red(); // Green wall.
@@ -44,10 +42,9 @@ void DragonScene::init(unsigned int viewportWidth, unsigned int viewportHeight)
 		renderers.push_back(new MeshRenderer(&(dragon->meshes[i])));
 	}
 	auto * dragonRenderer = renderers[dragonIndex];
-	dragonRenderer->transform.scale = glm::vec3(1.79f);
-	dragonRenderer->transform.rotation = glm::vec3(0, 2.0, 0);
-	dragonRenderer->transform.position = glm::vec3(-0.09f, -0.50f, 0.01f);
-	dragonRenderer->transform.updateTransformMatrix();
+	dragonRenderer->transform.setScale(glm::vec3(1.79f));
+	dragonRenderer->transform.setRotation(glm::vec3(0, 2.0, 0));
+	dragonRenderer->transform.setPosition(glm::vec3(-0.09f, -0.50f, 0.01f));
 	dragonRenderer->tweakable = true;
 	dragonRenderer->name = "Dragon";
 	dragonRenderer->materialSetting = MaterialSetting::White();
@@ -76,16 +73,15 @@ void DragonScene::init(unsigned int viewportWidth, unsigned int viewportHeight)
 	lampRenderer->materialSetting->specularReflectivity = 0.0f;
 	lampRenderer->materialSetting->diffuseReflectivity = 1.0f;
 
-	lampRenderer->transform.position = glm::vec3(0, 0.975, 0);
-	lampRenderer->transform.rotation = glm::vec3(-3.1414 * 0.5, 3.1414 * 0.5, 0);
-	lampRenderer->transform.scale = glm::vec3(0.14f, 0.34f, 1.0f);
-	lampRenderer->transform.updateTransformMatrix();
+	lampRenderer->transform.setPosition(glm::vec3(0, 0.975, 0));
+	lampRenderer->transform.setRotation(glm::vec3(-3.1414 * 0.5, 3.1414 * 0.5, 0));
+	lampRenderer->transform.setScale(glm::vec3(0.14f, 0.34f, 1.0f));
 	lampRenderer->name = "Ceiling lamp";
 
 	// Point light.
 	PointLight p;
 	p.color = glm::vec3(0.5);
-	p.position = lampRenderer->transform.position - glm::vec3(0, 0.2, 0);
+	p.position = lampRenderer->transform.getPosition() - glm::vec3(0, 0.2, 0);
 	pointLights.push_back(p);
 }
 
@@ -25,9 +25,7 @@ void GlassScene::init(unsigned int viewportWidth, unsigned int viewportHeight) {
 		renderers.push_back(new MeshRenderer(&(cornell->meshes[i])));
 	}
 	for (auto & r : renderers) {
-		r->transform.position -= glm::vec3(0.00f, 0.0f, 0);
-		r->transform.scale = glm::vec3(0.995f);
-		r->transform.updateTransformMatrix();
+		r->transform.setScale(glm::vec3(0.995f));
 	}
 
 	// Light cube.
@@ -58,10 +56,9 @@ void GlassScene::init(unsigned int viewportWidth, unsigned int viewportHeight) {
 		renderers.push_back(new MeshRenderer(&(buddha->meshes[i])));
 	}
 	buddhaRenderer = renderers[buddhaIndex];
-	buddhaRenderer->transform.scale = glm::vec3(1.8f);
-	buddhaRenderer->transform.rotation = glm::vec3(0, 2.4, 0);
-	buddhaRenderer->transform.position = glm::vec3(0, -0.13, 0.05);// glm::vec3(0, 0.0, 0);
-	buddhaRenderer->transform.updateTransformMatrix();
+	buddhaRenderer->transform.setScale(glm::vec3(1.8f));
+	buddhaRenderer->transform.setRotation(glm::vec3(0, 2.4, 0));
+	buddhaRenderer->transform.setPosition(glm::vec3(0, -0.13, 0.05));// glm::vec3(0, 0.0, 0);
 	buddhaRenderer->tweakable = true;
 	buddhaRenderer->name = "Buddha";
 	buddhaRenderer->materialSetting = MaterialSetting::White();
@@ -93,9 +90,9 @@ void GlassScene::init(unsigned int viewportWidth, unsigned int viewportHeight) {
 	}
 	MeshRenderer * bwr = renderers[backWallIndex];
 	bwr->materialSetting = MaterialSetting::White();
-	bwr->transform.scale = glm::vec3(2);
-	bwr->transform.position = glm::vec3(0, 0, 0.99);
-	bwr->transform.rotation = glm::vec3(-1.57079632679, 0, 0);
+	bwr->transform.setScale(glm::vec3(2));
+	bwr->transform.setPosition(glm::vec3(0, 0, 0.99));
+	bwr->transform.setRotation(glm::vec3(-1.57079632679, 0, 0));
 	bwr->tweakable = true;
 
 	// Lighting.
@@ -110,15 +107,14 @@ void GlassScene::init(unsigned int viewportWidth, unsigned int viewportHeight) {
 void GlassScene::update(float mouseXDelta, float mouseYDelta, bool buttonsPressed[]) {
 	FirstPersonScene::update(mouseXDelta, mouseYDelta, buttonsPressed);
 
-	buddhaRenderer->transform.rotation.y = Time::time;
+	buddhaRenderer->transform.setRotation(glm::vec3(0, Time::time, 0));
 
 	glm::vec3 r = glm::vec3(sinf(float(Time::time * 0.67)), sinf(float(Time::time * 0.78)), cosf(float(Time::time * 0.67)));
 
-	renderers[lightCubeIndex]->transform.position = 0.45f * r + 0.20f * r * glm::vec3(1, 0, 1);
-	renderers[lightCubeIndex]->transform.scale = glm::vec3(0.049f);
-	renderers[lightCubeIndex]->transform.updateTransformMatrix();
+	renderers[lightCubeIndex]->transform.setPosition(0.45f * r + 0.20f * r * glm::vec3(1, 0, 1));
+	renderers[lightCubeIndex]->transform.setScale(glm::vec3(0.049f));
 
-	pointLights[0].position = renderers[lightCubeIndex]->transform.position;
+	pointLights[0].position = renderers[lightCubeIndex]->transform.getPosition();
 	renderers[lightCubeIndex]->materialSetting->diffuseColor = pointLights[0].color;
 }
 
@@ -27,9 +27,7 @@ void MultipleObjectsScene::init(unsigned int viewportWidth, unsigned int viewpor
 		renderers.push_back(new MeshRenderer(&(cornell->meshes[i])));
 	}
 	for (auto & r : renderers) {
-		r->transform.position -= glm::vec3(0.00f, 0.0f, 0);
-		r->transform.scale = glm::vec3(0.995f);
-		r->transform.updateTransformMatrix();
+		r->transform.setScale(glm::vec3(0.995f));
 	}
 
 	renderers[0]->materialSetting = MaterialSetting::Red(); // Green wall.
@@ -64,10 +62,9 @@ void MultipleObjectsScene::init(unsigned int viewportWidth, unsigned int viewpor
 	objectMaterialSetting->specularDiffusion = 3.2f;
 	objectMaterialSetting->transparency = 0.1f;
 	objectRenderer->tweakable = true;
-	objectRenderer->transform.scale = glm::vec3(0.23f);
-	objectRenderer->transform.rotation = glm::vec3(0.00, 0.30, 0.00);
-	objectRenderer->transform.position = glm::vec3(0.07, -0.49, 0.36);
-	objectRenderer->transform.updateTransformMatrix();
+	objectRenderer->transform.setScale(glm::vec3(0.23f));
+	objectRenderer->transform.setRotation(glm::vec3(0.00, 0.30, 0.00));
+	objectRenderer->transform.setPosition(glm::vec3(0.07, -0.49, 0.36));
 
 	// Dragon.
 	objectIndex = renderers.size();
@@ -87,10 +84,9 @@ void MultipleObjectsScene::init(unsigned int viewportWidth, unsigned int viewpor
 	objectMaterialSetting->diffuseReflectivity = 0.35f;
 	objectMaterialSetting->specularDiffusion = 2.2f;
 	objectRenderer->tweakable = true;
-	objectRenderer->transform.scale = glm::vec3(1.3f);
-	objectRenderer->transform.rotation = glm::vec3(0, 2.1, 0);
-	objectRenderer->transform.position = glm::vec3(-0.28, -0.52, 0.00);
-	objectRenderer->transform.updateTransformMatrix();
+	objectRenderer->transform.setScale(glm::vec3(1.3f));
+	objectRenderer->transform.setRotation(glm::vec3(0, 2.1, 0));
+	objectRenderer->transform.setPosition(glm::vec3(-0.28, -0.52, 0.00));
 
 	// Bunny.
 	objectIndex = renderers.size();
@@ -110,10 +106,9 @@ void MultipleObjectsScene::init(unsigned int viewportWidth, unsigned int viewpor
 	objectMaterialSetting->diffuseReflectivity = 0.4f;
 	objectMaterialSetting->specularDiffusion = 3.4f;
 	objectRenderer->tweakable = true;
-	objectRenderer->transform.scale = glm::vec3(0.31f);
-	objectRenderer->transform.rotation = glm::vec3(0, 0.4, 0);
-	objectRenderer->transform.position = glm::vec3(0.44, -0.52, 0);
-	objectRenderer->transform.updateTransformMatrix();
+	objectRenderer->transform.setScale(glm::vec3(0.31f));
+	objectRenderer->transform.setRotation(glm::vec3(0, 0.4, 0));
+	objectRenderer->transform.setPosition(glm::vec3(0.44, -0.52, 0));
 
 	// Light sphere.
 	Shape * lightSphere = ObjLoader::loadObjFile("Assets/Models/sphere.obj");
@@ -147,14 +142,11 @@ void MultipleObjectsScene::update(float mouseXDelta, float mouseYDelta, bool but
 	// Lighting rotation.
 	glm::vec3 r = glm::vec3(sinf(float(Time::time * 0.97)), sinf(float(Time::time * 0.45)), sinf(float(Time::time * 0.32)));
 
-	renderers[lightSphereIndex]->transform.position = glm::vec3(0, 0.5, 0.1) + r * 0.1f;
-	renderers[lightSphereIndex]->transform.position.x *= 4.5f;
-	renderers[lightSphereIndex]->transform.position.z *= 4.5f;
-	renderers[lightSphereIndex]->transform.rotation = r;
-	renderers[lightSphereIndex]->transform.scale = glm::vec3(0.049f);
-	renderers[lightSphereIndex]->transform.updateTransformMatrix();
+	renderers[lightSphereIndex]->transform.setPosition((glm::vec3(0, 0.5, 0.1) + r * 0.1f) * glm::vec3(4.5f, 1.0f, 4.5f));
+	renderers[lightSphereIndex]->transform.setRotation(r);
+	renderers[lightSphereIndex]->transform.setScale(glm::vec3(0.049f));
 
-	pointLights[0].position = renderers[lightSphereIndex]->transform.position;
+	pointLights[0].position = renderers[lightSphereIndex]->transform.getPosition();
 	renderers[lightSphereIndex]->materialSetting->diffuseColor = pointLights[0].color;
 }
 
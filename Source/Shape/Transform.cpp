@@ -8,6 +8,7 @@ Transform::Transform() {
 
 void Transform::updateTransformMatrix() {
 	transform = glm::translate(position) * glm::mat4_cast(glm::quat(rotation)) * glm::scale(scale);
+	if (parent) { transform = parent->getTransformMatrix() * transform; }
 	transformInvTrans = glm::transpose(glm::inverse(transform));
 	transformIsInvalid = false;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <iosfwd>
 #include <vector>
 
 #include <glm.hpp>
@@ -8,7 +9,8 @@
 #include <mat4x4.hpp>
 #include <gtc/quaternion.hpp>
 
-/// <summary> Represents a transform: rotation, position and scale. </summary>
+/// <summary> Represents a transform: rotation, position and scale. The renderers use TransformHandle instead, whose
+/// children follow their parents. </summary>
 class Transform {
 public:
 	glm::vec3 position = { 0,0,0 }, scale = { 1,1,1 }, rotation = { 0,0,0 };
@@ -19,7 +21,9 @@ public:
 	/// <summary> Is true when the transform matrix is not correctly representing the position, scale and rotation vectors. </summary>
 	bool transformIsInvalid = false;
 
-	/// <summary> Recalculates the transform matrix according to the position, scale and rotation vectors. </summary>
+	/// <summary> Recalculates the transform matrix according to the position, scale and rotation vectors, relative to
+	/// the current matrix of the parent if there is one. Moving the parent doesn't invalidate its children: a hierarchy
+	/// has to be updated parents first, every time one of them moves. </summary>
 	void updateTransformMatrix();
 
 	/// <summary> Returns a reference to the transform matrix </summary>
@@ -0,0 +1,31 @@
+#include "TransformHandle.h"
+
+TransformHandle::TransformHandle() : handle(TransformStore::getInstance().add()) {}
+
+TransformHandle::~TransformHandle()
+{
+	TransformStore::getInstance().remove(handle);
+}
+
+void TransformHandle::setPosition(const glm::vec3 & position) { TransformStore::getInstance().setPosition(handle, position); }
+void TransformHandle::setRotation(const glm::vec3 & rotation) { TransformStore::getInstance().setRotation(handle, rotation); }
+void TransformHandle::setScale(const glm::vec3 & scale) { TransformStore::getInstance().setScale(handle, scale); }
+
+void TransformHandle::setParent(const TransformHandle * parent)
+{
+	TransformStore::getInstance().setParent(handle, parent ? parent->handle : TransformStore::NO_PARENT);
+}
+
+glm::vec3 TransformHandle::getPosition() const { return TransformStore::getInstance().getPosition(handle); }
+glm::vec3 TransformHandle::getRotation() const { return TransformStore::getInstance().getRotation(handle); }
+glm::vec3 TransformHandle::getScale() const { return TransformStore::getInstance().getScale(handle); }
+
+const glm::mat4 & TransformHandle::getTransformMatrix() const
+{
+	return TransformStore::getInstance().getWorldMatrix(handle);
+}
+
+const glm::mat4 & TransformHandle::getInverseTransposeTransformMatrix() const
+{
+	return TransformStore::getInstance().getWorldInverseTransposeMatrix(handle);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "TransformStore.h"
+
+/// <summary> A transform owned by TransformStore::getInstance(), which holds its position, rotation, scale and parent.
+/// The setters only write to the store; the matrices are the ones of the last TransformStore::update(), which
+/// Graphics runs once per frame before any pass. Moving a parent moves its children with it. </summary>
+class TransformHandle {
+public:
+	TransformHandle();
+	~TransformHandle();
+	TransformHandle(const TransformHandle &) = delete;
+	TransformHandle & operator=(const TransformHandle &) = delete;
+
+	void setPosition(const glm::vec3 & position);
+	void setRotation(const glm::vec3 & rotation); // Euler angles in radians.
+	void setScale(const glm::vec3 & scale);
+	/// <summary> nullptr makes the transform a root. </summary>
+	void setParent(const TransformHandle * parent);
+
+	glm::vec3 getPosition() const;
+	glm::vec3 getRotation() const;
+	glm::vec3 getScale() const;
+
+	/// <summary> World matrices as of the last update of the store. </summary>
+	const glm::mat4 & getTransformMatrix() const;
+	const glm::mat4 & getInverseTransposeTransformMatrix() const;
+
+	TransformStore::Handle getHandle() const { return handle; }
+
+private:
+	TransformStore::Handle handle;
+};
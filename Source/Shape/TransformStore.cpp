@@ -0,0 +1,340 @@
+#include "TransformStore.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "../Graphic/Voxelization/VoxelSimd.h"
+#include "../Time/Time.h"
+
+using namespace VoxelSimd;
+
+constexpr TransformStore::Handle TransformStore::NO_PARENT;
+constexpr int TransformStore::AFFINE_ELEMENTS;
+
+namespace {
+
+/// <summary> Sine and cosine of any angle, within a few float ulps of std::sin and std::cos for the angles of a
+/// transform. The angle is wrapped to [-pi, pi] (2 pi split in two floats, the first one exact when multiplied by the
+/// number of turns), a quarter of it is then in [-pi/4, pi/4] where the minimax polynomials of Cephes are accurate, and
+/// two double angle steps bring it back. </summary>
+inline void sinCos(Float angle, Float & s, Float & c)
+{
+	const Float turns = VoxelSimd::round(mul(angle, set1(0.15915494309189533577f)));
+	angle = sub(sub(angle, mul(turns, set1(6.28125f))), mul(turns, set1(1.9353071795864769253e-3f)));
+	const Float x = mul(angle, set1(0.25f));
+	const Float x2 = mul(x, x);
+
+	s = madd(madd(madd(set1(-1.9515295891e-4f), x2, set1(8.3321608736e-3f)), x2, set1(-1.6666654611e-1f)), mul(x, x2), x);
+	c = madd(madd(madd(set1(2.443315711809948e-5f), x2, set1(-1.388731625493765e-3f)), x2, set1(4.166664568298827e-2f)), mul(x2, x2),
+			 madd(set1(-0.5f), x2, set1(1.0f)));
+
+	for (int step = 0; step < 2; ++step)
+	{
+		const Float doubleSin = mul(set1(2.0f), mul(s, c));
+		c = sub(mul(c, c), mul(s, s));
+		s = doubleSin;
+	}
+}
+
+} // namespace
+
+TransformStore & TransformStore::getInstance()
+{
+	// Never destroyed: the scene, and the handles of its renderers, are deleted after the statics created later.
+	static TransformStore * instance = new TransformStore();
+	return *instance;
+}
+
+TransformStore::Handle TransformStore::add(Handle parent)
+{
+	if (!freeHandles.empty())
+	{
+		// remove() left it an identity root.
+		const Handle handle = freeHandles.back();
+		freeHandles.pop_back();
+		if (parent != NO_PARENT)
+			setParent(handle, parent);
+		return handle;
+	}
+
+	const Handle handle = Handle(parents.size());
+	parents.push_back(NO_PARENT);
+	localChanged.push_back(1);
+	anyLocalChanged = true;
+	worldChanged.push_back(0);
+	worldMatrices.push_back(glm::mat4(1.0f));
+	worldInverseTransposes.push_back(glm::mat4(1.0f));
+
+	// Whole SIMD blocks of identity transforms, so that update() never reads past the arrays.
+	const size_t padded = (parents.size() + kWidth - 1) / kWidth * kWidth;
+	if (components[PX].size() < padded)
+	{
+		for (int component = 0; component < COMPONENTS; ++component)
+			components[component].resize(padded, component >= SX ? 1.0f : 0.0f);
+		for (int element = 0; element < AFFINE_ELEMENTS; ++element)
+		{
+			const float identity = element % 4 == 0 ? 1.0f : 0.0f; // Elements 0, 4 and 8 are the diagonal.
+			local[element].resize(padded, identity);
+			world[element].resize(padded, identity);
+		}
+	}
+
+	if (parent != NO_PARENT)
+		setParent(handle, parent);
+	return handle;
+}
+
+void TransformStore::setParent(Handle handle, Handle parent)
+{
+	if (parents[handle] == parent)
+		return;
+
+	for (Handle ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+		assert(ancestor != handle && "A transform can't be its own ancestor.");
+
+	parents[handle] = parent;
+	localChanged[handle] = 1; // The world matrix changes even if the local one doesn't.
+	anyLocalChanged = true;
+	orderValid = false;
+}
+
+void TransformStore::remove(Handle handle)
+{
+	for (Handle child = 0; child < parents.size(); ++child)
+		if (parents[child] == handle)
+			setParent(child, NO_PARENT);
+	setParent(handle, NO_PARENT);
+	setLocal(handle, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+	freeHandles.push_back(handle);
+}
+
+void TransformStore::setLocal(Handle handle, const glm::vec3 & position, const glm::vec3 & rotation, const glm::vec3 & scale)
+{
+	setComponents(handle, PX, position);
+	setComponents(handle, RX, rotation);
+	setComponents(handle, SX, scale);
+}
+
+void TransformStore::setComponents(Handle handle, int first, const glm::vec3 & values)
+{
+	for (int component = 0; component < 3; ++component)
+	{
+		float & stored = components[first + component][handle];
+		if (stored != values[component])
+		{
+			stored = values[component];
+			localChanged[handle] = 1;
+			anyLocalChanged = true;
+		}
+	}
+}
+
+void TransformStore::clear()
+{
+	*this = TransformStore();
+}
+
+void TransformStore::sortByDepth()
+{
+	// Depth of each transform, walking up to the first ancestor whose depth is known.
+	const uint32_t unknown = 0xffffffffu;
+	std::vector<uint32_t> depths(parents.size(), unknown);
+	std::vector<Handle> path;
+	uint32_t maxDepth = 0;
+	for (Handle handle = 0; handle < parents.size(); ++handle)
+	{
+		Handle current = handle;
+		while (current != NO_PARENT && depths[current] == unknown)
+		{
+			path.push_back(current);
+			current = parents[current];
+		}
+		uint32_t depth = current == NO_PARENT ? 0 : depths[current] + 1;
+		for (auto it = path.rbegin(); it != path.rend(); ++it, ++depth)
+			depths[*it] = depth;
+		path.clear();
+		maxDepth = std::max(maxDepth, depths[handle]);
+	}
+
+	// Counting sort, handles stay in order within a depth.
+	std::vector<size_t> firsts(maxDepth + 2, 0);
+	for (uint32_t depth : depths)
+		++firsts[depth + 1];
+	for (size_t depth = 1; depth < firsts.size(); ++depth)
+		firsts[depth] += firsts[depth - 1];
+	order.resize(parents.size());
+	for (Handle handle = 0; handle < parents.size(); ++handle)
+		order[firsts[depths[handle]]++] = handle;
+
+	hierarchy = maxDepth > 0;
+	orderValid = true;
+}
+
+void TransformStore::composeLocal(size_t first)
+{
+	Float sines[3], cosines[3];
+	for (int axis = 0; axis < 3; ++axis)
+		sinCos(mul(load(&components[RX + axis][first]), set1(0.5f)), sines[axis], cosines[axis]);
+
+	// Quaternion of the euler angles, as glm::quat(vec3) builds it.
+	const Float cxcy = mul(cosines[0], cosines[1]), sxsy = mul(sines[0], sines[1]);
+	const Float sxcy = mul(sines[0], cosines[1]), cxsy = mul(cosines[0], sines[1]);
+	const Float qw = madd(cxcy, cosines[2], mul(sxsy, sines[2]));
+	const Float qx = sub(mul(sxcy, cosines[2]), mul(cxsy, sines[2]));
+	const Float qy = madd(cxsy, cosines[2], mul(sxcy, sines[2]));
+	const Float qz = sub(mul(cxcy, sines[2]), mul(sxsy, cosines[2]));
+
+	// Rotation matrix of the quaternion (glm::mat4_cast), columns scaled, then the translation.
+	const Float one = set1(1.0f), two = set1(2.0f);
+	const Float xx = mul(qx, qx), yy = mul(qy, qy), zz = mul(qz, qz);
+	const Float xy = mul(qx, qy), xz = mul(qx, qz), yz = mul(qy, qz);
+	const Float wx = mul(qw, qx), wy = mul(qw, qy), wz = mul(qw, qz);
+	const Float scaleX = load(&components[SX][first]), scaleY = load(&components[SY][first]), scaleZ = load(&components[SZ][first]);
+
+	store(&local[0][first], mul(sub(one, mul(two, VoxelSimd::add(yy, zz))), scaleX));
+	store(&local[1][first], mul(mul(two, VoxelSimd::add(xy, wz)), scaleX));
+	store(&local[2][first], mul(mul(two, sub(xz, wy)), scaleX));
+	store(&local[3][first], mul(mul(two, sub(xy, wz)), scaleY));
+	store(&local[4][first], mul(sub(one, mul(two, VoxelSimd::add(xx, zz))), scaleY));
+	store(&local[5][first], mul(mul(two, VoxelSimd::add(yz, wx)), scaleY));
+	store(&local[6][first], mul(mul(two, VoxelSimd::add(xz, wy)), scaleZ));
+	store(&local[7][first], mul(mul(two, sub(yz, wx)), scaleZ));
+	store(&local[8][first], mul(sub(one, mul(two, VoxelSimd::add(xx, yy))), scaleZ));
+	store(&local[9][first], load(&components[PX][first]));
+	store(&local[10][first], load(&components[PY][first]));
+	store(&local[11][first], load(&components[PZ][first]));
+}
+
+void TransformStore::inverseTranspose(size_t first)
+{
+	Float m[AFFINE_ELEMENTS];
+	for (int element = 0; element < AFFINE_ELEMENTS; ++element)
+		m[element] = load(&world[element][first]);
+
+	// For an affine matrix [A t], the inverse transpose is [cofactors(A) / det(A), 0] with -A^-1 t as its last row.
+	// The columns of the cofactor matrix are the cross products of the columns of A.
+	auto cross = [](const Float * a, const Float * b, Float * out) {
+		out[0] = sub(mul(a[1], b[2]), mul(a[2], b[1]));
+		out[1] = sub(mul(a[2], b[0]), mul(a[0], b[2]));
+		out[2] = sub(mul(a[0], b[1]), mul(a[1], b[0]));
+	};
+	Float inverse[9];
+	cross(&m[3], &m[6], &inverse[0]);
+	cross(&m[6], &m[0], &inverse[3]);
+	cross(&m[0], &m[3], &inverse[6]);
+	const Float inverseDeterminant = div(set1(1.0f), madd(m[0], inverse[0], madd(m[1], inverse[1], mul(m[2], inverse[2]))));
+	for (int element = 0; element < 9; ++element)
+		inverse[element] = mul(inverse[element], inverseDeterminant);
+
+	// Row c of A^-1 is column c of its transpose.
+	Float translation[3];
+	for (int c = 0; c < 3; ++c)
+		translation[c] = sub(set1(0.0f), madd(inverse[3 * c], m[9], madd(inverse[3 * c + 1], m[10], mul(inverse[3 * c + 2], m[11]))));
+
+	// Back to one matrix per transform, for the ones that changed.
+	float lanes[AFFINE_ELEMENTS + 12][kWidth];
+	for (int element = 0; element < AFFINE_ELEMENTS; ++element)
+		store(lanes[element], m[element]);
+	for (int element = 0; element < 9; ++element)
+		store(lanes[AFFINE_ELEMENTS + element], inverse[element]);
+	for (int c = 0; c < 3; ++c)
+		store(lanes[AFFINE_ELEMENTS + 9 + c], translation[c]);
+
+	const size_t count = std::min<size_t>(kWidth, parents.size() - first);
+	for (size_t lane = 0; lane < count; ++lane)
+	{
+		if (!worldChanged[first + lane])
+			continue;
+
+		glm::mat4 & matrix = worldMatrices[first + lane];
+		glm::mat4 & inverseTransposed = worldInverseTransposes[first + lane];
+		for (int c = 0; c < 4; ++c)
+		{
+			for (int r = 0; r < 3; ++r)
+				matrix[c][r] = lanes[3 * c + r][lane];
+			matrix[c][3] = c == 3 ? 1.0f : 0.0f;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int r = 0; r < 3; ++r)
+				inverseTransposed[c][r] = lanes[AFFINE_ELEMENTS + 3 * c + r][lane];
+			inverseTransposed[c][3] = lanes[AFFINE_ELEMENTS + 9 + c][lane];
+		}
+		inverseTransposed[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+TransformStore::Stats TransformStore::update()
+{
+	Stats stats;
+	stats.transforms = parents.size();
+	const double startTime = Time::currentTime();
+	const size_t count = parents.size();
+	if (!anyLocalChanged)
+	{
+		std::fill(worldChanged.begin(), worldChanged.end(), uint8_t(0));
+		stats.seconds = Time::currentTime() - startTime;
+		return stats;
+	}
+	anyLocalChanged = false;
+
+	auto anyInBlock = [count](const std::vector<uint8_t> & flags, size_t first) {
+		const size_t end = std::min<size_t>(first + kWidth, count);
+		for (size_t i = first; i < end; ++i)
+			if (flags[i])
+				return true;
+		return false;
+	};
+
+	for (size_t first = 0; first < count; first += kWidth)
+		if (anyInBlock(localChanged, first))
+			composeLocal(first);
+
+	// World matrices, parents first.
+	if (!orderValid)
+		sortByDepth();
+	auto propagate = [this, &stats](Handle handle) {
+		const Handle parent = parents[handle];
+		const bool changed = localChanged[handle] || (parent != NO_PARENT && worldChanged[parent]);
+		worldChanged[handle] = changed;
+		stats.localUpdates += localChanged[handle];
+		localChanged[handle] = 0;
+		if (!changed)
+			return;
+		++stats.worldUpdates;
+
+		if (parent == NO_PARENT)
+		{
+			for (int element = 0; element < AFFINE_ELEMENTS; ++element)
+				world[element][handle] = local[element][handle];
+			return;
+		}
+
+		float p[AFFINE_ELEMENTS], l[AFFINE_ELEMENTS];
+		for (int element = 0; element < AFFINE_ELEMENTS; ++element)
+		{
+			p[element] = world[element][parent];
+			l[element] = local[element][handle];
+		}
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 3; ++r)
+				world[3 * c + r][handle] = p[r] * l[3 * c] + p[3 + r] * l[3 * c + 1] + p[6 + r] * l[3 * c + 2] + (c == 3 ? p[9 + r] : 0.0f);
+	};
+	if (hierarchy)
+	{
+		for (Handle handle : order)
+			propagate(handle);
+	}
+	else
+	{
+		for (Handle handle = 0; handle < count; ++handle)
+			propagate(handle);
+	}
+
+	for (size_t first = 0; first < count; first += kWidth)
+		if (anyInBlock(worldChanged, first))
+			inverseTranspose(first);
+
+	stats.seconds = Time::currentTime() - startTime;
+	return stats;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm.hpp>
+
+/// <summary> The transforms of many objects stored as arrays of components (one array per position, rotation and
+/// scale component, one per matrix element) instead of one Transform per object. setLocal() only marks the transforms
+/// whose position, rotation or scale changed; update() then composes the local matrices of the changed ones several at a
+/// time (AVX2, SSE2 or NEON), propagates world = parent world * local down the hierarchy, and recomputes the inverse
+/// transposes of the world matrices that changed, once per frame. The matrices match Transform::updateTransformMatrix()
+/// up to rounding. The transforms of the renderers live in getInstance(), see TransformHandle. </summary>
+class TransformStore {
+public:
+	using Handle = uint32_t;
+	static constexpr Handle NO_PARENT = 0xffffffffu;
+
+	/// <summary> The store that owns the transforms of the renderers, updated once per frame by Graphics. </summary>
+	static TransformStore & getInstance();
+
+	struct Stats {
+		size_t transforms = 0;
+		size_t localUpdates = 0;	// Local matrices composed again.
+		size_t worldUpdates = 0;	// World matrices that changed, including the children of the moved transforms.
+		double seconds = 0;
+
+		double transformsPerSecond() const { return seconds > 0 ? worldUpdates / seconds : 0; }
+	};
+
+	/// <summary> Adds an identity transform. </summary>
+	Handle add(Handle parent = NO_PARENT);
+	/// <summary> Frees a handle for a later add(). Its children become roots. </summary>
+	void remove(Handle handle);
+	/// <summary> The parent must not be a descendant of the transform. </summary>
+	void setParent(Handle handle, Handle parent);
+	/// <summary> Same meaning as the fields of Transform (euler angles in radians). Marks the transform as changed only
+	/// if one of them differs. </summary>
+	void setLocal(Handle handle, const glm::vec3 & position, const glm::vec3 & rotation, const glm::vec3 & scale);
+	void setPosition(Handle handle, const glm::vec3 & position) { setComponents(handle, PX, position); }
+	void setRotation(Handle handle, const glm::vec3 & rotation) { setComponents(handle, RX, rotation); }
+	void setScale(Handle handle, const glm::vec3 & scale) { setComponents(handle, SX, scale); }
+	void clear();
+
+	/// <summary> Brings the world matrices up to date with the changes since the last update. </summary>
+	Stats update();
+
+	size_t size() const { return parents.size(); }
+	Handle getParent(Handle handle) const { return parents[handle]; }
+	glm::vec3 getPosition(Handle handle) const { return getComponents(handle, PX); }
+	glm::vec3 getRotation(Handle handle) const { return getComponents(handle, RX); }
+	glm::vec3 getScale(Handle handle) const { return getComponents(handle, SX); }
+	/// <summary> Whether the world matrix changed in the last update. </summary>
+	bool wasUpdated(Handle handle) const { return worldChanged[handle] != 0; }
+	const glm::mat4 & getWorldMatrix(Handle handle) const { return worldMatrices[handle]; }
+	const glm::mat4 & getWorldInverseTransposeMatrix(Handle handle) const { return worldInverseTransposes[handle]; }
+
+private:
+	// Components of position, rotation and scale.
+	enum { PX, PY, PZ, RX, RY, RZ, SX, SY, SZ, COMPONENTS };
+	// Elements of an affine matrix, column major without the last row (column * 3 + row).
+	static constexpr int AFFINE_ELEMENTS = 12;
+
+	void setComponents(Handle handle, int first, const glm::vec3 & values);
+	glm::vec3 getComponents(Handle handle, int first) const
+	{
+		return glm::vec3(components[first][handle], components[first + 1][handle], components[first + 2][handle]);
+	}
+	void composeLocal(size_t first);
+	void inverseTranspose(size_t first);
+	void sortByDepth();
+
+	std::vector<float> components[COMPONENTS];		// Padded to a whole number of SIMD blocks.
+	std::vector<float> local[AFFINE_ELEMENTS];
+	std::vector<float> world[AFFINE_ELEMENTS];
+	std::vector<Handle> parents;
+	std::vector<uint8_t> localChanged;
+	std::vector<uint8_t> worldChanged;
+	bool anyLocalChanged = false;
+	std::vector<Handle> freeHandles;
+
+	// Parents before children, only used when there is a hierarchy.
+	std::vector<Handle> order;
+	bool hierarchy = false;
+	bool orderValid = true;
+
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<glm::mat4> worldInverseTransposes;
+};
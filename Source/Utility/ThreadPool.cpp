@@ -0,0 +1,87 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// The calling thread takes part in every job, so spawn one worker less.
+	workers.reserve(threadCount - 1);
+	for (unsigned int i = 1; i < threadCount; ++i)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shuttingDown = true;
+	}
+	jobAvailable.notify_all();
+	for (auto &worker : workers) worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, const RangeFunction &function)
+{
+	if (count == 0)
+		return;
+	grainSize = std::max<size_t>(1, grainSize);
+
+	// Not worth waking up the workers.
+	if (workers.empty() || count <= grainSize)
+	{
+		function(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &function;
+		jobCount = count;
+		jobGrainSize = grainSize;
+		nextChunk = 0;
+		activeWorkers = (unsigned int)workers.size();
+		++jobGeneration;
+	}
+	jobAvailable.notify_all();
+
+	runChunks(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	jobFinished.wait(lock, [this] { return activeWorkers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::runChunks(unsigned int workerIndex)
+{
+	for (;;)
+	{
+		size_t begin = nextChunk.fetch_add(jobGrainSize, std::memory_order_relaxed);
+		if (begin >= jobCount)
+			break;
+		(*job)(begin, std::min(jobCount, begin + jobGrainSize), workerIndex);
+	}
+}
+
+void ThreadPool::workerLoop(unsigned int workerIndex)
+{
+	uint64_t seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [&] { return shuttingDown || jobGeneration != seenGeneration; });
+			if (shuttingDown)
+				return;
+			seenGeneration = jobGeneration;
+		}
+
+		runChunks(workerIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--activeWorkers == 0)
+			jobFinished.notify_one();
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary> A fixed size pool of worker threads used by the CPU (headless) voxel code paths. </summary>
+class ThreadPool {
+public:
+	/// <summary> Range job: [begin, end) of the iteration space plus the index of the executing worker. </summary>
+	using RangeFunction = std::function<void(size_t begin, size_t end, unsigned int workerIndex)>;
+
+	/// <summary> Creates a pool with the given number of threads (including the calling thread).
+	/// Zero means one thread per hardware core. </summary>
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	/// <summary> Number of threads that execute work, including the calling thread. </summary>
+	unsigned int size() const { return (unsigned int)workers.size() + 1; }
+
+	/// <summary> Splits [0, count) into chunks of 'grainSize' and runs them on all threads.
+	/// Blocks until every chunk has been processed. </summary>
+	void parallelFor(size_t count, size_t grainSize, const RangeFunction &function);
+
+	ThreadPool(const ThreadPool &) = delete;
+	void operator=(const ThreadPool &) = delete;
+private:
+	void workerLoop(unsigned int workerIndex);
+	void runChunks(unsigned int workerIndex);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+
+	// Current job.
+	const RangeFunction *job = nullptr;
+	size_t jobCount = 0;
+	size_t jobGrainSize = 1;
+	std::atomic<size_t> nextChunk{ 0 };
+	unsigned int activeWorkers = 0;
+	uint64_t jobGeneration = 0;
+	bool shuttingDown = false;
+};